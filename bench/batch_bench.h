@@ -0,0 +1,47 @@
+#ifndef _BATCH_BENCH_H_
+#define _BATCH_BENCH_H_
+#include <iostream>
+#include "../copy/copy_engine.h"
+
+// Copies <source> into <workdir>/unbatched the way the engine used to, a task per small
+// file, metadata set file by file and nothing preallocated, and into <workdir>/batched with
+// directory-clustered small files, preallocation and the deferred metadata pass. Reports
+// files/s of both. A warm-up copy first puts the source in the page cache; both timed
+// copies go into an empty directory. `generate --dlls 40000 --components 15000 --large 0
+// tree` makes about 115k files, as many as a Windows install.
+inline int RunSmallFilesBench(const std::vector<std::filesystem::path>& paths, const CopyOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"small-files: expected <source> <workdir>" << std::endl;
+        return 1;
+    }
+    std::filesystem::path unbatched = paths[1] / "unbatched", batched = paths[1] / "batched";
+    std::error_code ec;
+
+    auto copy = [&](const std::filesystem::path& target, bool batch, CopyStats& stats) {
+        std::filesystem::remove_all(target, ec);
+        CopyOptions run = options;
+        run.batched = run.preallocate = batch;
+        CopyEngine engine(run);
+        bool ok = engine.Run(paths[0], target);
+        for (const auto& error : engine.Errors()) std::wcout << L"  " << error << std::endl;
+        stats = engine.Stats();
+        return ok;
+    };
+    auto report = [](const wchar_t* pass, const CopyStats& stats) {
+        std::wcout << L"small-files: pass=" << pass << L" files=" << stats.files << L" directories=" << stats.directories
+                   << L" bytes=" << stats.bytes << L" seconds=" << stats.seconds << L" metadata-seconds=" << stats.metadataSeconds
+                   << L" files/s=" << stats.FilesPerSecond() << std::endl;
+    };
+
+    CopyStats before, after;
+    if (!copy(unbatched, false, before) || !copy(unbatched, false, before)) return 1;
+    report(L"unbatched", before);
+    std::filesystem::remove_all(unbatched, ec);
+    if (!copy(batched, true, after)) return 1;
+    report(L"batched", after);
+    std::filesystem::remove_all(batched, ec);
+    std::wcout << L"small-files: speedup=" << (after.seconds > 0 ? before.seconds / after.seconds : 0) << std::endl;
+    return after.files == before.files ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _BCD_BENCH_H_
+#define _BCD_BENCH_H_
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include "../editor/bcd_index.h"
+
+// Every regular file under the given paths that starts with the regf signature
+inline std::vector<std::filesystem::path> CollectHiveCorpus(const std::vector<std::filesystem::path>& roots) {
+    std::vector<std::filesystem::path> corpus;
+    auto consider = [&](const std::filesystem::path& path) {
+        char magic[4] = {};
+        std::ifstream file(path, std::ios::binary);
+        if (file.read(magic, 4) && std::memcmp(magic, "regf", 4) == 0) corpus.push_back(path);
+    };
+    for (const auto& root : roots) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(root, ec)) {
+            for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+                 it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                if (ec) break;
+                if (it->is_regular_file(ec)) consider(it->path());
+            }
+        }
+        else if (std::filesystem::is_regular_file(root, ec)) {
+            consider(root);
+        }
+    }
+    return corpus;
+}
+
+// Maps, indexes and validates every store in the corpus `iterations` times
+inline int RunBcdValidateBench(const std::vector<std::filesystem::path>& roots, int iterations) {
+    std::vector<std::filesystem::path> corpus = CollectHiveCorpus(roots);
+    if (corpus.empty()) {
+        std::wcerr << L"bcd-validate: no BCD hives found" << std::endl;
+        return 1;
+    }
+
+    size_t invalid = 0;
+    uintmax_t bytes = 0;
+    for (const auto& path : corpus) {
+        BcdIndex index;
+        std::error_code ec;
+        bytes += std::filesystem::file_size(path, ec);
+        if (!index.Open(path)) {
+            std::wcout << L"  " << path.wstring() << L": " << index.Error() << std::endl;
+            ++invalid;
+            continue;
+        }
+        BcdValidationReport report = index.Validate();
+        if (!report.valid) {
+            ++invalid;
+            std::wcout << L"  " << path.wstring() << L": " << report.errors.size() << L" error(s), first: "
+                       << report.errors.front() << std::endl;
+        }
+    }
+
+    size_t passed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& path : corpus) {
+            BcdIndex index;
+            if (index.Open(path) && index.Validate().valid) ++passed;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double total = static_cast<double>(corpus.size()) * iterations;
+
+    std::wcout << L"bcd-validate: stores=" << corpus.size() << L" invalid=" << invalid
+               << L" iterations=" << iterations << L" seconds=" << seconds
+               << L" validations/s=" << (seconds > 0 ? total / seconds : 0.0)
+               << L" MB/s=" << (seconds > 0 ? bytes * static_cast<double>(iterations) / seconds / 1e6 : 0.0) << std::endl;
+    return passed == (corpus.size() - invalid) * static_cast<size_t>(iterations) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _COMPRESS_BENCH_H_
+#define _COMPRESS_BENCH_H_
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "../compression/wof_codec.h"
+#include "../copy/work_pool.h"
+#include "../platform/file.h"
+
+// Compresses every file under <tree> into CompactOS streams in memory, ranges of
+// `rangeSize` spread over the pool the way the copy engine does it, and decompresses each
+// range again to check the round trip. Reports the ratio and per-core MB/s both ways; a
+// mismatch fails the run.
+inline int RunCompressBench(const std::vector<std::filesystem::path>& paths, const std::vector<WofFormat>& formats,
+                            size_t threads, size_t rangeSize) {
+    if (paths.size() != 1) {
+        std::wcerr << L"compress: expected <tree>" << std::endl;
+        return 1;
+    }
+    struct Source {
+        std::filesystem::path path;
+        uint64_t size;
+    };
+    std::vector<Source> sources;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(paths[0], ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code entryError;
+        if (it->is_regular_file(entryError) && !it->is_symlink(entryError)) sources.push_back(Source{ it->path(), it->file_size(entryError) });
+    }
+    if (ec || sources.empty()) {
+        std::wcerr << L"compress: no files below " << paths[0].wstring() << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    for (WofFormat format : formats) {
+        if (format == WOF_NONE) continue;
+        size_t range = std::max(WofCodec::ChunkSize(format), rangeSize / WofCodec::ChunkSize(format) * WofCodec::ChunkSize(format));
+        std::atomic<uint64_t> bytes{ 0 }, stored{ 0 }, compressNanos{ 0 }, decompressNanos{ 0 }, mismatches{ 0 }, errors{ 0 };
+        auto start = std::chrono::steady_clock::now();
+        WorkStealingPool pool(threads);
+        for (const auto& source : sources) {
+            stored += WofCodec::TableSize(format, source.size);
+            for (uint64_t offset = 0; offset < source.size; offset += range) {
+                size_t length = static_cast<size_t>(std::min<uint64_t>(range, source.size - offset));
+                pool.Submit([&, path = source.path, offset, length] {
+                    static thread_local WofCodec codec;
+                    std::vector<uint8_t> data(length), packed, back(length);
+                    std::vector<uint32_t> sizes;
+                    File input;
+                    size_t got = 0;
+                    if (!input.Open(path, File::READ) || !input.ReadAt(data.data(), length, offset, got) || got != length) {
+                        errors++;
+                        return;
+                    }
+                    auto begin = std::chrono::steady_clock::now();
+                    codec.Compress(format, data.data(), length, packed, sizes);
+                    auto middle = std::chrono::steady_clock::now();
+                    std::vector<uint8_t> stream = WofCodec::Table(format, length, sizes);
+                    stream.insert(stream.end(), packed.begin(), packed.end());
+                    auto decode = std::chrono::steady_clock::now();
+                    bool same = codec.Decompress(format, stream.data(), stream.size(), back.data(), length) && back == data;
+                    auto end = std::chrono::steady_clock::now();
+                    compressNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(middle - begin).count();
+                    decompressNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(end - decode).count();
+                    bytes += length;
+                    stored += packed.size();
+                    if (!same) mismatches++;
+                });
+            }
+        }
+        pool.Wait();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double compressSeconds = compressNanos / 1e9, decompressSeconds = decompressNanos / 1e9;
+        std::wcout << L"compress: format=" << WofCodec::Name(format) << L" files=" << sources.size() << L" bytes=" << bytes
+                   << L" stored=" << stored << L" ratio=" << (bytes ? static_cast<double>(stored) / bytes : 0)
+                   << L" threads=" << pool.Threads() << L" seconds=" << seconds
+                   << L" compress-MB/s/core=" << (compressSeconds > 0 ? bytes / compressSeconds / 1e6 : 0)
+                   << L" decompress-MB/s/core=" << (decompressSeconds > 0 ? bytes / decompressSeconds / 1e6 : 0)
+                   << L" mismatches=" << mismatches << L" errors=" << errors << std::endl;
+        failures += mismatches != 0 || errors != 0;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _COPY_BENCH_H_
+#define _COPY_BENCH_H_
+#include <iostream>
+#include "../copy/copy_engine.h"
+
+// Copies <source> into <destination> once and reports the copy phase throughput
+inline int RunCopyBench(const std::vector<std::filesystem::path>& paths, const CopyOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"copy: expected <source> <destination>" << std::endl;
+        return 1;
+    }
+    CopyEngine engine(options);
+    bool ok = engine.Run(paths[0], paths[1]);
+    for (const auto& error : engine.Errors()) std::wcout << L"  " << error << std::endl;
+
+    const CopyStats& stats = engine.Stats();
+    std::wcout << L"copy: files=" << stats.files << L" directories=" << stats.directories << L" links=" << stats.links
+               << L" bytes=" << stats.bytes << L" chunks=" << stats.chunks << L" fast=" << stats.fastCopies << L" steals=" << stats.steals
+               << L" errors=" << stats.errors << L" seconds=" << stats.seconds
+               << L" metadata-seconds=" << stats.metadataSeconds << L" files/s=" << stats.FilesPerSecond() << L" MB/s=" << stats.MBPerSecond() << std::endl;
+    if (stats.plan.files) std::wcout << L"copy: read plan " << stats.plan.ToString() << std::endl;
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _ESP_BENCH_H_
+#define _ESP_BENCH_H_
+#include <iostream>
+#include "../disk/fat32_writer.h"
+
+// Formats and populates a system partition at `options.offset` of <target> from the boot
+// files of <windows> and <bcd store>, creating an image of `imageSize` bytes when nothing
+// is there
+inline int RunEspBench(const std::vector<std::filesystem::path>& paths, const Fat32Options& options, uint64_t imageSize) {
+    if (paths.size() != 3) {
+        std::wcerr << L"esp: expected <windows> <bcd store> <target>" << std::endl;
+        return 1;
+    }
+    std::error_code ec;
+    if (!std::filesystem::exists(paths[2], ec)) {
+        File image;
+        if (!image.Open(paths[2], File::WRITE) || !image.Resize(options.offset + imageSize)) {
+            std::wcerr << L"esp: cannot create " << paths[2].wstring() << std::endl;
+            return 1;
+        }
+    }
+    Fat32Writer writer(options);
+    if (!writer.AddBootFiles(paths[0], paths[1]) || !writer.Run(paths[2])) {
+        std::wcerr << L"esp: " << writer.Error() << std::endl;
+        return 1;
+    }
+    const Fat32Stats& stats = writer.Stats();
+    std::wcout << L"esp: files=" << stats.files << L" directories=" << stats.directories << L" clusters=" << stats.clusters
+               << L" used=" << stats.usedClusters << L" written=" << stats.bytesWritten << L" seconds=" << stats.seconds
+               << L" MB/s=" << (stats.seconds > 0 ? stats.bytesWritten / stats.seconds / 1e6 : 0) << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _HASH_BENCH_H_
+#define _HASH_BENCH_H_
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include "../copy/manifest_verifier.h"
+#include "../hash/content_hash.h"
+#include "../hash/sha1.h"
+
+// Hashes an in-memory buffer of pseudo-random data with every kernel and reports GB/s,
+// the ceiling for hash-while-copying and for the verify pass
+inline int RunHashBench(size_t size, int iterations) {
+    std::vector<uint8_t> data(size);
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (auto& byte : data) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        byte = static_cast<uint8_t>(state);
+    }
+
+    struct Kernel {
+        std::wstring name;
+        std::function<uint64_t()> run;
+    };
+    std::vector<Kernel> kernels = {
+        { L"crc32c-table", [&] { return static_cast<uint64_t>(Crc32c::Update(0, data.data(), data.size(), Crc32c::KERNEL_TABLE)); } },
+        { L"xxh64", [&] { return XxHash64::Hash(data.data(), data.size()); } },
+        { L"sha1", [&] { return static_cast<uint64_t>(Sha1::Of(data.data(), data.size())[0]); } },
+    };
+    if (Crc32c::HardwareAvailable()) {
+        kernels.insert(kernels.begin() + 1, { std::wstring(L"crc32c-") + Crc32c::KernelName(Crc32c::KERNEL_HARDWARE),
+            [&] { return static_cast<uint64_t>(Crc32c::Update(0, data.data(), data.size(), Crc32c::KERNEL_HARDWARE)); } });
+    }
+
+    for (const auto& kernel : kernels) {
+        uint64_t sink = kernel.run();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) sink ^= kernel.run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::wcout << L"hash: kernel=" << kernel.name << L" bytes=" << size << L" iterations=" << iterations
+                   << L" seconds=" << seconds << L" GB/s=" << (seconds > 0 ? static_cast<double>(size) * iterations / seconds / 1e9 : 0)
+                   << L" (" << std::hex << (sink & 0xFF) << std::dec << L")" << std::endl;
+    }
+    return 0;
+}
+
+// Checks <target> against the manifest a copy with --manifest left there
+inline int RunVerifyBench(const std::vector<std::filesystem::path>& paths, const VerifyOptions& options) {
+    if (paths.size() != 1) {
+        std::wcerr << L"verify: expected <target>" << std::endl;
+        return 1;
+    }
+    ManifestVerifier verifier(options);
+    bool ok = verifier.Run(paths[0]);
+    if (!ok && verifier.Failed().empty()) {
+        std::wcerr << L"verify: " << verifier.Error() << std::endl;
+        return 1;
+    }
+    for (const auto& path : verifier.Failed()) std::wcout << L"  failed: " << path.generic_wstring() << std::endl;
+    const VerifyStats& stats = verifier.Stats();
+    std::wcout << L"verify: hash=" << HashKindName(verifier.Hash()) << L" files=" << stats.files << L" chunks=" << stats.chunks
+               << L" bytes=" << stats.bytes << L" corrupt=" << stats.corrupt << L" missing=" << stats.missing
+               << L" seconds=" << stats.seconds << L" MB/s=" << stats.MBPerSecond() << std::endl;
+    return ok ? 0 : 2;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _IMAGE_BENCH_H_
+#define _IMAGE_BENCH_H_
+#include <iostream>
+#include "../imaging/volume_imager.h"
+
+// Images the NTFS volume in <source> onto <target> and reports bytes written vs skipped.
+// With several targets the source is read once and fanned out to all of them; each target
+// gets its own line with its throughput or why it was dropped.
+inline int RunImageBench(const std::vector<std::filesystem::path>& paths, const ImageOptions& options) {
+    if (paths.size() < 2) {
+        std::wcerr << L"image: expected <source> <target>..." << std::endl;
+        return 1;
+    }
+    VolumeImager imager(options);
+    bool ok = paths.size() == 2 ? imager.Run(paths[0], paths[1])
+        : imager.Run(paths[0], std::vector<std::filesystem::path>(paths.begin() + 1, paths.end()));
+    if (!ok) {
+        std::wcerr << L"image: " << imager.Error() << std::endl;
+        return 1;
+    }
+    const ImageStats& stats = imager.Stats();
+    std::wcout << L"image: volume=" << stats.volumeBytes << L" allocated=" << stats.allocatedBytes
+               << L" written=" << stats.bytesWritten << L" skipped=" << stats.bytesSkipped << L" zeros=" << stats.zeroBytes << L" runs=" << stats.runs
+               << L" qd=" << options.io.queueDepth << L" block=" << options.io.blockSize
+               << L" seconds=" << stats.seconds << L" MB/s=" << stats.MBPerSecond() << std::endl;
+    int failures = 0;
+    for (const auto& target : stats.targets) {
+        std::wcout << L"image: target=" << target.name << L" written=" << target.bytes << L" zeros=" << target.zeroBytes
+                   << L" seconds=" << target.seconds << L" MB/s=" << target.MBPerSecond()
+                   << (target.failed ? L" failed: " + target.error : std::wstring()) << std::endl;
+        failures += target.failed;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
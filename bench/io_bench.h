@@ -0,0 +1,42 @@
+#ifndef _IO_BENCH_H_
+#define _IO_BENCH_H_
+#include <iostream>
+#include "../io/io_backend.h"
+#include "../io/stream_copy.h"
+
+// Streams <source> into <destination> through the chosen backend and verifies the result
+inline int RunIoBench(const std::vector<std::filesystem::path>& paths, const IoOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"io: expected <source> <destination>" << std::endl;
+        return 1;
+    }
+    std::unique_ptr<AsyncIo> io = CreateAsyncIo(options);
+    if (!io) {
+        std::wcerr << L"io: backend " << AsyncIo::KindName(options.backend) << L" is not available" << std::endl;
+        return 1;
+    }
+
+    File input, output;
+    if (!input.Open(paths[0], File::READ, File::ASYNC)) {
+        std::wcerr << L"io: " << input.Error() << std::endl;
+        return 1;
+    }
+    if (!output.Open(paths[1], File::WRITE, File::ASYNC | (options.direct ? File::DIRECT : 0))) {
+        std::wcerr << L"io: " << output.Error() << std::endl;
+        return 1;
+    }
+    StreamCopier copier(*io, options);
+    bool ok = copier.Copy(input, output, 0, input.Size());
+    if (!ok) std::wcout << L"  " << copier.Error() << std::endl;
+    output.Close();
+
+    const StreamStats& stats = copier.Stats();
+    std::wcout << L"io: backend=" << AsyncIo::KindName(io->Kind()) << L" qd=" << options.queueDepth
+               << L" block=" << options.blockSize << L" direct=" << options.direct
+               << L" registered=" << copier.RegisteredBuffers() << L" bytes=" << stats.bytes
+               << L" zeros=" << stats.zeroBytes               << L" requests=" << stats.requests << L" seconds=" << stats.seconds
+               << L" MB/s=" << stats.MBPerSecond() << std::endl;
+    return ok ? 0 : 1;
+}
+
+#endif
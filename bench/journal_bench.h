@@ -0,0 +1,92 @@
+#ifndef _JOURNAL_BENCH_H_
+#define _JOURNAL_BENCH_H_
+#include <iostream>
+#include "../copy/copy_engine.h"
+#include "../copy/manifest_verifier.h"
+#include "../pipeline/journal.h"
+
+// Copies <source> into <workdir>/plain without a journal and into <workdir>/journaled with
+// one, which gives the cost of journaling; reruns the journaled copy, which must resume
+// every file and copy nothing; then cuts the journal in the middle of a record, as a crash
+// during a commit would, and reruns again: the torn record is dropped, what is before it
+// resumes, the rest is copied, and the manifest of the result must verify.
+inline int RunJournalBench(const std::vector<std::filesystem::path>& paths, CopyOptions options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"journal: expected <source> <workdir>" << std::endl;
+        return 1;
+    }
+    const std::filesystem::path& source = paths[0];
+    std::filesystem::path plain = paths[1] / "plain", journaled = paths[1] / "journaled";
+    std::filesystem::path journalPath = journaled / Journal::FILE_NAME;
+    std::error_code ec;
+    std::filesystem::remove_all(plain, ec);
+    std::filesystem::remove_all(journaled, ec);
+    std::filesystem::create_directories(journaled, ec);
+    options.manifest = true;
+    const std::string identity = source.u8string();
+
+    auto copy = [&](const std::filesystem::path& target, Journal* journal, CopyStats& stats) {
+        CopyOptions run = options;
+        run.journal = journal;
+        CopyEngine engine(run);
+        bool ok = engine.Run(source, target);
+        for (const auto& error : engine.Errors()) std::wcout << L"  " << error << std::endl;
+        stats = engine.Stats();
+        return ok;
+    };
+    auto report = [](const wchar_t* pass, const CopyStats& stats, const JournalStats* journal) {
+        std::wcout << L"journal: pass=" << pass << L" files=" << stats.files << L" bytes=" << stats.bytes
+                   << L" resumed-files=" << stats.resumedFiles << L" resumed-bytes=" << stats.resumedBytes
+                   << L" seconds=" << stats.seconds << L" files/s=" << stats.FilesPerSecond();
+        if (journal) {
+            std::wcout << L" replayed=" << journal->replayed << L" torn-bytes=" << journal->tornBytes << L" appended=" << journal->appended
+                       << L" commits=" << journal->commits << L" journal-bytes=" << journal->bytes << L" commit-seconds=" << journal->commitSeconds;
+        }
+        std::wcout << std::endl;
+    };
+
+    // The first plain copy only warms the page cache, so both timed copies read from it
+    // and write into an empty directory
+    CopyStats base, first, second, third;
+    if (!copy(plain, nullptr, base)) return 1;
+    std::filesystem::remove_all(plain, ec);
+    if (!copy(plain, nullptr, base)) return 1;
+    report(L"plain", base, nullptr);
+
+    Journal journal;
+    if (!journal.Open(journalPath, identity, true)) {
+        std::wcerr << L"journal: " << journal.Error() << std::endl;
+        return 1;
+    }
+    bool ok = copy(journaled, &journal, first);
+    journal.Close();
+    report(L"journaled", first, &journal.Stats());
+    std::wcout << L"journal: overhead=" << (base.seconds > 0 ? (first.seconds / base.seconds - 1) * 100 : 0) << L"%" << std::endl;
+    if (!ok) return 1;
+
+    journal.Open(journalPath, identity, true);
+    ok = copy(journaled, &journal, second);
+    journal.Close();
+    report(L"rerun", second, &journal.Stats());
+    int failures = !ok || second.resumedFiles != second.files || second.resumedBytes != second.bytes;
+
+    // Half way into the file is almost never a record boundary
+    uint64_t size = std::filesystem::file_size(journalPath, ec);
+    std::filesystem::resize_file(journalPath, size / 2 + 3, ec);
+    journal.Open(journalPath, identity, true);
+    ok = copy(journaled, &journal, third);
+    journal.Close();
+    report(L"torn", third, &journal.Stats());
+    failures += !ok || journal.Stats().tornBytes == 0 || third.resumedFiles == 0 || third.resumedFiles == third.files;
+
+    VerifyOptions verifyOptions;
+    verifyOptions.direct = false;
+    ManifestVerifier verifier(verifyOptions);
+    bool verified = verifier.Run(journaled);
+    std::wcout << L"journal: verify files=" << verifier.Stats().files << L" corrupt=" << verifier.Stats().corrupt
+               << L" missing=" << verifier.Stats().missing << std::endl;
+    failures += !verified;
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _PARTITION_BENCH_H_
+#define _PARTITION_BENCH_H_
+#include <iostream>
+#include "../disk/partitioner.h"
+
+// Writes the Windows To Go layout to <device or image>, creating an image of `imageSize`
+// bytes first when nothing is there, and prints where each partition landed
+inline int RunPartitionBench(const std::vector<std::filesystem::path>& paths, const PartitionOptions& options, uint64_t imageSize) {
+    if (paths.size() != 1) {
+        std::wcerr << L"partition: expected <device or image>" << std::endl;
+        return 1;
+    }
+    std::error_code ec;
+    if (!std::filesystem::exists(paths[0], ec)) {
+        File image;
+        if (!image.Open(paths[0], File::WRITE) || !image.Resize(imageSize)) {
+            std::wcerr << L"partition: cannot create " << paths[0].wstring() << std::endl;
+            return 1;
+        }
+    }
+    Partitioner partitioner(options);
+    if (!partitioner.Run(paths[0])) {
+        std::wcerr << L"partition: " << partitioner.Error() << std::endl;
+        return 1;
+    }
+    for (const auto& partition : partitioner.Partitions()) {
+        std::wcout << L"  " << Partitioner::RoleName(partition.role) << L": offset=" << partition.offset << L" size=" << partition.size
+                   << L" aligned=" << (partition.offset % partitioner.Stats().alignment == 0 && partition.size % partitioner.Stats().alignment == 0)
+                   << std::endl;
+    }
+    const PartitionStats& stats = partitioner.Stats();
+    std::wcout << L"partition: style=" << (options.style == LAYOUT_GPT ? L"gpt" : L"mbr") << L" alignment=" << stats.alignment
+               << L" sector=" << stats.sectorSize << L" written=" << stats.bytesWritten << L" seconds=" << stats.seconds << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _PROBE_BENCH_H_
+#define _PROBE_BENCH_H_
+#include <fstream>
+#include <iostream>
+#include "../disk/usb_probe.h"
+
+// Probes <device or image> and prints the JSON report, or writes it to `report` when given.
+// Without --read-only the contents are overwritten.
+inline int RunProbeBench(const std::vector<std::filesystem::path>& paths, const UsbProbeOptions& options, const std::filesystem::path& report) {
+    if (paths.size() != 1) {
+        std::wcerr << L"probe: expected <device or image>" << std::endl;
+        return 1;
+    }
+    UsbProbe probe(options);
+    if (!probe.Run(paths[0])) {
+        std::wcerr << L"probe: " << probe.Error() << std::endl;
+        return 1;
+    }
+    std::string json = probe.Report().ToJson();
+    if (report.empty()) {
+        std::cout << json;
+    }
+    else if (!(std::ofstream(report, std::ios::binary | std::ios::trunc) << json)) {
+        std::wcerr << L"probe: cannot write " << report.wstring() << std::endl;
+        return 1;
+    }
+    std::wcerr << L"probe: " << probe.Report().ToString() << std::endl;
+    return probe.Report().Healthy() ? 0 : 2;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _PROGRESS_BENCH_H_
+#define _PROGRESS_BENCH_H_
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "../progress/progress_channel.h"
+
+// Producers hammer the channel the way the copy workers do, one Advance() per 64 KB and a
+// message now and then, while a monitor drains at 10 Hz. Reports the cost of a call on the
+// hot path, what reached the UI and what was dropped; the final counts must come through.
+inline int RunProgressBench(size_t threads, double seconds) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    ProgressChannel channel;
+    uint64_t notices = 0, ticks = 0;
+    ProgressMonitor monitor(channel, [&](const ProgressEvent&) { notices++; }, [&](const ProgressView&) { ticks++; });
+    monitor.Start();
+    channel.Stage(STAGE_COPY, L"progress bench");
+
+    std::atomic<uint64_t> bytes{ 0 }, files{ 0 }, calls{ 0 }, messages{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration<double>(seconds);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads; ++t) {
+        producers.emplace_back([&] {
+            uint64_t count = 0;
+            while (std::chrono::steady_clock::now() < deadline) {
+                for (int i = 0; i < 1024; ++i, ++count) {
+                    uint64_t done = bytes.fetch_add(64 << 10, std::memory_order_relaxed) + (64 << 10);
+                    if ((count & 63) == 0) files.fetch_add(1, std::memory_order_relaxed);
+                    channel.Advance(STAGE_COPY, done, files.load(std::memory_order_relaxed));
+                    if ((count & 4095) == 0) {
+                        channel.Message(L"progress bench message");
+                        messages.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+            calls.fetch_add(count, std::memory_order_relaxed);
+        });
+    }
+    for (auto& producer : producers) producer.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    channel.Advance(STAGE_COPY, bytes, files, 0, true);
+    monitor.Stop();
+
+    const ProgressView& view = monitor.View();
+    bool complete = view.bytesDone == bytes && view.filesDone == files;
+    std::wcout << L"progress: threads=" << threads << L" calls=" << calls << L" ns/call="
+               << (calls > 0 ? elapsed * 1e9 * threads / calls : 0) << L" messages=" << messages << L" notices=" << notices
+               << L" dropped=" << channel.Dropped() << L" ticks=" << ticks << L" final=" << (complete ? L"ok" : L"MISSING")
+               << std::endl;
+    std::wcout << L"  " << view.ToString() << std::endl;
+    return complete ? 0 : 2;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef _READ_BENCH_H_
+#define _READ_BENCH_H_
+#include <chrono>
+#include <iostream>
+#include "../copy/copy_engine.h"
+#include "../copy/read_plan.h"
+
+// Reads every file of <tree> twice with a cold cache: in walk order, handed to the worker
+// pool the way an unordered copy does, and in the order ReadPlanner makes, each worker
+// taking the next batch and prefetching it first, the way an ordered copy does. Reports
+// the planner's head travel estimate and MB/s of both passes. `generate fragmented` makes
+// a tree whose disk layout is out of directory order. The cache is dropped per file with
+// posix_fadvise, so elsewhere than Linux the second pass may read from memory.
+inline int RunReadOrderBench(const std::vector<std::filesystem::path>& paths, const CopyOptions& options) {
+    if (paths.size() != 1) {
+        std::wcerr << L"read-order: expected <tree>" << std::endl;
+        return 1;
+    }
+    std::vector<std::filesystem::path> files;
+    std::vector<uint64_t> sizes;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(paths[0], ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        files.push_back(it->path());
+        sizes.push_back(it->file_size(ec));
+    }
+    uint64_t total = 0;
+    for (uint64_t size : sizes) total += size;
+
+    auto evict = [&] {
+        for (const auto& path : files) {
+            File file;
+#ifdef __linux__
+            if (file.Open(path, File::READ)) posix_fadvise(file.Native(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        }
+    };
+    std::atomic<uint64_t> failed{ 0 };
+    auto read = [&](size_t index) {
+        static thread_local std::vector<uint8_t> buffer(1 << 20);
+        File file;
+        size_t got = 0;
+        if (!file.Open(files[index], File::READ)) {
+            failed++;
+            return;
+        }
+        for (uint64_t at = 0; file.ReadAt(buffer.data(), buffer.size(), at, got) && got > 0; at += got) {}
+    };
+    auto seconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    ReadPlanOptions planOptions;
+    planOptions.threads = options.threads;
+    planOptions.readAhead = options.readAhead;
+    ReadPlanner planner(planOptions);
+    std::vector<ReadBatch> batches = planner.Plan(files, sizes);
+    const ReadPlanStats& plan = planner.Stats();
+
+    evict();
+    auto start = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(options.threads);
+        for (size_t i = 0; i < files.size(); ++i) pool.Submit([&, i] { read(i); });
+        pool.Wait();
+    }
+    double walked = seconds(start);
+
+    evict();
+    start = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(options.threads);
+        std::atomic<size_t> next{ 0 };
+        for (size_t t = 0; t < pool.Threads(); ++t) {
+            pool.Submit([&] {
+                for (size_t b; (b = next++) < batches.size();) {
+                    for (const ReadExtent& extent : batches[b].prefetch) {
+                        File file;
+                        if (file.Open(files[extent.file], File::READ)) file.Prefetch(extent.offset, extent.length);
+                    }
+                    for (size_t i : batches[b].files) read(i);
+                }
+            });
+        }
+        pool.Wait();
+    }
+    double ordered = seconds(start) + plan.seconds;
+
+    std::wcout << L"read-order: files=" << plan.files << L" mapped=" << plan.mapped << L" fragmented=" << plan.fragmented
+               << L" extents=" << plan.extents << L" batches=" << plan.batches << L" bytes=" << total
+               << L" travel-walk-MB=" << plan.givenTravel / 1000000 << L" travel-planned-MB=" << plan.plannedTravel / 1000000
+               << L" plan-seconds=" << plan.seconds << std::endl;
+    std::wcout << L"read-order: walk seconds=" << walked << L" MB/s=" << (walked > 0 ? total / walked / 1e6 : 0)
+               << L" | ordered seconds=" << ordered << L" MB/s=" << (ordered > 0 ? total / ordered / 1e6 : 0)
+               << L" (planning included) speedup=" << (ordered > 0 ? walked / ordered : 0) << L" errors=" << failed.load() << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _RESYNC_BENCH_H_
+#define _RESYNC_BENCH_H_
+#include <iostream>
+#include "../copy/resync_engine.h"
+
+// Resyncs <destination> with <source> once and reports how much was skipped and written.
+// Run it twice on the same pair to time the no-change case, or touch part of the source between runs.
+inline int RunResyncBench(const std::vector<std::filesystem::path>& paths, const ResyncOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"resync: expected <source> <destination>" << std::endl;
+        return 1;
+    }
+    ResyncEngine engine(options);
+    bool ok = engine.Run(paths[0], paths[1]);
+    for (const auto& error : engine.Errors()) std::wcout << L"  " << error << std::endl;
+
+    const ResyncStats& stats = engine.Stats();
+    std::wcout << L"resync: files=" << stats.files << L" unchanged=" << stats.unchanged << L" updated=" << stats.updated
+               << L" created=" << stats.created << L" deleted=" << stats.deleted << L" directories=" << stats.directories
+               << L" links=" << stats.links << L" chunks-skipped=" << stats.chunksSkipped << L" chunks-written=" << stats.chunksWritten
+               << L" read=" << stats.bytesRead << L" written=" << stats.bytesWritten << L" errors=" << stats.errors
+               << L" seconds=" << stats.seconds << std::endl;
+    return ok ? 0 : 1;
+}
+
+#endif
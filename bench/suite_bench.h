@@ -0,0 +1,129 @@
+#ifndef _SUITE_BENCH_H_
+#define _SUITE_BENCH_H_
+#include <chrono>
+#include <iostream>
+#include "synthetic.h"
+#include "bcd_bench.h"
+#include "version_bench.h"
+#include "copy_bench.h"
+#include "image_bench.h"
+#include "resync_bench.h"
+#include "hash_bench.h"
+#include "partition_bench.h"
+#include "esp_bench.h"
+#include "vhdx_bench.h"
+#include "compress_bench.h"
+#include "tweak_bench.h"
+
+struct SuiteOptions {
+    SyntheticTreeOptions tree;
+    size_t loaders = 8;                                  // Loader entries in generated BCD stores
+    uint64_t imageSize = 4ULL << 30;                     // NTFS image size
+    double allocated = 0.4;                              // Fraction of its clusters in use
+};
+
+// Writes one kind of synthetic data to <target>: tree or fragmented (a directory, --dlls
+// files for the latter), bcd or ntfs (a file)
+inline int RunGenerateBench(const std::vector<std::filesystem::path>& paths, const SuiteOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"generate: expected tree|fragmented|bcd|ntfs <target>" << std::endl;
+        return 1;
+    }
+    std::string kind = paths[0].string();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = false;
+    std::wstring summary;
+    if (kind == "tree") {
+        SyntheticStats stats;
+        ok = SyntheticData::Tree(paths[1], options.tree, stats);
+        summary = stats.ToString();
+    }
+    else if (kind == "fragmented") {
+        SyntheticStats stats;
+        ok = SyntheticData::Fragmented(paths[1], options.tree.dlls, options.tree.seed, stats);
+        summary = stats.ToString();
+    }
+    else if (kind == "bcd") {
+        ok = SyntheticData::BcdHive(paths[1], options.loaders);
+        summary = std::to_wstring(options.loaders) + L" loaders";
+    }
+    else if (kind == "ntfs") {
+        uint64_t allocated = 0;
+        ok = SyntheticData::NtfsImage(paths[1], options.imageSize, options.allocated, options.tree.seed, allocated);
+        summary = std::to_wstring(options.imageSize >> 20) + L" MB volume, " + std::to_wstring(allocated >> 20) + L" MB allocated";
+    }
+    else {
+        std::wcerr << L"generate: unknown kind " << paths[0].wstring() << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::wcerr << L"generate: cannot write " << paths[1].wstring() << std::endl;
+        return 1;
+    }
+    std::wcout << L"generate: " << paths[0].wstring() << L" " << summary << L" seconds=" << seconds << std::endl;
+    return 0;
+}
+
+// Generates a tree, a BCD store and an NTFS image under <workdir> unless they are already
+// there, then runs every engine over them once. With the same flags and seed the data is
+// identical, so the result lines can be compared between releases.
+inline int RunSuiteBench(const std::vector<std::filesystem::path>& paths, const SuiteOptions& options,
+                         const CopyOptions& copyOptions, const ResyncOptions& resyncOptions, const VerifyOptions& verifyOptions,
+                         const ImageOptions& imageOptions) {
+    if (paths.size() != 1) {
+        std::wcerr << L"suite: expected <workdir>" << std::endl;
+        return 1;
+    }
+    std::filesystem::path work = paths[0];
+    std::filesystem::path tree = work / "tree", stores = work / "bcd", ntfs = work / "ntfs.img";
+    std::error_code ec;
+    std::filesystem::create_directories(stores, ec);
+    if (!std::filesystem::exists(tree, ec) && RunGenerateBench({ "tree", tree }, options) != 0) return 1;
+    for (size_t loaders : { size_t(1), options.loaders, options.loaders * 16 }) {
+        std::filesystem::path store = stores / ("BCD-" + std::to_string(loaders));
+        if (!std::filesystem::exists(store, ec) && !SyntheticData::BcdHive(store, loaders)) {
+            std::wcerr << L"suite: cannot write " << store.wstring() << std::endl;
+            return 1;
+        }
+    }
+    if (!std::filesystem::exists(ntfs, ec) && RunGenerateBench({ "ntfs", ntfs }, options) != 0) return 1;
+
+    std::wcout << L"suite: dlls=" << options.tree.dlls << L" components=" << options.tree.components << L" large="
+               << options.tree.largeFiles << L"x" << (options.tree.largeSize >> 20) << L"MB image=" << (options.imageSize >> 20)
+               << L"MB seed=" << options.tree.seed << std::endl;
+
+    std::filesystem::path copy = work / "copy", image = work / "image.out";
+    std::filesystem::remove_all(copy, ec);
+    std::filesystem::remove(image, ec);
+    CopyOptions manifested = copyOptions;
+    manifested.manifest = true;
+    int failures = 0;
+    failures += RunBcdValidateBench({ stores }, 100) != 0;
+    failures += RunVersionDetectBench({ tree }, 100) != 0;
+    failures += RunCopyBench({ tree, copy }, manifested) != 0;
+    failures += RunVerifyBench({ copy }, verifyOptions) != 0;
+    failures += RunResyncBench({ tree, copy }, resyncOptions) != 0;
+    failures += RunTweakBench({ copy }) != 0;
+    failures += RunImageBench({ ntfs, image }, imageOptions) != 0;
+    failures += RunVhdxBench({ ntfs, work / "image.vhdx" }, imageOptions, VhdxOptions()) != 0;
+    failures += RunHashBench(64 << 20, 5) != 0;
+    failures += RunCompressBench({ tree }, { WOF_XPRESS4K }, copyOptions.threads, copyOptions.chunkSize) != 0;
+
+    // A 1 GB disk image with the default layout; on a file the ESP starts at the minimum alignment
+    std::filesystem::path disk = work / "disk.img";
+    std::filesystem::remove(disk, ec);
+    PartitionOptions layout;
+    Fat32Options esp;
+    esp.offset = layout.minAlignment;
+    esp.size = layout.espSize;
+    failures += RunPartitionBench({ disk }, layout, 1ULL << 30) != 0;
+    failures += RunEspBench({ tree / "Windows", tree / "Boot" / "BCD", disk }, esp, esp.size) != 0;
+    std::filesystem::remove(image, ec);
+    std::filesystem::remove(work / "image.vhdx", ec);
+    std::filesystem::remove(disk, ec);
+    std::wcout << L"suite: failures=" << failures << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,423 @@
+#ifndef _SYNTHETIC_H_
+#define _SYNTHETIC_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "../editor/bcd_store.h"
+#include "../editor/hive.h"
+#include "../platform/file.h"
+
+struct SyntheticTreeOptions {
+    size_t dlls = 4000;                                  // PE files in Windows\System32, mostly under 64 KB
+    size_t components = 1500;                            // WinSxS component directories
+    size_t filesPerComponent = 4;
+    size_t largeFiles = 3;
+    uint64_t largeSize = 2ULL << 30;                     // Each
+    uint32_t build = 22621;                              // Kernel and SOFTWARE hive report 10.0.<build>
+    uint64_t seed = 1;
+};
+
+struct SyntheticStats {
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t bytes = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files in " + std::to_wstring(directories) + L" directories, "
+            + std::to_wstring(bytes / 1000000) + L" MB";
+    }
+};
+
+// Reproducible stand-ins for what the engines see in the field, so every engine can be
+// benchmarked on Linux and the numbers compared between releases:
+//   Tree()      a Windows-shaped volume: thousands of small DLLs, deep WinSxS and
+//               DriverStore paths, a few multi-GB files, a kernel and SOFTWARE/SYSTEM hives
+//               the version detector recognizes, boot manager and fonts under Windows\Boot
+//               and a BCD store at \Boot\BCD
+//   BcdHive()   a store with a boot manager and N loaders
+//   NtfsImage() an NTFS-shaped volume (boot sector, $MFT, $Bitmap) with allocated runs
+//               filled, for the block imager
+//   Fragmented() small files scattered over the disk out of directory order, most in two
+//               extents, for the read planner
+// File contents mix random, text-like and zero 4 KB blocks in roughly the proportions of
+// a system volume, so compressors and zero detection see realistic data.
+class SyntheticData {
+
+    public:
+
+        static bool Tree(const std::filesystem::path& root, const SyntheticTreeOptions& options, SyntheticStats& stats) {
+            Random random(options.seed);
+            stats = SyntheticStats();
+            std::filesystem::path windows = root / "Windows";
+            std::filesystem::path system32 = windows / "System32";
+            std::string version = "10.0." + std::to_string(options.build);
+
+            if (!Directory(system32 / "config", stats) || !Directory(root / "Boot", stats)) return false;
+            if (!Pe(system32 / "ntoskrnl.exe", 10, 0, static_cast<uint16_t>(options.build), 1, 8 << 20, random, stats)) return false;
+            if (!VersionHives(system32 / "config", options.build, stats)) return false;
+            if (!BcdHive(root / "Boot" / "BCD", 2)) return false;
+            stats.files++;
+
+            // What the system partition is populated from
+            std::filesystem::path boot = windows / "Boot";
+            if (!Directory(boot / "EFI", stats) || !Directory(boot / "Fonts", stats) || !Directory(boot / "PCAT", stats)) return false;
+            if (!Pe(boot / "EFI" / "bootmgfw.efi", 10, 0, static_cast<uint16_t>(options.build), 1, 1600 << 10, random, stats)
+                || !Pe(boot / "PCAT" / "bootmgr", 10, 0, static_cast<uint16_t>(options.build), 1, 420 << 10, random, stats)) {
+                return false;
+            }
+            for (const char* font : { "segmono_boot.ttf", "segoe_slboot.ttf", "segoen_slboot.ttf", "wgl4_boot.ttf", "malgun_boot.ttf" }) {
+                if (!Data(boot / "Fonts" / font, 40960 + random.Next() % (2 << 20), random, stats)) return false;
+            }
+
+            for (size_t i = 0; i < options.dlls; ++i) {
+                std::string name = "wtg" + Hex(i, 5) + (i % 5 == 0 ? ".exe" : ".dll");
+                if (!Pe(system32 / name, 10, 0, static_cast<uint16_t>(options.build), static_cast<uint16_t>(i),
+                        SmallSize(random), random, stats)) {
+                    return false;
+                }
+            }
+
+            // Component store: long names, one directory per component and version
+            std::filesystem::path sxs = windows / "WinSxS";
+            std::filesystem::path repository = system32 / "DriverStore" / "FileRepository";
+            for (size_t i = 0; i < options.components; ++i) {
+                bool driver = i % 4 == 3;
+                std::filesystem::path component = driver
+                    ? repository / ("wtgdrv" + std::to_string(i) + ".inf_amd64_" + Hex(random.Next(), 16))
+                    : sxs / ("amd64_microsoft-windows-wtg-component-" + std::to_string(i) + "_31bf3856ad364e35_" + version
+                             + "." + std::to_string(i % 3000) + "_none_" + Hex(random.Next(), 16));
+                if (driver) component /= "x64";
+                if (!Directory(component, stats)) return false;
+                for (size_t f = 0; f < options.filesPerComponent; ++f) {
+                    std::string name = "file" + std::to_string(f) + (f % 3 == 2 ? ".mui" : ".dll");
+                    if (!Data(component / name, SmallSize(random), random, stats)) return false;
+                }
+            }
+            if (!Directory(sxs / "Manifests", stats)) return false;
+            for (size_t i = 0; i < options.components; ++i) {
+                if (!Data(sxs / "Manifests" / ("amd64_wtg-component-" + std::to_string(i) + ".manifest"), 512 + random.Next() % 4096,
+                          random, stats)) {
+                    return false;
+                }
+            }
+
+            std::filesystem::path download = windows / "SoftwareDistribution" / "Download";
+            if (!Directory(download, stats)) return false;
+            for (size_t i = 0; i < options.largeFiles; ++i) {
+                if (!Data(download / ("update" + std::to_string(i) + ".cab"), options.largeSize, random, stats)) return false;
+            }
+            return true;
+        }
+
+        // Files are written in a shuffled order, first halves then second halves in another
+        // order, with the filesystem flushed in between so delayed allocation cannot put the
+        // halves back together. Only the layout the filesystem picks is random; the contents
+        // follow the seed as everywhere else.
+        static bool Fragmented(const std::filesystem::path& root, size_t count, uint64_t seed, SyntheticStats& stats) {
+            Random random(seed);
+            stats = SyntheticStats();
+            std::vector<std::filesystem::path> paths;
+            std::vector<uint64_t> sizes;
+            for (size_t i = 0; i < count; ++i) {
+                std::filesystem::path directory = root / ("dir" + Hex(i % 64, 2));
+                if (!Directory(directory, stats)) return false;
+                paths.push_back(directory / ("f" + Hex(i, 5) + ".bin"));
+                sizes.push_back((16 << 10) + random.Next() % (240 << 10));
+            }
+            std::vector<uint8_t> buffer(256 << 10);
+            for (int half = 0; half < 2; ++half) {
+                std::vector<size_t> order(count);
+                for (size_t i = 0; i < count; ++i) order[i] = i;
+                for (size_t i = count; i > 1; --i) std::swap(order[i - 1], order[random.Next() % i]);
+                File file;
+                for (size_t i : order) {
+                    uint64_t first = sizes[i] / 2 / 4096 * 4096;
+                    uint64_t at = half == 0 ? 0 : first, length = half == 0 ? first : sizes[i] - first;
+                    Fill(buffer.data(), static_cast<size_t>(length), random);
+                    if (!file.Open(paths[i], half == 0 ? File::WRITE : File::UPDATE) || !file.WriteAt(buffer.data(), static_cast<size_t>(length), at)) {
+                        return false;
+                    }
+                }
+                if (count && !file.SyncFilesystem()) return false;
+            }
+            for (uint64_t size : sizes) stats.bytes += size;
+            stats.files = count;
+            return true;
+        }
+
+        static bool BcdHive(const std::filesystem::path& path, size_t loaders) {
+            BcdStore store;
+            store.Create(path);
+            BcdGuid bootmgr;
+            BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+            if (!store.CreateObject(bootmgr, BCD_OBJECT_BOOTMGR)) return false;
+            store.SetString(bootmgr, BCD_LIBRARY_DESCRIPTION, L"Windows Boot Manager");
+            store.SetInteger(bootmgr, BCD_BOOTMGR_TIMEOUT, 30);
+            BcdDevice device;
+            device.kind = BcdDevice::PARTITION;
+            device.style = BcdDevice::MBR;
+            device.mbrSignature = 0x57544731;
+            device.partitionOffset = 1 << 20;
+            std::vector<BcdGuid> order;
+            for (size_t i = 0; i < std::max<size_t>(1, loaders); ++i) {
+                BcdGuid loader = BcdGuid::Random();
+                if (!store.CreateObject(loader, BCD_OBJECT_OSLOADER)) return false;
+                store.SetString(loader, BCD_LIBRARY_DESCRIPTION, L"Windows " + std::to_wstring(i));
+                store.SetString(loader, BCD_LIBRARY_PATH, L"\\Windows\\system32\\winload.efi");
+                store.SetString(loader, BCD_OSLOADER_SYSTEMROOT, L"\\Windows");
+                store.SetDevice(loader, BCD_LIBRARY_DEVICE, device);
+                store.SetDevice(loader, BCD_OSLOADER_OSDEVICE, device);
+                order.push_back(loader);
+            }
+            store.SetObjectRef(bootmgr, BCD_BOOTMGR_DEFAULT, order.front());
+            store.SetObjectList(bootmgr, BCD_BOOTMGR_DISPLAYORDER, order);
+            return store.SaveAs(path);
+        }
+
+        // `allocated` is the fraction of clusters in use; returns the allocated bytes
+        static bool NtfsImage(const std::filesystem::path& path, uint64_t size, double allocated, uint64_t seed, uint64_t& allocatedBytes) {
+            const uint64_t clusterSize = 4096, mftLcn = 16, mftClusters = 64, bitmapLcn = 200, firstData = 300;
+            uint64_t clusters = std::max<uint64_t>(size / clusterSize, 1024);
+            uint64_t bitmapClusters = (clusters / 8 + clusterSize - 1) / clusterSize;
+            File file;
+            if (!file.Open(path, File::WRITE) || !file.Resize(clusters * clusterSize + 512)) return false;
+
+            Random random(seed);
+            std::vector<uint8_t> bitmap(static_cast<size_t>((clusters + 7) / 8), 0);
+            auto use = [&](uint64_t first, uint64_t count) {
+                for (uint64_t c = first; c < std::min(clusters, first + count); ++c) bitmap[static_cast<size_t>(c / 8)] |= 1 << (c % 8);
+            };
+            use(0, mftLcn + mftClusters);
+            use(bitmapLcn, bitmapClusters);
+            std::vector<std::pair<uint64_t, uint64_t>> runs;
+            for (uint64_t c = firstData; c < clusters;) {
+                uint64_t length = 1 + random.Next() % 300;
+                if (random.Next() % 1000 < allocated * 1000) {
+                    runs.push_back({ c, std::min(length, clusters - c) });
+                    use(c, length);
+                }
+                c += length + 1 + random.Next() % 200;
+            }
+
+            std::vector<uint8_t> boot(512, 0);
+            std::memcpy(&boot[3], "NTFS    ", 8);
+            Put(boot, 0x0B, 512, 2);
+            boot[0x0D] = static_cast<uint8_t>(clusterSize / 512);
+            Put(boot, 0x28, clusters * clusterSize / 512, 8);
+            Put(boot, 0x30, mftLcn, 8);
+            Put(boot, 0x38, 2, 8);
+            boot[0x40] = 0xF6;                           // 2^10 = 1024-byte records
+            boot[510] = 0x55;
+            boot[511] = 0xAA;
+            bool ok = file.WriteAt(boot.data(), boot.size(), 0) && file.WriteAt(boot.data(), boot.size(), clusters * clusterSize);
+            std::vector<uint8_t> mft = MftRecord({ { mftLcn, mftClusters } }, mftClusters * clusterSize);
+            std::vector<uint8_t> bitmapRecord = MftRecord({ { bitmapLcn, bitmapClusters } }, bitmap.size());
+            ok = ok && file.WriteAt(mft.data(), mft.size(), mftLcn * clusterSize)
+                && file.WriteAt(bitmapRecord.data(), bitmapRecord.size(), mftLcn * clusterSize + 6 * 1024)
+                && file.WriteAt(bitmap.data(), bitmap.size(), bitmapLcn * clusterSize);
+
+            allocatedBytes = 0;
+            std::vector<uint8_t> buffer;
+            for (const auto& [first, count] : runs) {
+                buffer.resize(static_cast<size_t>(count * clusterSize));
+                Fill(buffer.data(), buffer.size(), random);
+                ok = ok && file.WriteAt(buffer.data(), buffer.size(), first * clusterSize);
+            }
+            for (uint8_t byte : bitmap) {
+                for (; byte; byte &= byte - 1) allocatedBytes += clusterSize;
+            }
+            return ok;
+        }
+
+    private:
+
+        // xorshift64*, fast and the same on every platform
+        struct Random {
+            uint64_t state;
+            explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL | 1) {}
+            uint64_t Next() {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                return state * 0x2545F4914F6CDD1DULL;
+            }
+        };
+
+        // 80% under 64 KB, most of the rest under 1 MB, a few up to 8 MB
+        static uint64_t SmallSize(Random& random) {
+            uint64_t pick = random.Next() % 100;
+            if (pick < 80) return 1024 + random.Next() % (63 << 10);
+            if (pick < 97) return (64 << 10) + random.Next() % (960 << 10);
+            return (1 << 20) + random.Next() % (7 << 20);
+        }
+
+        // Per 4 KB block: 45% random, 35% text-like, 20% zeros
+        static void Fill(uint8_t* data, size_t length, Random& random) {
+            static const char text[] = "The quick brown fox jumps over the lazy dog. C:\\Windows\\System32\\drivers\\etc ";
+            for (size_t at = 0; at < length; at += 4096) {
+                size_t block = std::min<size_t>(4096, length - at);
+                uint64_t kind = random.Next() % 100;
+                if (kind < 45) {
+                    for (size_t i = 0; i < block; i += 8) {
+                        uint64_t value = random.Next();
+                        std::memcpy(data + at + i, &value, std::min<size_t>(8, block - i));
+                    }
+                }
+                else if (kind < 80) {
+                    size_t shift = static_cast<size_t>(random.Next() % (sizeof(text) - 1));
+                    for (size_t i = 0; i < block; ++i) data[at + i] = static_cast<uint8_t>(text[(i + shift) % (sizeof(text) - 1)]);
+                }
+                else {
+                    std::memset(data + at, 0, block);
+                }
+            }
+        }
+
+        static bool Directory(const std::filesystem::path& path, SyntheticStats& stats) {
+            std::error_code ec;
+            if (std::filesystem::is_directory(path, ec)) return true;
+            std::filesystem::create_directories(path, ec);
+            stats.directories++;
+            return !ec;
+        }
+
+        static bool Data(const std::filesystem::path& path, uint64_t size, Random& random, SyntheticStats& stats,
+                         const std::vector<uint8_t>& header = {}) {
+            File file;
+            if (!file.Open(path, File::WRITE)) return false;
+            std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(size, 1 << 20)));
+            for (uint64_t at = 0; at < size; at += buffer.size()) {
+                size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - at));
+                Fill(buffer.data(), length, random);
+                if (at == 0 && !header.empty()) std::memcpy(buffer.data(), header.data(), std::min(header.size(), length));
+                if (!file.WriteAt(buffer.data(), length, at)) return false;
+            }
+            stats.files++;
+            stats.bytes += size;
+            return true;
+        }
+
+        // A PE32+ image with one .rsrc section holding VS_VERSIONINFO, which is all the
+        // version detector reads, followed by filler
+        static bool Pe(const std::filesystem::path& path, uint16_t major, uint16_t minor, uint16_t build, uint16_t revision,
+                       uint64_t size, Random& random, SyntheticStats& stats) {
+            std::vector<uint8_t> b(0x600, 0);
+            b[0] = 'M';
+            b[1] = 'Z';
+            Put(b, 0x3C, 0x40, 4);
+            std::memcpy(&b[0x40], "PE\0\0", 4);
+            Put(b, 0x44, 0x8664, 2);                     // AMD64
+            Put(b, 0x46, 1, 2);                          // One section
+            Put(b, 0x54, 0xF0, 2);                       // Optional header size
+            size_t optional = 0x58;
+            Put(b, optional, 0x20B, 2);                  // PE32+
+            Put(b, optional + 108, 16, 4);               // Data directories
+            Put(b, optional + 112 + 16, 0x1000, 4);      // Resource directory RVA
+            Put(b, optional + 112 + 20, 0x200, 4);
+            size_t section = optional + 0xF0;
+            std::memcpy(&b[section], ".rsrc", 5);
+            Put(b, section + 8, 0x200, 4);
+            Put(b, section + 12, 0x1000, 4);
+            Put(b, section + 16, 0x200, 4);
+            Put(b, section + 20, 0x400, 4);
+            size_t r = 0x400;                            // Type RT_VERSION -> name 1 -> language 0x409 -> data
+            Put(b, r + 14, 1, 2);
+            Put(b, r + 16, 16, 4);
+            Put(b, r + 20, 0x80000018, 4);
+            Put(b, r + 0x18 + 14, 1, 2);
+            Put(b, r + 0x18 + 16, 1, 4);
+            Put(b, r + 0x18 + 20, 0x80000030, 4);
+            Put(b, r + 0x30 + 14, 1, 2);
+            Put(b, r + 0x30 + 16, 0x409, 4);
+            Put(b, r + 0x30 + 20, 0x48, 4);
+            Put(b, r + 0x48, 0x1060, 4);
+            Put(b, r + 0x4C, 0x5C, 4);
+            size_t v = r + 0x60;
+            Put(b, v, 0x5C, 2);
+            Put(b, v + 2, 52, 2);
+            const char* key = "VS_VERSION_INFO";
+            for (size_t i = 0; key[i]; ++i) Put(b, v + 6 + 2 * i, static_cast<uint8_t>(key[i]), 2);
+            Put(b, v + 40, 0xFEEF04BD, 4);
+            Put(b, v + 48, static_cast<uint32_t>(major) << 16 | minor, 4);
+            Put(b, v + 52, static_cast<uint32_t>(build) << 16 | revision, 4);
+            return Data(path, std::max<uint64_t>(size, b.size()), random, stats, b);
+        }
+
+        static bool VersionHives(const std::filesystem::path& config, uint32_t build, SyntheticStats& stats) {
+            Hive software;
+            software.CreateEmpty(L"ROOT");
+            Hive::Key* current = software.CreatePath(L"Microsoft\\Windows NT\\CurrentVersion");
+            current->SetValue(L"CurrentMajorVersionNumber", REGF_DWORD, Hive::EncodeDword(10));
+            current->SetValue(L"CurrentMinorVersionNumber", REGF_DWORD, Hive::EncodeDword(0));
+            current->SetValue(L"CurrentBuildNumber", REGF_SZ, Hive::EncodeString(std::to_wstring(build)));
+            current->SetValue(L"UBR", REGF_DWORD, Hive::EncodeDword(1));
+            current->SetValue(L"ProductName", REGF_SZ, Hive::EncodeString(L"Windows 10 Pro"));
+
+            Hive system;
+            system.CreateEmpty(L"ROOT");
+            system.CreatePath(L"Select")->SetValue(L"Current", REGF_DWORD, Hive::EncodeDword(1));
+            Hive::Key* memory = system.CreatePath(L"ControlSet001\\Control\\Session Manager\\Memory Management");
+            memory->SetValue(L"PagingFiles", REGF_MULTI_SZ, Hive::EncodeMultiString({ L"?:\\pagefile.sys" }));
+            system.CreatePath(L"ControlSet001\\Control\\Power")->SetValue(L"HibernateEnabled", REGF_DWORD, Hive::EncodeDword(1));
+            system.CreatePath(L"ControlSet001\\Services\\SysMain")->SetValue(L"Start", REGF_DWORD, Hive::EncodeDword(2));
+            if (!software.Save(config / "SOFTWARE") || !system.Save(config / "SYSTEM")) return false;
+            stats.files += 2;
+            return true;
+        }
+
+        static std::vector<uint8_t> MftRecord(const std::vector<std::pair<uint64_t, uint64_t>>& runs, uint64_t size) {
+            std::vector<uint8_t> runlist;
+            int64_t previous = 0;
+            for (const auto& [lcn, count] : runs) {
+                int64_t delta = static_cast<int64_t>(lcn) - previous;
+                previous = static_cast<int64_t>(lcn);
+                uint8_t lengthBytes = 1, offsetBytes = 1;
+                while (lengthBytes < 8 && count >> (8 * lengthBytes)) lengthBytes++;
+                while (offsetBytes < 8 && (delta >> (8 * offsetBytes - 1)) != 0 && (delta >> (8 * offsetBytes - 1)) != -1) offsetBytes++;
+                runlist.push_back(static_cast<uint8_t>(lengthBytes | offsetBytes << 4));
+                for (uint8_t i = 0; i < lengthBytes; ++i) runlist.push_back(static_cast<uint8_t>(count >> (8 * i)));
+                for (uint8_t i = 0; i < offsetBytes; ++i) runlist.push_back(static_cast<uint8_t>(static_cast<uint64_t>(delta) >> (8 * i)));
+            }
+            runlist.push_back(0);
+
+            std::vector<uint8_t> record(1024, 0);
+            std::memcpy(record.data(), "FILE", 4);
+            Put(record, 0x04, 0x30, 2);                  // Update sequence array offset
+            Put(record, 0x06, 3, 2);                     // and count: the number plus one per sector
+            Put(record, 0x14, 0x38, 2);                  // First attribute
+            size_t attribute = 0x38, length = (0x40 + runlist.size() + 7) / 8 * 8;
+            Put(record, attribute, 0x80, 4);             // $DATA
+            Put(record, attribute + 4, length, 4);
+            record[attribute + 8] = 1;                   // Non-resident
+            Put(record, attribute + 0x20, 0x40, 2);      // Runlist offset
+            Put(record, attribute + 0x28, size, 8);
+            Put(record, attribute + 0x30, size, 8);
+            Put(record, attribute + 0x38, size, 8);
+            std::memcpy(&record[attribute + 0x40], runlist.data(), runlist.size());
+            Put(record, attribute + length, 0xFFFFFFFF, 4);
+            const uint16_t usn = 0x1234;
+            Put(record, 0x30, usn, 2);
+            for (size_t sector = 0; sector < 2; ++sector) {
+                size_t tail = sector * 512 + 510;
+                record[0x32 + 2 * sector] = record[tail];
+                record[0x33 + 2 * sector] = record[tail + 1];
+                Put(record, tail, usn, 2);
+            }
+            return record;
+        }
+
+        static void Put(std::vector<uint8_t>& buffer, size_t offset, uint64_t value, size_t bytes) {
+            for (size_t i = 0; i < bytes; ++i) buffer[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+
+        static std::string Hex(uint64_t value, size_t digits) {
+            static const char hex[] = "0123456789abcdef";
+            std::string text(digits, '0');
+            for (size_t i = 0; i < digits; ++i) text[digits - 1 - i] = hex[(value >> (4 * i)) & 0xF];
+            return text;
+        }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _TRACE_BENCH_H_
+#define _TRACE_BENCH_H_
+#include <chrono>
+#include <iostream>
+#include "../trace/tracer.h"
+
+// Cost of a TraceScope with tracing off (what every copy chunk pays by default) and on
+inline int RunTraceBench(int iterations) {
+    Tracer& tracer = Tracer::Instance();
+    bool was = tracer.Enabled();
+    uint64_t count = static_cast<uint64_t>(iterations) * 10000;
+    for (bool on : { false, true }) {
+        tracer.Enable(on);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < count; ++i) {
+            TraceScope scope("bench.scope", "bench");
+            scope.Bytes(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::wcout << L"trace: enabled=" << on << L" scopes=" << count << L" ns/scope=" << seconds * 1e9 / count << std::endl;
+    }
+    tracer.Enable(was);
+    tracer.Clear();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _TWEAK_BENCH_H_
+#define _TWEAK_BENCH_H_
+#include <iostream>
+#include "../editor/hive_tweaks.h"
+
+// Applies the Windows To Go tweak table to the hives under each volume root, then reads
+// every row back through HiveView (base block checksum checked) rather than the Hive parser
+// that wrote it, and applies the table a second time, which must find nothing to change.
+// Edits the hives in place: point it at a generated tree or a copy.
+inline int RunTweakBench(const std::vector<std::filesystem::path>& roots) {
+    if (roots.empty()) {
+        std::wcerr << L"tweak: expected <volume root>..." << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    for (const auto& root : roots) {
+        HiveTweaker tweaker;
+        if (!tweaker.Apply(root)) {
+            std::wcerr << L"tweak: " << root.wstring() << L": " << tweaker.Error() << std::endl;
+            failures++;
+            continue;
+        }
+        HiveTweakStats first = tweaker.Stats();
+
+        size_t checked = 0, wrong = 0;
+        for (const wchar_t* name : { L"SYSTEM", L"SOFTWARE" }) {
+            MappedFile file;
+            HiveView view;
+            auto path = FindPathNoCase(root, std::wstring(L"Windows\\System32\\config\\") + name);
+            if (!path || !file.Open(*path) || !view.Attach(file.Data(), file.Size())) {
+                std::wcerr << L"tweak: " << name << L" does not read back: " << view.Error() << std::endl;
+                wrong++;
+                continue;
+            }
+            std::wstring controlSet = L"ControlSet00" + std::to_wstring(view.Dword(view.Open(L"Select"), L"Current").value_or(1));
+            for (const auto& tweak : HiveTweaker::Table()) {
+                if (std::wstring(name) != tweak.hive || !HiveTweaker::Applies(tweak, first.version)) continue;
+                std::wstring keyPath = tweak.key;
+                if (keyPath.compare(0, 17, L"CurrentControlSet") == 0) keyPath = controlSet + keyPath.substr(17);
+                uint32_t key = view.Open(keyPath);
+                if (key == HiveView::NONE && tweak.existingKey) continue;
+                uint32_t length = 0, type = 0;
+                const uint8_t* data = view.ValueData(view.Value(key, tweak.value), length, type);
+                std::vector<uint8_t> wanted = HiveTweaker::Encode(tweak);
+                checked++;
+                if (!data || type != static_cast<uint32_t>(tweak.type) || std::vector<uint8_t>(data, data + length) != wanted) {
+                    std::wcerr << L"tweak: " << name << L"\\" << keyPath << L"\\" << tweak.value << L" reads back wrong" << std::endl;
+                    wrong++;
+                }
+            }
+        }
+
+        bool again = tweaker.Apply(root);
+        std::wcout << L"tweak: root=" << root.wstring() << L" version=" << first.version << L" applied=" << first.applied
+                   << L" unchanged=" << first.unchanged << L" skipped=" << first.skipped << L" hives=" << first.hivesWritten
+                   << L" bytes=" << first.bytes << L" seconds=" << first.seconds << L" checked=" << checked << L" wrong=" << wrong
+                   << L" second-pass-applied=" << tweaker.Stats().applied << std::endl;
+        failures += wrong != 0 || !again || tweaker.Stats().applied != 0;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _VERSION_BENCH_H_
+#define _VERSION_BENCH_H_
+#include <chrono>
+#include <iostream>
+#include "../editor/windows_version.h"
+
+// Each path is a Windows volume root: a mount point or an extracted image directory
+inline int RunVersionDetectBench(const std::vector<std::filesystem::path>& roots, int iterations) {
+    if (roots.empty()) {
+        std::wcerr << L"version-detect: no image roots given" << std::endl;
+        return 1;
+    }
+
+    size_t unknown = 0;
+    for (const auto& root : roots) {
+        WindowsBuild build;
+        if (!WindowsVersionDetector::DetectUncached(root.wstring(), build)) {
+            std::wcout << L"  " << root.wstring() << L": no kernel or SOFTWARE hive version found" << std::endl;
+            ++unknown;
+            continue;
+        }
+        std::wcout << L"  " << root.wstring() << L": " << build.ToString()
+                   << (build.fromRegistry ? L" registry" : L"") << (build.fromKernel ? L" kernel" : L"")
+                   << (build.productName.empty() ? L"" : L" \"" + build.productName + L"\"") << std::endl;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& root : roots) {
+            WindowsBuild build;
+            WindowsVersionDetector::DetectUncached(root.wstring(), build);
+        }
+    }
+    double uncached = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& root : roots) WindowsVersionDetector::DetectVersion(root.wstring());
+    }
+    double cached = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double total = static_cast<double>(roots.size()) * iterations;
+
+    std::wcout << L"version-detect: images=" << roots.size() << L" unknown=" << unknown
+               << L" iterations=" << iterations
+               << L" images/s=" << (uncached > 0 ? total / uncached : 0.0)
+               << L" cached-images/s=" << (cached > 0 ? total / cached : 0.0) << std::endl;
+    return unknown == 0 ? 0 : 1;
+}
+
+#endif
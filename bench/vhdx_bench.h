@@ -0,0 +1,234 @@
+#ifndef _VHDX_BENCH_H_
+#define _VHDX_BENCH_H_
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "../disk/partitioner.h"
+#include "../imaging/volume_imager.h"
+
+// Reads a VHDX back the way a consumer would and checks what VhdxWriter promised: the file
+// identifier, both headers and region tables with their CRC-32C, the metadata items, and a
+// BAT whose present blocks are 1 MB aligned, inside the file and not overlapping. Read()
+// then returns virtual disk bytes, zeros for blocks never allocated.
+class VhdxCheck {
+
+    public:
+
+        bool Open(const std::filesystem::path& path) {
+            if (!file.Open(path, File::READ)) return Fail(file.Error());
+            std::vector<uint8_t> identifier(8), header(4096), regions(64 << 10);
+            if (!Load(identifier, 0) || std::memcmp(identifier.data(), "vhdxfile", 8) != 0) return Fail(L"No file identifier");
+            for (uint64_t at : { 64 << 10, 128 << 10 }) {
+                if (!Load(header, at) || Hive::Get32(header.data(), 0) != 0x64616568 || !Checksummed(header)) return Fail(L"Bad header at " + std::to_wstring(at));
+                if (Hive::Get16(header.data(), 66) != 1 || Hive::Get64(header.data(), 72) % VhdxWriter::MB != 0) return Fail(L"Bad header fields");
+                for (size_t i = 48; i < 64; ++i) {
+                    if (header[i]) return Fail(L"Log GUID set, a log would need replaying");
+                }
+            }
+            uint64_t batOffset = 0, batLength = 0, metadataOffset = 0;
+            for (uint64_t at : { 192 << 10, 256 << 10 }) {
+                if (!Load(regions, at) || Hive::Get32(regions.data(), 0) != 0x69676572 || !Checksummed(regions)) return Fail(L"Bad region table at " + std::to_wstring(at));
+                for (uint32_t i = 0; i < Hive::Get32(regions.data(), 8); ++i) {
+                    const uint8_t* entry = regions.data() + 16 + 32 * i;
+                    BcdGuid guid = BcdGuid::FromBytes(entry);
+                    if (guid == VhdxWriter::Guid(VhdxWriter::BAT_REGION)) {
+                        batOffset = Hive::Get64(entry, 16);
+                        batLength = Hive::Get32(entry, 24);
+                    }
+                    else if (guid == VhdxWriter::Guid(VhdxWriter::METADATA_REGION)) {
+                        metadataOffset = Hive::Get64(entry, 16);
+                    }
+                }
+            }
+            if (!batOffset || !metadataOffset) return Fail(L"Region table lacks the BAT or the metadata");
+
+            std::vector<uint8_t> metadata(VhdxWriter::MB);
+            if (!Load(metadata, metadataOffset) || std::memcmp(metadata.data(), "metadata", 8) != 0) return Fail(L"No metadata table");
+            for (uint16_t i = 0; i < Hive::Get16(metadata.data(), 10); ++i) {
+                const uint8_t* entry = metadata.data() + 32 + 32 * i;
+                BcdGuid guid = BcdGuid::FromBytes(entry);
+                const uint8_t* value = metadata.data() + Hive::Get32(entry, 16);
+                if (guid == VhdxWriter::Guid(VhdxWriter::FILE_PARAMETERS)) blockSize = Hive::Get32(value, 0);
+                else if (guid == VhdxWriter::Guid(VhdxWriter::VIRTUAL_DISK_SIZE)) size = Hive::Get64(value, 0);
+                else if (guid == VhdxWriter::Guid(VhdxWriter::LOGICAL_SECTOR_SIZE)) logicalSector = Hive::Get32(value, 0);
+            }
+            if (!blockSize || !size || !logicalSector) return Fail(L"Metadata lacks the block size, disk size or sector size");
+
+            uint64_t chunkRatio = (8ULL << 20) * logicalSector / blockSize;
+            blocks = (size + blockSize - 1) / blockSize;
+            uint64_t entries = blocks + (blocks - 1) / chunkRatio;
+            if (entries * 8 > batLength) return Fail(L"BAT region too small");
+            std::vector<uint8_t> table(static_cast<size_t>(entries * 8));
+            if (!Load(table, batOffset)) return Fail(L"Cannot read the BAT");
+            std::vector<std::pair<uint64_t, uint64_t>> used = { { 0, 4 * VhdxWriter::MB } };
+            for (uint64_t i = 0; i < entries; ++i) {
+                uint64_t entry = Hive::Get64(table.data(), i * 8);
+                bool bitmap = (i + 1) % (chunkRatio + 1) == 0;
+                if (bitmap) {
+                    if (entry != 0) return Fail(L"Sector bitmap entry " + std::to_wstring(i) + L" present on a disk without a parent");
+                    continue;
+                }
+                uint64_t state = entry & 7, offset = entry & ~(VhdxWriter::MB - 1);
+                if (state == VhdxWriter::BLOCK_NOT_PRESENT) {
+                    if (offset) return Fail(L"Absent block with an offset");
+                    map.push_back(0);
+                    continue;
+                }
+                if (state != VhdxWriter::BLOCK_FULLY_PRESENT || offset + blockSize > file.Size()) return Fail(L"Bad BAT entry " + std::to_wstring(i));
+                map.push_back(offset);
+                used.emplace_back(offset, offset + blockSize);
+                allocated++;
+            }
+            std::sort(used.begin(), used.end());
+            for (size_t i = 1; i < used.size(); ++i) {
+                if (used[i].first < used[i - 1].second) return Fail(L"Payload blocks overlap at " + std::to_wstring(used[i].first));
+            }
+            return true;
+        }
+
+        bool Read(uint64_t offset, uint8_t* data, size_t length) {
+            while (length > 0) {
+                uint64_t block = offset / blockSize, within = offset % blockSize;
+                size_t take = static_cast<size_t>(std::min<uint64_t>(length, blockSize - within)), got = 0;
+                if (block >= map.size()) return Fail(L"Read beyond the virtual disk");
+                if (!map[block]) std::memset(data, 0, take);
+                else if (!file.ReadAt(data, take, map[block] + within, got) || got != take) return Fail(L"Short read in block " + std::to_wstring(block));
+                offset += take;
+                data += take;
+                length -= take;
+            }
+            return true;
+        }
+
+        uint64_t Size() const { return size; }
+        uint64_t Blocks() const { return blocks; }
+        uint64_t Allocated() const { return allocated; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        File file;
+        std::vector<uint64_t> map;           // Virtual block -> file offset, 0 if absent
+        uint64_t size = 0, blocks = 0, allocated = 0;
+        uint32_t blockSize = 0, logicalSector = 0;
+        std::wstring error;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        bool Load(std::vector<uint8_t>& buffer, uint64_t offset) {
+            size_t got = 0;
+            return file.ReadAt(buffer.data(), buffer.size(), offset, got) && got == buffer.size();
+        }
+
+        static bool Checksummed(std::vector<uint8_t> data) {
+            uint32_t stored = Hive::Get32(data.data(), 4);
+            Hive::Put32(data.data(), 4, 0);
+            return Crc32c::Of(data.data(), data.size()) == stored;
+        }
+};
+
+// Images the NTFS volume in <source> into a dynamically expanding VHDX at <target>, the way
+// a VHDX copy lays out a stick (GPT, MSR, Windows, no ESP), then reads the file back with
+// VhdxCheck and compares every allocated cluster with the source. Reports how many blocks
+// were allocated and the file size against the virtual size, runs `qemu-img check` when it
+// is on the path, and round-trips the "vhd=[E:]\file" boot device through the BCD encoding.
+inline int RunVhdxBench(const std::vector<std::filesystem::path>& paths, const ImageOptions& imageOptions, const VhdxOptions& vhdxOptions) {
+    if (paths.size() != 2) {
+        std::wcerr << L"vhdx: expected <ntfs volume or image> <target.vhdx>" << std::endl;
+        return 1;
+    }
+    File source;
+    NtfsVolume volume;
+    std::vector<ClusterRun> clusters;
+    if (!source.Open(paths[0], File::READ) || !volume.Open(source) || !volume.AllocatedRuns(clusters)) {
+        std::wcerr << L"vhdx: cannot read the NTFS volume in " << paths[0].wstring() << L": " << volume.Error() << std::endl;
+        return 1;
+    }
+
+    PartitionOptions layout;
+    layout.esp = false;
+    layout.alignment = layout.minAlignment;
+    auto roundUp = [&](uint64_t value) { return (value + layout.alignment - 1) / layout.alignment * layout.alignment; };
+    VhdxOptions options = vhdxOptions;
+    options.size = 2 * layout.alignment + roundUp(layout.msrSize) + roundUp(volume.VolumeBytes() + 4096);
+    VhdxWriter vhdx;
+    Partitioner partitioner(layout);
+    if (!vhdx.Create(paths[1], options) || !partitioner.Run(vhdx)) {
+        std::wcerr << L"vhdx: " << (vhdx.Error().empty() ? partitioner.Error() : vhdx.Error()) << std::endl;
+        return 1;
+    }
+    ImageOptions image = imageOptions;
+    image.targetOffset = partitioner.Partitions().back().offset;
+    image.targetCapacity = partitioner.Partitions().back().size;
+    VolumeImager imager(image);
+    if (!imager.Run(paths[0], vhdx) || !vhdx.Close()) {
+        std::wcerr << L"vhdx: " << (imager.Error().empty() ? vhdx.Error() : imager.Error()) << std::endl;
+        return 1;
+    }
+    const ImageStats& stats = imager.Stats();
+    const VhdxStats& written = vhdx.Stats();
+
+    VhdxCheck check;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = check.Open(paths[1]);
+    if (ok && check.Size() != options.size) ok = false;
+    std::vector<uint8_t> expected(1 << 20), actual(1 << 20);
+    if (ok && (!check.Read(512, actual.data(), 512) || std::memcmp(actual.data(), "EFI PART", 8) != 0)) ok = false;
+    uint64_t compared = 0, mismatched = 0;
+    for (const ClusterRun& run : clusters) {
+        if (!ok) break;
+        uint64_t offset = run.lcn * volume.ClusterSize(), end = (run.lcn + run.count) * volume.ClusterSize();
+        for (; offset < end; offset += expected.size()) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(expected.size(), end - offset)), got = 0;
+            if (!source.ReadAt(expected.data(), length, offset, got) || got != length || !check.Read(image.targetOffset + offset, actual.data(), length)) {
+                ok = false;
+                break;
+            }
+            mismatched += std::memcmp(expected.data(), actual.data(), length) != 0;
+            compared += length;
+        }
+    }
+    double checkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The loader entry of a VHDX copy, resolved through a stand-in for the Win32 resolver
+    BcdStore store;
+    BcdDevice host, device;
+    host.kind = BcdDevice::PARTITION;
+    host.style = BcdDevice::GPT;
+    host.partitionGuid = BcdGuid::Random();
+    host.diskGuid = BcdGuid::Random();
+    store.deviceResolver = [&](const std::wstring& text, BcdDevice& resolved) {
+        resolved = host;
+        return text == L"partition=E:";
+    };
+    bool boot = store.ResolveDevice(L"vhd=[E:]\\WindowsToGo.vhdx", device) && device.kind == BcdDevice::VHD;
+    BcdDevice decoded = BcdDevice::Decode(device.Encode());
+    boot = boot && decoded == device && decoded.file == L"\\WindowsToGo.vhdx" && !(decoded == host);
+
+    std::wcout << L"vhdx: volume=" << stats.volumeBytes << L" allocated=" << stats.allocatedBytes << L" written=" << stats.bytesWritten
+               << L" zeros=" << stats.zeroBytes << L" virtual=" << options.size << L" file=" << written.fileBytes
+               << L" blocks=" << written.allocatedBlocks << L"/" << written.blocks << L" block=" << options.blockSize
+               << L" seconds=" << stats.seconds << L" MB/s=" << stats.MBPerSecond() << std::endl;
+    std::wcout << L"vhdx: check=" << (ok ? L"ok" : L"failed: " + check.Error()) << L" compared=" << compared << L" mismatched="
+               << mismatched << L" seconds=" << checkSeconds << L" boot-device=" << (boot ? L"ok" : L"failed") << std::endl;
+
+#ifdef _WIN32
+    const char* quiet = " >NUL 2>&1";
+#else
+    const char* quiet = " >/dev/null 2>&1";
+#endif
+    int qemu = 0;
+    if (std::system((std::string("qemu-img --version") + quiet).c_str()) == 0) {
+        qemu = std::system(("qemu-img check -f vhdx \"" + paths[1].string() + "\"" + quiet).c_str());
+        std::wcout << L"vhdx: qemu-img check " << (qemu == 0 ? L"ok" : L"failed") << std::endl;
+    }
+    else {
+        std::wcout << L"vhdx: qemu-img not found, not run" << std::endl;
+    }
+    return ok && mismatched == 0 && boot && qemu == 0 ? 0 : 1;
+}
+
+#endif
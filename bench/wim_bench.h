@@ -0,0 +1,52 @@
+#ifndef _WIM_BENCH_H_
+#define _WIM_BENCH_H_
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "../wim/wim_apply.h"
+
+// Applies image <index> of <wim> into <target> and reports throughput. When wimlib-imagex
+// is on the PATH the same image is applied with it into <target>.wimlib for comparison.
+inline int RunWimApplyBench(const std::vector<std::filesystem::path>& paths, uint32_t image, const WimApplyOptions& options) {
+    if (paths.size() != 2) {
+        std::wcerr << L"wim-apply: expected <wim> <target>" << std::endl;
+        return 1;
+    }
+    WimApplier applier(options);
+    if (!applier.Run(paths[0], image, paths[1])) {
+        std::wcerr << L"wim-apply: " << applier.Error() << std::endl;
+        return 1;
+    }
+    const WimApplyStats& stats = applier.Stats();
+    std::wcout << L"wim-apply: image=" << image << L" files=" << stats.files << L" directories=" << stats.directories
+               << L" hardlinks=" << stats.hardLinks << L" blobs=" << stats.blobs << L" duplicates=" << stats.duplicates
+               << L" clones=" << stats.clones << L" skipped=" << stats.skipped << L" chunks=" << stats.chunks
+               << L" read=" << stats.bytesRead << L" decompressed=" << stats.bytesDecompressed << L" bytes=" << stats.bytes
+               << L" seconds=" << stats.seconds << L" MB/s=" << stats.MBPerSecond() << std::endl;
+
+#ifdef _WIN32
+    const std::string quiet = " >NUL 2>&1";
+#else
+    const std::string quiet = " >/dev/null 2>&1";
+#endif
+    if (std::system(("wimlib-imagex --version" + quiet).c_str()) != 0) {
+        std::wcout << L"wimlib: wimlib-imagex not found, skipped" << std::endl;
+        return 0;
+    }
+    std::filesystem::path reference = paths[1].string() + ".wimlib";
+    std::error_code ec;
+    std::filesystem::remove_all(reference, ec);
+    std::string command = "wimlib-imagex apply \"" + paths[0].string() + "\" " + std::to_string(image) + " \"" + reference.string() + "\"" + quiet;
+    auto start = std::chrono::steady_clock::now();
+    int status = std::system(command.c_str());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (status != 0) {
+        std::wcout << L"wimlib: apply failed" << std::endl;
+        return 0;
+    }
+    std::wcout << L"wimlib: seconds=" << seconds << L" MB/s=" << (seconds > 0 ? stats.bytes / seconds / 1e6 : 0)
+               << L" speedup=" << (stats.seconds > 0 ? seconds / stats.seconds : 0) << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,359 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bcd_bench.h"
+#include "version_bench.h"
+#include "copy_bench.h"
+#include "io_bench.h"
+#include "image_bench.h"
+#include "wim_bench.h"
+#include "resync_bench.h"
+#include "probe_bench.h"
+#include "hash_bench.h"
+#include "progress_bench.h"
+#include "trace_bench.h"
+#include "suite_bench.h"
+#include "partition_bench.h"
+#include "esp_bench.h"
+#include "zero_bench.h"
+#include "compress_bench.h"
+#include "tweak_bench.h"
+#include "journal_bench.h"
+#include "read_bench.h"
+#include "batch_bench.h"
+#include "vhdx_bench.h"
+#include "../trace/tracer.h"
+
+// Benchmarks for the portable engines, run locally and compared between releases.
+//   wtg_bench bcd-validate [--iterations N] <store or directory>...
+//   wtg_bench version-detect [--iterations N] <volume root>...
+//   wtg_bench copy [--threads N] [--chunk-mb N] [--memory-mb N] [--no-fast-paths] [--manifest] [--compress FORMAT] [--ordered] [--read-ahead-mb N] [--unbatched] <source> <destination>
+//   wtg_bench io [--backend auto|uring|overlapped|threads] [--qd N] [--block-kb N] [--direct] [--zeros write|skip|discard] <source> <destination>
+//   wtg_bench image [--qd N] [--block-kb N] [--direct] [--merge-kb N] [--no-sparse] [--memory-mb N] <ntfs volume or image> <target>...
+//   wtg_bench vhdx [--block-kb N] [--vhdx-block-mb N] <ntfs volume or image> <target.vhdx>
+//   wtg_bench wim-apply [--image N] [--threads N] [--no-verify] [--no-fast-paths] <wim> <target directory>
+//   wtg_bench resync [--threads N] [--chunk-kb N] [--memory-mb N] [--keep-extra] <source> <destination>
+//   wtg_bench probe [--backend ...] [--read-only] [--buffered] [--seconds S] [--samples N] [--report FILE] <device or image>
+//   wtg_bench hash [--size-mb N] [--iterations N]
+//   wtg_bench zero-scan [--size-mb N] [--iterations N]
+//   wtg_bench compress [--format FORMAT|all] [--threads N] [--chunk-mb N] <tree>
+//   wtg_bench verify [--threads N] [--buffered] <target>
+//   wtg_bench tweak <volume root>...
+//   wtg_bench journal [--threads N] [--chunk-mb N] [--memory-mb N] <source> <workdir>
+//   wtg_bench read-order [--threads N] [--read-ahead-mb N] <tree>
+//   wtg_bench small-files [--threads N] [--read-ahead-mb N] <source> <workdir>
+//   wtg_bench progress [--threads N] [--seconds S]
+//   wtg_bench trace [--iterations N]
+//   wtg_bench generate [tree options] [--loaders N] [--image-mb N] [--allocated PCT] tree|fragmented|bcd|ntfs <target>
+//   wtg_bench suite [tree options] [--loaders N] [--image-mb N] [--allocated PCT] <workdir>
+//   wtg_bench partition [--mbr] [--align-kb N] [--esp-mb N] [--sector N] [--image-mb N] <device or image>
+//   wtg_bench esp [--offset-mb N] [--esp-mb N] [--sector N] <windows> <bcd store> <device or image>
+// Tree options: --dlls N --components N --large N --large-mb N --build N --seed N
+// Compression formats: xpress4k, xpress8k, xpress16k, lzx
+// Any command takes --trace FILE: spans go to a Chrome trace, per-span latencies to stdout.
+
+// Writes the trace when main returns, whichever command ran
+struct TraceOutput {
+    std::filesystem::path path;
+
+    ~TraceOutput() {
+        if (path.empty()) return;
+        if (!Tracer::Instance().WriteChromeTrace(path)) std::wcerr << L"trace: cannot write " << path.wstring() << std::endl;
+        std::wcout << Tracer::Instance().SummaryText();
+    }
+};
+
+static void Usage() {
+    std::wcerr << L"usage: wtg_bench bcd-validate [--iterations N] <store or directory>..." << std::endl
+               << L"       wtg_bench version-detect [--iterations N] <volume root>..." << std::endl
+               << L"       wtg_bench copy [--threads N] [--chunk-mb N] [--memory-mb N] [--no-fast-paths] [--manifest] [--compress FORMAT] [--ordered] [--read-ahead-mb N] [--unbatched] <source> <destination>" << std::endl
+               << L"       wtg_bench io [--backend auto|uring|overlapped|threads] [--qd N] [--block-kb N] [--direct] [--zeros write|skip|discard] <source> <destination>" << std::endl
+               << L"       wtg_bench image [--qd N] [--block-kb N] [--direct] [--merge-kb N] [--no-sparse] [--memory-mb N] <ntfs volume or image> <target>..." << std::endl
+               << L"       wtg_bench vhdx [--block-kb N] [--vhdx-block-mb N] <ntfs volume or image> <target.vhdx>" << std::endl
+               << L"       wtg_bench wim-apply [--image N] [--threads N] [--no-verify] [--no-fast-paths] <wim> <target directory>" << std::endl
+               << L"       wtg_bench resync [--threads N] [--chunk-kb N] [--memory-mb N] [--keep-extra] <source> <destination>" << std::endl
+               << L"       wtg_bench probe [--backend auto|uring|overlapped|threads] [--read-only] [--buffered] [--seconds S] [--samples N] [--report FILE] <device or image>" << std::endl
+               << L"       wtg_bench hash [--size-mb N] [--iterations N]" << std::endl
+               << L"       wtg_bench zero-scan [--size-mb N] [--iterations N]" << std::endl
+               << L"       wtg_bench compress [--format FORMAT|all] [--threads N] [--chunk-mb N] <tree>" << std::endl
+               << L"       wtg_bench verify [--threads N] [--buffered] <target>" << std::endl
+               << L"       wtg_bench tweak <volume root>..." << std::endl
+               << L"       wtg_bench journal [--threads N] [--chunk-mb N] [--memory-mb N] <source> <workdir>" << std::endl
+               << L"       wtg_bench read-order [--threads N] [--read-ahead-mb N] <tree>" << std::endl
+               << L"       wtg_bench small-files [--threads N] [--read-ahead-mb N] <source> <workdir>" << std::endl
+               << L"       wtg_bench progress [--threads N] [--seconds S]" << std::endl
+               << L"       wtg_bench trace [--iterations N]" << std::endl
+               << L"       wtg_bench generate [tree options] [--loaders N] [--image-mb N] [--allocated PCT] tree|fragmented|bcd|ntfs <target>" << std::endl
+               << L"       wtg_bench suite [tree options] [--loaders N] [--image-mb N] [--allocated PCT] <workdir>" << std::endl
+               << L"       wtg_bench partition [--mbr] [--align-kb N] [--esp-mb N] [--sector N] [--image-mb N] <device or image>" << std::endl
+               << L"       wtg_bench esp [--offset-mb N] [--esp-mb N] [--sector N] <windows> <bcd store> <device or image>" << std::endl
+               << L"       tree options: --dlls N --components N --large N --large-mb N --build N --seed N" << std::endl
+               << L"       compression formats: xpress4k, xpress8k, xpress16k, lzx" << std::endl
+               << L"       any command: --trace FILE writes a Chrome trace and prints a latency summary" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        Usage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    int iterations = 100;
+    CopyOptions copyOptions;
+    IoOptions ioOptions;
+    ImageOptions imageOptions;
+    VhdxOptions vhdxOptions;
+    WimApplyOptions wimOptions;
+    ResyncOptions resyncOptions;
+    UsbProbeOptions probeOptions;
+    VerifyOptions verifyOptions;
+    size_t hashSize = 64 << 20;
+    std::vector<WofFormat> compressFormats = { WOF_XPRESS4K, WOF_XPRESS8K, WOF_XPRESS16K, WOF_LZX };
+    SuiteOptions suiteOptions;
+    PartitionOptions partitionOptions;
+    Fat32Options fatOptions;
+    std::filesystem::path report;
+    TraceOutput trace;
+    uint32_t image = 1;
+    std::vector<std::filesystem::path> paths;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            copyOptions.threads = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+            wimOptions.threads = copyOptions.threads;
+            resyncOptions.threads = copyOptions.threads;
+            verifyOptions.threads = copyOptions.threads;
+        }
+        else if (arg == "--chunk-mb" && i + 1 < argc) {
+            copyOptions.chunkSize = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--memory-mb" && i + 1 < argc) {
+            copyOptions.maxBufferMemory = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+            resyncOptions.maxBufferMemory = copyOptions.maxBufferMemory;
+            imageOptions.memory = copyOptions.maxBufferMemory;
+        }
+        else if (arg == "--chunk-kb" && i + 1 < argc) {
+            resyncOptions.chunkSize = static_cast<uint32_t>(std::max(4, std::atoi(argv[++i]))) << 10;
+        }
+        else if (arg == "--keep-extra") {
+            resyncOptions.deleteExtra = false;
+        }
+        else if (arg == "--no-fast-paths") {
+            copyOptions.fastPaths = false;
+            wimOptions.fastPaths = false;
+        }
+        else if (arg == "--image" && i + 1 < argc) {
+            image = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--no-verify") {
+            wimOptions.verify = false;
+        }
+        else if (arg == "--backend" && i + 1 < argc) {
+            std::string name = argv[++i];
+            ioOptions.backend = name == "uring" ? IO_URING : name == "overlapped" ? IO_OVERLAPPED : name == "threads" ? IO_THREADS : IO_AUTO;
+            probeOptions.backend = ioOptions.backend;
+        }
+        else if (arg == "--qd" && i + 1 < argc) {
+            ioOptions.queueDepth = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--block-kb" && i + 1 < argc) {
+            ioOptions.blockSize = static_cast<size_t>(std::max(4, std::atoi(argv[++i]))) << 10;
+        }
+        else if (arg == "--direct") {
+            ioOptions.direct = true;
+        }
+        else if (arg == "--zeros" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            ioOptions.zeros = policy == "skip" ? ZEROS_SKIP : policy == "discard" ? ZEROS_DISCARD : ZEROS_WRITE;
+        }
+        else if ((arg == "--compress" || arg == "--format") && i + 1 < argc) {
+            std::string name = argv[++i];
+            WofFormat format = WOF_NONE;
+            if (name == "all") {
+                compressFormats = { WOF_XPRESS4K, WOF_XPRESS8K, WOF_XPRESS16K, WOF_LZX };
+            }
+            else if (WofCodec::Parse(std::wstring(name.begin(), name.end()), format)) {
+                copyOptions.compression = format;
+                compressFormats = { format };
+            }
+            else {
+                Usage();
+                return 1;
+            }
+        }
+        else if (arg == "--no-sparse") {
+            imageOptions.sparse = false;
+        }
+        else if (arg == "--vhdx-block-mb" && i + 1 < argc) {
+            vhdxOptions.blockSize = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--merge-kb" && i + 1 < argc) {
+            imageOptions.mergeGap = static_cast<uint64_t>(std::max(0, std::atoi(argv[++i]))) << 10;
+        }
+        else if (arg == "--read-only") {
+            probeOptions.write = false;
+        }
+        else if (arg == "--buffered") {
+            probeOptions.direct = false;
+            verifyOptions.direct = false;
+        }
+        else if (arg == "--manifest") {
+            copyOptions.manifest = true;
+        }
+        else if (arg == "--ordered") {
+            copyOptions.ordered = true;
+        }
+        else if (arg == "--unbatched") {
+            copyOptions.batched = false;
+            copyOptions.preallocate = false;
+        }
+        else if (arg == "--read-ahead-mb" && i + 1 < argc) {
+            copyOptions.readAhead = static_cast<uint64_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--size-mb" && i + 1 < argc) {
+            hashSize = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--seconds" && i + 1 < argc) {
+            probeOptions.secondsPerTest = std::max(0.01, std::atof(argv[++i]));
+        }
+        else if (arg == "--samples" && i + 1 < argc) {
+            probeOptions.verifySamples = static_cast<size_t>(std::max(2, std::atoi(argv[++i])));
+        }
+        else if (arg == "--report" && i + 1 < argc) {
+            report = argv[++i];
+        }
+        else if (arg == "--dlls" && i + 1 < argc) {
+            suiteOptions.tree.dlls = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--components" && i + 1 < argc) {
+            suiteOptions.tree.components = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--large" && i + 1 < argc) {
+            suiteOptions.tree.largeFiles = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--large-mb" && i + 1 < argc) {
+            suiteOptions.tree.largeSize = static_cast<uint64_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--build" && i + 1 < argc) {
+            suiteOptions.tree.build = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            suiteOptions.tree.seed = static_cast<uint64_t>(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--loaders" && i + 1 < argc) {
+            suiteOptions.loaders = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--image-mb" && i + 1 < argc) {
+            suiteOptions.imageSize = static_cast<uint64_t>(std::max(4, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--allocated" && i + 1 < argc) {
+            suiteOptions.allocated = std::min(100, std::max(0, std::atoi(argv[++i]))) / 100.0;
+        }
+        else if (arg == "--mbr") {
+            partitionOptions.style = LAYOUT_MBR;
+        }
+        else if (arg == "--align-kb" && i + 1 < argc) {
+            partitionOptions.alignment = static_cast<uint64_t>(std::max(4, std::atoi(argv[++i]))) << 10;
+        }
+        else if (arg == "--esp-mb" && i + 1 < argc) {
+            partitionOptions.espSize = static_cast<uint64_t>(std::max(32, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--sector" && i + 1 < argc) {
+            partitionOptions.sectorSize = static_cast<uint32_t>(std::max(512, std::atoi(argv[++i])));
+            fatOptions.sectorSize = partitionOptions.sectorSize;
+        }
+        else if (arg == "--offset-mb" && i + 1 < argc) {
+            fatOptions.offset = static_cast<uint64_t>(std::max(0, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            trace.path = argv[++i];
+            Tracer::Instance().Enable();
+        }
+        else {
+            paths.emplace_back(arg);
+        }
+    }
+
+    if (command == "bcd-validate") {
+        return RunBcdValidateBench(paths, iterations);
+    }
+    if (command == "version-detect") {
+        return RunVersionDetectBench(paths, iterations);
+    }
+    if (command == "copy") {
+        return RunCopyBench(paths, copyOptions);
+    }
+    if (command == "io") {
+        return RunIoBench(paths, ioOptions);
+    }
+    if (command == "image") {
+        imageOptions.io = ioOptions;
+        return RunImageBench(paths, imageOptions);
+    }
+    if (command == "vhdx") {
+        imageOptions.io = ioOptions;
+        return RunVhdxBench(paths, imageOptions, vhdxOptions);
+    }
+    if (command == "wim-apply") {
+        return RunWimApplyBench(paths, image, wimOptions);
+    }
+    if (command == "resync") {
+        return RunResyncBench(paths, resyncOptions);
+    }
+    if (command == "probe") {
+        return RunProbeBench(paths, probeOptions, report);
+    }
+    if (command == "hash") {
+        // 100 passes over 64 MB would keep SHA-1 busy for half a minute
+        return RunHashBench(hashSize, iterations == 100 ? 10 : iterations);
+    }
+    if (command == "zero-scan") {
+        return RunZeroScanBench(hashSize, iterations == 100 ? 10 : iterations);
+    }
+    if (command == "compress") {
+        return RunCompressBench(paths, compressFormats, copyOptions.threads, copyOptions.chunkSize);
+    }
+    if (command == "verify") {
+        return RunVerifyBench(paths, verifyOptions);
+    }
+    if (command == "tweak") {
+        return RunTweakBench(paths);
+    }
+    if (command == "journal") {
+        return RunJournalBench(paths, copyOptions);
+    }
+    if (command == "read-order") {
+        return RunReadOrderBench(paths, copyOptions);
+    }
+    if (command == "small-files") {
+        return RunSmallFilesBench(paths, copyOptions);
+    }
+    if (command == "trace") {
+        return RunTraceBench(iterations);
+    }
+    if (command == "progress") {
+        return RunProgressBench(copyOptions.threads, probeOptions.secondsPerTest);
+    }
+    if (command == "generate") {
+        return RunGenerateBench(paths, suiteOptions);
+    }
+    if (command == "partition") {
+        return RunPartitionBench(paths, partitionOptions, suiteOptions.imageSize);
+    }
+    if (command == "esp") {
+        fatOptions.size = partitionOptions.espSize;
+        return RunEspBench(paths, fatOptions, partitionOptions.espSize);
+    }
+    if (command == "suite") {
+        imageOptions.io = ioOptions;
+        return RunSuiteBench(paths, suiteOptions, copyOptions, resyncOptions, verifyOptions, imageOptions);
+    }
+
+    Usage();
+    return 1;
+}
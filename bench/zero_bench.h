@@ -0,0 +1,51 @@
+#ifndef _ZERO_BENCH_H_
+#define _ZERO_BENCH_H_
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include "../io/zero_scan.h"
+
+// Scans an all-zero buffer, the worst case, with every kernel, out of memory and from
+// cache, next to a memcpy of the same buffer as the bandwidth the scan has to keep up with.
+// "blocks" is what the copier does per block: 4 KiB granules from the front.
+inline int RunZeroScanBench(size_t size, int iterations) {
+    std::vector<uint8_t> data(size, 0), copy(size, 1);
+    struct Kernel {
+        std::wstring name;
+        std::function<bool(const uint8_t*, size_t)> run;
+    };
+    std::vector<Kernel> kernels = {
+        { L"scalar", [](const uint8_t* p, size_t n) { return ZeroScan::IsZero(p, n, ZeroScan::KERNEL_SCALAR); } },
+        { std::wstring(ZeroScan::KernelName(ZeroScan::KERNEL_SIMD)) + L"-blocks",
+          [](const uint8_t* p, size_t n) { return ZeroScan::ZeroPrefix(p, n, 4096) == n; } },
+        { L"memcpy", [&](const uint8_t* p, size_t n) { std::memcpy(copy.data(), p, n); return copy[n / 2] == 0; } },
+    };
+    if (ZeroScan::SimdAvailable()) {
+        kernels.insert(kernels.begin() + 1, { ZeroScan::KernelName(ZeroScan::KERNEL_SIMD),
+            [](const uint8_t* p, size_t n) { return ZeroScan::IsZero(p, n, ZeroScan::KERNEL_SIMD); } });
+    }
+
+    bool ok = true;
+    for (size_t length : { size, std::min<size_t>(size, 256 << 10) }) {
+        int rounds = static_cast<int>(std::max<uint64_t>(iterations, static_cast<uint64_t>(iterations) * size / length / 16));
+        for (const auto& kernel : kernels) {
+            ok = kernel.run(data.data(), length) && ok;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < rounds; ++i) ok = kernel.run(data.data(), length) && ok;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::wcout << L"zero-scan: kernel=" << kernel.name << L" bytes=" << length << L" iterations=" << rounds
+                       << L" seconds=" << seconds << L" GB/s=" << (seconds > 0 ? static_cast<double>(length) * rounds / seconds / 1e9 : 0)
+                       << std::endl;
+        }
+    }
+    // A single set byte anywhere must be found
+    for (size_t at : { size_t(0), size / 3, size - 1 }) {
+        data[at] = 1;
+        ok = ok && !ZeroScan::IsZero(data.data(), size) && !ZeroScan::IsZero(data.data(), size, ZeroScan::KERNEL_SCALAR);
+        data[at] = 0;
+    }
+    if (!ok) std::wcerr << L"zero-scan: kernels disagree" << std::endl;
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef _BITSTREAM_H_
+#define _BITSTREAM_H_
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+
+// Input bitstream shared by the XPRESS Huffman and LZX formats: 16-bit little endian words
+// consumed most significant bit first. Reading past the end yields zero bits instead of
+// failing, the same as Windows' decoder, because a compressor may stop mid-word; callers
+// bound their loops by the known output size.
+class BitReader {
+
+    public:
+
+        BitReader(const uint8_t* data, size_t size) : next(data), end(data + size) {}
+
+        // Makes at least `count` (at most 16) bits available to Peek
+        void Ensure(unsigned count) {
+            if (bitsLeft >= count) return;
+            if (end - next >= 2) {
+                buffer |= static_cast<uint32_t>(next[0] | next[1] << 8) << (16 - bitsLeft);
+                next += 2;
+                bitsLeft += 16;
+            }
+            else {
+                bitsLeft = 32;
+            }
+        }
+
+        // Next `count` (1..16) bits without consuming them, Ensure(count) first
+        uint32_t Peek(unsigned count) const { return buffer >> (32 - count); }
+
+        void Remove(unsigned count) {
+            buffer <<= count;
+            bitsLeft -= count;
+        }
+
+        uint32_t ReadBits(unsigned count) {
+            if (count == 0) return 0;
+            Ensure(count);
+            uint32_t bits = Peek(count);
+            Remove(count);
+            return bits;
+        }
+
+        // Byte-aligned fields live between the words, at the current input position
+        uint8_t ReadByte() {
+            if (next == end) return 0;
+            return *next++;
+        }
+
+        uint16_t ReadU16() {
+            if (end - next < 2) return 0;
+            uint16_t value = static_cast<uint16_t>(next[0] | next[1] << 8);
+            next += 2;
+            return value;
+        }
+
+        uint32_t ReadU32() {
+            if (end - next < 4) return 0;
+            uint32_t value = static_cast<uint32_t>(next[0]) | static_cast<uint32_t>(next[1]) << 8
+                | static_cast<uint32_t>(next[2]) << 16 | static_cast<uint32_t>(next[3]) << 24;
+            next += 4;
+            return value;
+        }
+
+        bool ReadBytes(uint8_t* out, size_t count) {
+            if (static_cast<size_t>(end - next) < count) return false;
+            std::memcpy(out, next, count);
+            next += count;
+            return true;
+        }
+
+        // Drops the buffered bits so the next read starts at a word boundary
+        void Align() {
+            buffer = 0;
+            bitsLeft = 0;
+        }
+
+    private:
+
+        const uint8_t* next;
+        const uint8_t* end;
+        uint32_t buffer = 0;       // Unread bits, left justified
+        unsigned bitsLeft = 0;
+};
+
+// Output side of BitReader. Words are reserved two ahead of the bits that fill them and
+// bytes go to the current end, which is where the reader finds them: it has fetched the
+// word holding the next bit plus one more when it reads a byte field. LZX never writes
+// bytes here, so its stream is just the words in order. The caller passes an upper bound
+// on the output so the hot path is plain stores; Flush trims `output` to what was written.
+class BitWriter {
+
+    public:
+
+        BitWriter(std::vector<uint8_t>& output, size_t capacity) : out(output), start(output.size()) {
+            out.resize(start + capacity + 4);
+            base = out.data() + start;
+            first = 0;
+            second = 2;
+            next = 4;
+        }
+
+        // Appends the low `count` (at most 16) bits of `bits`
+        void WriteBits(uint32_t bits, unsigned count) {
+            buffer = buffer << count | (bits & ((1U << count) - 1));
+            bitCount += count;
+            if (bitCount > 16) {
+                bitCount -= 16;
+                Put16(first, static_cast<uint16_t>(buffer >> bitCount));
+                first = second;
+                second = next;
+                next += 2;
+            }
+        }
+
+        void WriteByte(uint8_t value) { base[next++] = value; }
+
+        void WriteU16(uint16_t value) {
+            base[next++] = static_cast<uint8_t>(value);
+            base[next++] = static_cast<uint8_t>(value >> 8);
+        }
+
+        // Pads the last word with zero bits; returns the bytes written since construction
+        size_t Flush() {
+            Put16(first, static_cast<uint16_t>(buffer << (16 - bitCount)));
+            Put16(second, 0);
+            buffer = 0;
+            bitCount = 0;
+            out.resize(start + next);
+            return next;
+        }
+
+    private:
+
+        std::vector<uint8_t>& out;
+        size_t start;
+        uint8_t* base;             // out.data() + start, stable: out is never grown past capacity
+        size_t first;              // Reserved word the pending bits go to
+        size_t second;             // The one after it
+        size_t next;               // End of the output
+        uint32_t buffer = 0;       // Pending bits, right justified
+        unsigned bitCount = 0;
+
+        void Put16(size_t at, uint16_t value) {
+            base[at] = static_cast<uint8_t>(value);
+            base[at + 1] = static_cast<uint8_t>(value >> 8);
+        }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef _HUFFMAN_H_
+#define _HUFFMAN_H_
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "bitstream.h"
+
+// Canonical Huffman decode table. Codes up to `tableBits` long resolve with one lookup,
+// longer ones go through a second table indexed by the remaining bits. Both XPRESS and LZX
+// transmit only code lengths; codes are assigned in (length, symbol) order.
+class HuffmanTable {
+
+    public:
+
+        static constexpr unsigned MAX_LENGTH = 16;
+
+        // False if the lengths over-subscribe the code. An incomplete code is accepted (an
+        // unused LZX tree is all zeros); decoding an unassigned codeword fails instead.
+        bool Build(const uint8_t* lengths, size_t count, unsigned primaryBits, unsigned maxCodeLength) {
+            tableBits = primaryBits;
+            maxLength = maxCodeLength;
+            unsigned subBits = maxLength - tableBits;
+            entries.assign(static_cast<size_t>(1) << tableBits, INVALID);
+
+            uint32_t counts[MAX_LENGTH + 1] = {};
+            for (size_t i = 0; i < count; ++i) {
+                if (lengths[i] > maxLength) return false;
+                counts[lengths[i]]++;
+            }
+            int64_t left = 1;
+            for (unsigned length = 1; length <= maxLength; ++length) {
+                left = (left << 1) - counts[length];
+                if (left < 0) return false;
+            }
+
+            uint32_t nextCode[MAX_LENGTH + 2] = {};
+            for (unsigned length = 1; length <= maxLength; ++length) {
+                nextCode[length + 1] = (nextCode[length] + counts[length]) << 1;
+            }
+            for (size_t symbol = 0; symbol < count; ++symbol) {
+                unsigned length = lengths[symbol];
+                if (length == 0) continue;
+                uint32_t code = nextCode[length]++;
+                uint32_t entry = static_cast<uint32_t>(symbol) << 8 | length;
+                if (length <= tableBits) {
+                    size_t first = static_cast<size_t>(code) << (tableBits - length);
+                    std::fill(entries.begin() + first, entries.begin() + first + (static_cast<size_t>(1) << (tableBits - length)), entry);
+                    continue;
+                }
+                size_t prefix = code >> (length - tableBits);
+                if (entries[prefix] == INVALID) {
+                    entries[prefix] = static_cast<uint32_t>(entries.size()) << 8 | SUBTABLE;
+                    entries.resize(entries.size() + (static_cast<size_t>(1) << subBits), INVALID);
+                }
+                uint32_t low = code & ((1U << (length - tableBits)) - 1);
+                size_t first = (entries[prefix] >> 8) + (static_cast<size_t>(low) << (maxLength - length));
+                std::fill(entries.begin() + first, entries.begin() + first + (static_cast<size_t>(1) << (maxLength - length)), entry);
+            }
+            return true;
+        }
+
+        // Next symbol from `reader`, or -1 for a codeword the table does not assign
+        int Decode(BitReader& reader) const {
+            reader.Ensure(maxLength);
+            uint32_t bits = reader.Peek(maxLength);
+            uint32_t entry = entries[bits >> (maxLength - tableBits)];
+            if ((entry & 0xFF) == SUBTABLE) entry = entries[(entry >> 8) + (bits & ((1U << (maxLength - tableBits)) - 1))];
+            if (entry == INVALID) return -1;
+            reader.Remove(entry & 0xFF);
+            return static_cast<int>(entry >> 8);
+        }
+
+    private:
+
+        static constexpr uint32_t INVALID = 0xFFFFFFFF;
+        static constexpr uint32_t SUBTABLE = 0xFE;     // Low byte of a link; real lengths are <= 16
+
+        std::vector<uint32_t> entries;                 // symbol << 8 | length, or offset << 8 | SUBTABLE
+        unsigned tableBits = 0;
+        unsigned maxLength = 0;
+};
+
+// Encoder side: code lengths from symbol frequencies, limited to what the format allows,
+// and the canonical codes the decoder above assigns to them
+class HuffmanCode {
+
+    public:
+
+        // Unused symbols get length 0. A single used symbol is paired with a dummy so the
+        // code stays complete, which stricter decoders than ours insist on.
+        static void Lengths(const uint32_t* frequencies, size_t count, unsigned maxLength, uint8_t* lengths) {
+            std::fill(lengths, lengths + count, 0);
+            // Frequency above symbol in one key, so a plain sort gives a deterministic order
+            std::vector<uint64_t> keys;
+            for (size_t i = 0; i < count; ++i) {
+                if (frequencies[i] != 0) keys.push_back(static_cast<uint64_t>(frequencies[i]) << 32 | i);
+            }
+            if (keys.empty()) return;
+            if (keys.size() == 1) {
+                uint32_t symbol = static_cast<uint32_t>(keys[0]);
+                lengths[symbol] = 1;
+                lengths[symbol == 0 ? 1 : 0] = 1;
+                return;
+            }
+            std::sort(keys.begin(), keys.end());
+            std::vector<uint32_t> symbols(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i) symbols[i] = static_cast<uint32_t>(keys[i]);
+
+            // Two-queue construction: leaves in frequency order, merged nodes come out in order too
+            size_t leaves = symbols.size();
+            std::vector<uint64_t> weight(2 * leaves - 1);
+            std::vector<uint32_t> parent(2 * leaves - 1, 0);
+            for (size_t i = 0; i < leaves; ++i) weight[i] = frequencies[symbols[i]];
+            size_t nextLeaf = 0, nextNode = leaves;
+            for (size_t node = leaves; node < 2 * leaves - 1; ++node) {
+                size_t pick[2];
+                for (auto& child : pick) {
+                    if (nextLeaf < leaves && (nextNode >= node || weight[nextLeaf] <= weight[nextNode])) child = nextLeaf++;
+                    else child = nextNode++;
+                }
+                weight[node] = weight[pick[0]] + weight[pick[1]];
+                parent[pick[0]] = parent[pick[1]] = static_cast<uint32_t>(node);
+            }
+            std::vector<uint32_t> depth(2 * leaves - 1, 0);
+            uint32_t counts[64] = {};
+            for (size_t node = 2 * leaves - 2; node-- > 0;) {
+                depth[node] = depth[parent[node]] + 1;
+                if (node < leaves) counts[std::min<uint32_t>(depth[node], 63)]++;
+            }
+
+            // Push codes longer than the limit up to it, then lengthen the shortest codes
+            // below it until the Kraft sum is exactly one again
+            for (unsigned length = maxLength + 1; length < 64; ++length) {
+                counts[maxLength] += counts[length];
+                counts[length] = 0;
+            }
+            uint64_t total = 0;
+            for (unsigned length = 1; length <= maxLength; ++length) total += static_cast<uint64_t>(counts[length]) << (maxLength - length);
+            while (total > (1ULL << maxLength)) {
+                counts[maxLength]--;
+                for (unsigned length = maxLength - 1; length > 0; --length) {
+                    if (counts[length] != 0) {
+                        counts[length]--;
+                        counts[length + 1] += 2;
+                        break;
+                    }
+                }
+                total--;
+            }
+            // The rarest symbols take the longest codes
+            size_t at = 0;
+            for (unsigned length = maxLength; length > 0; --length) {
+                for (uint32_t i = 0; i < counts[length]; ++i) lengths[symbols[at++]] = static_cast<uint8_t>(length);
+            }
+        }
+
+        // Codewords, most significant bit first, for lengths from Lengths()
+        static void Codes(const uint8_t* lengths, size_t count, uint32_t* codes) {
+            uint32_t counts[HuffmanTable::MAX_LENGTH + 1] = {};
+            for (size_t i = 0; i < count; ++i) counts[lengths[i]]++;
+            counts[0] = 0;
+            uint32_t nextCode[HuffmanTable::MAX_LENGTH + 2] = {};
+            for (unsigned length = 1; length <= HuffmanTable::MAX_LENGTH; ++length) {
+                nextCode[length + 1] = (nextCode[length] + counts[length]) << 1;
+            }
+            for (size_t symbol = 0; symbol < count; ++symbol) codes[symbol] = lengths[symbol] ? nextCode[lengths[symbol]]++ : 0;
+        }
+};
+
+#endif
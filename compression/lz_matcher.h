@@ -0,0 +1,144 @@
+#ifndef _LZ_MATCHER_H_
+#define _LZ_MATCHER_H_
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// One step of an LZ77 parse: a literal byte (length 0) or a copy of `length` bytes from
+// `offset` bytes back
+struct LzItem {
+    uint32_t length;
+    uint32_t value;          // Offset of a match, the byte of a literal
+};
+
+// Hash chain match finder with one step of lazy evaluation, shared by the XPRESS and LZX
+// encoders. Chunks are independent, so the chains only ever cover the current chunk; head
+// entries are absolute positions and anything below the chunk's base is stale, which saves
+// clearing the table for every 4 KiB chunk.
+class LzMatcher {
+
+    public:
+
+        static constexpr size_t MIN_HASHED = 3;
+
+        // `maxChain` candidates are tried per position, a match of `niceLength` ends the search
+        explicit LzMatcher(size_t maxChain = 24, size_t niceLength = 64)
+            : chainLimit(maxChain), nice(niceLength), head(static_cast<size_t>(1) << HASH_BITS, 0) {}
+
+        // Parses `size` bytes into `items`. Matches are at least `minLength` (>= 3) long, at most
+        // `maxLength`, and reach back at most `maxOffset` bytes.
+        void Parse(const uint8_t* input, size_t size, size_t minLength, size_t maxLength, size_t maxOffset, std::vector<LzItem>& items) {
+            Reset(input, size);
+            items.clear();
+            minimum = std::max(minLength, MIN_HASHED);
+            longest = maxLength;
+            farthest = maxOffset;
+            size_t at = 0;
+            LzItem current = Find(0);
+            while (at < size) {
+                if (current.length < minimum) {
+                    items.push_back(LzItem{ 0, data[at] });
+                    if (++at < size) current = Find(at);
+                    continue;
+                }
+                // Lazy: a longer match one byte later wins over this one
+                if (current.length < nice && at + 1 < size) {
+                    LzItem next = Find(at + 1);
+                    if (next.length > current.length) {
+                        items.push_back(LzItem{ 0, data[at] });
+                        at++;
+                        current = next;
+                        continue;
+                    }
+                    for (size_t p = at + 2; p < at + current.length; ++p) Insert(p);
+                }
+                else {
+                    for (size_t p = at + 1; p < at + current.length; ++p) Insert(p);
+                }
+                items.push_back(current);
+                at += current.length;
+                if (at < size) current = Find(at);
+            }
+        }
+
+    private:
+
+        static constexpr unsigned HASH_BITS = 15;
+        static constexpr uint32_t REBASE = 0xF0000000;
+
+        size_t chainLimit;
+        size_t nice;
+        std::vector<uint32_t> head;          // Hash -> latest absolute position
+        std::vector<uint32_t> previous;      // Chunk position -> earlier absolute position, same hash
+        uint32_t base = 1;                   // Absolute position of the chunk's first byte; 0 is never valid
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t minimum = MIN_HASHED;
+        size_t longest = 0;
+        size_t farthest = 0;
+
+        void Reset(const uint8_t* input, size_t length) {
+            if (static_cast<uint64_t>(base) + size + length >= REBASE) {
+                std::fill(head.begin(), head.end(), 0);
+                base = 1;
+            }
+            else {
+                base += static_cast<uint32_t>(size);
+            }
+            data = input;
+            size = length;
+            if (previous.size() < size) previous.resize(size);
+        }
+
+        static uint32_t Hash(const uint8_t* p) {
+            uint32_t value = static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16;
+            return (value * 2654435761U) >> (32 - HASH_BITS);
+        }
+
+        void Insert(size_t at) {
+            if (at + MIN_HASHED > size) return;
+            uint32_t& slot = head[Hash(data + at)];
+            previous[at] = slot;
+            slot = base + static_cast<uint32_t>(at);
+        }
+
+        // Longest match at `at`, which is inserted into the chains as a side effect
+        LzItem Find(size_t at) {
+            LzItem best{ 0, 0 };
+            if (at + MIN_HASHED > size) return best;
+            size_t limit = std::min(longest, size - at);
+            uint32_t& slot = head[Hash(data + at)];
+            uint32_t candidate = slot;
+            previous[at] = candidate;
+            slot = base + static_cast<uint32_t>(at);
+            for (size_t chain = chainLimit; candidate >= base && chain > 0; --chain, candidate = previous[candidate - base]) {
+                size_t from = candidate - base;
+                size_t offset = at - from;
+                if (offset > farthest) break;
+                if (best.length != 0 && (best.length >= limit || data[from + best.length] != data[at + best.length])) continue;
+                size_t length = MatchLength(data + from, data + at, limit);
+                if (length > best.length) {
+                    best = LzItem{ static_cast<uint32_t>(length), static_cast<uint32_t>(offset) };
+                    if (length >= nice || length >= limit) break;
+                }
+            }
+            if (best.length < minimum) best.length = 0;
+            return best;
+        }
+
+        static size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+            size_t length = 0;
+            while (length + 8 <= limit) {
+                uint64_t x, y;
+                std::memcpy(&x, a + length, 8);
+                std::memcpy(&y, b + length, 8);
+                if (x != y) break;
+                length += 8;
+            }
+            while (length < limit && a[length] == b[length]) length++;
+            return length;
+        }
+};
+
+#endif
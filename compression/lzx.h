@@ -0,0 +1,395 @@
+#ifndef _LZX_H_
+#define _LZX_H_
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "huffman.h"
+#include "lz_matcher.h"
+#include "xpress_huffman.h"
+
+// LZX as used by WIM and CompactOS: a 32 KiB window, every chunk an independent stream
+// (trees and recent offsets start fresh), and x86 call translation with a fixed 12000000
+// byte "file size" undone after each chunk. Handles verbatim, aligned offset and
+// uncompressed blocks.
+class LzxDecoder {
+
+    public:
+
+        static constexpr size_t CHUNK_SIZE = 32768;
+        static constexpr size_t NUM_CHARS = 256;
+        static constexpr size_t NUM_LEN_HEADERS = 8;
+        static constexpr size_t NUM_OFFSET_SLOTS = 30;           // For a 32 KiB window
+        static constexpr size_t NUM_MAIN_SYMBOLS = NUM_CHARS + NUM_OFFSET_SLOTS * NUM_LEN_HEADERS;
+        static constexpr size_t NUM_LEN_SYMBOLS = 249;
+        static constexpr size_t NUM_ALIGNED_SYMBOLS = 8;
+        static constexpr size_t NUM_PRE_SYMBOLS = 20;
+        static constexpr size_t MIN_MATCH = 2;
+        static constexpr uint32_t OFFSET_ADJUSTMENT = 2;
+        static constexpr int32_t E8_FILE_SIZE = 12000000;
+
+        enum BlockType {
+            BLOCK_VERBATIM = 1,
+            BLOCK_ALIGNED = 2,
+            BLOCK_UNCOMPRESSED = 3
+        };
+
+        static uint32_t SlotBase(size_t slot) {
+            static const uint32_t bases[NUM_OFFSET_SLOTS] = {
+                0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192,
+                256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576
+            };
+            return bases[slot];
+        }
+
+        static unsigned SlotExtraBits(size_t slot) { return slot < 4 ? 0 : static_cast<unsigned>(slot / 2 - 1); }
+
+        bool Decompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+            if (outSize > CHUNK_SIZE) return false;
+            std::memset(mainLengths, 0, sizeof(mainLengths));
+            std::memset(lenLengths, 0, sizeof(lenLengths));
+            uint32_t recent[3] = { 1, 1, 1 };
+            BitReader reader(in, inSize);
+            size_t at = 0;
+            while (at < outSize) {
+                reader.Ensure(4);
+                unsigned type = reader.ReadBits(3);
+                size_t blockSize = reader.ReadBits(1) ? CHUNK_SIZE : reader.ReadBits(16);
+                if (blockSize == 0) return false;
+                blockSize = std::min(blockSize, outSize - at);
+
+                if (type == BLOCK_UNCOMPRESSED) {
+                    // Word aligned; an already aligned stream still skips one word
+                    reader.Ensure(1);
+                    reader.Align();
+                    for (auto& offset : recent) {
+                        offset = reader.ReadU32();
+                        if (offset == 0) return false;
+                    }
+                    if (!reader.ReadBytes(out + at, blockSize)) return false;
+                    if (blockSize & 1) reader.ReadByte();
+                    at += blockSize;
+                    continue;
+                }
+                if (type != BLOCK_VERBATIM && type != BLOCK_ALIGNED) return false;
+                if (type == BLOCK_ALIGNED) {
+                    uint8_t alignedLengths[NUM_ALIGNED_SYMBOLS];
+                    for (auto& length : alignedLengths) length = static_cast<uint8_t>(reader.ReadBits(3));
+                    if (!alignedTable.Build(alignedLengths, NUM_ALIGNED_SYMBOLS, 7, 7)) return false;
+                }
+                if (!ReadLengths(reader, mainLengths, NUM_CHARS)
+                    || !ReadLengths(reader, mainLengths + NUM_CHARS, NUM_MAIN_SYMBOLS - NUM_CHARS)
+                    || !ReadLengths(reader, lenLengths, NUM_LEN_SYMBOLS)) {
+                    return false;
+                }
+                if (!mainTable.Build(mainLengths, NUM_MAIN_SYMBOLS, 11, 16) || !lenTable.Build(lenLengths, NUM_LEN_SYMBOLS, 10, 16)) {
+                    return false;
+                }
+                if (!DecodeBlock(reader, type == BLOCK_ALIGNED, out, at, at + blockSize, outSize, recent)) return false;
+            }
+            UndoE8Translation(out, outSize);
+            return true;
+        }
+
+    private:
+
+        // Delta coded lengths persist between the blocks of a chunk; padded for RLE overrun
+        uint8_t mainLengths[NUM_MAIN_SYMBOLS + 64];
+        uint8_t lenLengths[NUM_LEN_SYMBOLS + 64];
+        HuffmanTable mainTable;
+        HuffmanTable lenTable;
+        HuffmanTable alignedTable;
+        HuffmanTable preTable;
+
+        // Code lengths are sent through a 20 symbol pretree as deltas from the previous
+        // block's lengths, with run-length codes 17-19
+        bool ReadLengths(BitReader& reader, uint8_t* lengths, size_t count) {
+            uint8_t preLengths[NUM_PRE_SYMBOLS];
+            for (auto& length : preLengths) length = static_cast<uint8_t>(reader.ReadBits(4));
+            if (!preTable.Build(preLengths, NUM_PRE_SYMBOLS, 6, 15)) return false;
+            size_t i = 0;
+            while (i < count) {
+                int symbol = preTable.Decode(reader);
+                if (symbol < 0) return false;
+                if (symbol < 17) {
+                    lengths[i] = static_cast<uint8_t>((lengths[i] + 17 - symbol) % 17);
+                    i++;
+                    continue;
+                }
+                size_t run;
+                uint8_t value = 0;
+                if (symbol == 17) {
+                    run = 4 + reader.ReadBits(4);
+                }
+                else if (symbol == 18) {
+                    run = 20 + reader.ReadBits(5);
+                }
+                else {
+                    run = 4 + reader.ReadBits(1);
+                    int delta = preTable.Decode(reader);
+                    if (delta < 0 || delta > 16) return false;
+                    value = static_cast<uint8_t>((lengths[i] + 17 - delta) % 17);
+                }
+                // A run may overshoot the end by up to 50 entries, absorbed by the padding
+                for (size_t end = i + run; i < end; ++i) lengths[i] = value;
+            }
+            return true;
+        }
+
+        bool DecodeBlock(BitReader& reader, bool aligned, uint8_t* out, size_t& at, size_t blockEnd, size_t outSize, uint32_t* recent) {
+            while (at < blockEnd) {
+                int symbol = mainTable.Decode(reader);
+                if (symbol < 0) return false;
+                if (symbol < static_cast<int>(NUM_CHARS)) {
+                    out[at++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+                symbol -= NUM_CHARS;
+                size_t slot = static_cast<size_t>(symbol) / NUM_LEN_HEADERS;
+                size_t length = static_cast<size_t>(symbol) % NUM_LEN_HEADERS;
+                if (length == NUM_LEN_HEADERS - 1) {
+                    int extra = lenTable.Decode(reader);
+                    if (extra < 0) return false;
+                    length += static_cast<size_t>(extra);
+                }
+                length += MIN_MATCH;
+
+                uint32_t offset;
+                if (slot < 3) {
+                    // Repeat offset: swap it to the front
+                    offset = recent[slot];
+                    recent[slot] = recent[0];
+                    recent[0] = offset;
+                }
+                else {
+                    unsigned extraBits = SlotExtraBits(slot);
+                    offset = SlotBase(slot);
+                    if (aligned && extraBits >= 3) {
+                        offset += reader.ReadBits(extraBits - 3) << 3;
+                        int low = alignedTable.Decode(reader);
+                        if (low < 0) return false;
+                        offset += static_cast<uint32_t>(low);
+                    }
+                    else {
+                        offset += reader.ReadBits(extraBits);
+                    }
+                    offset -= OFFSET_ADJUSTMENT;
+                    recent[2] = recent[1];
+                    recent[1] = recent[0];
+                    recent[0] = offset;
+                }
+                if (offset == 0 || offset > at || length > outSize - at) return false;
+                XpressHuffmanDecoder::CopyMatch(out + at, offset, length);
+                at += length;
+            }
+            return true;
+        }
+
+        // The compressor rewrote the targets of E8 (x86 CALL) bytes as absolute positions
+        // to make them repeat; turn them back into relative displacements
+        static void UndoE8Translation(uint8_t* data, size_t size) {
+            if (size <= 10) return;
+            for (size_t i = 0; i < size - 10; ++i) {
+                if (data[i] != 0xE8) continue;
+                uint8_t* target = data + i + 1;
+                int32_t absolute = static_cast<int32_t>(static_cast<uint32_t>(target[0]) | static_cast<uint32_t>(target[1]) << 8
+                    | static_cast<uint32_t>(target[2]) << 16 | static_cast<uint32_t>(target[3]) << 24);
+                int32_t position = static_cast<int32_t>(i);
+                int32_t relative;
+                if (absolute >= 0) {
+                    if (absolute >= E8_FILE_SIZE) {
+                        i += 4;
+                        continue;
+                    }
+                    relative = absolute - position;
+                }
+                else {
+                    if (absolute < -position) {
+                        i += 4;
+                        continue;
+                    }
+                    relative = absolute + E8_FILE_SIZE;
+                }
+                uint32_t value = static_cast<uint32_t>(relative);
+                target[0] = static_cast<uint8_t>(value);
+                target[1] = static_cast<uint8_t>(value >> 8);
+                target[2] = static_cast<uint8_t>(value >> 16);
+                target[3] = static_cast<uint8_t>(value >> 24);
+                i += 4;
+            }
+        }
+};
+
+// Compressor for the LZX above: one verbatim block per chunk, the lazy hash chain parse
+// shared with XPRESS, repeat offsets where a match happens to reuse one, and the E8
+// translation the decoder undoes. Aligned offset blocks would buy a percent or two on code.
+class LzxEncoder {
+
+    public:
+
+        static constexpr size_t MAX_MATCH = LzxDecoder::MIN_MATCH + LzxDecoder::NUM_LEN_HEADERS - 1 + LzxDecoder::NUM_LEN_SYMBOLS - 1;
+        static constexpr size_t MAX_OFFSET = LzxDecoder::CHUNK_SIZE - 3;
+        static constexpr unsigned MAX_CODE_LENGTH = 16;
+        static constexpr unsigned MAX_PRE_CODE_LENGTH = 15;
+
+        explicit LzxEncoder(size_t maxChain = 32) : matcher(maxChain, 96) {}
+
+        // Appends the compressed form of `size` (at most CHUNK_SIZE) bytes to `out`; returns its length
+        size_t Compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+            size_t start = out.size();
+            translated.assign(in, in + size);
+            E8Translation(translated.data(), size);
+            matcher.Parse(translated.data(), size, LzMatcher::MIN_HASHED, MAX_MATCH, MAX_OFFSET, items);
+
+            uint32_t mainFrequencies[LzxDecoder::NUM_MAIN_SYMBOLS] = {};
+            uint32_t lenFrequencies[LzxDecoder::NUM_LEN_SYMBOLS] = {};
+            uint32_t recent[3] = { 1, 1, 1 };
+            symbols.clear();
+            for (const auto& item : items) {
+                Coded coded{ item.value, -1, 0, 0 };
+                if (item.length != 0) {
+                    size_t slot = Slot(item.value, recent, coded);
+                    size_t length = item.length - LzxDecoder::MIN_MATCH;
+                    size_t header = std::min(length, LzxDecoder::NUM_LEN_HEADERS - 1);
+                    if (header == LzxDecoder::NUM_LEN_HEADERS - 1) {
+                        coded.lenSymbol = static_cast<int>(length - header);
+                        lenFrequencies[coded.lenSymbol]++;
+                    }
+                    coded.mainSymbol = static_cast<uint32_t>(LzxDecoder::NUM_CHARS + slot * LzxDecoder::NUM_LEN_HEADERS + header);
+                }
+                mainFrequencies[coded.mainSymbol]++;
+                symbols.push_back(coded);
+            }
+
+            uint8_t mainLengths[LzxDecoder::NUM_MAIN_SYMBOLS], lenLengths[LzxDecoder::NUM_LEN_SYMBOLS];
+            uint32_t mainCodes[LzxDecoder::NUM_MAIN_SYMBOLS], lenCodes[LzxDecoder::NUM_LEN_SYMBOLS];
+            HuffmanCode::Lengths(mainFrequencies, LzxDecoder::NUM_MAIN_SYMBOLS, MAX_CODE_LENGTH, mainLengths);
+            HuffmanCode::Lengths(lenFrequencies, LzxDecoder::NUM_LEN_SYMBOLS, MAX_CODE_LENGTH, lenLengths);
+            HuffmanCode::Codes(mainLengths, LzxDecoder::NUM_MAIN_SYMBOLS, mainCodes);
+            HuffmanCode::Codes(lenLengths, LzxDecoder::NUM_LEN_SYMBOLS, lenCodes);
+
+            // At most 16 bits a literal and 45 bits a match of three or more, plus the trees
+            BitWriter writer(out, size * 2 + 4096);
+            writer.WriteBits(LzxDecoder::BLOCK_VERBATIM, 3);
+            if (size == LzxDecoder::CHUNK_SIZE) {
+                writer.WriteBits(1, 1);
+            }
+            else {
+                writer.WriteBits(0, 1);
+                writer.WriteBits(static_cast<uint32_t>(size), 16);
+            }
+            WriteLengths(writer, mainLengths, LzxDecoder::NUM_CHARS);
+            WriteLengths(writer, mainLengths + LzxDecoder::NUM_CHARS, LzxDecoder::NUM_MAIN_SYMBOLS - LzxDecoder::NUM_CHARS);
+            WriteLengths(writer, lenLengths, LzxDecoder::NUM_LEN_SYMBOLS);
+            for (const auto& coded : symbols) {
+                writer.WriteBits(mainCodes[coded.mainSymbol], mainLengths[coded.mainSymbol]);
+                if (coded.lenSymbol >= 0) writer.WriteBits(lenCodes[coded.lenSymbol], lenLengths[coded.lenSymbol]);
+                writer.WriteBits(coded.extra, coded.extraBits);
+            }
+            writer.Flush();
+            return out.size() - start;
+        }
+
+    private:
+
+        struct Coded {
+            uint32_t mainSymbol;
+            int lenSymbol;           // -1 when the length fits the main symbol
+            uint32_t extra;          // Verbatim offset bits
+            unsigned extraBits;
+        };
+
+        LzMatcher matcher;
+        std::vector<LzItem> items;
+        std::vector<Coded> symbols;
+        std::vector<uint8_t> translated;
+
+        // Offset slot for a match, updating the recent offsets the way the decoder will
+        static size_t Slot(uint32_t offset, uint32_t* recent, Coded& coded) {
+            for (size_t i = 0; i < 3; ++i) {
+                if (recent[i] != offset) continue;
+                recent[i] = recent[0];
+                recent[0] = offset;
+                return i;
+            }
+            recent[2] = recent[1];
+            recent[1] = recent[0];
+            recent[0] = offset;
+            uint32_t formatted = offset + LzxDecoder::OFFSET_ADJUSTMENT;
+            size_t slot = 3;
+            while (slot + 1 < LzxDecoder::NUM_OFFSET_SLOTS && LzxDecoder::SlotBase(slot + 1) <= formatted) slot++;
+            coded.extraBits = LzxDecoder::SlotExtraBits(slot);
+            coded.extra = formatted - LzxDecoder::SlotBase(slot);
+            return slot;
+        }
+
+        // Lengths through the pretree, as deltas from an all-zero previous tree since every
+        // chunk starts fresh; runs of zeros use 17/18, runs of anything else 19
+        static void WriteLengths(BitWriter& writer, const uint8_t* lengths, size_t count) {
+            struct Run {
+                unsigned symbol;
+                uint32_t extra;
+                unsigned extraBits;
+                int delta;           // Symbol 19's repeated value, -1 otherwise
+            };
+            std::vector<Run> runs;
+            uint32_t frequencies[LzxDecoder::NUM_PRE_SYMBOLS] = {};
+            for (size_t i = 0; i < count;) {
+                size_t run = 1;
+                while (i + run < count && lengths[i + run] == lengths[i]) run++;
+                unsigned delta = (17 - lengths[i]) % 17;
+                Run item{ delta, 0, 0, -1 };
+                if (lengths[i] == 0 && run >= 20) {
+                    run = std::min<size_t>(run, 51);
+                    item = Run{ 18, static_cast<uint32_t>(run - 20), 5, -1 };
+                }
+                else if (lengths[i] == 0 && run >= 4) {
+                    run = std::min<size_t>(run, 19);
+                    item = Run{ 17, static_cast<uint32_t>(run - 4), 4, -1 };
+                }
+                else if (run >= 4) {
+                    run = std::min<size_t>(run, 5);
+                    item = Run{ 19, static_cast<uint32_t>(run - 4), 1, static_cast<int>(delta) };
+                    frequencies[delta]++;
+                }
+                else {
+                    run = 1;
+                }
+                frequencies[item.symbol]++;
+                runs.push_back(item);
+                i += run;
+            }
+            uint8_t preLengths[LzxDecoder::NUM_PRE_SYMBOLS];
+            uint32_t preCodes[LzxDecoder::NUM_PRE_SYMBOLS];
+            HuffmanCode::Lengths(frequencies, LzxDecoder::NUM_PRE_SYMBOLS, MAX_PRE_CODE_LENGTH, preLengths);
+            HuffmanCode::Codes(preLengths, LzxDecoder::NUM_PRE_SYMBOLS, preCodes);
+            for (uint8_t length : preLengths) writer.WriteBits(length, 4);
+            for (const auto& item : runs) {
+                writer.WriteBits(preCodes[item.symbol], preLengths[item.symbol]);
+                writer.WriteBits(item.extra, item.extraBits);
+                if (item.delta >= 0) writer.WriteBits(preCodes[item.delta], preLengths[item.delta]);
+            }
+        }
+
+        // Inverse of LzxDecoder::UndoE8Translation: CALL targets become absolute positions
+        static void E8Translation(uint8_t* data, size_t size) {
+            if (size <= 10) return;
+            for (size_t i = 0; i < size - 10; ++i) {
+                if (data[i] != 0xE8) continue;
+                uint8_t* target = data + i + 1;
+                int32_t relative = static_cast<int32_t>(static_cast<uint32_t>(target[0]) | static_cast<uint32_t>(target[1]) << 8
+                    | static_cast<uint32_t>(target[2]) << 16 | static_cast<uint32_t>(target[3]) << 24);
+                int32_t position = static_cast<int32_t>(i);
+                if (relative >= -position && relative < LzxDecoder::E8_FILE_SIZE) {
+                    int32_t absolute = relative < LzxDecoder::E8_FILE_SIZE - position ? relative + position : relative - LzxDecoder::E8_FILE_SIZE;
+                    uint32_t value = static_cast<uint32_t>(absolute);
+                    target[0] = static_cast<uint8_t>(value);
+                    target[1] = static_cast<uint8_t>(value >> 8);
+                    target[2] = static_cast<uint8_t>(value >> 16);
+                    target[3] = static_cast<uint8_t>(value >> 24);
+                }
+                i += 4;
+            }
+        }
+};
+
+#endif
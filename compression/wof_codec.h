@@ -0,0 +1,131 @@
+#ifndef _WOF_CODEC_H_
+#define _WOF_CODEC_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "lzx.h"
+#include "xpress_huffman.h"
+
+// CompactOS algorithms; the values are Windows' FILE_PROVIDER_COMPRESSION_* constants
+enum WofFormat {
+    WOF_NONE = -1,
+    WOF_XPRESS4K = 0,
+    WOF_LZX = 1,
+    WOF_XPRESS8K = 2,
+    WOF_XPRESS16K = 3
+};
+
+// The WofCompressedData stream of a CompactOS file: the file cut into fixed chunks (4, 8
+// or 16 KiB for XPRESS, 32 KiB for LZX), each compressed on its own, behind a table with
+// the end offset of every chunk but the last (4 byte entries, 8 from 4 GiB of original
+// data up), relative to the end of the table. A chunk that does not shrink is stored as
+// is and recognised by its size. Independent chunks are what lets a file be compressed
+// on every core at once: each caller compresses a run of whole chunks with its own codec
+// and the table is put together from the sizes afterwards.
+class WofCodec {
+
+    public:
+
+        static size_t ChunkSize(WofFormat format) {
+            switch (format) {
+                case WOF_XPRESS4K: return 4096;
+                case WOF_XPRESS8K: return 8192;
+                case WOF_XPRESS16K: return 16384;
+                case WOF_LZX: return LzxDecoder::CHUNK_SIZE;
+                default: return 0;
+            }
+        }
+
+        static const wchar_t* Name(WofFormat format) {
+            switch (format) {
+                case WOF_XPRESS4K: return L"xpress4k";
+                case WOF_XPRESS8K: return L"xpress8k";
+                case WOF_XPRESS16K: return L"xpress16k";
+                case WOF_LZX: return L"lzx";
+                default: return L"none";
+            }
+        }
+
+        static bool Parse(const std::wstring& name, WofFormat& format) {
+            for (WofFormat candidate : { WOF_NONE, WOF_XPRESS4K, WOF_XPRESS8K, WOF_XPRESS16K, WOF_LZX }) {
+                if (name == Name(candidate)) {
+                    format = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static size_t ChunkCount(WofFormat format, uint64_t size) {
+            return static_cast<size_t>((size + ChunkSize(format) - 1) / ChunkSize(format));
+        }
+
+        static size_t TableSize(WofFormat format, uint64_t size) {
+            size_t count = ChunkCount(format, size);
+            return count == 0 ? 0 : (count - 1) * (size > 0xFFFFFFFFULL ? 8 : 4);
+        }
+
+        // Appends the chunks of `size` bytes to `out` and their stored sizes to `sizes`.
+        // `size` is a multiple of the chunk size except for the file's last run.
+        void Compress(WofFormat format, const uint8_t* in, size_t size, std::vector<uint8_t>& out, std::vector<uint32_t>& sizes) {
+            size_t chunk = ChunkSize(format);
+            for (size_t at = 0; at < size; at += chunk) {
+                size_t length = std::min(chunk, size - at);
+                size_t start = out.size();
+                size_t packed = format == WOF_LZX ? lzx.Compress(in + at, length, out) : xpress.Compress(in + at, length, out);
+                if (packed >= length) {
+                    out.resize(start);
+                    out.insert(out.end(), in + at, in + at + length);
+                    packed = length;
+                }
+                sizes.push_back(static_cast<uint32_t>(packed));
+            }
+        }
+
+        // The chunk table for a file of `size` bytes whose chunks have `sizes`
+        static std::vector<uint8_t> Table(WofFormat format, uint64_t size, const std::vector<uint32_t>& sizes) {
+            std::vector<uint8_t> table(TableSize(format, size));
+            size_t width = size > 0xFFFFFFFFULL ? 8 : 4;
+            uint64_t end = 0;
+            for (size_t i = 0; i + 1 < sizes.size(); ++i) {
+                end += sizes[i];
+                for (size_t byte = 0; byte < width; ++byte) table[i * width + byte] = static_cast<uint8_t>(end >> (byte * 8));
+            }
+            return table;
+        }
+
+        // Whole stream back to `size` bytes, for checking what Compress wrote
+        bool Decompress(WofFormat format, const uint8_t* stream, size_t streamSize, uint8_t* out, uint64_t size) {
+            size_t chunk = ChunkSize(format), count = ChunkCount(format, size), tableSize = TableSize(format, size);
+            size_t width = size > 0xFFFFFFFFULL ? 8 : 4;
+            if (streamSize < tableSize) return false;
+            uint64_t start = 0;
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t end = streamSize - tableSize;
+                if (i + 1 < count) {
+                    end = 0;
+                    for (size_t byte = 0; byte < width; ++byte) end |= static_cast<uint64_t>(stream[i * width + byte]) << (byte * 8);
+                }
+                uint64_t at = static_cast<uint64_t>(i) * chunk;
+                size_t length = static_cast<size_t>(std::min<uint64_t>(chunk, size - at));
+                if (end <= start || end - start > length || tableSize + end > streamSize) return false;
+                const uint8_t* in = stream + tableSize + start;
+                size_t packed = static_cast<size_t>(end - start);
+                if (packed == length) std::memcpy(out + at, in, length);
+                else if (format == WOF_LZX ? !lzxDecoder.Decompress(in, packed, out + at, length)
+                                           : !xpressDecoder.Decompress(in, packed, out + at, length)) return false;
+                start = end;
+            }
+            return true;
+        }
+
+    private:
+
+        XpressHuffmanEncoder xpress;
+        LzxEncoder lzx;
+        XpressHuffmanDecoder xpressDecoder;
+        LzxDecoder lzxDecoder;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef _XPRESS_HUFFMAN_H_
+#define _XPRESS_HUFFMAN_H_
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "huffman.h"
+#include "lz_matcher.h"
+
+// LZ77 + Huffman XPRESS ([MS-XCA] 2.2), the "XPRESS" compression of WIM files and the
+// XPRESS4K/8K/16K of CompactOS. A chunk starts with 512 4-bit code lengths (256 literals,
+// then 256 match headers of log2(offset) << 4 | length), followed by the bitstream. One
+// table covers 64 KiB of output, which is the largest chunk WIM allows for XPRESS.
+class XpressHuffmanDecoder {
+
+    public:
+
+        static constexpr size_t NUM_SYMBOLS = 512;
+        static constexpr size_t MAX_CHUNK = 65536;
+        static constexpr unsigned MAX_CODE_LENGTH = 15;
+        static constexpr unsigned TABLE_BITS = 11;
+        static constexpr size_t MIN_MATCH = 3;
+
+        bool Decompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+            if (inSize < NUM_SYMBOLS / 2 || outSize > MAX_CHUNK) return false;
+            uint8_t lengths[NUM_SYMBOLS];
+            for (size_t i = 0; i < NUM_SYMBOLS / 2; ++i) {
+                lengths[i * 2] = in[i] & 0x0F;
+                lengths[i * 2 + 1] = in[i] >> 4;
+            }
+            if (!table.Build(lengths, NUM_SYMBOLS, TABLE_BITS, MAX_CODE_LENGTH)) return false;
+
+            BitReader reader(in + NUM_SYMBOLS / 2, inSize - NUM_SYMBOLS / 2);
+            size_t at = 0;
+            while (at < outSize) {
+                int symbol = table.Decode(reader);
+                if (symbol < 0) return false;
+                if (symbol < 256) {
+                    out[at++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+                symbol -= 256;
+                size_t length = symbol & 0x0F;
+                unsigned offsetBits = (symbol >> 4) & 0x0F;
+                reader.Ensure(16);
+                size_t offset = (static_cast<size_t>(1) << offsetBits) | reader.ReadBits(offsetBits);
+                if (length == 0x0F) {
+                    length += reader.ReadByte();
+                    if (length == 0x0F + 0xFF) length = reader.ReadU16();
+                }
+                length += MIN_MATCH;
+                if (offset > at || length > outSize - at) return false;
+                CopyMatch(out + at, offset, length);
+                at += length;
+            }
+            return true;
+        }
+
+        // Overlapping LZ77 copy; offsets shorter than the length repeat the pattern
+        static void CopyMatch(uint8_t* to, size_t offset, size_t length) {
+            const uint8_t* from = to - offset;
+            if (offset >= length) {
+                std::memcpy(to, from, length);
+                return;
+            }
+            for (size_t i = 0; i < length; ++i) to[i] = from[i];
+        }
+
+    private:
+
+        HuffmanTable table;
+};
+
+// Compressor for the format above, one chunk at a time: a lazy hash chain parse, one
+// Huffman code per chunk, and the end-of-data symbol (a zero-length match header) that
+// Windows' decoder expects after the last item.
+class XpressHuffmanEncoder {
+
+    public:
+
+        static constexpr size_t MAX_OFFSET = 65535;
+        static constexpr unsigned END_OF_DATA = 256;
+
+        explicit XpressHuffmanEncoder(size_t maxChain = 24) : matcher(maxChain) {}
+
+        // Appends the compressed form of `size` (at most MAX_CHUNK) bytes to `out`; returns its length
+        size_t Compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+            size_t start = out.size();
+            matcher.Parse(in, size, XpressHuffmanDecoder::MIN_MATCH, size, MAX_OFFSET, items);
+            uint32_t frequencies[XpressHuffmanDecoder::NUM_SYMBOLS] = {};
+            for (const auto& item : items) frequencies[Symbol(item)]++;
+            frequencies[END_OF_DATA]++;
+            uint8_t lengths[XpressHuffmanDecoder::NUM_SYMBOLS];
+            uint32_t codes[XpressHuffmanDecoder::NUM_SYMBOLS];
+            HuffmanCode::Lengths(frequencies, XpressHuffmanDecoder::NUM_SYMBOLS, XpressHuffmanDecoder::MAX_CODE_LENGTH, lengths);
+            HuffmanCode::Codes(lengths, XpressHuffmanDecoder::NUM_SYMBOLS, codes);
+            for (size_t i = 0; i < XpressHuffmanDecoder::NUM_SYMBOLS / 2; ++i) {
+                out.push_back(static_cast<uint8_t>(lengths[i * 2] | lengths[i * 2 + 1] << 4));
+            }
+
+            // Literals cost at most 15 bits a byte, matches less than 18
+            BitWriter writer(out, size * 9 / 4 + 64);
+            for (const auto& item : items) {
+                unsigned symbol = Symbol(item);
+                writer.WriteBits(codes[symbol], lengths[symbol]);
+                if (item.length == 0) continue;
+                // Long lengths go out as bytes before the offset bits; the decoder finds them at
+                // the same place whichever order it reads them in
+                size_t length = item.length - XpressHuffmanDecoder::MIN_MATCH;
+                if (length >= 0x0F) {
+                    if (length - 0x0F < 0xFF) {
+                        writer.WriteByte(static_cast<uint8_t>(length - 0x0F));
+                    }
+                    else {
+                        writer.WriteByte(0xFF);
+                        writer.WriteU16(static_cast<uint16_t>(length));
+                    }
+                }
+                unsigned offsetBits = Log2(item.value);
+                writer.WriteBits(item.value - (1U << offsetBits), offsetBits);
+            }
+            writer.WriteBits(codes[END_OF_DATA], lengths[END_OF_DATA]);
+            writer.Flush();
+            return out.size() - start;
+        }
+
+    private:
+
+        LzMatcher matcher;
+        std::vector<LzItem> items;
+
+        static unsigned Log2(uint32_t value) {
+            unsigned bits = 0;
+            while (value >>= 1) bits++;
+            return bits;
+        }
+
+        static unsigned Symbol(const LzItem& item) {
+            if (item.length == 0) return item.value;
+            size_t length = std::min<size_t>(item.length - XpressHuffmanDecoder::MIN_MATCH, 0x0F);
+            return static_cast<unsigned>(256 + (Log2(item.value) << 4) + length);
+        }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+
+// Fixed number of equally sized, page aligned I/O buffers. Acquire() blocks while all
+// of them are out, which is what caps the copy engine's in-flight memory no matter how
+// many workers or chunks are queued. Buffers are allocated on first use.
+class BufferPool {
+
+    public:
+
+        static constexpr size_t ALIGNMENT = 4096;
+
+        // Returned to the pool when it goes out of scope
+        class Lease {
+
+            public:
+
+                Lease() = default;
+                Lease(BufferPool* owner, uint8_t* data) : pool(owner), buffer(data) {}
+                Lease(Lease&& other) noexcept : pool(other.pool), buffer(other.buffer) { other.buffer = nullptr; }
+                Lease& operator=(Lease&& other) noexcept {
+                    if (this != &other) {
+                        Release();
+                        pool = other.pool;
+                        buffer = other.buffer;
+                        other.buffer = nullptr;
+                    }
+                    return *this;
+                }
+                ~Lease() { Release(); }
+
+                uint8_t* Data() const { return buffer; }
+                size_t Size() const { return pool ? pool->BufferSize() : 0; }
+
+            private:
+
+                BufferPool* pool = nullptr;
+                uint8_t* buffer = nullptr;
+
+                void Release() {
+                    if (buffer) pool->Release(buffer);
+                    buffer = nullptr;
+                }
+        };
+
+        BufferPool(size_t count, size_t size)
+            : capacity(count ? count : 1), bufferSize((size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT) {}
+
+        ~BufferPool() {
+            for (uint8_t* buffer : allocated) operator delete[](buffer, std::align_val_t(ALIGNMENT));
+        }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        Lease Acquire() {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [&] { return !free.empty() || allocated.size() < capacity; });
+            uint8_t* buffer;
+            if (!free.empty()) {
+                buffer = free.back();
+                free.pop_back();
+            }
+            else {
+                buffer = static_cast<uint8_t*>(operator new[](bufferSize, std::align_val_t(ALIGNMENT)));
+                allocated.push_back(buffer);
+            }
+            return Lease(this, buffer);
+        }
+
+        size_t BufferSize() const { return bufferSize; }
+        size_t Capacity() const { return capacity; }
+
+    private:
+
+        const size_t capacity;
+        const size_t bufferSize;
+        std::mutex mutex;
+        std::condition_variable available;
+        std::vector<uint8_t*> allocated;
+        std::vector<uint8_t*> free;
+
+        void Release(uint8_t* buffer) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free.push_back(buffer);
+            }
+            available.notify_one();
+        }
+};
+
+#endif
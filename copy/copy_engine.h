@@ -0,0 +1,781 @@
+#ifndef _COPY_ENGINE_H_
+#define _COPY_ENGINE_H_
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include "buffer_pool.h"
+#include "work_pool.h"
+#include "manifest.h"
+#include "read_plan.h"
+#include "../io/fast_copy.h"
+#include "../pipeline/journal.h"
+#include "../platform/file.h"
+#include "../platform/paths.h"
+#include "../platform/wof_file.h"
+#include "../progress/progress_channel.h"
+#include "../trace/tracer.h"
+
+struct CopyOptions {
+    size_t threads = 0;                                  // 0 = one per hardware thread
+    size_t chunkSize = 8 << 20;                          // Unit of work for large files, also the buffer size
+    uint64_t largeFileThreshold = 32ULL << 20;           // Files above this are split into chunks
+    size_t maxBufferMemory = 256 << 20;                  // Cap on data in flight
+    bool fastPaths = true;                               // Try reflink / copy_file_range before buffers
+    bool manifest = false;                               // Hash every chunk from the buffer it is written from (no
+                                                         // extra I/O) into the target's manifest, for ManifestVerifier
+                                                         // and ResyncEngine; data then always passes through buffers
+    HashKind hash = HASH_CRC32C;                         // Manifest: chunk hash, stored with it
+    std::vector<std::wstring> excludes;                  // Paths relative to the source root, any case
+    WofFormat compression = WOF_NONE;                    // Write CompactOS compressed files (NTFS targets); each chunk
+                                                         // task compresses its range and the ranges are appended to
+                                                         // the stream in order, so one large file uses every core
+    std::vector<std::wstring> uncompressed;              // Paths, and everything below them, kept plain
+    uint64_t compressThreshold = 4096;                   // Files up to this size take a cluster either way
+    bool batched = true;                                 // A directory's small files go to one worker together (within
+                                                         // each planned batch when ordered); times, attributes and ACLs
+                                                         // follow in a pass of their own once the data is written, so
+                                                         // flash takes the data writes back to back
+    bool preallocate = true;                             // Reserve each file's size on the target before writing it
+    bool ordered = false;                                // Walk only lists files; ReadPlanner sorts them by first extent
+                                                         // and each worker prefetches and copies the next batch of
+                                                         // neighbours; for live or mounted volumes on HDD and SATA disks
+    uint64_t readAhead = 8ULL << 20;                     // Ordered: neighbouring files are prefetched together up to this;
+                                                         // batched: small files of a directory per task up to this
+    ProgressChannel* progress = nullptr;                 // Gets STAGE_COPY counters, rate limited
+    Journal* journal = nullptr;                          // Open journal: files it lists with an unchanged source are
+                                                         // skipped, a cut-off large file gets only its missing chunks,
+                                                         // and what is copied now is added to it
+};
+
+struct CopyStats {
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t links = 0;
+    uint64_t bytes = 0;
+    uint64_t chunks = 0;
+    uint64_t fastCopies = 0;                             // Files or chunks copied by the kernel
+    uint64_t compressedFiles = 0;
+    uint64_t compressedBytes = 0;                        // What those files take on the target, chunk tables included
+    uint64_t steals = 0;
+    uint64_t resumedFiles = 0;                           // Finished by an earlier run, per the journal
+    uint64_t resumedBytes = 0;                           // Those files and the finished chunks of partial ones
+    uint64_t clusters = 0;                               // Batched: runs of small files of one directory written together
+    uint64_t errors = 0;
+    double seconds = 0;
+    double metadataSeconds = 0;                          // The deferred metadata pass, part of seconds
+    ReadPlanStats plan;                                  // Ordered runs
+
+    double FilesPerSecond() const { return seconds > 0 ? files / seconds : 0; }
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files, " + std::to_wstring(bytes / 1000000) + L" MB in "
+            + std::to_wstring(seconds) + L" s (" + std::to_wstring(static_cast<uint64_t>(FilesPerSecond())) + L" files/s, "
+            + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s)"
+            + (compressedFiles ? L", " + std::to_wstring(compressedFiles) + L" compressed to " + std::to_wstring(compressedBytes / 1000000) + L" MB" : L"")
+            + (resumedBytes ? L", " + std::to_wstring(resumedFiles) + L" files and " + std::to_wstring(resumedBytes / 1000000) + L" MB resumed" : L"")
+            + (metadataSeconds > 0 ? L", metadata pass " + std::to_wstring(metadataSeconds) + L" s" : L"")
+            + (plan.files ? L"; read plan: " + plan.ToString() : L"");
+    }
+};
+
+// Copies a directory tree with one walker thread and a work-stealing pool of copy workers.
+// The walker creates directories in order and queues every file; small files are one task,
+// large ones are preallocated and queued as independent chunk tasks so a single 4 GB WIM
+// or pagefile-sized file spreads over all workers. Every task borrows a buffer from a
+// bounded pool, so in-flight memory stays at maxBufferMemory however far the walker runs ahead.
+// Where the filesystems allow it a file is reflinked or handed to copy_file_range instead.
+// Hashing, compression, resuming and read ordering are options, described in CopyOptions.
+class CopyEngine {
+
+    public:
+
+        explicit CopyEngine(const CopyOptions& copyOptions = CopyOptions()) : options(copyOptions) {
+            size_t unit = options.compression == WOF_NONE ? BufferPool::ALIGNMENT : std::max(BufferPool::ALIGNMENT, WofCodec::ChunkSize(options.compression));
+            options.chunkSize = std::max<size_t>(unit, (options.chunkSize + unit - 1) / unit * unit);
+        }
+        ~CopyEngine() = default;
+
+        bool Run(const std::filesystem::path& source, const std::filesystem::path& destination) {
+            stats = CopyStats();
+            errors.clear();
+            files = directories = links = bytes = chunks = fastCopies = compressedFiles = compressedBytes = failures = 0;
+            resumedFiles = resumedBytes = clusters = 0;
+            plan = ReadPlanStats();
+            metadataSeconds = 0;
+            cloneSupported = rangeSupported = options.fastPaths && !options.manifest;
+            manifest = Manifest(static_cast<uint32_t>(options.chunkSize), options.hash);
+            auto start = std::chrono::steady_clock::now();
+
+            std::error_code ec;
+            if (!std::filesystem::is_directory(source, ec)) {
+                Fail(L"Source is not a directory: " + source.wstring());
+                return false;
+            }
+            std::filesystem::create_directories(destination, ec);
+            if (ec) {
+                Fail(L"Cannot create " + destination.wstring());
+                return false;
+            }
+            if (options.compression != WOF_NONE && !WofFile::Supported(destination)) {
+                Fail(L"Cannot write compressed files to " + destination.wstring() + L": not NTFS");
+                return false;
+            }
+
+            size_t bufferCount = std::max<size_t>(1, options.maxBufferMemory / std::max<size_t>(options.chunkSize, BufferPool::ALIGNMENT));
+            BufferPool buffers(bufferCount, options.chunkSize);
+            {
+                WorkStealingPool pool(options.threads);
+                Walk(source, destination, pool, buffers);
+                if (options.ordered) CopyOrdered(pool, buffers);
+                pool.Wait();
+                if (options.batched) ApplyMetadata(pool);
+                stats.steals = pool.Steals();
+            }
+            if (options.manifest && !manifest.Save(destination / Manifest::FILE_NAME)) Fail(manifest.Error());
+            Advance(true);
+
+            stats.files = files;
+            stats.directories = directories;
+            stats.links = links;
+            stats.bytes = bytes;
+            stats.chunks = chunks;
+            stats.fastCopies = fastCopies;
+            stats.compressedFiles = compressedFiles;
+            stats.compressedBytes = compressedBytes;
+            stats.resumedFiles = resumedFiles;
+            stats.resumedBytes = resumedBytes;
+            stats.clusters = clusters;
+            stats.errors = failures;
+            stats.plan = plan;
+            stats.metadataSeconds = metadataSeconds;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return failures == 0;
+        }
+
+        const CopyStats& Stats() const { return stats; }
+        const std::vector<std::wstring>& Errors() const { return errors; }
+        std::wstring Error() const { return errors.empty() ? std::wstring() : errors.front(); }
+
+        // Timestamps and, on Windows, the ACL and the hidden/system/read-only bits boot files
+        // rely on. Owner and group need privileges a plain copy may not hold; the DACL alone
+        // is applied then.
+        static void CopyMetadata(const std::filesystem::path& source, const std::filesystem::path& destination) {
+            TraceScope scope("copy.metadata", "copy");
+            std::error_code ec;
+            auto time = std::filesystem::last_write_time(source, ec);
+            if (!ec) std::filesystem::last_write_time(destination, time, ec);
+#ifdef _WIN32
+            SECURITY_INFORMATION parts = OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION;
+            DWORD needed = 0;
+            GetFileSecurityW(source.c_str(), parts, NULL, 0, &needed);
+            std::vector<uint8_t> descriptor(needed);
+            if (needed > 0 && GetFileSecurityW(source.c_str(), parts, descriptor.data(), needed, &needed)
+                && !SetFileSecurityW(destination.c_str(), parts, descriptor.data())) {
+                SetFileSecurityW(destination.c_str(), DACL_SECURITY_INFORMATION, descriptor.data());
+            }
+            DWORD attributes = GetFileAttributesW(source.c_str());
+            if (attributes != INVALID_FILE_ATTRIBUTES) SetFileAttributesW(destination.c_str(), attributes);
+#else
+            auto permissions = std::filesystem::status(source, ec).permissions();
+            if (!ec) std::filesystem::permissions(destination, permissions, ec);
+#endif
+        }
+
+    private:
+
+        // Shared by the chunk tasks of one large file; the last one to finish closes it out
+        struct LargeFile {
+            File input;
+            File output;
+            std::filesystem::path source;
+            std::filesystem::path destination;
+            std::string key;
+            uint64_t size = 0;
+            int64_t sourceTime = 0;
+            std::vector<uint64_t> hashes;
+            std::atomic<size_t> remaining{ 0 };
+            std::atomic<bool> failed{ false };
+        };
+
+        // A file the walk found, for an ordered copy to dispatch once the plan is made, or a
+        // batched copy to queue with its directory
+        struct PlannedFile {
+            std::filesystem::path source;
+            std::filesystem::path destination;
+            std::filesystem::path relative;
+            uint64_t size = 0;
+            std::string key;
+        };
+
+        static constexpr size_t CLUSTER_FILES = 64;             // Batched: most small files per task
+
+        // A file whose data is on the target, for the metadata pass
+        struct FinishedFile {
+            std::filesystem::path source;
+            std::filesystem::path destination;
+            std::string key;
+            uint64_t size = 0;
+            std::vector<uint64_t> hashes;
+        };
+
+        // The same for a compressed file. Chunk tasks finish in any order but the stream is
+        // written front to back, so a range waits in `pending` until the ones before it are out.
+        struct CompressedFile {
+            File input;
+            WofFile output;
+            std::filesystem::path source;
+            std::filesystem::path destination;
+            std::string key;
+            uint64_t size = 0;
+            std::vector<uint64_t> hashes;
+            std::atomic<size_t> remaining{ 0 };
+            std::atomic<bool> failed{ false };
+            std::mutex mutex;                            // Guards the rest
+            std::vector<std::vector<uint8_t>> pending;   // Compressed ranges not yet written
+            std::vector<std::vector<uint32_t>> pendingSizes;
+            std::vector<bool> ready;
+            size_t next = 0;                             // First range not yet written
+            uint64_t written = 0;                        // Stream bytes after the chunk table
+            std::vector<uint32_t> sizes;                 // Chunk sizes of the written ranges
+        };
+
+        CopyOptions options;
+        Manifest manifest;
+        std::mutex manifestMutex;
+        CopyStats stats;
+        std::mutex errorMutex;
+        std::vector<std::wstring> errors;
+        std::atomic<uint64_t> files{ 0 }, directories{ 0 }, links{ 0 }, bytes{ 0 }, chunks{ 0 }, fastCopies{ 0 }, failures{ 0 };
+        std::atomic<uint64_t> compressedFiles{ 0 }, compressedBytes{ 0 }, resumedFiles{ 0 }, resumedBytes{ 0 }, clusters{ 0 };
+        std::atomic<bool> cloneSupported{ true }, rangeSupported{ true };
+        std::vector<PlannedFile> planned;
+        std::vector<PlannedFile> cluster;                       // Batched: small files of one directory, not yet queued
+        uint64_t clusterBytes = 0;
+        std::mutex finishedMutex;
+        std::vector<FinishedFile> finished;                     // Batched: waiting for the metadata pass
+        ReadPlanStats plan;
+        double metadataSeconds = 0;
+
+        void Fail(const std::wstring& message) {
+            failures++;
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errors.push_back(message);
+        }
+
+        void Advance(bool last = false) {
+            if (options.progress) options.progress->Advance(STAGE_COPY, bytes.load(), files.load(), 0, last);
+        }
+
+        void Walk(const std::filesystem::path& source, const std::filesystem::path& destination,
+                  WorkStealingPool& pool, BufferPool& buffers) {
+            std::error_code ec;
+            auto it = std::filesystem::recursive_directory_iterator(source, std::filesystem::directory_options::skip_permission_denied, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                std::filesystem::path relative = it->path().lexically_relative(source);
+                if (PathListed(relative, options.excludes) || (options.manifest && relative == Manifest::FILE_NAME)
+                    || relative == Journal::FILE_NAME) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                std::filesystem::path target = destination / relative;
+                std::error_code entryError;
+                if (it->is_symlink(entryError)) {
+                    // Copied as a link, never followed: a junction loop must not copy the disk twice
+                    std::filesystem::remove(target, entryError);
+                    std::filesystem::copy_symlink(it->path(), target, entryError);
+                    if (entryError) Fail(L"Cannot copy link " + it->path().wstring());
+                    else links++;
+                    it.disable_recursion_pending();
+                }
+                else if (it->is_directory(entryError)) {
+                    std::filesystem::create_directory(target, entryError);
+                    if (entryError) {
+                        Fail(L"Cannot create " + target.wstring());
+                        it.disable_recursion_pending();
+                    }
+                    else {
+                        directories++;
+                    }
+                }
+                else if (it->is_regular_file(entryError)) {
+                    uint64_t size = it->file_size(entryError);
+                    std::string key = options.manifest || options.journal ? Manifest::Key(relative) : std::string();
+                    if (Resume(it->path(), target, key, size)) continue;
+                    PlannedFile file{ it->path(), target, relative, size, std::move(key) };
+                    if (options.ordered) planned.push_back(std::move(file));
+                    else if (options.batched) Cluster(std::move(file), pool, buffers);
+                    else Dispatch(file, pool, buffers);
+                }
+            }
+            if (ec) Fail(L"Directory walk failed below " + source.wstring());
+            SubmitCluster(pool, buffers);
+        }
+
+        // Small files of one directory go to a worker together, up to readAhead bytes, so its
+        // entries on the target are written in one burst; large and compressed files are
+        // split into chunks as usual
+        void Cluster(PlannedFile file, WorkStealingPool& pool, BufferPool& buffers) {
+            if (file.size > options.largeFileThreshold || Compressible(file.relative, file.size)) {
+                Dispatch(file, pool, buffers);
+                return;
+            }
+            if (!cluster.empty() && (cluster.front().destination.parent_path() != file.destination.parent_path()
+                || clusterBytes + file.size > options.readAhead || cluster.size() >= CLUSTER_FILES)) {
+                SubmitCluster(pool, buffers);
+            }
+            clusterBytes += file.size;
+            cluster.push_back(std::move(file));
+        }
+
+        void SubmitCluster(WorkStealingPool& pool, BufferPool& buffers) {
+            if (cluster.empty()) return;
+            clusters++;
+            pool.Submit([this, &buffers, group = std::move(cluster)] {
+                for (const PlannedFile& file : group) CopySmall(file.source, file.destination, file.key, buffers);
+            });
+            cluster.clear();
+            clusterBytes = 0;
+        }
+
+        // Times, attributes and ACLs of every copied file, then its journal and manifest
+        // entries, which must not claim a file before its metadata is on the target
+        void ApplyMetadata(WorkStealingPool& pool) {
+            TraceScope scope("copy.metadata-pass", "copy");
+            auto start = std::chrono::steady_clock::now();
+            for (size_t first = 0; first < finished.size(); first += 256) {
+                pool.Submit([this, first] {
+                    for (size_t i = first; i < std::min(finished.size(), first + 256); ++i) {
+                        FinishedFile& file = finished[i];
+                        CopyMetadata(file.source, file.destination);
+                        Done(file.source, file.destination, file.key, file.size, std::move(file.hashes));
+                    }
+                });
+            }
+            pool.Wait();
+            finished.clear();
+            metadataSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void Dispatch(PlannedFile& file, WorkStealingPool& pool, BufferPool& buffers) {
+            if (Compressible(file.relative, file.size)) QueueCompressed(file.source, file.destination, file.size, std::move(file.key), pool, buffers);
+            else if (file.size > options.largeFileThreshold) QueueChunks(file.source, file.destination, file.size, std::move(file.key), pool, buffers);
+            else pool.Submit([this, &buffers, from = file.source, to = file.destination, key = std::move(file.key)] { CopySmall(from, to, key, buffers); });
+        }
+
+        // One task per worker, each taking the next batch in disk order until none are left:
+        // its extents are prefetched, then the files it completes are copied. Large and
+        // compressed ones queue their chunks as usual, which run once the batches are done;
+        // small files are copied right there, batched a directory at a time.
+        void CopyOrdered(WorkStealingPool& pool, BufferPool& buffers) {
+            std::vector<std::filesystem::path> sources;
+            std::vector<uint64_t> sizes;
+            for (const auto& file : planned) {
+                sources.push_back(file.source);
+                sizes.push_back(file.size);
+            }
+            ReadPlanOptions planOptions;
+            planOptions.threads = options.threads;
+            planOptions.readAhead = options.readAhead;
+            ReadPlanner planner(planOptions);
+            std::vector<ReadBatch> batches = planner.Plan(sources, sizes);
+            plan = planner.Stats();
+
+            std::atomic<size_t> next{ 0 };
+            for (size_t i = 0; i < pool.Threads(); ++i) {
+                pool.Submit([&] {
+                    for (size_t b; (b = next++) < batches.size();) {
+                        for (const ReadExtent& extent : batches[b].prefetch) {
+                            File input;
+                            if (input.Open(planned[extent.file].source, File::READ)) input.Prefetch(extent.offset, extent.length);
+                        }
+                        std::vector<size_t> small;
+                        for (size_t file : batches[b].files) {
+                            PlannedFile& entry = planned[file];
+                            if (entry.size > options.largeFileThreshold || Compressible(entry.relative, entry.size)) Dispatch(entry, pool, buffers);
+                            else small.push_back(file);
+                        }
+                        if (options.batched) clusters += GroupByDirectory(small);
+                        for (size_t file : small) CopySmall(planned[file].source, planned[file].destination, planned[file].key, buffers);
+                    }
+                });
+            }
+            pool.Wait();
+            planned.clear();
+        }
+
+        // Neighbours on disk need not share a directory; the already prefetched files of a
+        // batch are reordered so each directory's go out back to back, directories in the
+        // order they first appear. Returns how many runs that makes.
+        size_t GroupByDirectory(std::vector<size_t>& files) const {
+            std::unordered_map<std::filesystem::path::string_type, size_t> rank;
+            std::vector<std::pair<size_t, size_t>> keyed;
+            for (size_t file : files) keyed.emplace_back(rank.emplace(planned[file].destination.parent_path().native(), rank.size()).first->second, file);
+            std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (size_t i = 0; i < keyed.size(); ++i) files[i] = keyed[i].second;
+            return rank.size();
+        }
+
+        void CopySmall(const std::filesystem::path& source, const std::filesystem::path& destination, const std::string& key,
+                       BufferPool& buffers) {
+            File input, output;
+            if (!input.Open(source, File::READ) || !output.Open(destination, File::WRITE)) {
+                Fail(L"Cannot copy " + source.wstring());
+                return;
+            }
+            uint64_t size = input.Size();
+            bool cloned = size > 0 && TryClone(input, output);
+            if (!cloned && options.preallocate) output.Allocate(size);
+            if (cloned || (size > 0 && TryCopyRange(input, output, 0, size))) {
+                output.Close();
+                bytes += size;
+                files++;
+                Advance();
+                Finish(source, destination, key, size, {});
+                return;
+            }
+            BufferPool::Lease buffer = buffers.Acquire();
+            std::vector<uint64_t> hashes;
+            uint64_t offset = 0;
+            for (;;) {
+                size_t got = 0;
+                if (!Read(input, buffer.Data(), buffer.Size(), offset, got)) {
+                    Fail(L"Read failed: " + source.wstring());
+                    return;
+                }
+                if (got == 0) break;
+                if (!Write(output, buffer.Data(), got, offset)) {
+                    Fail(L"Write failed: " + destination.wstring());
+                    return;
+                }
+                if (options.manifest) hashes.push_back(ContentHash(options.hash, buffer.Data(), got));
+                offset += got;
+                if (got < buffer.Size()) break;
+            }
+            output.Close();
+            bytes += offset;
+            files++;
+            Advance();
+            Finish(source, destination, key, offset, std::move(hashes));
+        }
+
+        void QueueChunks(const std::filesystem::path& source, const std::filesystem::path& destination, uint64_t size,
+                         std::string key, WorkStealingPool& pool, BufferPool& buffers) {
+            auto file = std::make_shared<LargeFile>();
+            file->source = source;
+            file->destination = destination;
+            file->key = std::move(key);
+            file->size = size;
+            size_t count = static_cast<size_t>((size + options.chunkSize - 1) / options.chunkSize);
+            if (options.manifest) file->hashes.resize(count);
+
+            // Chunks an interrupted run finished, if the target is still the one it was writing
+            std::vector<bool> done(count);
+            size_t missing = count;
+            uint64_t finishedBytes = 0;
+            if (options.journal) {
+                std::error_code ec;
+                file->sourceTime = Manifest::Time(std::filesystem::last_write_time(source, ec));
+                auto finished = options.journal->Chunks(file->key, size, file->sourceTime);
+                if (!finished.empty() && std::filesystem::file_size(destination, ec) == size && !ec) {
+                    for (const auto& [offset, chunk] : finished) {
+                        size_t index = static_cast<size_t>(offset / options.chunkSize);
+                        uint64_t length = std::min<uint64_t>(options.chunkSize, size - std::min(offset, size));
+                        if (offset % options.chunkSize != 0 || index >= count || chunk.length != length) continue;
+                        if (options.manifest && chunk.hash != static_cast<uint8_t>(options.hash)) continue;
+                        if (options.manifest) file->hashes[index] = chunk.value;
+                        done[index] = true;
+                        missing--;
+                        finishedBytes += length;
+                    }
+                }
+            }
+            bool resuming = missing < count;
+            if (!file->input.Open(source, File::READ) || !file->output.Open(destination, resuming ? File::UPDATE : File::WRITE)) {
+                Fail(L"Cannot copy " + source.wstring());
+                return;
+            }
+            if (!resuming && TryClone(file->input, file->output)) {
+                file->input.Close();
+                file->output.Close();
+                bytes += size;
+                files++;
+                Advance();
+                Finish(source, destination, file->key, size, {});
+                return;
+            }
+            if (!resuming && options.preallocate) file->output.Allocate(size);
+            if (!resuming && !file->output.Resize(size)) {
+                Fail(L"Cannot preallocate " + destination.wstring());
+                return;
+            }
+            resumedBytes += finishedBytes;
+            bytes += finishedBytes;
+            file->remaining = missing;
+            if (missing == 0) {
+                FinishLarge(*file);
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (done[i]) continue;
+                uint64_t offset = static_cast<uint64_t>(i) * options.chunkSize;
+                size_t length = static_cast<size_t>(std::min<uint64_t>(options.chunkSize, size - offset));
+                pool.Submit([this, &buffers, file, offset, length] { CopyChunk(*file, offset, length, buffers); });
+            }
+        }
+
+        void CopyChunk(LargeFile& file, uint64_t offset, size_t length, BufferPool& buffers) {
+            if (!file.failed && TryCopyRange(file.input, file.output, offset, length)) {
+                bytes += length;
+                chunks++;
+                if (options.journal) options.journal->RecordChunk(file.key, file.size, file.sourceTime, offset, { static_cast<uint32_t>(length), Journal::NO_HASH, 0 });
+            }
+            else if (!file.failed) {
+                BufferPool::Lease buffer = buffers.Acquire();
+                size_t got = 0;
+                if (!Read(file.input, buffer.Data(), length, offset, got) || got != length
+                    || !Write(file.output, buffer.Data(), length, offset)) {
+                    file.failed = true;
+                }
+                else {
+                    uint64_t hash = options.manifest ? ContentHash(options.hash, buffer.Data(), length) : 0;
+                    if (options.manifest) file.hashes[offset / options.chunkSize] = hash;
+                    bytes += length;
+                    chunks++;
+                    if (options.journal) {
+                        options.journal->RecordChunk(file.key, file.size, file.sourceTime, offset,
+                                                     { static_cast<uint32_t>(length), options.manifest ? static_cast<uint8_t>(options.hash) : Journal::NO_HASH, hash });
+                    }
+                }
+            }
+            Advance();
+            if (--file.remaining > 0) return;
+            FinishLarge(file);
+        }
+
+        void FinishLarge(LargeFile& file) {
+            file.input.Close();
+            file.output.Close();
+            if (file.failed) {
+                Fail(L"Copy failed: " + file.source.wstring());
+                return;
+            }
+            files++;
+            Finish(file.source, file.destination, file.key, file.size, std::move(file.hashes));
+        }
+
+        bool Compressible(const std::filesystem::path& relative, uint64_t size) const {
+            if (options.compression == WOF_NONE || size <= options.compressThreshold) return false;
+            for (std::filesystem::path path = relative; !path.empty(); path = path.parent_path()) {
+                if (PathListed(path, options.uncompressed)) return false;
+                if (path == path.parent_path()) break;
+            }
+            return true;
+        }
+
+        // A file of one range is opened and compressed by a single task, like a small copy
+        void QueueCompressed(const std::filesystem::path& source, const std::filesystem::path& destination, uint64_t size,
+                             std::string key, WorkStealingPool& pool, BufferPool& buffers) {
+            auto file = std::make_shared<CompressedFile>();
+            file->source = source;
+            file->destination = destination;
+            file->key = std::move(key);
+            file->size = size;
+            size_t count = static_cast<size_t>((size + options.chunkSize - 1) / options.chunkSize);
+            file->remaining = count;
+            file->pending.resize(count);
+            file->pendingSizes.resize(count);
+            file->ready.resize(count);
+            if (options.manifest) file->hashes.resize(count);
+            if (count == 1) {
+                pool.Submit([this, &buffers, file] {
+                    if (OpenCompressed(*file)) CompressChunk(*file, 0, static_cast<size_t>(file->size), buffers);
+                });
+                return;
+            }
+            if (!OpenCompressed(*file)) return;
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t offset = static_cast<uint64_t>(i) * options.chunkSize;
+                size_t length = static_cast<size_t>(std::min<uint64_t>(options.chunkSize, size - offset));
+                pool.Submit([this, &buffers, file, offset, length] { CompressChunk(*file, offset, length, buffers); });
+            }
+        }
+
+        bool OpenCompressed(CompressedFile& file) {
+            if (!file.input.Open(file.source, File::READ)) {
+                Fail(L"Cannot copy " + file.source.wstring());
+                return false;
+            }
+            if (!file.output.Open(file.destination, options.compression, file.size)) {
+                Fail(file.output.Error());
+                return false;
+            }
+            return true;
+        }
+
+        // Each worker keeps its own encoders and match finder tables
+        static WofCodec& Codec() {
+            static thread_local WofCodec codec;
+            return codec;
+        }
+
+        void CompressChunk(CompressedFile& file, uint64_t offset, size_t length, BufferPool& buffers) {
+            size_t index = static_cast<size_t>(offset / options.chunkSize);
+            if (!file.failed) {
+                BufferPool::Lease buffer = buffers.Acquire();
+                size_t got = 0;
+                if (!Read(file.input, buffer.Data(), length, offset, got) || got != length) {
+                    file.failed = true;
+                }
+                else {
+                    if (options.manifest) file.hashes[index] = ContentHash(options.hash, buffer.Data(), length);
+                    std::vector<uint8_t> packed;
+                    std::vector<uint32_t> sizes;
+                    {
+                        TraceScope scope("copy.compress", "copy");
+                        scope.Bytes(length);
+                        Codec().Compress(options.compression, buffer.Data(), length, packed, sizes);
+                    }
+                    bytes += length;
+                    chunks++;
+                    Deliver(file, index, std::move(packed), std::move(sizes));
+                }
+            }
+            Advance();
+            if (--file.remaining > 0) return;
+
+            file.input.Close();
+            uint64_t stored = 0;
+            if (!file.failed) {
+                std::vector<uint8_t> table = WofCodec::Table(options.compression, file.size, file.sizes);
+                stored = table.size() + file.written;
+                if (!file.output.WriteAt(table.data(), table.size(), 0) || !file.output.Commit()) file.failed = true;
+            }
+            if (file.failed) {
+                file.output.Abort();
+                Fail(L"Copy failed: " + file.source.wstring() + (file.output.Error().empty() ? L"" : L": " + file.output.Error()));
+                return;
+            }
+            files++;
+            compressedFiles++;
+            compressedBytes += stored;
+            Finish(file.source, file.destination, file.key, file.size, std::move(file.hashes));
+        }
+
+        // Parks a compressed range and writes out every range that is now next in line
+        void Deliver(CompressedFile& file, size_t index, std::vector<uint8_t> packed, std::vector<uint32_t> sizes) {
+            std::lock_guard<std::mutex> lock(file.mutex);
+            file.pending[index] = std::move(packed);
+            file.pendingSizes[index] = std::move(sizes);
+            file.ready[index] = true;
+            size_t tableSize = WofCodec::TableSize(options.compression, file.size);
+            for (; file.next < file.ready.size() && file.ready[file.next]; ++file.next) {
+                std::vector<uint8_t>& data = file.pending[file.next];
+                if (!file.failed) {
+                    TraceScope scope("copy.write", "copy");
+                    scope.Bytes(data.size());
+                    if (!file.output.WriteAt(data.data(), data.size(), tableSize + file.written)) file.failed = true;
+                }
+                file.written += data.size();
+                file.sizes.insert(file.sizes.end(), file.pendingSizes[file.next].begin(), file.pendingSizes[file.next].end());
+                std::vector<uint8_t>().swap(data);
+                std::vector<uint32_t>().swap(file.pendingSizes[file.next]);
+            }
+        }
+
+        // A file listed in the journal is taken as copied if its source has not changed since and
+        // the target is still there; its chunk hashes go into the manifest as if just computed
+        bool Resume(const std::filesystem::path& source, const std::filesystem::path& destination, const std::string& key, uint64_t size) {
+            const JournalFile* entry = options.journal ? options.journal->FileDone(key) : nullptr;
+            if (!entry || entry->size != size) return false;
+            std::error_code ec;
+            if (entry->sourceTime != Manifest::Time(std::filesystem::last_write_time(source, ec)) || ec) return false;
+            if (!std::filesystem::is_regular_file(destination, ec)) return false;
+            if (options.manifest) {
+                if (entry->hash != static_cast<uint8_t>(options.hash) || entry->chunks.size() != (size + options.chunkSize - 1) / options.chunkSize) return false;
+                Record(source, destination, key, size, entry->chunks);
+            }
+            resumedFiles++;
+            resumedBytes += size;
+            bytes += size;
+            files++;
+            Advance();
+            return true;
+        }
+
+        // A file's data is on the target: its metadata follows now, or in the metadata pass
+        void Finish(const std::filesystem::path& source, const std::filesystem::path& destination, const std::string& key,
+                    uint64_t size, std::vector<uint64_t> hashes) {
+            if (!options.batched) {
+                CopyMetadata(source, destination);
+                Done(source, destination, key, size, std::move(hashes));
+                return;
+            }
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push_back(FinishedFile{ source, destination, key, size, std::move(hashes) });
+        }
+
+        // Everything about a file is on the target: tell the journal and the manifest
+        void Done(const std::filesystem::path& source, const std::filesystem::path& destination, const std::string& key,
+                  uint64_t size, std::vector<uint64_t> hashes) {
+            if (options.journal) {
+                JournalFile entry;
+                std::error_code ec;
+                entry.size = size;
+                entry.sourceTime = Manifest::Time(std::filesystem::last_write_time(source, ec));
+                entry.hash = options.manifest ? static_cast<uint8_t>(options.hash) : Journal::NO_HASH;
+                if (options.manifest) entry.chunks = hashes;
+                if (!ec) options.journal->RecordFile(key, entry);
+            }
+            if (options.manifest) Record(source, destination, key, size, std::move(hashes));
+        }
+
+        // Times are read back after CopyMetadata, so the entry matches what a resync will see
+        void Record(const std::filesystem::path& source, const std::filesystem::path& destination, const std::string& key,
+                    uint64_t size, std::vector<uint64_t> hashes) {
+            ManifestEntry entry;
+            std::error_code ec;
+            entry.size = size;
+            entry.sourceTime = Manifest::Time(std::filesystem::last_write_time(source, ec));
+            if (!ec) entry.targetTime = Manifest::Time(std::filesystem::last_write_time(destination, ec));
+            if (ec) return;
+            entry.chunks = std::move(hashes);
+            std::lock_guard<std::mutex> lock(manifestMutex);
+            manifest.Set(key, std::move(entry));
+        }
+
+        static bool Read(File& file, uint8_t* data, size_t length, uint64_t offset, size_t& got) {
+            TraceScope scope("copy.read", "copy");
+            bool ok = file.ReadAt(data, length, offset, got);
+            scope.Bytes(got);
+            return ok;
+        }
+
+        static bool Write(File& file, const uint8_t* data, size_t length, uint64_t offset) {
+            TraceScope scope("copy.write", "copy");
+            scope.Bytes(length);
+            return file.WriteAt(data, length, offset);
+        }
+
+        bool TryClone(File& input, File& output) {
+            if (!cloneSupported) return false;
+            TraceScope scope("copy.clone", "copy");
+            FastCopyResult result = FastCopy::Clone(input, output);
+            if (result == FAST_COPY_UNSUPPORTED) cloneSupported = false;
+            if (result == FAST_COPY_DONE) fastCopies++;
+            return result == FAST_COPY_DONE;
+        }
+
+        bool TryCopyRange(File& input, File& output, uint64_t offset, uint64_t length) {
+            if (!rangeSupported) return false;
+            TraceScope scope("copy.range", "copy");
+            scope.Bytes(length);
+            FastCopyResult result = FastCopy::CopyRange(input, output, offset, length);
+            if (result == FAST_COPY_UNSUPPORTED) rangeSupported = false;
+            if (result == FAST_COPY_DONE) fastCopies++;
+            return result == FAST_COPY_DONE;
+        }
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include "../hash/content_hash.h"
+
+// What the resync engine knows about one file it wrote: the source size and time it was
+// copied from, the time the target ended up with (read back, so FAT's 2 s granularity
+// compares equal next run) and the hash of every chunk as it is on the target.
+struct ManifestEntry {
+    uint64_t size = 0;
+    int64_t sourceTime = 0;
+    int64_t targetTime = 0;
+    std::vector<uint64_t> chunks;
+};
+
+// The file list kept at the root of a copied or resynced target, keyed by the generic UTF-8
+// path relative to the root. Binary, little endian:
+//   "WTGMANI1", u32 version, u32 chunk size, u32 hash kind, u32 reserved, u64 entry count
+//   per entry: u32 path length, path, u64 size, i64 source time, i64 target time,
+//              u32 chunk count, u64 chunk hashes
+//   u64 XXH64 of everything before it
+// A manifest that fails any check is treated as absent, which only costs a slower resync.
+class Manifest {
+
+    public:
+
+        static constexpr const char* FILE_NAME = ".wtg_manifest";
+        static constexpr uint32_t VERSION = 2;
+
+        explicit Manifest(uint32_t chunk = 1 << 20, HashKind kind = HASH_XXH64) : chunkSize(chunk), hash(kind) {}
+
+        static std::string Key(const std::filesystem::path& relative) {
+            auto text = relative.generic_u8string();
+            return std::string(reinterpret_cast<const char*>(text.data()), text.size());
+        }
+
+        static int64_t Time(std::filesystem::file_time_type time) {
+            return static_cast<int64_t>(time.time_since_epoch().count());
+        }
+
+        // Empty manifest with the same chunk size if the file is missing or does not check out
+        bool Load(const std::filesystem::path& path) { return Load(path, false); }
+
+        // Takes chunk size and hash kind from the file, for a verify pass
+        bool LoadAny(const std::filesystem::path& path) { return Load(path, true); }
+
+        bool Load(const std::filesystem::path& path, bool any) {
+            entries.clear();
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                error = L"No manifest at " + path.wstring();
+                return false;
+            }
+            std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!Parse(image.data(), image.size(), any)) {
+                entries.clear();
+                return false;
+            }
+            return true;
+        }
+
+        // Replaces the file through a temporary so an unplugged stick keeps the old manifest
+        bool Save(const std::filesystem::path& path) {
+            std::vector<uint8_t> image = Serialize();
+            std::filesystem::path temp = path;
+            temp += L".tmp";
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                if (!file.write(reinterpret_cast<const char*>(image.data()), image.size()) || !file.flush()) {
+                    error = L"Cannot write manifest " + temp.wstring();
+                    return false;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(temp, path, ec);
+            if (ec) {
+                std::filesystem::remove(temp, ec);
+                error = L"Cannot replace manifest " + path.wstring();
+                return false;
+            }
+            return true;
+        }
+
+        const ManifestEntry* Find(const std::string& key) const {
+            auto it = entries.find(key);
+            return it == entries.end() ? nullptr : &it->second;
+        }
+
+        void Set(const std::string& key, ManifestEntry entry) { entries[key] = std::move(entry); }
+
+        uint32_t ChunkSize() const { return chunkSize; }
+        HashKind Hash() const { return hash; }
+        size_t Size() const { return entries.size(); }
+        const std::unordered_map<std::string, ManifestEntry>& Entries() const { return entries; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        uint32_t chunkSize;
+        HashKind hash;
+        std::unordered_map<std::string, ManifestEntry> entries;
+        std::wstring error;
+
+        bool Parse(const uint8_t* image, size_t size, bool any) {
+            if (size < 40 || std::memcmp(image, "WTGMANI1", 8) != 0) {
+                error = L"Not a manifest";
+                return false;
+            }
+            if (Get<uint64_t>(image + size - 8) != XxHash64::Hash(image, size - 8)) {
+                error = L"Manifest checksum mismatch";
+                return false;
+            }
+            uint32_t chunk = Get<uint32_t>(image + 12);
+            uint32_t kind = Get<uint32_t>(image + 16);
+            if (Get<uint32_t>(image + 8) != VERSION || chunk == 0 || kind > HASH_CRC32C) {
+                error = L"Unsupported manifest version";
+                return false;
+            }
+            if (any) {
+                chunkSize = chunk;
+                hash = static_cast<HashKind>(kind);
+            }
+            else if (chunk != chunkSize || kind != static_cast<uint32_t>(hash)) {
+                error = L"Manifest chunk size or hash differs";
+                return false;
+            }
+            uint64_t count = Get<uint64_t>(image + 24);
+            size_t end = size - 8, at = 32;
+            for (uint64_t i = 0; i < count; ++i) {
+                if (end - at < 4) return Truncated();
+                uint32_t length = Get<uint32_t>(image + at);
+                at += 4;
+                if (end - at < static_cast<uint64_t>(length) + 28) return Truncated();
+                std::string key(reinterpret_cast<const char*>(image + at), length);
+                at += length;
+                ManifestEntry entry;
+                entry.size = Get<uint64_t>(image + at);
+                entry.sourceTime = Get<int64_t>(image + at + 8);
+                entry.targetTime = Get<int64_t>(image + at + 16);
+                uint32_t chunks = Get<uint32_t>(image + at + 24);
+                at += 28;
+                if ((end - at) / 8 < chunks) return Truncated();
+                entry.chunks.resize(chunks);
+                for (uint32_t c = 0; c < chunks; ++c, at += 8) entry.chunks[c] = Get<uint64_t>(image + at);
+                entries[std::move(key)] = std::move(entry);
+            }
+            return true;
+        }
+
+        std::vector<uint8_t> Serialize() const {
+            std::vector<uint8_t> image(8);
+            std::memcpy(image.data(), "WTGMANI1", 8);
+            Put(image, VERSION);
+            Put(image, chunkSize);
+            Put(image, static_cast<uint32_t>(hash));
+            Put(image, static_cast<uint32_t>(0));
+            Put(image, static_cast<uint64_t>(entries.size()));
+            for (const auto& [key, entry] : entries) {
+                Put(image, static_cast<uint32_t>(key.size()));
+                image.insert(image.end(), key.begin(), key.end());
+                Put(image, entry.size);
+                Put(image, entry.sourceTime);
+                Put(image, entry.targetTime);
+                Put(image, static_cast<uint32_t>(entry.chunks.size()));
+                for (uint64_t hash : entry.chunks) Put(image, hash);
+            }
+            Put(image, XxHash64::Hash(image.data(), image.size()));
+            return image;
+        }
+
+        bool Truncated() {
+            error = L"Manifest is truncated";
+            return false;
+        }
+
+        template <typename T>
+        static T Get(const uint8_t* p) {
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); ++i) value |= static_cast<T>(static_cast<uint64_t>(p[i]) << (8 * i));
+            return value;
+        }
+
+        template <typename T>
+        static void Put(std::vector<uint8_t>& image, T value) {
+            for (size_t i = 0; i < sizeof(T); ++i) image.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef _MANIFEST_VERIFIER_H_
+#define _MANIFEST_VERIFIER_H_
+#include <chrono>
+#include <memory>
+#include <string>
+#include "buffer_pool.h"
+#include "manifest.h"
+#include "work_pool.h"
+#include "../platform/file.h"
+#include "../progress/progress_channel.h"
+#include "../trace/tracer.h"
+
+struct VerifyOptions {
+    size_t threads = 0;                                  // 0 = one per hardware thread
+    uint64_t segmentSize = 64ULL << 20;                  // Unit of work, large files are split into segments
+    size_t maxBufferMemory = 256 << 20;                  // Cap on data in flight
+    bool direct = true;                                  // Read around the page cache, or a verify right after
+                                                         // the copy only checks memory
+    ProgressChannel* progress = nullptr;                 // Gets STAGE_VERIFY counters against the manifest total
+};
+
+struct VerifyStats {
+    uint64_t files = 0;
+    uint64_t chunks = 0;
+    uint64_t bytes = 0;
+    uint64_t corrupt = 0;                                // Files with a chunk that does not match
+    uint64_t missing = 0;                                // Files gone, unreadable or of the wrong size
+    double seconds = 0;
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files, " + std::to_wstring(bytes / 1000000) + L" MB verified in "
+            + std::to_wstring(seconds) + L" s (" + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s), "
+            + std::to_wstring(corrupt) + L" corrupt, " + std::to_wstring(missing) + L" missing";
+    }
+};
+
+// Re-reads a target against the manifest its copy left behind, with the files split into
+// segments over a work-stealing pool like the copy itself. Reads are unbuffered where the
+// filesystem allows, so it checks what the stick returns, not the cache. Failed files are
+// collected as paths relative to the root so a caller can copy them again.
+class ManifestVerifier {
+
+    public:
+
+        explicit ManifestVerifier(const VerifyOptions& verifyOptions = VerifyOptions()) : options(verifyOptions) {}
+        ~ManifestVerifier() = default;
+
+        bool Run(const std::filesystem::path& root) {
+            stats = VerifyStats();
+            error.clear();
+            failed.clear();
+            files = chunks = bytes = corrupt = missing = 0;
+            auto start = std::chrono::steady_clock::now();
+
+            Manifest manifest;
+            if (!manifest.LoadAny(root / Manifest::FILE_NAME)) {
+                error = manifest.Error();
+                return false;
+            }
+            hash = manifest.Hash();
+            chunkSize = manifest.ChunkSize();
+            uint64_t segment = std::max<uint64_t>(options.segmentSize / chunkSize, 1) * chunkSize;
+            size_t bufferSize = (static_cast<size_t>(chunkSize) + BufferPool::ALIGNMENT - 1) / BufferPool::ALIGNMENT * BufferPool::ALIGNMENT;
+            BufferPool buffers(std::max<size_t>(1, options.maxBufferMemory / bufferSize), bufferSize);
+            total = 0;
+            for (const auto& entry : manifest.Entries()) total += entry.second.size;
+            {
+                WorkStealingPool pool(options.threads);
+                for (const auto& [key, entry] : manifest.Entries()) Queue(root, key, entry, segment, pool, buffers);
+                pool.Wait();
+            }
+            Advance(true);
+
+            stats.files = files;
+            stats.chunks = chunks;
+            stats.bytes = bytes;
+            stats.corrupt = corrupt;
+            stats.missing = missing;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return corrupt == 0 && missing == 0;
+        }
+
+        const VerifyStats& Stats() const { return stats; }
+        const std::vector<std::filesystem::path>& Failed() const { return failed; }
+        const std::wstring& Error() const { return error; }
+        uint32_t ChunkSize() const { return chunkSize; }
+        HashKind Hash() const { return hash; }
+
+    private:
+
+        // Shared by the segments of one file; the last one to finish reports it
+        struct Job {
+            File file;
+            std::string key;
+            const ManifestEntry* entry = nullptr;
+            std::atomic<size_t> remaining{ 0 };
+            std::atomic<bool> bad{ false };
+            std::atomic<bool> unreadable{ false };
+        };
+
+        VerifyOptions options;
+        VerifyStats stats;
+        std::wstring error;
+        HashKind hash = HASH_XXH64;
+        uint32_t chunkSize = 1 << 20;
+        uint64_t total = 0;
+        std::mutex failedMutex;
+        std::vector<std::filesystem::path> failed;
+        std::atomic<uint64_t> files{ 0 }, chunks{ 0 }, bytes{ 0 }, corrupt{ 0 }, missing{ 0 };
+
+        void Report(const std::string& key, bool unreadable) {
+            (unreadable ? missing : corrupt)++;
+            std::lock_guard<std::mutex> lock(failedMutex);
+            failed.push_back(std::filesystem::u8path(key));
+        }
+
+        void Advance(bool last = false) {
+            if (options.progress) options.progress->Advance(STAGE_VERIFY, bytes.load(), files.load(), total, last);
+        }
+
+        void Queue(const std::filesystem::path& root, const std::string& key, const ManifestEntry& entry, uint64_t segment,
+                   WorkStealingPool& pool, BufferPool& buffers) {
+            auto job = std::make_shared<Job>();
+            job->key = key;
+            job->entry = &entry;
+            std::filesystem::path path = root / std::filesystem::u8path(key);
+            bool opened = (options.direct && job->file.Open(path, File::READ, File::DIRECT)) || job->file.Open(path, File::READ);
+            if (!opened || job->file.Size() != entry.size || entry.chunks.size() != (entry.size + chunkSize - 1) / chunkSize) {
+                Report(key, true);
+                return;
+            }
+            size_t segments = static_cast<size_t>(std::max<uint64_t>(1, (entry.size + segment - 1) / segment));
+            job->remaining = segments;
+            for (size_t i = 0; i < segments; ++i) {
+                uint64_t offset = static_cast<uint64_t>(i) * segment;
+                uint64_t end = std::min<uint64_t>(entry.size, offset + segment);
+                pool.Submit([this, &buffers, job, offset, end] { VerifySegment(*job, offset, end, buffers); });
+            }
+        }
+
+        void VerifySegment(Job& job, uint64_t offset, uint64_t end, BufferPool& buffers) {
+            if (!job.bad && !job.unreadable) {
+                BufferPool::Lease buffer = buffers.Acquire();
+                for (uint64_t at = offset; at < end; at += chunkSize) {
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(chunkSize, end - at));
+                    // Unbuffered reads must be whole sectors; the tail of the file comes back short
+                    size_t request = (length + BufferPool::ALIGNMENT - 1) / BufferPool::ALIGNMENT * BufferPool::ALIGNMENT;
+                    size_t got = 0;
+                    bool read;
+                    {
+                        TraceScope scope("verify.read", "verify");
+                        scope.Bytes(length);
+                        read = job.file.ReadAt(buffer.Data(), request, at, got) && got >= length;
+                    }
+                    if (!read) {
+                        job.unreadable = true;
+                        break;
+                    }
+                    bytes += length;
+                    chunks++;
+                    Advance();
+                    if (ContentHash(hash, buffer.Data(), length) != job.entry->chunks[static_cast<size_t>(at / chunkSize)]) {
+                        job.bad = true;
+                        break;
+                    }
+                }
+            }
+            Advance();
+            if (--job.remaining > 0) return;
+
+            job.file.Close();
+            files++;
+            if (job.unreadable) Report(job.key, true);
+            else if (job.bad) Report(job.key, false);
+        }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef _READ_PLAN_H_
+#define _READ_PLAN_H_
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "work_pool.h"
+#include "../platform/extents.h"
+
+struct ReadPlanOptions {
+    size_t threads = 0;                    // Extent queries in parallel, 0 = one per hardware thread
+    uint64_t readAhead = 8ULL << 20;       // Extents are prefetched in batches of up to this many bytes
+    uint64_t gap = 1ULL << 20;             // ...no further apart on the disk than this
+};
+
+struct ReadPlanStats {
+    uint64_t files = 0;
+    uint64_t mapped = 0;                   // With data on the disk; the rest go last, in the order given
+    uint64_t fragmented = 0;               // More than one extent
+    uint64_t extents = 0;
+    uint64_t batches = 0;
+    uint64_t givenTravel = 0;              // Bytes the disk head moves between extents reading in the order given
+    uint64_t plannedTravel = 0;            // The same in planned order
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files (" + std::to_wstring(mapped) + L" mapped, " + std::to_wstring(fragmented)
+            + L" fragmented, " + std::to_wstring(extents) + L" extents) in " + std::to_wstring(batches) + L" batches; head travel "
+            + std::to_wstring(givenTravel / 1000000) + L" MB -> " + std::to_wstring(plannedTravel / 1000000) + L" MB, planned in "
+            + std::to_wstring(seconds) + L" s";
+    }
+};
+
+// A range of a file to prefetch; offset and length are in the file
+struct ReadExtent {
+    size_t file = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+// One step of a plan: extents next to each other on the disk, prefetched at once, and the
+// files whose last extent is among them, ready to be read from the cache. Indexes refer to
+// the list given to Plan().
+struct ReadBatch {
+    std::vector<ReadExtent> prefetch;
+    std::vector<size_t> files;
+    uint64_t bytes = 0;
+};
+
+// Schedules the reads of a list of files in disk order, so a copy of a live or mounted
+// volume reads it front to back instead of seeking for every file of a directory walk.
+// The extents of every file are gathered up front (FileExtents, in parallel) and sorted by
+// physical offset into batches of about readAhead bytes. A reader prefetches a batch in
+// one go, which the block layer merges into a few large reads, then copies the files it
+// completed; a fragmented file waits for the batch holding its last extent. Only the first
+// readAhead bytes of an extent are prefetched, large files are read in chunks anyway.
+// Files with no extent (resident, inline, or on a filesystem without the query) keep the
+// given order at the end. Planning only reads metadata; a file that cannot be mapped is
+// not an error.
+class ReadPlanner {
+
+    public:
+
+        explicit ReadPlanner(const ReadPlanOptions& planOptions = ReadPlanOptions()) : options(planOptions) {}
+
+        std::vector<ReadBatch> Plan(const std::vector<std::filesystem::path>& files, const std::vector<uint64_t>& sizes) {
+            stats = ReadPlanStats();
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::vector<FileExtent>> layouts(files.size());
+            {
+                WorkStealingPool pool(options.threads);
+                size_t slice = std::max<size_t>(1, files.size() / (pool.Threads() * 8));
+                for (size_t first = 0; first < files.size(); first += slice) {
+                    pool.Submit([&, first] {
+                        for (size_t i = first; i < std::min(files.size(), first + slice); ++i) {
+                            File file;
+                            if (!file.Open(files[i], File::READ) || !FileExtents::Query(file, layouts[i])) layouts[i].clear();
+                        }
+                    });
+                }
+                pool.Wait();
+            }
+
+            std::vector<Piece> pieces;
+            std::vector<size_t> remaining(files.size());
+            uint64_t previous = NONE;
+            for (size_t i = 0; i < files.size(); ++i) {
+                stats.files++;
+                stats.mapped += !layouts[i].empty();
+                stats.fragmented += layouts[i].size() > 1;
+                stats.extents += layouts[i].size();
+                remaining[i] = layouts[i].size();
+                for (const auto& extent : layouts[i]) {
+                    pieces.push_back(Piece{ extent.physical, i, extent.logical, extent.length });
+                    stats.givenTravel += Travel(previous, extent.physical);
+                    previous = extent.physical + extent.length;
+                }
+            }
+            std::sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b) { return a.physical < b.physical; });
+
+            std::vector<ReadBatch> batches;
+            previous = NONE;
+            for (const Piece& piece : pieces) {
+                uint64_t length = std::min(piece.length, options.readAhead);
+                if (batches.empty() || batches.back().bytes + length > options.readAhead || Travel(previous, piece.physical) > options.gap) {
+                    batches.emplace_back();
+                }
+                stats.plannedTravel += Travel(previous, piece.physical);
+                previous = piece.physical + piece.length;
+                batches.back().prefetch.push_back(ReadExtent{ piece.file, piece.logical, length });
+                batches.back().bytes += length;
+                if (--remaining[piece.file] == 0) batches.back().files.push_back(piece.file);
+            }
+            bool tail = false;
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (!layouts[i].empty()) continue;
+                uint64_t length = std::min(i < sizes.size() ? sizes[i] : 0, options.readAhead);
+                if (!tail || batches.back().bytes + length > options.readAhead) batches.emplace_back();
+                tail = true;
+                batches.back().prefetch.push_back(ReadExtent{ i, 0, length });
+                batches.back().files.push_back(i);
+                batches.back().bytes += length;
+            }
+            stats.batches = batches.size();
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return batches;
+        }
+
+        const ReadPlanStats& Stats() const { return stats; }
+
+    private:
+
+        struct Piece {
+            uint64_t physical;
+            size_t file;
+            uint64_t logical;
+            uint64_t length;
+        };
+
+        static constexpr uint64_t NONE = ~0ULL;
+
+        ReadPlanOptions options;
+        ReadPlanStats stats;
+
+        // Distance the head moves from the end of one extent to the start of the next
+        static uint64_t Travel(uint64_t from, uint64_t to) {
+            if (from == NONE) return 0;
+            return from > to ? from - to : to - from;
+        }
+};
+
+#endif
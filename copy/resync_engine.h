@@ -0,0 +1,388 @@
+#ifndef _RESYNC_ENGINE_H_
+#define _RESYNC_ENGINE_H_
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include "copy_engine.h"
+#include "manifest.h"
+
+struct ResyncOptions {
+    size_t threads = 0;                                  // 0 = one per hardware thread
+    uint32_t chunkSize = 1 << 20;                        // Unit of change detection for a target without a manifest
+    HashKind hash = HASH_XXH64;                          // Same, a stored manifest keeps its own chunk size and hash
+    uint64_t segmentSize = 64ULL << 20;                  // Unit of work, large files are split into segments
+    size_t maxBufferMemory = 256 << 20;                  // Cap on data in flight
+    bool deleteExtra = true;                             // Remove target entries the source no longer has
+    std::vector<std::wstring> excludes;                  // Paths relative to the source root, any case
+    ProgressChannel* progress = nullptr;                 // Gets STAGE_RESYNC counters (bytes read), rate limited
+};
+
+struct ResyncStats {
+    uint64_t files = 0;
+    uint64_t unchanged = 0;                              // Matched the manifest, not read at all
+    uint64_t updated = 0;                                // Rewritten chunk by chunk against the manifest or the target
+    uint64_t created = 0;                                // Not on the target before
+    uint64_t deleted = 0;
+    uint64_t directories = 0;
+    uint64_t links = 0;
+    uint64_t chunksSkipped = 0;
+    uint64_t chunksWritten = 0;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files (" + std::to_wstring(unchanged) + L" unchanged, " + std::to_wstring(updated)
+            + L" updated, " + std::to_wstring(created) + L" new, " + std::to_wstring(deleted) + L" deleted), "
+            + std::to_wstring(bytesWritten / 1000000) + L" MB written in " + std::to_wstring(seconds) + L" s";
+    }
+};
+
+// Brings a target previously written by it (or by a plain copy) up to date with the source
+// and writes only what changed. The manifest at the target root remembers, per file, the
+// source size and time it was copied from and the hash of every chunk on the target:
+//  - size and both times match: the file is skipped without being read
+//  - the target is untouched since the last run: the source is read and hashed, and only
+//    chunks whose hash differs from the manifest are written
+//  - anything else (no manifest, target edited): source and target are both read and only
+//    differing chunks are written, so a stick made by a full copy adopts cheaply
+// Reads are far cheaper than writes on usb flash, so a patch Tuesday that rewrites a few
+// hives and a slice of WinSxS costs those chunks plus a read of the changed files.
+// Change detection is by size and timestamp like robocopy /MIR; the hashes are XXH64 by
+// default, good against accidental change but not tampering. A manifest left by the copy
+// engine (CRC32C, probed chunk size) is taken as it is, so the first resync stays cheap.
+class ResyncEngine {
+
+    public:
+
+        explicit ResyncEngine(const ResyncOptions& resyncOptions = ResyncOptions()) : options(resyncOptions), configured(resyncOptions) {
+            Adopt(configured.chunkSize, configured.hash);
+        }
+        ~ResyncEngine() = default;
+
+        bool Run(const std::filesystem::path& source, const std::filesystem::path& destination) {
+            stats = ResyncStats();
+            errors.clear();
+            unchanged = updated = created = deleted = directories = links = 0;
+            chunksSkipped = chunksWritten = bytesRead = bytesWritten = failures = 0;
+            auto start = std::chrono::steady_clock::now();
+
+            std::error_code ec;
+            if (!std::filesystem::is_directory(source, ec)) {
+                Fail(L"Source is not a directory: " + source.wstring());
+                return false;
+            }
+            std::filesystem::create_directories(destination, ec);
+            if (ec) {
+                Fail(L"Cannot create " + destination.wstring());
+                return false;
+            }
+
+            std::filesystem::path manifestPath = destination / Manifest::FILE_NAME;
+            previous = Manifest(configured.chunkSize, configured.hash);
+            if (previous.LoadAny(manifestPath) && previous.ChunkSize() >= BufferPool::ALIGNMENT) Adopt(previous.ChunkSize(), previous.Hash());
+            else {
+                previous = Manifest(configured.chunkSize, configured.hash);
+                Adopt(configured.chunkSize, configured.hash);
+            }
+            current = Manifest(options.chunkSize, options.hash);
+            seen.clear();
+
+            // Each buffer holds a source chunk and the matching target chunk
+            size_t bufferCount = std::max<size_t>(1, options.maxBufferMemory / (2 * static_cast<size_t>(options.chunkSize)));
+            BufferPool buffers(bufferCount, 2 * static_cast<size_t>(options.chunkSize));
+            {
+                WorkStealingPool pool(options.threads);
+                Walk(source, destination, pool, buffers);
+                pool.Wait();
+            }
+            if (options.deleteExtra) DeleteExtra(destination);
+            if (!current.Save(manifestPath)) Fail(current.Error());
+            Advance(true);
+
+            stats.files = unchanged + updated + created;
+            stats.unchanged = unchanged;
+            stats.updated = updated;
+            stats.created = created;
+            stats.deleted = deleted;
+            stats.directories = directories;
+            stats.links = links;
+            stats.chunksSkipped = chunksSkipped;
+            stats.chunksWritten = chunksWritten;
+            stats.bytesRead = bytesRead;
+            stats.bytesWritten = bytesWritten;
+            stats.errors = failures;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return failures == 0;
+        }
+
+        const ResyncStats& Stats() const { return stats; }
+        const std::vector<std::wstring>& Errors() const { return errors; }
+        std::wstring Error() const { return errors.empty() ? std::wstring() : errors.front(); }
+
+    private:
+
+        // Chunk size and hash the hashes on the target are in, segments cut to whole chunks
+        void Adopt(uint32_t chunkSize, HashKind hash) {
+            options.chunkSize = std::max<uint32_t>(chunkSize, BufferPool::ALIGNMENT);
+            options.hash = hash;
+            options.segmentSize = std::max<uint64_t>(configured.segmentSize / options.chunkSize, 1) * options.chunkSize;
+        }
+
+        // One file being resynced; segments share it and the last one to finish records it
+        struct Job {
+            File input;
+            File output;
+            std::filesystem::path source;
+            std::filesystem::path destination;
+            std::string key;
+            ManifestEntry entry;                         // New state, chunk hashes filled in by the segments
+            std::vector<uint64_t> known;                 // Hashes the target chunks are known to have
+            uint64_t knownSize = 0;                      // Target size those hashes describe
+            bool compare = false;                        // No trusted hashes, read the target chunks instead
+            bool existed = false;
+            std::atomic<size_t> remaining{ 0 };
+            std::atomic<bool> failed{ false };
+        };
+
+        ResyncOptions options;                           // What this run uses
+        ResyncOptions configured;                        // As given, for targets without a usable manifest
+        ResyncStats stats;
+        Manifest previous;
+        Manifest current;
+        std::mutex manifestMutex;
+        std::unordered_set<std::string> seen;            // Every source entry, for DeleteExtra
+        std::mutex errorMutex;
+        std::vector<std::wstring> errors;
+        std::atomic<uint64_t> unchanged{ 0 }, updated{ 0 }, created{ 0 }, deleted{ 0 }, directories{ 0 }, links{ 0 };
+        std::atomic<uint64_t> chunksSkipped{ 0 }, chunksWritten{ 0 }, bytesRead{ 0 }, bytesWritten{ 0 }, failures{ 0 };
+
+        void Fail(const std::wstring& message) {
+            failures++;
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errors.push_back(message);
+        }
+
+        void Advance(bool last = false) {
+            if (options.progress) options.progress->Advance(STAGE_RESYNC, bytesRead.load(), unchanged + updated + created, 0, last);
+        }
+
+        bool Excluded(const std::filesystem::path& relative) const {
+            return relative == Manifest::FILE_NAME || relative == Journal::FILE_NAME || PathListed(relative, options.excludes);
+        }
+
+        void Walk(const std::filesystem::path& source, const std::filesystem::path& destination,
+                  WorkStealingPool& pool, BufferPool& buffers) {
+            std::error_code ec;
+            auto it = std::filesystem::recursive_directory_iterator(source, std::filesystem::directory_options::skip_permission_denied, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                std::filesystem::path relative = it->path().lexically_relative(source);
+                if (Excluded(relative)) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                seen.insert(Manifest::Key(relative));
+                std::filesystem::path target = destination / relative;
+                std::error_code entryError;
+                auto existing = std::filesystem::symlink_status(target, entryError);
+                if (it->is_symlink(entryError)) {
+                    it.disable_recursion_pending();
+                    auto link = std::filesystem::read_symlink(it->path(), entryError);
+                    std::error_code targetError;
+                    if (std::filesystem::is_symlink(existing) && std::filesystem::read_symlink(target, targetError) == link && !targetError) {
+                        continue;
+                    }
+                    std::filesystem::remove_all(target, entryError);
+                    std::filesystem::copy_symlink(it->path(), target, entryError);
+                    if (entryError) Fail(L"Cannot copy link " + it->path().wstring());
+                    else links++;
+                }
+                else if (it->is_directory(entryError)) {
+                    if (std::filesystem::exists(existing) && !std::filesystem::is_directory(existing)) {
+                        std::filesystem::remove(target, entryError);
+                    }
+                    std::filesystem::create_directory(target, entryError);
+                    if (entryError) {
+                        Fail(L"Cannot create " + target.wstring());
+                        it.disable_recursion_pending();
+                    }
+                    else {
+                        directories++;
+                    }
+                }
+                else if (it->is_regular_file(entryError)) {
+                    if (std::filesystem::exists(existing) && !std::filesystem::is_regular_file(existing)) {
+                        std::filesystem::remove_all(target, entryError);
+                        existing = std::filesystem::file_status(std::filesystem::file_type::not_found);
+                    }
+                    QueueFile(it->path(), target, Manifest::Key(relative), std::filesystem::is_regular_file(existing), pool, buffers);
+                }
+            }
+            if (ec) Fail(L"Directory walk failed below " + source.wstring());
+        }
+
+        void QueueFile(const std::filesystem::path& source, const std::filesystem::path& destination, std::string key, bool exists,
+                       WorkStealingPool& pool, BufferPool& buffers) {
+            auto job = std::make_shared<Job>();
+            job->source = source;
+            job->destination = destination;
+            job->key = std::move(key);
+            job->existed = exists;
+
+            std::error_code ec;
+            job->entry.size = std::filesystem::file_size(source, ec);
+            job->entry.sourceTime = Manifest::Time(std::filesystem::last_write_time(source, ec));
+            if (ec) {
+                Fail(L"Cannot stat " + source.wstring());
+                return;
+            }
+
+            const ManifestEntry* old = previous.Find(job->key);
+            std::error_code targetError;
+            uint64_t targetSize = exists ? std::filesystem::file_size(destination, targetError) : 0;
+            int64_t targetTime = exists ? Manifest::Time(std::filesystem::last_write_time(destination, targetError)) : 0;
+            bool trusted = exists && !targetError && old && old->size == targetSize && old->targetTime == targetTime;
+            if (trusted && old->size == job->entry.size && old->sourceTime == job->entry.sourceTime) {
+                unchanged++;
+                chunksSkipped += old->chunks.size();
+                Advance();
+                std::lock_guard<std::mutex> lock(manifestMutex);
+                current.Set(job->key, *old);
+                return;
+            }
+            if (trusted) {
+                job->known = old->chunks;
+                job->knownSize = old->size;
+            }
+            else if (exists && !targetError) {
+                job->compare = true;
+                job->knownSize = targetSize;
+            }
+
+#ifdef _WIN32
+            // Read-only, hidden and system targets cannot be opened for writing; CopyMetadata restores them
+            if (exists) SetFileAttributesW(destination.c_str(), FILE_ATTRIBUTE_NORMAL);
+#endif
+            if (!job->input.Open(source, File::READ) || !job->output.Open(destination, exists ? File::UPDATE : File::WRITE)) {
+                Fail(L"Cannot resync " + source.wstring());
+                return;
+            }
+            if (!job->output.Resize(job->entry.size)) {
+                Fail(L"Cannot resize " + destination.wstring());
+                return;
+            }
+            uint64_t chunk = options.chunkSize;
+            job->entry.chunks.resize(static_cast<size_t>((job->entry.size + chunk - 1) / chunk));
+            size_t segments = static_cast<size_t>(std::max<uint64_t>(1, (job->entry.size + options.segmentSize - 1) / options.segmentSize));
+            job->remaining = segments;
+            for (size_t i = 0; i < segments; ++i) {
+                uint64_t offset = static_cast<uint64_t>(i) * options.segmentSize;
+                uint64_t end = std::min<uint64_t>(job->entry.size, offset + options.segmentSize);
+                pool.Submit([this, &buffers, job, offset, end] { SyncSegment(*job, offset, end, buffers); });
+            }
+        }
+
+        // Hashes every source chunk of [offset, end) and writes the ones the target does not already hold
+        void SyncSegment(Job& job, uint64_t offset, uint64_t end, BufferPool& buffers) {
+            if (!job.failed) {
+                BufferPool::Lease buffer = buffers.Acquire();
+                uint8_t* data = buffer.Data();
+                uint8_t* old = data + options.chunkSize;
+                for (uint64_t at = offset; at < end && !job.failed; at += options.chunkSize) {
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(options.chunkSize, end - at));
+                    size_t index = static_cast<size_t>(at / options.chunkSize);
+                    size_t got = 0;
+                    bool read;
+                    {
+                        TraceScope scope("resync.read", "resync");
+                        scope.Bytes(length);
+                        read = job.input.ReadAt(data, length, at, got) && got == length;
+                    }
+                    if (!read) {
+                        job.failed = true;
+                        break;
+                    }
+                    bytesRead += length;
+                    Advance();
+                    uint64_t hash = ContentHash(options.hash, data, length);
+                    job.entry.chunks[index] = hash;
+
+                    // Only a chunk of the same length can match, the last one moves when the size changes
+                    bool sameLength = std::min<uint64_t>(job.knownSize, at + options.chunkSize) == at + length;
+                    bool same = false;
+                    if (sameLength && index < job.known.size()) {
+                        same = job.known[index] == hash;
+                    }
+                    else if (sameLength && job.compare) {
+                        if (job.output.ReadAt(old, length, at, got) && got == length) {
+                            bytesRead += length;
+                            same = std::memcmp(old, data, length) == 0;
+                        }
+                    }
+                    if (same) {
+                        chunksSkipped++;
+                        continue;
+                    }
+                    TraceScope write("resync.write", "resync");
+                    write.Bytes(length);
+                    if (!job.output.WriteAt(data, length, at)) {
+                        job.failed = true;
+                        break;
+                    }
+                    bytesWritten += length;
+                    chunksWritten++;
+                }
+            }
+            Advance();
+            if (--job.remaining > 0) return;
+
+            job.input.Close();
+            job.output.Close();
+            if (job.failed) {
+                Fail(L"Resync failed: " + job.source.wstring());
+                return;
+            }
+            CopyEngine::CopyMetadata(job.source, job.destination);
+            std::error_code ec;
+            job.entry.targetTime = Manifest::Time(std::filesystem::last_write_time(job.destination, ec));
+            if (ec) return;
+            if (job.existed) updated++;
+            else created++;
+            std::lock_guard<std::mutex> lock(manifestMutex);
+            current.Set(job.key, std::move(job.entry));
+        }
+
+        // Mirror deletes: whatever is on the target below a source directory but not in the source
+        void DeleteExtra(const std::filesystem::path& destination) {
+            std::vector<std::filesystem::path> extra;
+            std::error_code ec;
+            auto it = std::filesystem::recursive_directory_iterator(destination, std::filesystem::directory_options::skip_permission_denied, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                std::filesystem::path relative = it->path().lexically_relative(destination);
+                std::error_code entryError;
+                bool link = it->is_symlink(entryError);
+                if (Excluded(relative) || relative.filename() == std::string(Manifest::FILE_NAME) + ".tmp") {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                if (!seen.count(Manifest::Key(relative))) {
+                    extra.push_back(it->path());
+                    it.disable_recursion_pending();
+                }
+                else if (link) {
+                    it.disable_recursion_pending();
+                }
+            }
+            if (ec) Fail(L"Directory walk failed below " + destination.wstring());
+            for (const auto& path : extra) {
+                std::error_code removeError;
+                std::filesystem::remove_all(path, removeError);
+                if (removeError) Fail(L"Cannot delete " + path.wstring());
+                else deleted++;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _TREE_SCAN_H_
+#define _TREE_SCAN_H_
+#include <atomic>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "../platform/paths.h"
+
+struct TreeScanStats {
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t bytes = 0;                                  // Sum of regular file sizes
+    uint64_t unreadable = 0;                             // Entries or directories that could not be listed
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files in " + std::to_wstring(directories) + L" directories, "
+            + std::to_wstring(bytes / 1000000) + L" MB";
+    }
+};
+
+// Metadata-only walk of a source tree with the copy's excludes: how much there is to copy,
+// for the capacity check and the progress total, without waiting for the copy to find out.
+// Links are not followed, like the copy. Stops early when `cancel` is set.
+class TreeScanner {
+
+    public:
+
+        explicit TreeScanner(std::vector<std::wstring> excludeList = {}) : excludes(std::move(excludeList)) {}
+
+        bool Run(const std::filesystem::path& root, const std::atomic<bool>* cancel = nullptr) {
+            stats = TreeScanStats();
+            std::error_code ec;
+            std::filesystem::recursive_directory_iterator it(root, std::filesystem::directory_options::skip_permission_denied, ec);
+            if (ec) {
+                error = L"Cannot list " + root.wstring();
+                return false;
+            }
+            for (std::filesystem::recursive_directory_iterator end; it != end; it.increment(ec)) {
+                if (ec) {
+                    stats.unreadable++;
+                    ec.clear();
+                    continue;
+                }
+                if (cancel && *cancel) {
+                    error = L"Scan cancelled";
+                    return false;
+                }
+                if (!excludes.empty() && PathListed(it->path().lexically_relative(root), excludes)) {
+                    if (it->is_directory(ec)) it.disable_recursion_pending();
+                    continue;
+                }
+                std::error_code entryError;
+                if (it->is_symlink(entryError)) continue;
+                if (it->is_directory(entryError)) {
+                    stats.directories++;
+                }
+                else if (it->is_regular_file(entryError)) {
+                    uint64_t size = it->file_size(entryError);
+                    if (entryError) stats.unreadable++;
+                    else {
+                        stats.files++;
+                        stats.bytes += size;
+                    }
+                }
+            }
+            return true;
+        }
+
+        const TreeScanStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        std::vector<std::wstring> excludes;
+        TreeScanStats stats;
+        std::wstring error;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef _WORK_POOL_H_
+#define _WORK_POOL_H_
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// Work-stealing thread pool. Every worker owns a deque: tasks it submits itself go to the
+// back and it pops from the back (the chunks of the file it just opened stay hot), idle
+// workers steal the oldest task from the front of someone else's deque. Tasks submitted
+// from outside the pool are spread round-robin.
+class WorkStealingPool {
+
+    public:
+
+        using Task = std::function<void()>;
+
+        explicit WorkStealingPool(size_t threads = 0) {
+            if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+            for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+            for (size_t i = 0; i < threads; ++i) workers.emplace_back(&WorkStealingPool::Worker, this, i);
+        }
+
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        void Submit(Task task) {
+            size_t index = CurrentPool() == this ? CurrentIndex() : next++ % queues.size();
+            pending++;
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                queued++;
+            }
+            wake.notify_one();
+        }
+
+        // Blocks until every submitted task (including ones submitted by tasks) has run.
+        // Rethrows the first exception a task let escape.
+        void Wait() {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            idle.wait(lock, [&] { return pending == 0; });
+            if (failure) {
+                std::exception_ptr thrown = failure;
+                failure = nullptr;
+                std::rethrow_exception(thrown);
+            }
+        }
+
+        size_t Threads() const { return workers.size(); }
+        uint64_t Steals() const { return steals; }
+
+    private:
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> pending{ 0 };
+        std::atomic<size_t> next{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        size_t queued = 0;           // Tasks sitting in deques, guarded by sleepMutex
+        bool stopping = false;
+        std::exception_ptr failure;
+
+        static WorkStealingPool*& CurrentPool() {
+            static thread_local WorkStealingPool* pool = nullptr;
+            return pool;
+        }
+
+        static size_t& CurrentIndex() {
+            static thread_local size_t index = 0;
+            return index;
+        }
+
+        bool Take(size_t index, Task& task) {
+            {
+                Queue& own = *queues[index];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t offset = 1; offset < queues.size(); ++offset) {
+                Queue& victim = *queues[(index + offset) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    steals++;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Worker(size_t index) {
+            CurrentPool() = this;
+            CurrentIndex() = index;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    wake.wait(lock, [&] { return stopping || queued > 0; });
+                    if (queued == 0) return;
+                    queued--;
+                }
+                // A queued count was claimed, so some deque holds a task for us
+                Task task;
+                while (!Take(index, task)) std::this_thread::yield();
+                try {
+                    task();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    if (!failure) failure = std::current_exception();
+                }
+                task = nullptr;
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    idle.notify_all();
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _BOOT_FILES_H_
+#define _BOOT_FILES_H_
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../platform/paths.h"
+
+// A file of a boot volume: its backslash separated path there and where it is copied from
+struct BootFile {
+    std::wstring volumePath;
+    std::filesystem::path source;
+};
+
+// What a Windows To Go boot volume holds, from the installation at `windows` (its Boot
+// folder) and the BCD store to boot it: the UEFI boot manager at its own path and the
+// removable-media fallback path, its fonts, and for BIOS boot the PCAT boot manager with
+// a copy of the store at \Boot\BCD. Empty, with `error` set, without a UEFI boot manager.
+inline std::vector<BootFile> BootFiles(const std::filesystem::path& windows, const std::filesystem::path& bcd, std::wstring& error) {
+    auto bootmgfw = FindPathNoCase(windows, L"Boot\\EFI\\bootmgfw.efi");
+    if (!bootmgfw) {
+        error = L"No Boot\\EFI\\bootmgfw.efi in " + windows.wstring();
+        return {};
+    }
+    std::vector<BootFile> files = {
+        { L"EFI\\Microsoft\\Boot\\bootmgfw.efi", *bootmgfw }, { L"EFI\\Boot\\bootx64.efi", *bootmgfw }, { L"EFI\\Microsoft\\Boot\\BCD", bcd }
+    };
+    if (auto fonts = FindPathNoCase(windows, L"Boot\\Fonts")) {
+        std::error_code ec;
+        std::vector<std::filesystem::path> names;
+        for (const auto& entry : std::filesystem::directory_iterator(*fonts, ec)) {
+            if (entry.is_regular_file(ec)) names.push_back(entry.path());
+        }
+        std::sort(names.begin(), names.end());
+        for (const auto& name : names) files.push_back({ L"EFI\\Microsoft\\Boot\\Fonts\\" + name.filename().wstring(), name });
+    }
+    if (auto bootmgr = FindPathNoCase(windows, L"Boot\\PCAT\\bootmgr")) {
+        files.push_back({ L"bootmgr", *bootmgr });
+        files.push_back({ L"Boot\\BCD", bcd });
+    }
+    return files;
+}
+
+#endif
@@ -0,0 +1,509 @@
+#ifndef _FAT32_WRITER_H_
+#define _FAT32_WRITER_H_
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include "boot_files.h"
+#include "../editor/hive.h"
+#include "../platform/file.h"
+#include "../platform/paths.h"
+
+struct Fat32Options {
+    uint64_t offset = 0;                                 // Byte offset of the partition in the target
+    uint64_t size = 0;                                   // Partition size, 0 = from offset to the end of the target
+    uint32_t sectorSize = 512;
+    uint32_t clusterSize = 0;                            // 0 = the smallest that leaves FAT32 enough clusters
+    uint64_t dataAlignment = 1 << 20;                    // The first cluster starts on this, relative to the partition
+    uint32_t volumeId = 0;                               // 0 = time based
+    std::string label = "SYSTEM";
+};
+
+struct Fat32Stats {
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t clusters = 0;                               // In the volume
+    uint64_t usedClusters = 0;
+    uint64_t bytesWritten = 0;
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files in " + std::to_wstring(directories) + L" directories, "
+            + std::to_wstring(usedClusters) + L" of " + std::to_wstring(clusters) + L" clusters used, "
+            + std::to_wstring(bytesWritten >> 10) + L" KB written";
+    }
+};
+
+// Formats a FAT32 system partition and fills it with a known set of files in one go. The
+// boot sector, FSInfo, both FATs and every directory are laid out in memory first; files
+// get contiguous clusters in the order they were added, directories before them. The
+// partition is then written as a single ascending stream, reserved sectors through the last
+// used cluster, in large sequential writes, where format-then-copy would scatter small
+// FAT and directory updates over the slowest region of the stick. Free clusters are not
+// written; the FAT says they are free.
+// Names get long file name entries plus a generated 8.3 alias, like Windows creates them.
+class Fat32Writer {
+
+    public:
+
+        static constexpr uint32_t END_OF_CHAIN = 0x0FFFFFFF;
+
+        explicit Fat32Writer(const Fat32Options& fatOptions = Fat32Options()) : options(fatOptions) {
+            root = std::make_unique<Node>();
+            root->directory = true;
+        }
+
+        // `volumePath` is backslash or slash separated; missing directories are created
+        bool AddFile(const std::wstring& volumePath, const std::filesystem::path& source) {
+            std::error_code ec;
+            uint64_t size = std::filesystem::file_size(source, ec);
+            if (ec) return Fail(L"Cannot read " + source.wstring());
+            Node* node = Insert(volumePath);
+            if (!node) return false;
+            node->source = source;
+            node->size = size;
+            return true;
+        }
+
+        bool AddData(const std::wstring& volumePath, std::vector<uint8_t> data) {
+            Node* node = Insert(volumePath);
+            if (!node) return false;
+            node->size = data.size();
+            node->data = std::move(data);
+            return true;
+        }
+
+        // The boot files of the installation at `windows` with the store `bcd` (BootFiles)
+        bool AddBootFiles(const std::filesystem::path& windows, const std::filesystem::path& bcd) {
+            std::wstring missing;
+            std::vector<BootFile> files = BootFiles(windows, bcd, missing);
+            if (files.empty()) return Fail(missing);
+            for (const BootFile& file : files) {
+                if (!AddFile(file.volumePath, file.source)) return false;
+            }
+            return true;
+        }
+
+        bool Run(const std::filesystem::path& target) {
+            stats = Fat32Stats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+            File file;
+            if (!file.Open(target, File::UPDATE)) return Fail(file.Error());
+            uint64_t size = options.size;
+            if (size == 0) {
+                uint64_t total = file.Size();
+                if (total <= options.offset) return Fail(L"Nothing past offset " + std::to_wstring(options.offset) + L" in " + target.wstring());
+                size = total - options.offset;
+            }
+            if (!Layout(size)) return false;
+            if (!Allocate()) return false;
+
+            Stream stream(file, options.offset);
+            std::vector<uint8_t> reserved(static_cast<size_t>(reservedSectors) * sector, 0);
+            BootSector(reserved.data());
+            FsInfo(reserved.data() + sector);
+            std::memcpy(reserved.data() + 6 * sector, reserved.data(), 2 * sector);   // Backup boot sector and FSInfo
+            bool ok = stream.Put(reserved.data(), reserved.size());
+            for (int copy = 0; ok && copy < 2; ++copy) ok = WriteFat(stream);
+            for (Node* directory : directories) ok = ok && WriteDirectory(stream, *directory);
+            for (Node* node : files) ok = ok && WriteFile(stream, *node);
+            ok = ok && stream.Flush() && file.Sync();
+            if (!ok) return error.empty() ? Fail(stream.error.empty() ? file.Error() : stream.error) : false;
+            stats.bytesWritten = stream.written;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        const Fat32Stats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        struct Node {
+            std::wstring name;
+            bool directory = false;
+            std::vector<std::unique_ptr<Node>> children;
+            Node* parent = nullptr;
+            std::filesystem::path source;
+            std::vector<uint8_t> data;
+            uint64_t size = 0;
+            uint32_t cluster = 0;
+            uint32_t clusters = 0;
+            uint8_t shortName[11] = {};
+            std::vector<uint8_t> entries;                // Directories: their serialized entries
+        };
+
+        // Coalesces everything into 1 MiB sequential writes
+        struct Stream {
+            File& file;
+            uint64_t at;
+            std::vector<uint8_t> buffer;
+            uint64_t written = 0;
+            std::wstring error;
+
+            Stream(File& target, uint64_t offset) : file(target), at(offset) { buffer.reserve(1 << 20); }
+
+            bool Put(const uint8_t* data, size_t length) {
+                while (length > 0) {
+                    size_t part = std::min(length, buffer.capacity() - buffer.size());
+                    buffer.insert(buffer.end(), data, data + part);
+                    data += part;
+                    length -= part;
+                    if (buffer.size() == buffer.capacity() && !Flush()) return false;
+                }
+                return true;
+            }
+
+            bool Zeros(uint64_t length) {
+                static const uint8_t zeros[4096] = {};
+                for (; length > 0; length -= std::min<uint64_t>(length, sizeof(zeros))) {
+                    if (!Put(zeros, static_cast<size_t>(std::min<uint64_t>(length, sizeof(zeros))))) return false;
+                }
+                return true;
+            }
+
+            bool Flush() {
+                if (buffer.empty()) return true;
+                if (!file.WriteAt(buffer.data(), buffer.size(), at)) {
+                    error = file.Error();
+                    return false;
+                }
+                at += buffer.size();
+                written += buffer.size();
+                buffer.clear();
+                return true;
+            }
+        };
+
+        Fat32Options options;
+        Fat32Stats stats;
+        std::wstring error;
+        std::unique_ptr<Node> root;
+        std::vector<Node*> directories;                  // Cluster order, root first
+        std::vector<Node*> files;
+        uint32_t sector = 512;
+        uint32_t clusterSize = 4096;
+        uint32_t reservedSectors = 32;
+        uint32_t fatSectors = 0;
+        uint64_t totalSectors = 0;
+        uint32_t clusterCount = 0;
+        uint32_t nextCluster = 2;
+        uint16_t fatTime = 0;
+        uint16_t fatDate = 0;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        Node* Insert(const std::wstring& volumePath) {
+            Node* directory = root.get();
+            size_t start = 0;
+            while (start < volumePath.size()) {
+                size_t end = volumePath.find_first_of(L"\\/", start);
+                if (end == std::wstring::npos) end = volumePath.size();
+                std::wstring name = volumePath.substr(start, end - start);
+                start = end + 1;
+                if (name.empty()) continue;
+                if (name.size() > 255 || name.find_first_of(L"\"*:<>?|") != std::wstring::npos) {
+                    Fail(L"Invalid FAT name " + name);
+                    return nullptr;
+                }
+                bool last = start > volumePath.size();
+                Node* child = nullptr;
+                for (auto& existing : directory->children) {
+                    if (Hive::NamesEqual(existing->name, name)) child = existing.get();
+                }
+                if (!child) {
+                    directory->children.push_back(std::make_unique<Node>());
+                    child = directory->children.back().get();
+                    child->name = name;
+                    child->parent = directory;
+                    child->directory = !last;
+                }
+                else if (child->directory == last) {
+                    Fail(L"Both a file and a directory: " + volumePath);
+                    return nullptr;
+                }
+                directory = child;
+            }
+            if (directory == root.get()) {
+                Fail(L"Empty path");
+                return nullptr;
+            }
+            return directory;
+        }
+
+        // Sector, cluster and FAT sizes for a partition of `size` bytes
+        bool Layout(uint64_t size) {
+            sector = options.sectorSize;
+            if (sector < 512 || sector > 4096 || (sector & (sector - 1)) != 0) return Fail(L"Unsupported sector size " + std::to_wstring(sector));
+            totalSectors = std::min<uint64_t>(size / sector, 0xFFFFFFFF);
+            std::vector<uint32_t> candidates;
+            if (options.clusterSize) candidates.push_back(options.clusterSize);
+            else {
+                for (uint32_t candidate = 4096; candidate >= sector; candidate /= 2) candidates.push_back(candidate);
+            }
+            uint64_t alignSectors = std::max<uint64_t>(1, options.dataAlignment / sector);
+            for (uint32_t candidate : candidates) {
+                if (candidate < sector || candidate > 64 * 1024 || (candidate & (candidate - 1)) != 0) break;
+                uint32_t perCluster = candidate / sector;
+                // A FAT sized for every sector covers the clusters that remain; the data area
+                // then starts at the next alignment boundary
+                uint64_t fat = ((totalSectors / perCluster + 2) * 4 + sector - 1) / sector;
+                uint64_t data = (32 + 2 * fat + alignSectors - 1) / alignSectors * alignSectors;
+                if (data >= totalSectors) continue;
+                uint64_t count = (totalSectors - data) / perCluster;
+                if (count < 65525 || count > 0x0FFFFFF5) continue;
+                clusterSize = candidate;
+                fatSectors = static_cast<uint32_t>(fat);
+                reservedSectors = static_cast<uint32_t>(data - 2 * fat);
+                clusterCount = static_cast<uint32_t>(count);
+                stats.clusters = count;
+                return true;
+            }
+            return Fail(L"A " + std::to_wstring(size >> 20) + L" MB partition cannot hold FAT32 with " + std::to_wstring(sector)
+                + L" byte sectors");
+        }
+
+        // Clusters for every directory, then every file; serializes the directories
+        bool Allocate() {
+            std::time_t now = std::time(nullptr);
+            std::tm local = *std::localtime(&now);
+            fatTime = static_cast<uint16_t>(local.tm_hour << 11 | local.tm_min << 5 | local.tm_sec / 2);
+            fatDate = static_cast<uint16_t>(std::max(0, local.tm_year - 80) << 9 | (local.tm_mon + 1) << 5 | local.tm_mday);
+
+            directories.clear();
+            files.clear();
+            std::vector<Node*> pending{ root.get() };
+            while (!pending.empty()) {
+                Node* directory = pending.front();
+                pending.erase(pending.begin());
+                directories.push_back(directory);
+                for (auto& child : directory->children) {
+                    if (child->directory) pending.push_back(child.get());
+                    else files.push_back(child.get());
+                }
+            }
+            stats.directories = directories.size() - 1;
+            stats.files = files.size();
+
+            nextCluster = 2;
+            for (Node* directory : directories) {
+                if (!ShortNames(*directory)) return false;
+                // Entry count is known before the clusters are: . and .., label, and per child its LFN entries and the alias
+                size_t count = directory == root.get() ? 1 : 2;
+                for (auto& child : directory->children) count += 1 + (child->name.size() + 12) / 13;
+                directory->clusters = static_cast<uint32_t>(std::max<uint64_t>(1, (count * 32 + clusterSize - 1) / clusterSize));
+                directory->cluster = nextCluster;
+                nextCluster += directory->clusters;
+            }
+            for (Node* node : files) {
+                node->clusters = static_cast<uint32_t>((node->size + clusterSize - 1) / clusterSize);
+                node->cluster = node->clusters ? nextCluster : 0;
+                nextCluster += node->clusters;
+            }
+            stats.usedClusters = nextCluster - 2;
+            if (nextCluster - 2 > clusterCount) {
+                return Fail(L"The files need " + std::to_wstring(stats.usedClusters) + L" clusters, the partition has "
+                    + std::to_wstring(clusterCount));
+            }
+            for (Node* directory : directories) Serialize(*directory);
+            return true;
+        }
+
+        // 8.3 aliases: the name itself when it is a valid uppercase 8.3 name, else the
+        // first six usable characters, ~N and the first three of the extension
+        bool ShortNames(Node& directory) {
+            std::vector<std::string> taken;
+            for (auto& child : directory.children) {
+                std::wstring name = child->name;
+                size_t dot = name.find_last_of(L'.');
+                std::wstring base = dot == std::wstring::npos || dot == 0 ? name : name.substr(0, dot);
+                std::wstring extension = dot == std::wstring::npos || dot == 0 ? L"" : name.substr(dot + 1);
+                bool lossy = false;
+                auto clean = [&](const std::wstring& part, size_t limit) {
+                    std::string out;
+                    for (wchar_t c : part) {
+                        if (c == L' ' || c == L'.') {
+                            lossy = true;
+                            continue;
+                        }
+                        char mapped = c < 0x80 ? static_cast<char>(std::toupper(static_cast<int>(c))) : '_';
+                        if (c >= 0x80 || std::strchr("+,;=[]", mapped)) {
+                            mapped = '_';
+                            lossy = true;
+                        }
+                        out += mapped;
+                    }
+                    if (out.size() > limit) {
+                        lossy = true;
+                        out.resize(limit);
+                    }
+                    return out;
+                };
+                std::string shortBase = clean(base, 8), shortExtension = clean(extension, 3);
+                if (shortBase.empty()) {
+                    shortBase = "_";
+                    lossy = true;
+                }
+                std::string alias = Pad(shortBase, shortExtension);
+                for (size_t n = 1; lossy || std::find(taken.begin(), taken.end(), alias) != taken.end(); ++n) {
+                    if (n > 999999) return Fail(L"Too many similar names in a directory");
+                    std::string tail = "~" + std::to_string(n);
+                    alias = Pad(shortBase.substr(0, std::min(shortBase.size(), 8 - tail.size())) + tail, shortExtension);
+                    if (std::find(taken.begin(), taken.end(), alias) == taken.end()) break;
+                }
+                taken.push_back(alias);
+                std::memcpy(child->shortName, alias.data(), 11);
+            }
+            return true;
+        }
+
+        static std::string Pad(const std::string& base, const std::string& extension) {
+            std::string alias = base;
+            alias.resize(8, ' ');
+            alias += extension;
+            alias.resize(11, ' ');
+            return alias;
+        }
+
+        void Serialize(Node& directory) {
+            std::vector<uint8_t>& out = directory.entries;
+            out.assign(static_cast<size_t>(directory.clusters) * clusterSize, 0);
+            size_t at = 0;
+            auto entry = [&](const uint8_t* name, uint8_t attributes, uint32_t cluster, uint32_t size) {
+                uint8_t* e = &out[at];
+                std::memcpy(e, name, 11);
+                e[11] = attributes;
+                Hive::Put16(e, 14, fatTime);
+                Hive::Put16(e, 16, fatDate);
+                Hive::Put16(e, 18, fatDate);
+                Hive::Put16(e, 20, static_cast<uint16_t>(cluster >> 16));
+                Hive::Put16(e, 22, fatTime);
+                Hive::Put16(e, 24, fatDate);
+                Hive::Put16(e, 26, static_cast<uint16_t>(cluster));
+                Hive::Put32(e, 28, size);
+                at += 32;
+            };
+            if (&directory == root.get()) {
+                std::string label = options.label.substr(0, 11);
+                for (char& c : label) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                label.resize(11, ' ');
+                entry(reinterpret_cast<const uint8_t*>(label.data()), 0x08, 0, 0);
+            }
+            else {
+                uint8_t dot[11], dotdot[11];
+                std::memset(dot, ' ', 11);
+                std::memset(dotdot, ' ', 11);
+                dot[0] = dotdot[0] = dotdot[1] = '.';
+                entry(dot, 0x10, directory.cluster, 0);
+                entry(dotdot, 0x10, directory.parent == root.get() ? 0 : directory.parent->cluster, 0);
+            }
+            for (auto& child : directory.children) {
+                uint8_t checksum = 0;
+                for (uint8_t c : child->shortName) checksum = static_cast<uint8_t>(((checksum & 1) << 7) + (checksum >> 1) + c);
+                const std::wstring& name = child->name;
+                size_t parts = (name.size() + 12) / 13;
+                for (size_t part = parts; part > 0; --part) {
+                    uint8_t* e = &out[at];
+                    e[0] = static_cast<uint8_t>(part | (part == parts ? 0x40 : 0));
+                    e[11] = 0x0F;
+                    e[13] = checksum;
+                    static const size_t slots[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+                    for (size_t i = 0; i < 13; ++i) {
+                        size_t index = (part - 1) * 13 + i;
+                        uint16_t c = index < name.size() ? static_cast<uint16_t>(name[index]) : index == name.size() ? 0 : 0xFFFF;
+                        Hive::Put16(e, slots[i], c);
+                    }
+                    at += 32;
+                }
+                entry(child->shortName, child->directory ? 0x10 : 0x20, child->cluster,
+                      child->directory ? 0 : static_cast<uint32_t>(child->size));
+            }
+        }
+
+        void BootSector(uint8_t* boot) const {
+            static const uint8_t jump[3] = { 0xEB, 0x58, 0x90 };
+            std::memcpy(boot, jump, 3);
+            std::memcpy(boot + 3, "MSWIN4.1", 8);
+            Hive::Put16(boot, 11, static_cast<uint16_t>(sector));
+            boot[13] = static_cast<uint8_t>(clusterSize / sector);
+            Hive::Put16(boot, 14, static_cast<uint16_t>(reservedSectors));
+            boot[16] = 2;
+            boot[21] = 0xF8;
+            Hive::Put16(boot, 24, 63);
+            Hive::Put16(boot, 26, 255);
+            Hive::Put32(boot, 28, static_cast<uint32_t>(options.offset / sector));
+            Hive::Put32(boot, 32, static_cast<uint32_t>(totalSectors));
+            Hive::Put32(boot, 36, fatSectors);
+            Hive::Put32(boot, 44, 2);                    // Root directory cluster
+            Hive::Put16(boot, 48, 1);                    // FSInfo sector
+            Hive::Put16(boot, 50, 6);                    // Backup boot sector
+            boot[64] = 0x80;
+            boot[66] = 0x29;
+            uint32_t id = options.volumeId ? options.volumeId : static_cast<uint32_t>(std::time(nullptr) * 2654435761u);
+            Hive::Put32(boot, 67, id);
+            std::string label = options.label.substr(0, 11);
+            for (char& c : label) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            label.resize(11, ' ');
+            std::memcpy(boot + 71, label.data(), 11);
+            std::memcpy(boot + 82, "FAT32   ", 8);
+            static const uint8_t halt[3] = { 0xF4, 0xEB, 0xFD };   // Not bootable from BIOS: hlt, jmp back
+            std::memcpy(boot + 90, halt, 3);
+            boot[510] = 0x55;
+            boot[511] = 0xAA;
+        }
+
+        void FsInfo(uint8_t* info) const {
+            Hive::Put32(info, 0, 0x41615252);
+            Hive::Put32(info, 484, 0x61417272);
+            Hive::Put32(info, 488, clusterCount - (nextCluster - 2));
+            Hive::Put32(info, 492, nextCluster);
+            Hive::Put32(info, 508, 0xAA550000);
+        }
+
+        // Chains for what was allocated, zeros for the rest of the FAT
+        bool WriteFat(Stream& stream) const {
+            std::vector<uint8_t> fat(static_cast<size_t>(nextCluster) * 4, 0);
+            Hive::Put32(fat.data(), 0, 0x0FFFFFF8);
+            Hive::Put32(fat.data(), 4, END_OF_CHAIN);
+            auto chain = [&](const Node* node) {
+                for (uint32_t i = 0; i < node->clusters; ++i) {
+                    Hive::Put32(fat.data(), (static_cast<size_t>(node->cluster) + i) * 4, i + 1 == node->clusters ? END_OF_CHAIN : node->cluster + i + 1);
+                }
+            };
+            for (const Node* directory : directories) chain(directory);
+            for (const Node* node : files) chain(node);
+            return stream.Put(fat.data(), fat.size()) && stream.Zeros(static_cast<uint64_t>(fatSectors) * sector - fat.size());
+        }
+
+        bool WriteDirectory(Stream& stream, const Node& directory) const {
+            return stream.Put(directory.entries.data(), directory.entries.size());
+        }
+
+        bool WriteFile(Stream& stream, const Node& node) {
+            uint64_t padded = static_cast<uint64_t>(node.clusters) * clusterSize;
+            if (node.source.empty()) return stream.Put(node.data.data(), node.data.size()) && stream.Zeros(padded - node.size);
+            File source;
+            if (!source.Open(node.source, File::READ)) return Fail(source.Error());
+            std::vector<uint8_t> buffer(1 << 20);
+            for (uint64_t at = 0; at < node.size;) {
+                size_t done = 0;
+                if (!source.ReadAt(buffer.data(), static_cast<size_t>(std::min<uint64_t>(buffer.size(), node.size - at)), at, done) || done == 0) {
+                    return Fail(L"Cannot read " + node.source.wstring() + L", or it shrank");
+                }
+                if (!stream.Put(buffer.data(), done)) return false;
+                at += done;
+            }
+            return stream.Zeros(padded - node.size);
+        }
+};
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef _PARTITIONER_H_
+#define _PARTITIONER_H_
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "vhdx_writer.h"
+#include "../editor/bcd_store.h"
+#include "../platform/file.h"
+
+#ifndef _WIN32
+#include <sys/sysmacros.h>
+#endif
+
+enum PartitionStyle {
+    LAYOUT_GPT,                                          // ESP, MSR, Windows
+    LAYOUT_MBR                                           // Active FAT32 system partition, Windows
+};
+
+enum PartitionRole {
+    ROLE_ESP,
+    ROLE_MSR,
+    ROLE_WINDOWS
+};
+
+struct PartitionOptions {
+    PartitionStyle style = LAYOUT_GPT;
+    uint64_t diskSize = 0;                               // 0 = size of the file or device
+    uint32_t sectorSize = 0;                             // 0 = the device's logical sector size, 512 for files
+    uint64_t alignment = 0;                              // 0 = detected erase block, at least minAlignment
+    uint64_t minAlignment = 4 << 20;                     // Typical flash allocation unit; Windows itself uses 1 MiB
+    bool esp = true;                                     // false for a disk inside a VHD, booted from the ESP of the disk holding it
+    uint64_t espSize = 260 << 20;
+    uint64_t msrSize = 16 << 20;                         // GPT only
+    uint64_t windowsSize = 0;                            // 0 = the rest of the disk
+    uint64_t wipeSize = 1 << 20;                         // Zeroed at the start of each partition, so stale filesystems are not found
+};
+
+struct PlannedPartition {
+    PartitionRole role = ROLE_WINDOWS;
+    uint64_t offset = 0;                                 // Bytes
+    uint64_t size = 0;
+    BcdGuid type;                                        // GPT
+    BcdGuid guid;
+    uint8_t mbrType = 0;
+};
+
+struct PartitionStats {
+    uint64_t bytesWritten = 0;
+    uint64_t alignment = 0;
+    uint32_t sectorSize = 0;
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(alignment >> 10) + L" KB alignment, " + std::to_wstring(sectorSize) + L" byte sectors, "
+            + std::to_wstring(bytesWritten >> 10) + L" KB written in " + std::to_wstring(seconds) + L" s";
+    }
+};
+
+// Writes a Windows To Go partition table straight to a disk or a disk image, no diskpart:
+//   GPT  protective MBR, primary header and entries, ESP, MSR, Windows, backup entries and header
+//   MBR  an active FAT32 system partition (0x0C, which UEFI also boots from) and NTFS Windows
+// Every partition starts and ends on the alignment, the stick's erase block when the
+// device reports one, so a cluster never straddles two erase blocks and a write never costs
+// two erases. The whole table, and the wipe of each partition's first MiB, goes out in one
+// pass of ascending offsets: flash translation layers handle that best, and an interrupted
+// run leaves a disk whose primary table is either the old one or complete.
+// The MBR boot code is left to bootsect; this only writes the tables.
+class Partitioner {
+
+    public:
+
+        static constexpr uint32_t GPT_ENTRIES = 128;
+        static constexpr uint32_t GPT_ENTRY_SIZE = 128;
+
+        explicit Partitioner(const PartitionOptions& partitionOptions = PartitionOptions()) : options(partitionOptions) {}
+
+        bool Run(const std::filesystem::path& path) {
+            error.clear();
+            stats = PartitionStats();
+            auto start = std::chrono::steady_clock::now();
+            File file;
+            if (!file.Open(path, File::UPDATE)) return Fail(file.Error());
+            uint32_t sectorSize = options.sectorSize;
+            uint64_t eraseBlock = 0;
+            Geometry(path, file, sectorSize, eraseBlock);
+            uint64_t diskSize = options.diskSize ? options.diskSize : file.Size();
+            if (!Plan(diskSize, sectorSize, eraseBlock)) return false;
+
+            for (const Region& region : Regions()) {
+                if (!file.WriteAt(region.data.data(), region.data.size(), region.offset)) return Fail(file.Error());
+                stats.bytesWritten += region.data.size();
+            }
+            if (!file.Sync()) return Fail(file.Error());
+#ifdef _WIN32
+            // Let Windows drop its cached layout and mount the new partitions
+            DWORD returned = 0;
+            DeviceIoControl(file.Native(), IOCTL_DISK_UPDATE_PROPERTIES, NULL, 0, NULL, 0, &returned, NULL);
+#endif
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        // Partitions a virtual disk; the same layout, at the VHD's size and logical sector size
+        bool Run(VhdxWriter& disk) {
+            error.clear();
+            stats = PartitionStats();
+            auto start = std::chrono::steady_clock::now();
+            if (!Plan(options.diskSize ? options.diskSize : disk.Size(), options.sectorSize ? options.sectorSize : disk.LogicalSectorSize())) return false;
+            for (const Region& region : Regions()) {
+                if (!disk.Write(region.offset, region.data.data(), region.data.size())) return Fail(disk.Error());
+                stats.bytesWritten += region.data.size();
+            }
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        // Lays the partitions out without writing anything
+        bool Plan(uint64_t diskSize, uint32_t sectorSize, uint64_t eraseBlock = 0) {
+            partitions.clear();
+            sector = sectorSize ? sectorSize : 512;
+            if (sector < 512 || sector > 4096 || (sector & (sector - 1)) != 0) return Fail(L"Unsupported sector size " + std::to_wstring(sector));
+            align = options.alignment ? options.alignment : std::max(options.minAlignment, eraseBlock);
+            align = std::max<uint64_t>(RoundUpPowerOfTwo(align), sector);
+            stats.alignment = align;
+            stats.sectorSize = sector;
+            sectors = diskSize / sector;
+
+            // GPT keeps 33 sectors (or 6 of 4K) at each end; the first partition starts one alignment in
+            uint64_t tableSectors = 1 + GPT_ENTRIES * GPT_ENTRY_SIZE / sector;
+            uint64_t first = align;
+            uint64_t end = options.style == LAYOUT_GPT ? (sectors - tableSectors) * sector : sectors * sector;
+            end = end / align * align;
+            uint64_t espSize = options.esp ? RoundUp(options.espSize, align) : 0, msrSize = RoundUp(options.msrSize, align);
+            uint64_t fixed = espSize + (options.style == LAYOUT_GPT ? msrSize : 0);
+            if (diskSize < first || end < first + fixed + align) {
+                return Fail(L"The disk holds " + std::to_wstring(diskSize >> 20) + L" MB, too small for this layout");
+            }
+
+            uint64_t at = first;
+            auto add = [&](PartitionRole role, uint64_t size, const wchar_t* type, uint8_t mbrType) {
+                PlannedPartition partition;
+                partition.role = role;
+                partition.offset = at;
+                partition.size = size;
+                BcdGuid::Parse(type, partition.type);
+                partition.guid = BcdGuid::Random();
+                partition.mbrType = mbrType;
+                partitions.push_back(partition);
+                at += size;
+            };
+            if (options.esp) add(ROLE_ESP, espSize, L"{c12a7328-f81f-11d2-ba4b-00a0c93ec93b}", 0x0C);
+            if (options.style == LAYOUT_GPT) add(ROLE_MSR, msrSize, L"{e3c9e316-0b5c-4db8-817d-f92df00215ae}", 0);
+            uint64_t rest = end - at;
+            uint64_t windows = options.windowsSize ? std::min(rest, RoundUp(options.windowsSize, align)) : rest;
+            add(ROLE_WINDOWS, windows, L"{ebd0a0a2-b9e5-4433-87c0-68b6b72699c7}", 0x07);
+            disk = BcdGuid::Random();
+            mbrSignature = static_cast<uint32_t>(disk.data1 ^ disk.data2 << 16) | 1;
+            return true;
+        }
+
+        const std::vector<PlannedPartition>& Partitions() const { return partitions; }
+        const PartitionStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+        uint32_t MbrSignature() const { return mbrSignature; }
+        const BcdGuid& DiskGuid() const { return disk; }
+
+        static const wchar_t* RoleName(PartitionRole role) {
+            switch (role) {
+                case ROLE_ESP: return L"EFI system partition";
+                case ROLE_MSR: return L"Microsoft reserved partition";
+                default: return L"Basic data partition";
+            }
+        }
+
+    private:
+
+        struct Region {
+            uint64_t offset;
+            std::vector<uint8_t> data;
+        };
+
+        PartitionOptions options;
+        PartitionStats stats;
+        std::vector<PlannedPartition> partitions;
+        std::wstring error;
+        uint32_t sector = 512;
+        uint64_t align = 1 << 20;
+        uint64_t sectors = 0;
+        BcdGuid disk;
+        uint32_t mbrSignature = 0;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        // Everything to write, in ascending offset order. The region from sector 0 up to the
+        // first partition is one buffer (MBR, GPT header and entries, zeros for whatever was there).
+        std::vector<Region> Regions() const {
+            std::vector<Region> regions;
+            std::vector<uint8_t> entries = Entries();
+            std::vector<uint8_t> head(static_cast<size_t>(partitions.front().offset + options.wipeSize), 0);
+            uint8_t* mbr = head.data();
+            if (options.style == LAYOUT_GPT) {
+                MbrEntry(mbr, 0, 0xEE, false, 1, std::min<uint64_t>(sectors - 1, 0xFFFFFFFF));
+                Header(head.data() + sector, entries, 1, sectors - 1, 2);
+                std::memcpy(head.data() + 2 * sector, entries.data(), entries.size());
+            }
+            else {
+                Hive::Put32(mbr, 0x1B8, mbrSignature);
+                for (size_t i = 0; i < partitions.size(); ++i) {
+                    MbrEntry(mbr, i, partitions[i].mbrType, partitions[i].role == ROLE_ESP, partitions[i].offset / sector, partitions[i].size / sector);
+                }
+            }
+            mbr[510] = 0x55;
+            mbr[511] = 0xAA;
+            regions.push_back({ 0, std::move(head) });
+            for (size_t i = 1; i < partitions.size(); ++i) {
+                regions.push_back({ partitions[i].offset, std::vector<uint8_t>(static_cast<size_t>(std::min(options.wipeSize, partitions[i].size)), 0) });
+            }
+            // On MBR the tail is zeroed, or a backup GPT from an earlier layout would still be found
+            uint64_t entriesLba = sectors - 1 - entries.size() / sector;
+            std::vector<uint8_t> tail(entries.size() + sector, 0);
+            if (options.style == LAYOUT_GPT) {
+                std::memcpy(tail.data(), entries.data(), entries.size());
+                Header(tail.data() + entries.size(), entries, sectors - 1, 1, entriesLba);
+            }
+            regions.push_back({ entriesLba * sector, std::move(tail) });
+            return regions;
+        }
+
+        std::vector<uint8_t> Entries() const {
+            std::vector<uint8_t> entries(GPT_ENTRIES * GPT_ENTRY_SIZE, 0);
+            for (size_t i = 0; i < partitions.size(); ++i) {
+                uint8_t* entry = &entries[i * GPT_ENTRY_SIZE];
+                partitions[i].type.ToBytes(entry);
+                partitions[i].guid.ToBytes(entry + 0x10);
+                Hive::Put64(entry, 0x20, partitions[i].offset / sector);
+                Hive::Put64(entry, 0x28, (partitions[i].offset + partitions[i].size) / sector - 1);
+                const wchar_t* name = RoleName(partitions[i].role);
+                for (size_t c = 0; name[c] && c < 36; ++c) Hive::Put16(entry, 0x38 + 2 * c, static_cast<uint16_t>(name[c]));
+            }
+            return entries;
+        }
+
+        void Header(uint8_t* header, const std::vector<uint8_t>& entries, uint64_t self, uint64_t backup, uint64_t entriesLba) const {
+            uint64_t tableSectors = entries.size() / sector;
+            std::memcpy(header, "EFI PART", 8);
+            Hive::Put32(header, 0x08, 0x00010000);
+            Hive::Put32(header, 0x0C, 92);
+            Hive::Put64(header, 0x18, self);
+            Hive::Put64(header, 0x20, backup);
+            Hive::Put64(header, 0x28, 2 + tableSectors);
+            Hive::Put64(header, 0x30, sectors - 2 - tableSectors);
+            disk.ToBytes(header + 0x38);
+            Hive::Put64(header, 0x48, entriesLba);
+            Hive::Put32(header, 0x50, GPT_ENTRIES);
+            Hive::Put32(header, 0x54, GPT_ENTRY_SIZE);
+            Hive::Put32(header, 0x58, Crc32(entries.data(), entries.size()));
+            Hive::Put32(header, 0x10, Crc32(header, 92));
+        }
+
+        // LBA addressing only; CHS fields carry the "beyond 8 GB" marker every current OS ignores
+        static void MbrEntry(uint8_t* mbr, size_t index, uint8_t type, bool active, uint64_t lba, uint64_t count) {
+            uint8_t* entry = mbr + 0x1BE + 16 * index;
+            entry[0] = active ? 0x80 : 0x00;
+            entry[1] = 0xFE;
+            entry[2] = 0xFF;
+            entry[3] = 0xFF;
+            entry[4] = type;
+            entry[5] = 0xFE;
+            entry[6] = 0xFF;
+            entry[7] = 0xFF;
+            Hive::Put32(entry, 8, static_cast<uint32_t>(std::min<uint64_t>(lba, 0xFFFFFFFF)));
+            Hive::Put32(entry, 12, static_cast<uint32_t>(std::min<uint64_t>(count, 0xFFFFFFFF)));
+        }
+
+        // Logical sector size, and the erase block where the device reports one: MMC/SD
+        // readers expose preferred_erase_size, USB bridges at best a discard granularity or
+        // an optimal I/O size. Files keep 512 and no erase block.
+        static void Geometry(const std::filesystem::path& path, File& file, uint32_t& sectorSize, uint64_t& eraseBlock) {
+#ifdef _WIN32
+            (void)path;
+            DISK_GEOMETRY_EX geometry = {};
+            DWORD returned = 0;
+            if (sectorSize == 0 && DeviceIoControl(file.Native(), IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &geometry,
+                                                   sizeof(geometry), &returned, NULL)) {
+                sectorSize = geometry.Geometry.BytesPerSector;
+            }
+#else
+            struct stat st;
+            if (fstat(file.Native(), &st) != 0 || !S_ISBLK(st.st_mode)) return;
+            std::error_code ec;
+            std::filesystem::path node = std::filesystem::canonical("/sys/dev/block/" + std::to_string(major(st.st_rdev)) + ":"
+                + std::to_string(minor(st.st_rdev)), ec);
+            if (ec) return;
+            auto number = [](const std::filesystem::path& file) {
+                std::ifstream in(file);
+                uint64_t value = 0;
+                in >> value;
+                return value;
+            };
+            if (sectorSize == 0) sectorSize = static_cast<uint32_t>(number(node / "queue" / "logical_block_size"));
+            eraseBlock = std::max({ number(node / "device" / "preferred_erase_size"), number(node / "queue" / "discard_granularity"),
+                                    number(node / "queue" / "optimal_io_size") });
+            (void)path;
+#endif
+            // Anything past 64 MiB is a reporting error, not an erase block
+            if (eraseBlock > (64 << 20)) eraseBlock = 0;
+        }
+
+        static uint64_t RoundUp(uint64_t value, uint64_t unit) { return (value + unit - 1) / unit * unit; }
+
+        static uint64_t RoundUpPowerOfTwo(uint64_t value) {
+            uint64_t power = 1;
+            while (power < value) power <<= 1;
+            return power;
+        }
+
+        // CRC-32 (IEEE, reflected), the one GPT uses
+        static uint32_t Crc32(const uint8_t* data, size_t length) {
+            static const std::array<uint32_t, 256> table = [] {
+                std::array<uint32_t, 256> entries{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t crc = i;
+                    for (int bit = 0; bit < 8; ++bit) crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+                    entries[i] = crc;
+                }
+                return entries;
+            }();
+            uint32_t crc = 0xFFFFFFFF;
+            for (size_t i = 0; i < length; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+            return ~crc;
+        }
+};
+
+#endif
@@ -0,0 +1,528 @@
+#ifndef _USB_PROBE_H_
+#define _USB_PROBE_H_
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../io/io_backend.h"
+
+struct UsbProbeOptions {
+    IoBackendKind backend = IO_AUTO;
+    bool write = true;                                   // Write tests and the capacity verify; destroys the contents
+    bool direct = true;                                  // Falls back to buffered, and reports it, where refused
+    uint64_t capacity = 0;                               // 0 = size of the file or device
+    uint64_t minCapacity = 0;                            // Smaller devices fail the probe
+    std::vector<size_t> blockSizes = { 256 << 10, 1 << 20, 4 << 20 };
+    std::vector<size_t> sequentialDepths = { 1, 4, 16 };
+    std::vector<size_t> randomDepths = { 1, 4, 16, 32 };
+    size_t randomBlockSize = 4096;
+    uint64_t sequentialBytes = 64ULL << 20;              // Per test; a test also stops after secondsPerTest
+    uint64_t randomBytes = 16ULL << 20;
+    double secondsPerTest = 2.0;
+    size_t verifySamples = 1024;                         // Blocks spread over the whole capacity, up to twice this many
+    size_t verifyBlockSize = 64 << 10;
+    double recommendSlack = 0.05;                        // Cheapest setting within 5% of the fastest is recommended
+    uint64_t seed = 0;                                   // 0 = time based
+};
+
+// One throughput test: a block size and queue depth, sequential or random
+struct ProbeResult {
+    IoRequest::Op op = IoRequest::READ;
+    bool random = false;
+    size_t blockSize = 0;
+    size_t queueDepth = 0;
+    uint64_t bytes = 0;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+    double p50Us = 0;                                    // Request latency percentiles, microseconds
+    double p99Us = 0;
+    double maxUs = 0;
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+    double Iops() const { return seconds > 0 ? requests / seconds : 0; }
+};
+
+// Sampled write-then-read of unique blocks over the whole LBA range. A counterfeit stick
+// maps its advertised capacity onto less flash, so a high sample overwrites a low one and
+// reading back finds another sample's header there (aliased); a failing one returns errors
+// or wrong data (mismatches).
+struct ProbeVerify {
+    bool done = false;
+    size_t samples = 0;
+    size_t blockSize = 0;
+    size_t mismatches = 0;
+    size_t aliased = 0;
+    size_t ioErrors = 0;
+    uint64_t firstBad = UINT64_MAX;
+    uint64_t usableBytes = 0;                            // Capacity below the first bad sample
+    double seconds = 0;
+
+    bool Passed() const { return mismatches == 0 && aliased == 0 && ioErrors == 0; }
+};
+
+struct UsbProbeReport {
+    std::string path;
+    std::string vendor;
+    std::string model;
+    uint64_t capacity = 0;
+    bool direct = false;
+    IoBackendKind backend = IO_AUTO;
+    std::vector<ProbeResult> results;
+    ProbeVerify verify;
+    size_t recommendedBlockSize = 1 << 20;               // For the copy or imaging phase that follows
+    size_t recommendedQueueDepth = 32;
+    std::vector<std::string> problems;                   // too-small, io-errors, fake-capacity, data-errors
+    double seconds = 0;
+
+    bool Healthy() const { return problems.empty(); }
+
+    const ProbeResult* Best(IoRequest::Op op, bool random) const {
+        const ProbeResult* best = nullptr;
+        for (const auto& result : results) {
+            if (result.op == op && result.random == random && (!best || result.MBPerSecond() > best->MBPerSecond())) best = &result;
+        }
+        return best;
+    }
+
+    std::wstring ToString() const {
+        auto speed = [&](IoRequest::Op op, bool random) {
+            const ProbeResult* best = Best(op, random);
+            return best ? std::to_wstring(static_cast<uint64_t>(random ? best->Iops() : best->MBPerSecond())) : std::wstring(L"-");
+        };
+        std::wstring text = std::to_wstring(capacity / 1000000) + L" MB, seq read " + speed(IoRequest::READ, false)
+            + L" MB/s, seq write " + speed(IoRequest::WRITE, false) + L" MB/s, 4K read " + speed(IoRequest::READ, true)
+            + L" IOPS, 4K write " + speed(IoRequest::WRITE, true) + L" IOPS";
+        if (verify.done) text += verify.Passed() ? L", capacity verified" : L", capacity verify FAILED";
+        for (const auto& problem : problems) text += L", " + std::wstring(problem.begin(), problem.end());
+        return text;
+    }
+
+    // One JSON object, stable keys, so results from a batch of sticks can be ranked by script
+    std::string ToJson() const {
+        std::string json = "{\n  \"path\": " + Quote(path) + ",\n  \"vendor\": " + Quote(vendor) + ",\n  \"model\": " + Quote(model)
+            + ",\n  \"capacity\": " + std::to_string(capacity) + ",\n  \"direct\": " + (direct ? "true" : "false")
+            + ",\n  \"backend\": " + Quote(Narrow(AsyncIo::KindName(backend))) + ",\n  \"tests\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const ProbeResult& result = results[i];
+            json += std::string(i ? ",\n" : "\n") + "    {\"op\": \"" + (result.op == IoRequest::WRITE ? "write" : "read")
+                + "\", \"pattern\": \"" + (result.random ? "random" : "sequential") + "\", \"block\": " + std::to_string(result.blockSize)
+                + ", \"qd\": " + std::to_string(result.queueDepth) + ", \"bytes\": " + std::to_string(result.bytes)
+                + ", \"requests\": " + std::to_string(result.requests) + ", \"errors\": " + std::to_string(result.errors)
+                + ", \"seconds\": " + Number(result.seconds) + ", \"mbps\": " + Number(result.MBPerSecond())
+                + ", \"iops\": " + Number(result.Iops()) + ", \"p50_us\": " + Number(result.p50Us)
+                + ", \"p99_us\": " + Number(result.p99Us) + ", \"max_us\": " + Number(result.maxUs) + "}";
+        }
+        json += "\n  ],\n  \"verify\": ";
+        if (verify.done) {
+            json += "{\"samples\": " + std::to_string(verify.samples) + ", \"block\": " + std::to_string(verify.blockSize)
+                + ", \"mismatches\": " + std::to_string(verify.mismatches) + ", \"aliased\": " + std::to_string(verify.aliased)
+                + ", \"io_errors\": " + std::to_string(verify.ioErrors)
+                + ", \"first_bad\": " + (verify.firstBad == UINT64_MAX ? std::string("null") : std::to_string(verify.firstBad))
+                + ", \"usable_bytes\": " + std::to_string(verify.usableBytes) + ", \"seconds\": " + Number(verify.seconds) + "}";
+        }
+        else {
+            json += "null";
+        }
+        json += ",\n  \"recommended\": {\"block\": " + std::to_string(recommendedBlockSize) + ", \"qd\": " + std::to_string(recommendedQueueDepth)
+            + "},\n  \"healthy\": " + (Healthy() ? "true" : "false") + ",\n  \"problems\": [";
+        for (size_t i = 0; i < problems.size(); ++i) json += (i ? ", " : "") + Quote(problems[i]);
+        return json + "],\n  \"seconds\": " + Number(seconds) + "\n}\n";
+    }
+
+    static std::string Narrow(const std::wstring& text) { return std::string(text.begin(), text.end()); }
+
+    static std::string Number(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", value);
+        return text;
+    }
+
+    static std::string Quote(const std::string& text) {
+        std::string quoted = "\"";
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += static_cast<char>(c);
+            }
+            else if (c < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                quoted += escape;
+            }
+            else {
+                quoted += static_cast<char>(c);
+            }
+        }
+        return quoted + "\"";
+    }
+};
+
+// Characterizes a usb stick (or a file or loop image standing in for one) before anything is
+// copied to it: sequential throughput for each block size and queue depth, 4K random IOPS
+// at several queue depths, and a sampled verify of the whole advertised capacity. Every
+// test goes through the async I/O layer with unbuffered handles so the numbers are the
+// device's, not the page cache's. The fastest sequential setting, or a cheaper one within
+// recommendSlack of it, is recommended for the copy phase. Write tests run first because
+// reads of never written flash are answered by the controller without touching NAND.
+class UsbProbe {
+
+    public:
+
+        static constexpr size_t ALIGNMENT = 4096;
+        static constexpr char MAGIC[8] = { 'W', 'T', 'G', 'P', 'R', 'O', 'B', 'E' };
+
+        explicit UsbProbe(const UsbProbeOptions& probeOptions = UsbProbeOptions()) : options(probeOptions) {}
+        ~UsbProbe() = default;
+
+        bool Run(const std::filesystem::path& path) {
+            report = UsbProbeReport();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+            auto text = path.u8string();
+            report.path.assign(reinterpret_cast<const char*>(text.data()), text.size());
+            seed = options.seed ? options.seed : static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) | 1;
+
+            File file;
+            File::Mode mode = options.write ? File::UPDATE : File::READ;
+            report.direct = options.direct && file.Open(path, mode, File::ASYNC | File::DIRECT);
+            if (!report.direct && !file.Open(path, mode, File::ASYNC)) return Fail(file.Error());
+            report.capacity = (options.capacity ? options.capacity : file.Size()) / ALIGNMENT * ALIGNMENT;
+            if (report.capacity < options.verifyBlockSize) return Fail(L"Cannot determine the capacity of " + path.wstring());
+            Identify(path, file);
+#ifdef _WIN32
+            // Raw writes into a mounted volume are refused; dismounting fails harmlessly on disks and files
+            DWORD returned = 0;
+            if (options.write) {
+                DeviceIoControl(file.Native(), FSCTL_LOCK_VOLUME, NULL, 0, NULL, 0, &returned, NULL);
+                DeviceIoControl(file.Native(), FSCTL_DISMOUNT_VOLUME, NULL, 0, NULL, 0, &returned, NULL);
+            }
+#endif
+
+            std::vector<IoRequest::Op> ops;
+            if (options.write) ops.push_back(IoRequest::WRITE);
+            ops.push_back(IoRequest::READ);
+            for (IoRequest::Op op : ops) {
+                for (size_t block : options.blockSizes) {
+                    for (size_t depth : options.sequentialDepths) {
+                        if (!Measure(file, op, false, block, depth, options.sequentialBytes)) return false;
+                    }
+                }
+            }
+            for (IoRequest::Op op : ops) {
+                for (size_t depth : options.randomDepths) {
+                    if (!Measure(file, op, true, options.randomBlockSize, depth, options.randomBytes)) return false;
+                }
+            }
+            if (options.write && !Verify(file)) return false;
+
+            Recommend(options.write ? IoRequest::WRITE : IoRequest::READ);
+            if (report.capacity < options.minCapacity) report.problems.push_back("too-small");
+            for (const auto& result : report.results) {
+                if (result.errors > 0) {
+                    report.problems.push_back("io-errors");
+                    break;
+                }
+            }
+            if (report.verify.aliased > 0) report.problems.push_back("fake-capacity");
+            else if (report.verify.done && !report.verify.Passed()) report.problems.push_back("data-errors");
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        const UsbProbeReport& Report() const { return report; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        struct AlignedDelete {
+            void operator()(uint8_t* buffer) const { operator delete[](buffer, std::align_val_t(ALIGNMENT)); }
+        };
+
+        using Buffer = std::unique_ptr<uint8_t[], AlignedDelete>;
+
+        // Per request callbacks of Pump(): next offset (false when done), fill before a write,
+        // and the completion with its latency
+        using NextFunction = std::function<bool(uint64_t&)>;
+        using FillFunction = std::function<void(uint8_t*, uint64_t)>;
+        using DoneFunction = std::function<void(uint8_t*, uint64_t, int64_t, double)>;
+
+        UsbProbeOptions options;
+        UsbProbeReport report;
+        std::wstring error;
+        uint64_t seed = 1;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        uint64_t Random() {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            return seed;
+        }
+
+        // Keeps `depth` requests of `block` bytes in flight until next() runs dry
+        bool Pump(File& file, IoRequest::Op op, size_t block, size_t depth, const NextFunction& next,
+                  const FillFunction& fill, const DoneFunction& done) {
+            IoOptions io;
+            io.backend = options.backend;
+            io.queueDepth = depth;
+            io.blockSize = block;
+            io.threads = depth;
+            io.direct = report.direct;
+            std::unique_ptr<AsyncIo> backend = CreateAsyncIo(io);
+            if (!backend) return Fail(L"No async I/O backend available");
+            report.backend = backend->Kind();
+
+            struct Slot {
+                Buffer buffer;
+                uint64_t offset = 0;
+                std::chrono::steady_clock::time_point started;
+            };
+            std::vector<Slot> slots(depth);
+            std::vector<std::pair<void*, size_t>> registered;
+            for (auto& slot : slots) {
+                slot.buffer.reset(static_cast<uint8_t*>(operator new[](block, std::align_val_t(ALIGNMENT))));
+                registered.emplace_back(slot.buffer.get(), block);
+            }
+            bool fixed = backend->RegisterBuffers(registered);
+
+            auto issue = [&](size_t index) {
+                Slot& slot = slots[index];
+                if (!next(slot.offset)) return false;
+                if (op == IoRequest::WRITE && fill) fill(slot.buffer.get(), slot.offset);
+                IoRequest request;
+                request.op = op;
+                request.file = &file;
+                request.buffer = slot.buffer.get();
+                request.length = block;
+                request.offset = slot.offset;
+                request.tag = index;
+                request.bufferIndex = fixed ? static_cast<int>(index) : -1;
+                slot.started = std::chrono::steady_clock::now();
+                return backend->Submit(request);
+            };
+
+            size_t active = 0;
+            for (size_t i = 0; i < slots.size() && issue(i); ++i) active++;
+            backend->Flush();
+            std::vector<IoCompletion> completions;
+            while (active > 0) {
+                completions.clear();
+                if (backend->Reap(completions, 1) == 0) {
+                    return Fail(backend->Error().empty() ? L"I/O backend stalled" : backend->Error());
+                }
+                auto now = std::chrono::steady_clock::now();
+                for (const auto& completion : completions) {
+                    size_t index = static_cast<size_t>(completion.tag);
+                    Slot& slot = slots[index];
+                    done(slot.buffer.get(), slot.offset, completion.result, std::chrono::duration<double, std::micro>(now - slot.started).count());
+                    if (!issue(index)) active--;
+                }
+                backend->Flush();
+            }
+            return true;
+        }
+
+        bool Measure(File& file, IoRequest::Op op, bool random, size_t block, size_t depth, uint64_t limit) {
+            block = std::max<size_t>(ALIGNMENT, block / ALIGNMENT * ALIGNMENT);
+            depth = std::max<size_t>(1, depth);
+            uint64_t blocks = report.capacity / block;
+            if (blocks == 0) return true;
+
+            ProbeResult result;
+            result.op = op;
+            result.random = random;
+            result.blockSize = block;
+            result.queueDepth = depth;
+            std::vector<float> latencies;
+            std::vector<uint8_t> pattern(block);
+            for (size_t i = 0; i < block; i += 8) {
+                uint64_t value = Random();
+                std::memcpy(pattern.data() + i, &value, std::min<size_t>(8, block - i));
+            }
+
+            uint64_t issued = 0, position = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.secondsPerTest));
+            auto next = [&](uint64_t& offset) {
+                if (issued >= limit || std::chrono::steady_clock::now() >= deadline) return false;
+                offset = (random ? Random() % blocks : position++ % blocks) * block;
+                issued += block;
+                return true;
+            };
+            // Incompressible data, copied once per buffer rather than generated per request
+            auto fill = [&](uint8_t* buffer, uint64_t) {
+                if (std::memcmp(buffer, pattern.data(), 8) != 0) std::memcpy(buffer, pattern.data(), block);
+            };
+            auto done = [&](uint8_t*, uint64_t, int64_t transferred, double microseconds) {
+                result.requests++;
+                if (transferred != static_cast<int64_t>(block)) result.errors++;
+                else result.bytes += block;
+                latencies.push_back(static_cast<float>(microseconds));
+            };
+            if (!Pump(file, op, block, depth, next, fill, done)) return false;
+            if (op == IoRequest::WRITE && !file.Sync()) result.errors++;
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (!latencies.empty()) {
+                std::sort(latencies.begin(), latencies.end());
+                result.p50Us = latencies[latencies.size() / 2];
+                result.p99Us = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+                result.maxUs = latencies.back();
+            }
+            report.results.push_back(result);
+            return true;
+        }
+
+        // Header (magic, offset, run seed) then a stream seeded by both, so every sample differs
+        static void FillSample(uint8_t* buffer, size_t length, uint64_t offset, uint64_t run) {
+            std::memcpy(buffer, MAGIC, 8);
+            std::memcpy(buffer + 8, &offset, 8);
+            std::memcpy(buffer + 16, &run, 8);
+            uint64_t state = (offset + 1) * 0x9E3779B97F4A7C15ULL ^ run;
+            for (size_t i = 24; i + 8 <= length; i += 8) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                std::memcpy(buffer + i, &state, 8);
+            }
+        }
+
+        bool Verify(File& file) {
+            ProbeVerify& verify = report.verify;
+            auto start = std::chrono::steady_clock::now();
+            size_t block = std::max<size_t>(ALIGNMENT, options.verifyBlockSize / ALIGNMENT * ALIGNMENT);
+            // Samples sit on a power of two stride: a fake that wraps its address modulo a power
+            // of two (the usual case) lands every high sample exactly on a lower one. The last
+            // block is added because shortfalls that do not wrap show up at the top end.
+            uint64_t stride = ALIGNMENT;
+            while (stride < block || stride * 2 <= report.capacity / std::max<size_t>(1, options.verifySamples)) stride *= 2;
+            std::vector<uint64_t> offsets;
+            for (uint64_t offset = 0; offset + block <= report.capacity; offset += stride) offsets.push_back(offset);
+            uint64_t last = report.capacity / block * block - block;
+            if (offsets.back() != last) offsets.push_back(last);
+            verify.samples = offsets.size();
+            verify.blockSize = block;
+            uint64_t run = Random();
+            size_t depth = std::min<size_t>(16, offsets.size());
+
+            size_t index = 0;
+            auto next = [&](uint64_t& offset) {
+                if (index >= offsets.size()) return false;
+                offset = offsets[index++];
+                return true;
+            };
+            auto fill = [&](uint8_t* buffer, uint64_t offset) { FillSample(buffer, block, offset, run); };
+            auto bad = [&](uint64_t offset) { verify.firstBad = std::min(verify.firstBad, offset); };
+            auto written = [&](uint8_t*, uint64_t offset, int64_t transferred, double) {
+                if (transferred != static_cast<int64_t>(block)) {
+                    verify.ioErrors++;
+                    bad(offset);
+                }
+            };
+            if (!Pump(file, IoRequest::WRITE, block, depth, next, fill, written)) return false;
+            if (!file.Sync()) verify.ioErrors++;
+#if defined(__linux__)
+            // Buffered fallback: the reads must come from the device, not the pages just written
+            if (!report.direct) posix_fadvise(file.Native(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+            std::vector<uint8_t> expected(block);
+            index = 0;
+            auto read = [&](uint8_t* buffer, uint64_t offset, int64_t transferred, double) {
+                if (transferred != static_cast<int64_t>(block)) {
+                    verify.ioErrors++;
+                    bad(offset);
+                    return;
+                }
+                FillSample(expected.data(), block, offset, run);
+                if (std::memcmp(buffer, expected.data(), block) == 0) return;
+                uint64_t found = 0, foundRun = 0;
+                std::memcpy(&found, buffer + 8, 8);
+                std::memcpy(&foundRun, buffer + 16, 8);
+                if (std::memcmp(buffer, MAGIC, 8) == 0 && foundRun == run && found != offset) verify.aliased++;
+                else verify.mismatches++;
+                bad(offset);
+            };
+            if (!Pump(file, IoRequest::READ, block, depth, next, nullptr, read)) return false;
+
+            verify.usableBytes = verify.firstBad == UINT64_MAX ? report.capacity : verify.firstBad;
+            verify.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            verify.done = true;
+            return true;
+        }
+
+        // Fastest sequential setting, then the one with the least memory in flight within the slack
+        void Recommend(IoRequest::Op op) {
+            const ProbeResult* best = report.Best(op, false);
+            if (!best) return;
+            const ProbeResult* chosen = best;
+            for (const auto& result : report.results) {
+                if (result.op != op || result.random || result.MBPerSecond() < best->MBPerSecond() * (1 - options.recommendSlack)) continue;
+                uint64_t footprint = static_cast<uint64_t>(result.blockSize) * result.queueDepth;
+                uint64_t chosenFootprint = static_cast<uint64_t>(chosen->blockSize) * chosen->queueDepth;
+                if (footprint < chosenFootprint || (footprint == chosenFootprint && result.queueDepth < chosen->queueDepth)) chosen = &result;
+            }
+            report.recommendedBlockSize = chosen->blockSize;
+            report.recommendedQueueDepth = chosen->queueDepth;
+        }
+
+        // Vendor and model for the report, from sysfs or the storage descriptor; empty for files
+        void Identify(const std::filesystem::path& path, File& file) {
+#ifdef _WIN32
+            (void)path;
+            STORAGE_PROPERTY_QUERY query = {};
+            query.PropertyId = StorageDeviceProperty;
+            query.QueryType = PropertyStandardQuery;
+            std::vector<uint8_t> buffer(1024);
+            DWORD returned = 0;
+            if (!DeviceIoControl(file.Native(), IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), buffer.data(),
+                                 static_cast<DWORD>(buffer.size()), &returned, NULL) || returned < sizeof(STORAGE_DEVICE_DESCRIPTOR)) {
+                return;
+            }
+            auto descriptor = reinterpret_cast<const STORAGE_DEVICE_DESCRIPTOR*>(buffer.data());
+            auto field = [&](DWORD offset) {
+                if (offset == 0 || offset >= returned) return std::string();
+                const char* text = reinterpret_cast<const char*>(buffer.data() + offset);
+                return Trim(std::string(text, strnlen(text, returned - offset)));
+            };
+            report.vendor = field(descriptor->VendorIdOffset);
+            report.model = field(descriptor->ProductIdOffset);
+#else
+            (void)file;
+            std::error_code ec;
+            std::filesystem::path device = std::filesystem::canonical(path, ec);
+            if (ec || device.parent_path() != "/dev") return;
+            std::filesystem::path block = std::filesystem::canonical(std::filesystem::path("/sys/class/block") / device.filename(), ec);
+            if (ec) return;
+            // A partition's sysfs node sits below its disk's
+            if (!std::filesystem::exists(block / "device", ec)) block = block.parent_path();
+            report.vendor = ReadLine(block / "device" / "vendor");
+            report.model = ReadLine(block / "device" / "model");
+#endif
+        }
+
+        static std::string ReadLine(const std::filesystem::path& path) {
+            std::ifstream file(path);
+            std::string line;
+            std::getline(file, line);
+            return Trim(line);
+        }
+
+        static std::string Trim(const std::string& text) {
+            size_t begin = text.find_first_not_of(" \t\r\n");
+            if (begin == std::string::npos) return std::string();
+            return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+        }
+};
+
+#endif
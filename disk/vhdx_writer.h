@@ -0,0 +1,262 @@
+#ifndef _VHDX_WRITER_H_
+#define _VHDX_WRITER_H_
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../editor/bcd_store.h"
+#include "../hash/crc32c.h"
+#include "../platform/file.h"
+
+struct VhdxOptions {
+    uint64_t size = 0;                                   // Virtual disk size, rounded up to the logical sector size
+    uint32_t blockSize = 32 << 20;                       // Allocation unit, 1 to 256 MB and a power of two; Hyper-V's default
+    uint32_t logicalSectorSize = 512;                    // 512 or 4096; native boot wants 512
+    uint32_t physicalSectorSize = 4096;
+    bool skipZeros = true;                               // Zeros written to a block not yet allocated allocate nothing
+};
+
+struct VhdxStats {
+    uint64_t blocks = 0;                                 // Payload blocks of the virtual disk
+    uint64_t allocatedBlocks = 0;
+    uint64_t bytesWritten = 0;                           // Virtual disk bytes stored in the file
+    uint64_t zeroBytes = 0;                              // Zeros that allocated nothing
+    uint64_t fileBytes = 0;                              // Size of the file once closed
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(allocatedBlocks) + L" of " + std::to_wstring(blocks) + L" blocks allocated, "
+            + std::to_wstring(bytesWritten / 1000000) + L" MB written, " + std::to_wstring(zeroBytes / 1000000)
+            + L" MB of zeros skipped, " + std::to_wstring(fileBytes / 1000000) + L" MB file in " + std::to_wstring(seconds) + L" s";
+    }
+};
+
+// Writes a dynamically expanding VHDX (MS-VHDX 1.0) without the Windows virtual disk
+// service, so the image can be built on any host. The file is laid out as
+//   0 - 1 MB    file identifier, two headers, two region tables
+//   1 MB        log, 1 MB, never used: the log GUID is zero, nothing to replay
+//   2 MB        metadata: file parameters, virtual size, disk id, sector sizes
+//   3 MB        block allocation table, rounded up to 1 MB
+//   after it    payload blocks, in the order they are first written
+// A payload block is allocated the first time something other than zeros is written into
+// it, appended at the end of the file; a caller that writes in ascending order (an image,
+// a partition table, a file system) gets a file written front to back, and never-written
+// or all-zero blocks cost nothing. The table interleaves a sector bitmap entry after every
+// chunk of payload entries; a disk without a parent has no sector bitmap blocks, so those
+// stay NOT_PRESENT. The BAT, metadata, region tables and headers go out in Close(), headers
+// last, so a file cut off before that is not a disk at all rather than a wrong one.
+class VhdxWriter {
+
+    public:
+
+        static constexpr uint64_t MB = 1 << 20;
+        static constexpr uint64_t LOG_OFFSET = 1 * MB;
+        static constexpr uint64_t METADATA_OFFSET = 2 * MB;
+        static constexpr uint64_t BAT_OFFSET = 3 * MB;
+        static constexpr uint64_t BLOCK_NOT_PRESENT = 0;
+        static constexpr uint64_t BLOCK_FULLY_PRESENT = 6;
+
+        VhdxWriter() = default;
+        ~VhdxWriter() { Close(); }
+        VhdxWriter(const VhdxWriter&) = delete;
+        VhdxWriter& operator=(const VhdxWriter&) = delete;
+
+        bool Create(const std::filesystem::path& path, const VhdxOptions& vhdxOptions) {
+            Close();
+            error.clear();
+            stats = VhdxStats();
+            options = vhdxOptions;
+            start = std::chrono::steady_clock::now();
+            uint32_t logical = options.logicalSectorSize, physical = options.physicalSectorSize;
+            if ((logical != 512 && logical != 4096) || (physical != 512 && physical != 4096)) return Fail(L"Unsupported sector size");
+            if (options.blockSize < MB || options.blockSize > 256 * MB || (options.blockSize & (options.blockSize - 1)) != 0) {
+                return Fail(L"Block size must be a power of two from 1 to 256 MB");
+            }
+            options.size = (options.size + logical - 1) / logical * logical;
+            if (options.size == 0 || options.size > (64ULL << 40)) return Fail(L"Virtual disk size must be above 0 and at most 64 TB");
+
+            chunkRatio = (8ULL << 20) * logical / options.blockSize;
+            stats.blocks = (options.size + options.blockSize - 1) / options.blockSize;
+            uint64_t entries = stats.blocks + (stats.blocks - 1) / chunkRatio;
+            bat.assign(static_cast<size_t>(entries), BLOCK_NOT_PRESENT);
+            end = BAT_OFFSET + RoundUp(entries * 8, MB);
+            if (!file.Open(path, File::WRITE)) return Fail(file.Error());
+            file.SetSparse();
+            return true;
+        }
+
+        // Any offset and length inside the virtual disk; blocks are allocated as needed
+        bool Write(uint64_t offset, const void* data, size_t length) {
+            if (!file.IsOpen()) return Fail(L"No VHDX open");
+            if (offset > options.size || length > options.size - offset) return Fail(L"Write beyond the end of the virtual disk");
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            while (length > 0) {
+                uint64_t block = offset / options.blockSize;
+                uint64_t within = offset % options.blockSize;
+                size_t take = static_cast<size_t>(std::min<uint64_t>(length, options.blockSize - within));
+                uint64_t& entry = bat[static_cast<size_t>(Entry(block))];
+                if (entry == BLOCK_NOT_PRESENT) {
+                    if (options.skipZeros && IsZero(bytes, take)) {
+                        stats.zeroBytes += take;
+                        offset += take;
+                        bytes += take;
+                        length -= take;
+                        continue;
+                    }
+                    entry = end | BLOCK_FULLY_PRESENT;
+                    end += options.blockSize;
+                    stats.allocatedBlocks++;
+                }
+                if (!file.WriteAt(bytes, take, (entry & ~(MB - 1)) + within)) return Fail(file.Error());
+                stats.bytesWritten += take;
+                offset += take;
+                bytes += take;
+                length -= take;
+            }
+            return true;
+        }
+
+        // Writes the tables and headers and closes the file; true if nothing failed on the way
+        bool Close() {
+            if (!file.IsOpen()) return error.empty();
+            bool ok = error.empty() && file.Resize(end) && WriteTables() && file.Sync();
+            if (!ok && error.empty()) error = file.Error();
+            file.Close();
+            stats.fileBytes = end;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return ok;
+        }
+
+        uint64_t Size() const { return options.size; }
+        uint32_t LogicalSectorSize() const { return options.logicalSectorSize; }
+        const VhdxStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+        // BAT index of payload block `block`: a sector bitmap entry follows every chunkRatio of them
+        uint64_t Entry(uint64_t block) const { return block + block / chunkRatio; }
+
+        static BcdGuid Guid(const wchar_t* text) {
+            BcdGuid guid;
+            BcdGuid::Parse(text, guid);
+            return guid;
+        }
+
+        static constexpr const wchar_t* BAT_REGION = L"{2dc27766-f623-4200-9d64-115e9bfd4a08}";
+        static constexpr const wchar_t* METADATA_REGION = L"{8b7ca206-4790-4b9a-b8fe-575f050f886e}";
+        static constexpr const wchar_t* FILE_PARAMETERS = L"{caa16737-fa36-4d43-b3b6-33f0aa44e76b}";
+        static constexpr const wchar_t* VIRTUAL_DISK_SIZE = L"{2fa54224-cd1b-4876-b211-5dbed83bf4b8}";
+        static constexpr const wchar_t* VIRTUAL_DISK_ID = L"{beca12ab-b2e6-4523-93ef-c309e000c746}";
+        static constexpr const wchar_t* LOGICAL_SECTOR_SIZE = L"{8141bf1d-a96f-4709-ba47-f233a8faab5f}";
+        static constexpr const wchar_t* PHYSICAL_SECTOR_SIZE = L"{cda348c7-445d-4471-9cc9-e9885251c556}";
+
+    private:
+
+        VhdxOptions options;
+        VhdxStats stats;
+        std::wstring error;
+        File file;
+        std::vector<uint64_t> bat;
+        uint64_t chunkRatio = 1;
+        uint64_t end = 0;                                // Next block goes here; the file size once closed
+        std::chrono::steady_clock::time_point start;
+
+        bool Fail(const std::wstring& message) {
+            if (error.empty()) error = message;
+            return false;
+        }
+
+        static uint64_t RoundUp(uint64_t value, uint64_t unit) { return (value + unit - 1) / unit * unit; }
+
+        static bool IsZero(const uint8_t* data, size_t length) {
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                if (word) return false;
+            }
+            for (; i < length; ++i) {
+                if (data[i]) return false;
+            }
+            return true;
+        }
+
+        static void PutGuid(uint8_t* at, const wchar_t* text) { Guid(text).ToBytes(at); }
+
+        // Metadata, BAT, region tables, then the headers and the file identifier that make it a VHDX
+        bool WriteTables() {
+            std::vector<uint8_t> metadata(MB, 0);
+            std::memcpy(metadata.data(), "metadata", 8);
+            struct Item {
+                const wchar_t* id;
+                uint32_t length;
+                uint32_t flags;                          // 2 = virtual disk, 4 = required
+            };
+            const Item items[] = {
+                { FILE_PARAMETERS, 8, 4 }, { VIRTUAL_DISK_SIZE, 8, 6 }, { VIRTUAL_DISK_ID, 16, 6 },
+                { LOGICAL_SECTOR_SIZE, 4, 6 }, { PHYSICAL_SECTOR_SIZE, 4, 6 }
+            };
+            Hive::Put16(metadata.data(), 10, static_cast<uint16_t>(std::size(items)));
+            uint32_t at = 64 << 10;
+            for (size_t i = 0; i < std::size(items); ++i) {
+                uint8_t* entry = metadata.data() + 32 + 32 * i;
+                PutGuid(entry, items[i].id);
+                Hive::Put32(entry, 16, at);
+                Hive::Put32(entry, 20, items[i].length);
+                Hive::Put32(entry, 24, items[i].flags);
+                uint8_t* value = metadata.data() + at;
+                switch (i) {
+                    case 0: Hive::Put32(value, 0, options.blockSize); break;      // Blocks not kept allocated, no parent
+                    case 1: Hive::Put64(value, 0, options.size); break;
+                    case 2: BcdGuid::Random().ToBytes(value); break;
+                    case 3: Hive::Put32(value, 0, options.logicalSectorSize); break;
+                    default: Hive::Put32(value, 0, options.physicalSectorSize); break;
+                }
+                at += 4096;
+            }
+            if (!file.WriteAt(metadata.data(), metadata.size(), METADATA_OFFSET)) return false;
+
+            std::vector<uint8_t> table(static_cast<size_t>(RoundUp(bat.size() * 8, MB)), 0);
+            for (size_t i = 0; i < bat.size(); ++i) Hive::Put64(table.data(), i * 8, bat[i]);
+            if (!file.WriteAt(table.data(), table.size(), BAT_OFFSET)) return false;
+
+            std::vector<uint8_t> regions(64 << 10, 0);
+            Hive::Put32(regions.data(), 0, 0x69676572);  // "regi"
+            Hive::Put32(regions.data(), 8, 2);
+            PutGuid(regions.data() + 16, BAT_REGION);
+            Hive::Put64(regions.data(), 32, BAT_OFFSET);
+            Hive::Put32(regions.data(), 40, static_cast<uint32_t>(table.size()));
+            Hive::Put32(regions.data(), 44, 1);
+            PutGuid(regions.data() + 48, METADATA_REGION);
+            Hive::Put64(regions.data(), 64, METADATA_OFFSET);
+            Hive::Put32(regions.data(), 72, static_cast<uint32_t>(metadata.size()));
+            Hive::Put32(regions.data(), 76, 1);
+            Hive::Put32(regions.data(), 4, Crc32c::Of(regions.data(), regions.size()));
+            if (!file.WriteAt(regions.data(), regions.size(), 192 << 10) || !file.WriteAt(regions.data(), regions.size(), 256 << 10)) return false;
+
+            // Both headers valid, the second current; a later writer bumps the older one
+            BcdGuid fileWrite = BcdGuid::Random(), dataWrite = BcdGuid::Random();
+            for (uint64_t sequence : { 1, 2 }) {
+                std::vector<uint8_t> header(4096, 0);
+                Hive::Put32(header.data(), 0, 0x64616568);   // "head"
+                Hive::Put64(header.data(), 8, sequence);
+                fileWrite.ToBytes(header.data() + 16);
+                dataWrite.ToBytes(header.data() + 32);
+                Hive::Put16(header.data(), 66, 1);           // Version; log version 0, log GUID zero
+                Hive::Put32(header.data(), 68, static_cast<uint32_t>(MB));
+                Hive::Put64(header.data(), 72, LOG_OFFSET);
+                Hive::Put32(header.data(), 4, Crc32c::Of(header.data(), header.size()));
+                if (!file.WriteAt(header.data(), header.size(), sequence << 16)) return false;
+            }
+
+            std::vector<uint8_t> identifier(64 << 10, 0);
+            std::memcpy(identifier.data(), "vhdxfile", 8);
+            const wchar_t* creator = L"Windows To Go creator";
+            for (size_t c = 0; creator[c]; ++c) Hive::Put16(identifier.data(), 8 + 2 * c, static_cast<uint16_t>(creator[c]));
+            return file.WriteAt(identifier.data(), identifier.size(), 0);
+        }
+};
+
+#endif
@@ -1,25 +1,17 @@
 #ifndef _BCD_H_
 #define _BCD_H_
+#include <string>
 #include <vector>
 #include <thread> 
 #include <mutex>
 #include <atomic> // Use for to update the message constantly
-#include <windows.h>
-
-extern std::wstring MESSAGE;
-extern std::wstring ERROR;
-
-// Check Windows version by examining system files on the target drive
-enum WindowsVersion {
-    WIN_UNKNOWN,
-    WIN_XP,
-    WIN_VISTA,
-    WIN_7,
-    WIN_8,
-    WIN_8_1,
-    WIN_10,
-    WIN_11
-};
+#include "bcd_plan.h"
+#include "bcd_index.h"
+#include "windows_version.h"
+#include "../disk/boot_files.h"
+#include "../platform/partition_info.h"
+#include "../progress/progress_channel.h"
+#include "../trace/tracer.h"
 
 class BCD {
 
@@ -32,533 +24,495 @@ class BCD {
         explicit BCD(const std::wstring& _drive, const std::wstring& windows_driver) 
             : drive(_drive) { windows = windows_driver; }
 
-        ~bcd() = default;
+        ~BCD() = default;
 
     private:
 
-        static std::wstring windows;
+        static inline std::wstring windows;
         std::wstring drive;
 
+    public:
 
+        // Edits the store on the stick, <usbDrive>\Boot\BCD, which a copy or an image brought
+        // over from the source; a stick without one (an applied WIM) gets a new store with a
+        // boot manager and a loader. The source's own store is left alone.
         bool ModifyBootManager(const std::wstring& usbDrive) {
-            MESSAGE = L"Modifying BCD bootloader for USB compatibility...";
-            
-            // First validate the current BCD
-            if (!ValidateSystemBCD()) {
-                MESSAGE = L"ERROR: Cannot modify corrupted BCD";
+            TraceScope scope("bcd.modify-boot-manager", "bcd");
+            Progress().Message(L"Modifying BCD bootloader for USB compatibility...");
+            if (!BCDStoreExists(StorePathForDrive(usbDrive).wstring())
+                && (!CreateStoreForDrive(usbDrive) || !RepairBCDForDrive(usbDrive))) {
                 return false;
             }
             
             WindowsVersion version = GetWindowsVersionFromDrive(windows);
-            std::wstring bcdEditPath = GetBCDEditPathForVersion(version);
-            
-            // USB-specific BCD modifications
-            std::vector<std::wstring> usbModifications = GetUSBModificationsForVersion(version, usbDrive);
             
-            for (const auto& modification : usbModifications) {
-                std::wstring output;
-                if (!ExecuteBCDCommandForDrive(bcdEditPath, modification, targetWindowsDrive, output)) {
-                    MESSAGE = L"WARNING: Failed to apply USB modification: " + modification;
-                    // Continue with other modifications
-                }
-                Sleep(500); // Small delay between commands
-            }
+            // Every stage adds to one plan; duplicates collapse and the store is written once
+            BcdPlan plan;
+            AddUSBModificationsForVersion(plan, version, usbDrive);
+            ApplyVersionSpecificUSBOptimizations(plan, version);
             
-            // Apply version-specific USB optimizations
-            if (!ApplyVersionSpecificUSBOptimizations(version, usbDrive)) {
-                MESSAGE = L"WARNING: Some USB optimizations failed";
+            if (!CommitPlan(plan, usbDrive)) {
+                return false;
             }
             
             // Validate the modifications
-            MESSAGE = L"Validating USB boot modifications...";
-            if (!ValidateSystemBCD()) {
-                MESSAGE = L"ERROR: BCD corrupted after USB modifications";
+            Progress().Message(L"Validating USB boot modifications...");
+            if (!ValidateSystemBCD(usbDrive)) {
+                Progress().Error(L"BCD corrupted after USB modifications");
                 return false;
             }
             
-            MESSAGE = L"BCD successfully modified for USB boot compatibility";
+            Progress().Message(L"BCD successfully modified for USB boot compatibility");
             return true;
         }
 
-        static std::vector<std::wstring> GetUSBModificationsForVersion(WindowsVersion version, const std::wstring& usbDrive) {
-            std::vector<std::wstring> modifications;
-            
+    private:
+
+        static void AddUSBModificationsForVersion(BcdPlan& plan, WindowsVersion version, const std::wstring& usbDrive) {
             // COMMON USB MODIFICATIONS FOR ALL WINDOWS VERSIONS
-            modifications.push_back(L"/set {bootmgr} device partition=" + usbDrive);
-            modifications.push_back(L"/set {bootmgr} timeout 10");
-            modifications.push_back(L"/set {bootmgr} displayorder {current}");
-            modifications.push_back(L"/displayorder {current} /addfirst");
+            plan.Set(L"{bootmgr}", L"device", L"partition=" + usbDrive);
+            plan.Set(L"{bootmgr}", L"timeout", L"10");
+            plan.Set(L"{bootmgr}", L"displayorder", L"{current}");
+            plan.DisplayFirst(L"{current}");
             
             // Windows Boot Loader modifications for USB
-            modifications.push_back(L"/set {current} device partition=" + usbDrive);
-            modifications.push_back(L"/set {current} osdevice partition=" + usbDrive);
-            modifications.push_back(L"/set {current} path \\Windows\\system32\\winload.exe");
-            modifications.push_back(L"/set {current} systemroot \\Windows");
-            modifications.push_back(L"/set {current} detecthal yes");
-            modifications.push_back(L"/set {current} winpe no");
+            plan.Set(L"{current}", L"device", L"partition=" + usbDrive);
+            plan.Set(L"{current}", L"osdevice", L"partition=" + usbDrive);
+            plan.Set(L"{current}", L"path", L"\\Windows\\system32\\winload.exe");
+            plan.Set(L"{current}", L"systemroot", L"\\Windows");
+            plan.Set(L"{current}", L"detecthal", L"yes");
+            plan.Set(L"{current}", L"winpe", L"no");
             
             // VERSION-SPECIFIC MODIFICATIONS
             switch (version) {
                 case WIN_7:
-                    modifications.push_back(L"/set {current} nointegritychecks on");
-                    modifications.push_back(L"/set {current} pae forceenable");
-                    modifications.push_back(L"/set {current} useplatformclock yes");
-                    modifications.push_back(L"/set {current} truncatememory 0x10000000");
+                    plan.Set(L"{current}", L"nointegritychecks", L"on");
+                    plan.Set(L"{current}", L"pae", L"forceenable");
+                    plan.Set(L"{current}", L"useplatformclock", L"yes");
+                    plan.Set(L"{current}", L"truncatememory", L"0x10000000");
                     break;
                     
                 case WIN_8:
                 case WIN_8_1:
-                    modifications.push_back(L"/set {current} nointegritychecks on");
-                    modifications.push_back(L"/set {current} loadoptions DISABLE_INTEGRITY_CHECKS");
-                    modifications.push_back(L"/set {current} bootmenupolicy Legacy");
-                    modifications.push_back(L"/set {current} useplatformtick yes");
+                    plan.Set(L"{current}", L"nointegritychecks", L"on");
+                    plan.Set(L"{current}", L"loadoptions", L"DISABLE_INTEGRITY_CHECKS");
+                    plan.Set(L"{current}", L"bootmenupolicy", L"Legacy");
+                    plan.Set(L"{current}", L"useplatformtick", L"yes");
                     break;
                     
                 case WIN_10:
-                    modifications.push_back(L"/set {current} testsigning on");
-                    modifications.push_back(L"/set {current} bootmenupolicy Standard");
-                    modifications.push_back(L"/set {current} isolatedcontext no");
-                    modifications.push_back(L"/set {current] allowprereleaseboot yes");
-                    modifications.push_back(L"/set {current} bootlog yes");
-                    modifications.push_back(L"/set {current} quietboot no");
+                    plan.Set(L"{current}", L"testsigning", L"on");
+                    plan.Set(L"{current}", L"bootmenupolicy", L"Standard");
+                    plan.Set(L"{current}", L"isolatedcontext", L"no");
+                    plan.Set(L"{current}", L"bootlog", L"yes");
+                    plan.Set(L"{current}", L"quietboot", L"no");
                     break;
                     
                 case WIN_11:
-                    modifications.push_back(L"/set {current} testsigning on");
-                    modifications.push_back(L"/set {current} nointegritychecks on");
-                    modifications.push_back(L"/set {current} bootmenupolicy Standard");
-                    modifications.push_back(L"/set {current} hypervisorlaunchtype Off");
-                    modifications.push_back(L"/set {current} vsmLaunchType Off");
-                    modifications.push_back(L"/set {current} allowprereleaseboot yes");
-                    modifications.push_back(L"/set {current} bootlog yes");
-                    modifications.push_back(L"/set {current} quietboot no");
+                    plan.Set(L"{current}", L"testsigning", L"on");
+                    plan.Set(L"{current}", L"nointegritychecks", L"on");
+                    plan.Set(L"{current}", L"bootmenupolicy", L"Standard");
+                    plan.Set(L"{current}", L"hypervisorlaunchtype", L"Off");
+                    plan.Set(L"{current}", L"bootlog", L"yes");
+                    plan.Set(L"{current}", L"quietboot", L"no");
                     // Windows 11 specific: Disable VBS for better USB compatibility
-                    modifications.push_back(L"/set {current} isolatedcontext no");
-                    modifications.push_back(L"/set {current} vsmLaunchType Off");
+                    plan.Set(L"{current}", L"isolatedcontext", L"no");
+                    plan.Set(L"{current}", L"vsmlaunchtype", L"Off");
                     break;
                     
                 case WIN_VISTA:
-                    modifications.push_back(L"/set {current} nointegritychecks on");
-                    modifications.push_back(L"/set {current} pae forceenable");
+                    plan.Set(L"{current}", L"nointegritychecks", L"on");
+                    plan.Set(L"{current}", L"pae", L"forceenable");
                     break;
                     
                 default:
                     // Generic modifications for unknown versions
-                    modifications.push_back(L"/set {current} nointegritychecks on");
-                    modifications.push_back(L"/set {current} testsigning on");
+                    plan.Set(L"{current}", L"nointegritychecks", L"on");
+                    plan.Set(L"{current}", L"testsigning", L"on");
                     break;
             }
             
             // USB-SPECIFIC PERFORMANCE OPTIMIZATIONS
-            modifications.push_back(L"/set {current} custom:16000069 true"); // Enable USB boot flag
-            modifications.push_back(L"/set {current} custom:16000070 1");    // USB boot type
-            modifications.push_back(L"/set {current} custom:16000071 5000"); // USB boot delay
-            
-            return modifications;
+            plan.Set(L"{current}", L"custom:16000069", L"true"); // Enable USB boot flag
+            plan.Set(L"{current}", L"custom:16000070", L"1");    // USB boot type
+            plan.Set(L"{current}", L"custom:16000071", L"5000"); // USB boot delay
         }
 
-        static bool ApplyVersionSpecificUSBOptimizations(WindowsVersion version, const std::wstring& usbDrive) {
-            std::wstring bcdEditPath = GetBCDEditPathForVersion(version);
-            std::wstring output;
-            
+        static void ApplyVersionSpecificUSBOptimizations(BcdPlan& plan, WindowsVersion version) {
             switch (version) {
                 case WIN_10:
                 case WIN_11:
                     // Enable additional debugging for modern Windows
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} bootlog yes", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} sos yes", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} debug yes", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} debugtype Serial", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} debugport 1", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} baudrate 115200", targetWindowsDrive, output);
+                    plan.Set(L"{current}", L"bootlog", L"yes");
+                    plan.Set(L"{current}", L"sos", L"yes");
+                    plan.Set(L"{current}", L"debug", L"yes");
+                    plan.Set(L"{current}", L"debugtype", L"Serial");
+                    plan.Set(L"{current}", L"debugport", L"1");
+                    plan.Set(L"{current}", L"baudrate", L"115200");
                     break;
                     
                 case WIN_7:
                 case WIN_8:
                 case WIN_8_1:
                     // Legacy Windows USB optimizations
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} nx OptIn", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} increaseuserva 3072", targetWindowsDrive, output);
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} removememory 0", targetWindowsDrive, output);
+                    plan.Set(L"{current}", L"nx", L"OptIn");
+                    plan.Set(L"{current}", L"increaseuserva", L"3072");
+                    plan.Set(L"{current}", L"removememory", L"0");
                     break;
                     
                 default:
                     // Basic optimizations for older versions
-                    ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} nx OptIn", targetWindowsDrive, output);
+                    plan.Set(L"{current}", L"nx", L"OptIn");
                     break;
             }
             
             // Apply USB-specific registry-like settings through BCD
-            if (!ApplyUSBBootRegistryHacks(version, usbDrive)) {
-                MESSAGE = L"WARNING: Some USB registry hacks failed";
-            }
-            
-            return true;
+            ApplyUSBBootRegistryHacks(plan, version);
         }
 
-        static bool ApplyUSBBootRegistryHacks(WindowsVersion version, const std::wstring& usbDrive) {
+        static void ApplyUSBBootRegistryHacks(BcdPlan& plan, WindowsVersion version) {
             // These are advanced modifications that require direct BCD editing
             // They simulate registry tweaks for better USB boot compatibility
             
-            std::wstring bcdEditPath = GetBCDEditPathForVersion(version);
-            std::wstring output;
-            
             // Disable driver signature enforcement for USB boot
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} nointegritychecks on", targetWindowsDrive, output);
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} testsigning on", targetWindowsDrive, output);
+            plan.Set(L"{current}", L"nointegritychecks", L"on");
+            plan.Set(L"{current}", L"testsigning", L"on");
             
             // Enable legacy boot for better USB compatibility
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} bootmenupolicy Legacy", targetWindowsDrive, output);
+            plan.Set(L"{current}", L"bootmenupolicy", L"Legacy");
             
             // Disable secure boot for USB (if possible)
             if (version == WIN_8 || version == WIN_8_1 || version == WIN_10 || version == WIN_11) {
-                ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} disabledynamictick yes", targetWindowsDrive, output);
-                ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} useplatformclock yes", targetWindowsDrive, output);
+                plan.Set(L"{current}", L"disabledynamictick", L"yes");
+                plan.Set(L"{current}", L"useplatformclock", L"yes");
             }
             
             // Memory management for USB boot
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} removememory 0", targetWindowsDrive, output);
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} truncatememory 0", targetWindowsDrive, output);
+            plan.Set(L"{current}", L"removememory", L"0");
+            plan.Set(L"{current}", L"truncatememory", L"0");
             
             // USB-specific performance tweaks
             if (version == WIN_10 || version == WIN_11) {
-                ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} hypervisorlaunchtype Off", targetWindowsDrive, output);
-                ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} vsmLaunchType Off", targetWindowsDrive, output);
-                ExecuteBCDCommandForDrive(bcdEditPath, L"/set {current} isolatecontext no", targetWindowsDrive, output);
+                plan.Set(L"{current}", L"hypervisorlaunchtype", L"Off");
+                plan.Set(L"{current}", L"vsmlaunchtype", L"Off");
+                plan.Set(L"{current}", L"isolatedcontext", L"no");
             }
-            
-            return true;
         }
 
-        static bool CreateUSBSpecificBootEntry(const std::wstring& usbDrive) {
-            MESSAGE = L"Creating USB-specific boot entry...";
+        // Adds a dedicated USB boot entry to the plan and returns its identifier
+        // With a vhd path ("\WindowsToGo.vhdx") the loader boots Windows natively from that
+        // VHD on the USB drive instead of from the drive's own partition
+        static std::wstring AddUSBSpecificBootEntry(BcdPlan& plan, WindowsVersion version, const std::wstring& usbDrive,
+                                                    const std::wstring& vhd = L"") {
+            std::wstring usbBootGuid = plan.CreateOsLoader(L"Windows To Go - USB");
+            std::wstring device = vhd.empty() ? L"partition=" + usbDrive : L"vhd=[" + usbDrive + L"]" + vhd;
             
-            WindowsVersion version = GetWindowsVersionFromDrive(targetWindowsDrive);
-            std::wstring bcdEditPath = GetBCDEditPathForVersion(version);
-            std::wstring output;
+            // Configure the USB-specific boot entry
+            plan.Set(usbBootGuid, L"device", device);
+            plan.Set(usbBootGuid, L"osdevice", device);
+            plan.Set(usbBootGuid, L"path", L"\\Windows\\system32\\winload.exe");
+            plan.Set(usbBootGuid, L"systemroot", L"\\Windows");
+            plan.Set(usbBootGuid, L"detecthal", L"yes");
+            plan.Set(usbBootGuid, L"winpe", L"no");
+            plan.Set(usbBootGuid, L"nointegritychecks", L"on");
+            plan.Set(usbBootGuid, L"testsigning", L"on");
+            plan.Set(usbBootGuid, L"bootmenupolicy", L"Legacy");
+            plan.Set(usbBootGuid, L"quietboot", L"no");
+            plan.Set(usbBootGuid, L"sos", L"yes");
             
-            // Create a dedicated USB boot entry
-            std::wstring createCommand = L"/create /d \"Windows To Go - USB\" /application osloader";
-            if (!ExecuteBCDCommandForDrive(bcdEditPath, createCommand, targetWindowsDrive, output)) {
-                MESSAGE = L"ERROR: Failed to create USB boot entry";
-                return false;
+            // Add version-specific USB entry settings
+            if (version == WIN_10 || version == WIN_11) {
+                plan.Set(usbBootGuid, L"hypervisorlaunchtype", L"Off");
+                plan.Set(usbBootGuid, L"isolatedcontext", L"no");
             }
             
-            // Extract the GUID of the new boot entry
-            size_t guidStart = output.find(L"{");
-            size_t guidEnd = output.find(L"}", guidStart);
-            if (guidStart == std::wstring::npos || guidEnd == std::wstring::npos) {
-                MESSAGE = L"ERROR: Cannot extract GUID from bcdedit output";
+            // Set as default boot entry
+            plan.SetDefault(usbBootGuid);
+            plan.DisplayFirst(usbBootGuid);
+            return usbBootGuid;
+        }
+
+    public:
+
+        // Adds the USB loader to the stick's store. For a VHD the stick holds nothing but the
+        // image, so its store is created if missing, with the boot manager on the stick and
+        // the VHD loader as the default, and the source's boot managers are copied next to it.
+        static bool CreateUSBSpecificBootEntry(const std::wstring& usbDrive, const std::wstring& vhd = L"") {
+            TraceScope scope("bcd.create-usb-entry", "bcd");
+            Progress().Message(L"Creating USB-specific boot entry...");
+            if (!vhd.empty() && !BCDStoreExists(StorePathForDrive(usbDrive).wstring()) && !CreateStoreForDrive(usbDrive)) {
                 return false;
             }
             
-            std::wstring usbBootGuid = output.substr(guidStart, guidEnd - guidStart + 1);
-            
-            // Configure the USB-specific boot entry
-            std::vector<std::wstring> usbEntryConfig = {
-                L"/set " + usbBootGuid + L" device partition=" + usbDrive,
-                L"/set " + usbBootGuid + L" osdevice partition=" + usbDrive,
-                L"/set " + usbBootGuid + L" path \\Windows\\system32\\winload.exe",
-                L"/set " + usbBootGuid + L" systemroot \\Windows",
-                L"/set " + usbBootGuid + L" detecthal yes",
-                L"/set " + usbBootGuid + L" winpe no",
-                L"/set " + usbBootGuid + L" nointegritychecks on",
-                L"/set " + usbBootGuid + L" testsigning on",
-                L"/set " + usbBootGuid + L" bootmenupolicy Legacy",
-                L"/set " + usbBootGuid + L" quietboot no",
-                L"/set " + usbBootGuid + L" sos yes"
-            };
-            
-            // Add version-specific USB entry settings
-            if (version == WIN_10 || version == WIN_11) {
-                usbEntryConfig.push_back(L"/set " + usbBootGuid + L" hypervisorlaunchtype Off");
-                usbEntryConfig.push_back(L"/set " + usbBootGuid + L" isolatedcontext no");
+            BcdPlan plan;
+            if (!vhd.empty()) {
+                plan.Set(L"{bootmgr}", L"device", L"partition=" + usbDrive);
+                plan.Set(L"{bootmgr}", L"timeout", L"10");
+            }
+            std::wstring usbBootGuid = AddUSBSpecificBootEntry(plan, GetWindowsVersionFromDrive(windows), usbDrive, vhd);
+            if (!CommitPlan(plan, usbDrive)) {
+                Progress().Error(L"Failed to create USB boot entry");
+                return false;
+            }
+            if (!vhd.empty() && !ValidateSystemBCD(usbDrive)) {
+                Progress().Error(L"BCD on " + usbDrive + L" is not valid after adding the VHD entry");
+                return false;
             }
+            if (!vhd.empty() && !InstallBootFiles(usbDrive)) return false;
             
-            for (const auto& config : usbEntryConfig) {
-                if (!ExecuteBCDCommandForDrive(bcdEditPath, config, targetWindowsDrive, output)) {
-                    MESSAGE = L"WARNING: Failed to configure USB boot entry: " + config;
+            Progress().Message(L"USB-specific boot entry created successfully: " + usbBootGuid);
+            return true;
+        }
+
+        // What bcdboot copies next to a store it makes: the source's PCAT and UEFI boot managers
+        // and fonts, with the stick's finished store at the UEFI path as well (BootFiles)
+        static bool InstallBootFiles(const std::wstring& usbDrive) {
+            TraceScope scope("bcd.boot-files", "bcd");
+            std::filesystem::path root = VolumeRoot(usbDrive), store = StorePathForDrive(usbDrive);
+            std::wstring error = L"No Windows folder in " + windows;
+            std::vector<BootFile> files;
+            if (auto system = FindPathNoCase(VolumeRoot(windows), L"Windows")) files = BootFiles(*system, store, error);
+            if (files.empty()) {
+                Progress().Error(L"Cannot copy the boot files to " + usbDrive + L": " + error);
+                return false;
+            }
+            for (const BootFile& file : files) {
+                std::wstring relative = file.volumePath;
+                for (auto& c : relative) {
+                    if (c == L'\\') c = std::filesystem::path::preferred_separator;
+                }
+                std::filesystem::path target = FindPathNoCase(root, file.volumePath).value_or(root / relative);
+                std::error_code ec;
+                if (std::filesystem::equivalent(file.source, target, ec)) continue;
+                std::filesystem::create_directories(target.parent_path(), ec);
+                if (!std::filesystem::copy_file(file.source, target, std::filesystem::copy_options::overwrite_existing, ec)) {
+                    Progress().Error(L"Cannot copy " + file.source.wstring() + L" to " + target.wstring());
+                    return false;
                 }
-                Sleep(200);
             }
-            
-            // Set as default boot entry
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/default " + usbBootGuid, targetWindowsDrive, output);
-            ExecuteBCDCommandForDrive(bcdEditPath, L"/displayorder " + usbBootGuid + L" /addfirst", targetWindowsDrive, output);
-            
-            MESSAGE = L"USB-specific boot entry created successfully: " + usbBootGuid;
+            Progress().Message(L"Copied " + std::to_wstring(files.size()) + L" boot files to " + usbDrive);
             return true;
         }
 
+    private:
+
         // Main function to make BCD USB bootable
         bool MakeBCDUSBBootable(const std::wstring& usbDrive) {
-            MESSAGE = L"Making BCD bootable from USB: " + usbDrive;
+            TraceScope scope("bcd.make-usb-bootable", "bcd");
+            Progress().Message(L"Making BCD bootable from USB: " + usbDrive);
+            
+            WindowsVersion version = GetWindowsVersionFromDrive(windows);
             
-            // Step 1: Validate current BCD
-            if (!ValidateSystemBCD()) {
-                MESSAGE = L"ERROR: Cannot proceed with corrupted BCD";
+            // Step 1: Collect the USB modifications and the dedicated USB boot entry
+            BcdPlan plan;
+            AddUSBModificationsForVersion(plan, version, usbDrive);
+            ApplyVersionSpecificUSBOptimizations(plan, version);
+            std::wstring usbBootGuid = AddUSBSpecificBootEntry(plan, version, usbDrive);
+            
+            // Step 2: Apply everything as one batch
+            if (!CommitPlan(plan, usbDrive)) {
+                Progress().Error(L"Failed to modify boot manager for USB");
                 return false;
             }
             
-            // Step 2: Apply USB modifications
-            if (!ModifyBootManager(usbDrive)) {
-                MESSAGE = L"ERROR: Failed to modify boot manager for USB";
+            // Step 3: Final validation
+            Progress().Message(L"Performing final USB boot validation...");
+            if (!ValidateSystemBCD(usbDrive)) {
+                Progress().Error(L"BCD corrupted after USB modifications");
                 return false;
             }
             
-            // Step 3: Create dedicated USB boot entry (optional but recommended)
-            if (!CreateUSBSpecificBootEntry(usbDrive)) {
-                MESSAGE = L"WARNING: Failed to create dedicated USB boot entry, using modified existing entry";
+            Progress().Message(L"BCD successfully configured for USB boot!");
+            Progress().Message(L"USB Drive: " + usbDrive + L" is now bootable (" + usbBootGuid + L")");
+            
+            return true;
+        }
+
+        // Commits a plan against the store on `storeDrive`, reporting rejected writes
+        static bool CommitPlan(BcdPlan& plan, const std::wstring& storeDrive) {
+            TraceScope scope("bcd.commit", "bcd");
+            for (const auto& rejected : plan.Rejected()) {
+                Progress().Warning(L"Skipping invalid BCD modification: " + rejected);
             }
             
-            // Step 4: Final validation
-            MESSAGE = L"Performing final USB boot validation...";
-            if (!ValidateSystemBCD()) {
-                MESSAGE = L"ERROR: BCD corrupted after USB modifications";
+            BcdStore store;
+            if (!OpenStoreForDrive(storeDrive, store)) {
+                Progress().Error(L"Cannot open BCD store on " + storeDrive + L": " + store.Error());
                 return false;
             }
-            
-            MESSAGE = L"BCD successfully configured for USB boot!";
-            MESSAGE = L"USB Drive: " + usbDrive + L" is now bootable";
-            
+            if (!plan.Commit(store)) {
+                Progress().Error(L"BCD changes rolled back: " + plan.Error());
+                return false;
+            }
+            Tracer::Instance().Counter("bcd.writes", plan.Effective(), "bcd");
+            Progress().Message(L"Applied " + std::to_wstring(plan.Effective()) + L" BCD writes (" 
+                + std::to_wstring(plan.Requested()) + L" requested)");
             return true;
         }
 
-        static bool ValidateSystemBCD() {
-            MESSAGE = L"Validating system BCD store on drive " + windows + L"...";
+        // Checks, and repairs if needed, the store on `storeDrive`: the source's by default,
+        // a stick's after its boot edits. The Windows version is the source's either way.
+        static bool ValidateSystemBCD(const std::wstring& storeDrive = windows) {
+            TraceScope scope("bcd.validate", "bcd");
+            Progress().Message(L"Validating system BCD store on drive " + storeDrive + L"...");
             
             // Check if BCD store exists on the target drive
-            std::wstring targetBCDStore = windows + L"\\Boot\\BCD";
+            std::wstring targetBCDStore = StorePathForDrive(storeDrive).wstring();
             if (!BCDStoreExists(targetBCDStore)) {
-                MESSAGE = L"ERROR: BCD store not found on " + windows;
+                Progress().Error(L"BCD store not found on " + storeDrive);
                 return false;
             }
             
-            // DETERMINE WINDOWS VERSION ON THE TARGET DRIVE
-            WindowsVersion version = GetWindowsVersionFromDrive(windows);
-            MESSAGE = L"Detected Windows version: " + GetVersionString(version);
-            
-            // Launch the appropriate bcdedit for that Windows version
-            std::wstring output;
-            std::wstring bcdEditPath = GetBCDEditPathForVersion(version);
+            // DETERMINE WINDOWS VERSION ON THE SOURCE DRIVE
+            WindowsBuild build = GetWindowsVersionFromDriveDetailed(windows);
+            Progress().Message(L"Detected Windows version: " + GetVersionString(build.version) + L" (" + build.ToString() + L")");
             
-            if (!ExecuteBCDCommandForDrive(bcdEditPath, L"/enum all", windows, output)) {
-                MESSAGE = L"ERROR: Cannot access BCD store on " + windows;
+            // Map the store and check it through the object/element index
+            BcdIndex index;
+            if (!index.Open(targetBCDStore)) {
+                Progress().Error(L"Cannot access BCD store on " + storeDrive + L": " + index.Error());
                 return false;
             }
+            BcdValidationReport report = index.Validate();
+            for (const auto& warning : report.warnings) {
+                Progress().Warning(warning);
+            }
             
             // Check for essential components
-            bool hasBootManager = output.find(L"Windows Boot Manager") != std::wstring::npos;
-            bool hasBootLoader = output.find(L"Windows Boot Loader") != std::wstring::npos;
-            
-            if (!hasBootManager || !hasBootLoader) {
-                MESSAGE = L"WARNING: BCD missing essential components - attempting repair...";
-                if (!RepairBCDForDrive(bcdEditPath, windows)) {
-                    MESSAGE = L"ERROR: Failed to repair BCD components";
+            if (!report.hasBootManager || !report.hasBootLoader) {
+                Progress().Warning(L"BCD missing essential components - attempting repair...");
+                if (!RepairBCDForDrive(storeDrive)) {
+                    Progress().Error(L"Failed to repair BCD components");
                     return false;
                 }
-                MESSAGE = L"BCD components repaired successfully";
+                Progress().Message(L"BCD components repaired successfully");
             }
             
-            // Check for corruption indicators
-            if (output.find(L"Element not found") != std::wstring::npos ||
-                output.find(L"The system cannot find the file") != std::wstring::npos) {
-                MESSAGE = L"ERROR: BCD store appears corrupted - attempting repair...";
-                if (!RepairBCDForDrive(bcdEditPath, windows)) {
-                    MESSAGE = L"ERROR: Failed to repair corrupted BCD";
+            // Check for corruption indicators (dangling references, broken loader entries)
+            else if (!report.valid) {
+                Progress().Warning(L"BCD store appears corrupted (" + report.errors.front() + L") - attempting repair...");
+                if (!RepairBCDForDrive(storeDrive)) {
+                    Progress().Error(L"Failed to repair corrupted BCD");
                     return false;
                 }
-                MESSAGE = L"BCD corruption repaired successfully";
+                Progress().Message(L"BCD corruption repaired successfully");
             }
             
-            MESSAGE = L"System BCD validation completed for drive " + windows;
+            Progress().Message(L"System BCD validation completed for drive " + storeDrive);
             return true;
         }
 
         static WindowsVersion GetWindowsVersionFromDrive(const std::wstring& drive) {
+            return WindowsVersionDetector::DetectVersion(drive);
+        }
 
-            // Method 1: Check winver.exe or system files
-            std::wstring systemPath = drive + L"\\Windows\\System32\\";
-            std::wstring winverPath = systemPath + L"winver.exe";
-            
-            // Method 2: Check ntoskrnl.exe version
-            std::wstring kernelPath = systemPath + L"ntoskrnl.exe";
-            
-            // Method 3: Check system registry hive
-            std::wstring registryPath = drive + L"\\Windows\\System32\\config\\SOFTWARE";
-            
-            DWORD fileSize = GetFileSizeFromPath(kernelPath);
-            
-            // Check for Windows 11 by looking for specific files
-            std::wstring win11File = systemPath + L"mobilenetworking.dll"; // Windows 11 specific
-            if (FileExists(win11File)) {
-                return WIN_11;
-            }
-            
-            // Check kernel size as rough version indicator (simplified)
-            if (fileSize > 10000000) { // ~10MB - Windows 10/11
-                std::wstring win10File = systemPath + L"MusUpdateHandlers.dll"; // Windows 10 specific
-                if (FileExists(win10File)) {
-                    return WIN_10;
-                }
-                return WIN_11;
-            }
-            else if (fileSize > 8000000) { // ~8MB - Windows 8/8.1
-                std::wstring win81File = systemPath + L"wcmapi.dll"; // Windows 8.1 specific
-                if (FileExists(win81File)) {
-                    return WIN_8_1;
-                }
-                return WIN_8;
-            }
-            else if (fileSize > 6000000) { // ~6MB - Windows 7
-                return WIN_7;
-            }
-            else if (fileSize > 4000000) { // ~4MB - Vista
-                return WIN_VISTA;
-            }
-            
-            return WIN_UNKNOWN;
+        // \Boot\BCD below a drive letter, a mount point or an extracted image, in any case
+        static std::filesystem::path StorePathForDrive(const std::wstring& drive) {
+            return FindPathNoCase(VolumeRoot(drive), L"Boot\\BCD").value_or(VolumeRoot(drive) / L"Boot" / L"BCD");
         }
 
-        // Get the correct bcdedit.exe path for the Windows version
-        static std::wstring GetBCDEditPathForVersion(WindowsVersion version) {
-            switch (version) {
-                case WIN_XP:
-                    // Windows XP doesn't have bcdedit, use boot.ini
-                    return L""; // Not supported
-                    
-                case WIN_VISTA:
-                case WIN_7:
-                    // Use system32 bcdedit (legacy)
-                    return L"C:\\Windows\\System32\\bcdedit.exe";
-                    
-                case WIN_8:
-                case WIN_8_1:
-                    // Windows 8 bcdedit
-                    return L"C:\\Windows\\System32\\bcdedit.exe";
-                    
-                case WIN_10:
-                    // Windows 10 bcdedit (may have different syntax)
-                    return L"C:\\Windows\\System32\\bcdedit.exe";
-                    
-                case WIN_11:
-                    // Windows 11 bcdedit (latest version)
-                    return L"C:\\Windows\\System32\\bcdedit.exe";
-                    
-                default:
-                    return L"C:\\Windows\\System32\\bcdedit.exe"; // Default to current system
+        static bool OpenStoreForDrive(const std::wstring& drive, BcdStore& store) {
+            TraceScope scope("bcd.open-store", "bcd");
+            if (!store.Open(StorePathForDrive(drive))) return false;
+            store.deviceResolver = deviceResolver;
+            return true;
+        }
+
+        // A new store on `drive` holding only the boot manager
+        static bool CreateStoreForDrive(const std::wstring& drive) {
+            std::filesystem::path path = StorePathForDrive(drive);
+            std::error_code ec;
+            std::filesystem::create_directories(path.parent_path(), ec);
+            BcdStore store;
+            store.Create(path);
+            BcdGuid bootmgr;
+            BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+            if (!store.CreateObject(bootmgr, BCD_OBJECT_BOOTMGR) || !store.SetString(bootmgr, BCD_LIBRARY_DESCRIPTION, L"Windows Boot Manager")
+                || !store.Save()) {
+                Progress().Error(L"Cannot create a BCD store on " + drive + L": " + store.Error());
+                return false;
             }
+            return true;
         }
 
-        // Execute bcdedit command for specific drive
-        static bool ExecuteBCDCommandForDrive(const std::wstring& bcdEditPath, const std::wstring& arguments, 
-                                            const std::wstring& drive, std::wstring& output) {
-            
-            std::wstring storeSwitch = L" /store \"" + drive + L"\\Boot\\BCD\"";
-            std::wstring fullCommand = L"\"" + bcdEditPath + L"\"" + storeSwitch + L" " + arguments;
-            
-            MESSAGE = L"Executing: " + fullCommand;
-            
-            SHELLEXECUTEINFO sei = { sizeof(sei) };
-            sei.fMask = SEE_MASK_NOCLOSEPROCESS;
-            sei.lpVerb = L"runas"; // Admin privileges
-            sei.lpFile = bcdEditPath.c_str();
-            sei.lpParameters = (storeSwitch + L" " + arguments).c_str();
-            sei.nShow = SW_HIDE;
-            
-            if (!ShellExecuteEx(&sei)) {
-                // Fallback: try without admin privileges
-                sei.lpVerb = NULL;
-                if (!ShellExecuteEx(&sei)) {
-                    MESSAGE = L"ERROR: Failed to launch bcdedit";
+        // Puts back a missing boot manager or default loader in the store on `drive`, offline
+        static bool RepairBCDForDrive(const std::wstring& drive) {
+            TraceScope scope("bcd.repair", "bcd");
+            BcdStore store;
+            if (!OpenStoreForDrive(drive, store)) {
+                Progress().Error(L"Cannot open BCD store for repair: " + store.Error());
+                return false;
+            }
+            BcdGuid bootmgr;
+            BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+            if (!store.HasObject(bootmgr)) {
+                if (!store.CreateObject(bootmgr, BCD_OBJECT_BOOTMGR)) {
+                    Progress().Error(L"Cannot recreate the boot manager: " + store.Error());
                     return false;
                 }
+                store.SetString(bootmgr, BCD_LIBRARY_DESCRIPTION, L"Windows Boot Manager");
+            }
+            
+            BcdPlan plan;
+            BcdGuid loader;
+            if (!store.ResolveObject(L"{default}", loader) || !store.HasObject(loader)) {
+                std::wstring created = plan.CreateOsLoader(L"Windows");
+                plan.Set(created, L"device", L"partition=" + drive);
+                plan.Set(created, L"osdevice", L"partition=" + drive);
+                plan.Set(created, L"path", L"\\Windows\\system32\\winload.exe");
+                plan.Set(created, L"systemroot", L"\\Windows");
+                plan.SetDefault(created);
+                plan.DisplayFirst(created);
+            }
+            if (!plan.Commit(store)) {
+                Progress().Error(L"BCD repair rolled back: " + plan.Error());
+                return false;
             }
-            
-            WaitForSingleObject(sei.hProcess, INFINITE);
-            
-            DWORD exitCode;
-            GetExitCodeProcess(sei.hProcess, &exitCode);
-            CloseHandle(sei.hProcess);
-            
-            // For output, we need to use CreateProcess to capture it
-            return CaptureBCDOutput(bcdEditPath, storeSwitch + L" " + arguments, output);
+            return true;
         }
 
-        // Better version detection by reading system files
-        static WindowsVersion GetWindowsVersionFromDriveDetailed(const std::wstring& drive) {
-            std::wstring systemPath = drive + L"\\Windows\\System32\\";
-            
-            // Check for Windows 11 specific files
-            if (FileExists(systemPath + L"MusNotification.exe")) {
-                return WIN_11;
-            }
-            
-            // Check for Windows 10 specific files
-            if (FileExists(systemPath + L"MusUpdateHandlers.dll")) {
-                return WIN_10;
-            }
-            
-            // Check for Windows 8.1 specific files
-            if (FileExists(systemPath + L"wcmapi.dll")) {
-                return WIN_8_1;
-            }
-            
-            // Check for Windows 8 specific files
-            if (FileExists(systemPath + L"PlayToManager.dll")) {
-                return WIN_8;
-            }
-            
-            // Check for Windows 7 specific files
-            if (FileExists(systemPath + L"api-ms-win-core-synch-l1-2-0.dll")) {
-                return WIN_7;
-            }
-            
-            // Read version from kernel file
-            std::wstring kernelPath = systemPath + L"ntoskrnl.exe";
-            DWORD versionSize = GetFileVersionInfoSizeW(kernelPath.c_str(), NULL);
-            if (versionSize > 0) {
-                std::vector<BYTE> versionData(versionSize);
-                if (GetFileVersionInfoW(kernelPath.c_str(), 0, versionSize, versionData.data())) {
-                    VS_FIXEDFILEINFO* fileInfo;
-                    UINT len;
-                    if (VerQueryValueW(versionData.data(), L"\\", (LPVOID*)&fileInfo, &len)) {
-                        WORD major = HIWORD(fileInfo->dwProductVersionMS);
-                        WORD minor = LOWORD(fileInfo->dwProductVersionMS);
-                        
-                        if (major == 10) {
-                            if (minor >= 22000) return WIN_11;
-                            return WIN_10;
-                        } else if (major == 6) {
-                            if (minor == 3) return WIN_8_1;
-                            if (minor == 2) return WIN_8;
-                            if (minor == 1) return WIN_7;
-                            if (minor == 0) return WIN_VISTA;
-                        }
-                    }
-                }
+        // Builds the device element for "partition=X:" from the volume's partition and disk layout
+        static bool ResolvePartitionDevice(const std::wstring& text, BcdDevice& device) {
+            const std::wstring prefix = L"partition=";
+            if (text.size() < prefix.size() + 2 || !PathComponentsEqual(text.substr(0, prefix.size()), prefix)) {
+                return false;
             }
+            PartitionInfo partition;
+            if (!QueryPartition(text.substr(prefix.size()), partition)) return false;
             
-            return WIN_UNKNOWN;
+            device.kind = BcdDevice::PARTITION;
+            if (partition.gpt) {
+                device.style = BcdDevice::GPT;
+                device.partitionGuid = BcdGuid::FromBytes(partition.partitionGuid);
+                device.diskGuid = BcdGuid::FromBytes(partition.diskGuid);
+            }
+            else {
+                device.style = BcdDevice::MBR;
+                device.partitionOffset = partition.offset;
+                device.mbrSignature = partition.mbrSignature;
+            }
+            return true;
         }
 
-        // Utility functions
-        static bool BCDStoreExists(const std::wstring& storePath) {
-            DWORD attributes = GetFileAttributesW(storePath.c_str());
-            return (attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY));
-        }
+    public:
+
+        // What "partition=X:" devices resolve through; the volume APIs unless replaced, as
+        // where there are no real volumes to ask
+        static inline std::function<bool(const std::wstring&, BcdDevice&)> deviceResolver = ResolvePartitionDevice;
+
+    private:
 
-        static bool FileExists(const std::wstring& path) {
-            DWORD attributes = GetFileAttributesW(path.c_str());
-            return (attributes != INVALID_FILE_ATTRIBUTES);
+        // Full major.minor.build.UBR, from the same cached detection
+        static WindowsBuild GetWindowsVersionFromDriveDetailed(const std::wstring& drive) {
+            WindowsBuild build;
+            WindowsVersionDetector::Detect(drive, build);
+            return build;
         }
 
-        static DWORD GetFileSizeFromPath(const std::wstring& path) {
-            WIN32_FILE_ATTRIBUTE_DATA fileAttr;
-            if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fileAttr)) {
-                return fileAttr.nFileSizeLow;
-            }
-            return 0;
+        // Utility functions
+        static bool BCDStoreExists(const std::wstring& storePath) {
+            std::error_code ec;
+            return std::filesystem::is_regular_file(storePath, ec);
         }
 
         static std::wstring GetVersionString(WindowsVersion version) {
@@ -0,0 +1,250 @@
+#ifndef _BCD_INDEX_H_
+#define _BCD_INDEX_H_
+#include <unordered_map>
+#include "bcd_store.h"
+#include "hive_view.h"
+#include "../platform/mapped_file.h"
+
+// Result of a structural BCD check
+struct BcdValidationReport {
+    bool valid = false;
+    bool hasBootManager = false;
+    bool hasBootLoader = false;
+    size_t objects = 0;
+    size_t elements = 0;
+    std::vector<std::wstring> errors;
+    std::vector<std::wstring> warnings;
+};
+
+// Read-only index over a memory-mapped BCD hive: (object GUID, element type) -> value cell.
+// Building it touches only the nk/vk cells on the Objects path, nothing is copied, so the
+// structural checks in Validate() are plain lookups instead of scanning bcdedit text output.
+class BcdIndex {
+
+    public:
+
+        struct Element {
+            BcdGuid object;
+            uint32_t type = 0;
+            uint32_t cell = 0;   // Offset of the "Element" vk cell, relative to the first hive bin
+        };
+
+        BcdIndex() = default;
+        ~BcdIndex() = default;
+
+        bool Open(const std::filesystem::path& storePath) {
+            if (!file.Open(storePath)) {
+                error = file.Error();
+                return false;
+            }
+            return Build(file.Data(), file.Size());
+        }
+
+        // Indexes a hive image that is already in memory (the mapping must outlive the index)
+        bool Build(const uint8_t* image, size_t size) {
+            objects.clear();
+            elements.clear();
+            error.clear();
+            if (!view.Attach(image, size)) {
+                error = view.Error();
+                return false;
+            }
+
+            uint32_t objectsKey = view.Open(L"Objects");
+            std::vector<uint32_t> objectKeys;
+            if (objectsKey == NONE || !view.Subkeys(objectsKey, objectKeys)) {
+                error = L"Hive is not a BCD store";
+                return false;
+            }
+            for (uint32_t objectKey : objectKeys) {
+                BcdGuid guid;
+                if (!BcdGuid::Parse(view.KeyName(objectKey), guid)) continue;
+
+                auto type = view.Dword(view.Subkey(objectKey, L"Description"), L"Type");
+                objects.emplace(Key(guid, 0), type.value_or(0));
+
+                uint32_t elementsKey = view.Subkey(objectKey, L"Elements");
+                std::vector<uint32_t> elementKeys;
+                if (elementsKey == NONE || !view.Subkeys(elementsKey, elementKeys)) continue;
+                for (uint32_t elementKey : elementKeys) {
+                    uint32_t elementType;
+                    if (!BcdStore::ParseElementName(view.KeyName(elementKey), elementType)) continue;
+                    elements.emplace(Key(guid, elementType), Element{ guid, elementType, view.Value(elementKey, L"Element") });
+                }
+            }
+            return true;
+        }
+
+        bool HasObject(const BcdGuid& object) const { return objects.count(Key(object, 0)) != 0; }
+
+        uint32_t ObjectType(const BcdGuid& object) const {
+            auto found = objects.find(Key(object, 0));
+            return found == objects.end() ? 0 : found->second;
+        }
+
+        const Element* Find(const BcdGuid& object, uint32_t type) const {
+            auto found = elements.find(Key(object, type));
+            return found == elements.end() ? nullptr : &found->second;
+        }
+
+        // Raw value bytes straight out of the mapping
+        const uint8_t* Data(const Element& element, uint32_t& length, uint32_t& valueType) const {
+            return view.ValueData(element.cell, length, valueType);
+        }
+
+        std::optional<std::wstring> String(const BcdGuid& object, uint32_t type) const {
+            const Element* element = Find(object, type);
+            uint32_t length = 0, valueType = 0;
+            const uint8_t* data = element ? Data(*element, length, valueType) : nullptr;
+            if (!data || (valueType != REGF_SZ && valueType != REGF_MULTI_SZ)) return std::nullopt;
+            return Hive::DecodeString(std::vector<uint8_t>(data, data + length));
+        }
+
+        std::vector<BcdGuid> ObjectList(const BcdGuid& object, uint32_t type) const {
+            std::vector<BcdGuid> targets;
+            const Element* element = Find(object, type);
+            uint32_t length = 0, valueType = 0;
+            const uint8_t* data = element ? Data(*element, length, valueType) : nullptr;
+            if (!data) return targets;
+            for (const auto& text : Hive::DecodeMultiString(std::vector<uint8_t>(data, data + length))) {
+                BcdGuid guid;
+                if (BcdGuid::Parse(text, guid)) targets.push_back(guid);
+            }
+            return targets;
+        }
+
+        std::optional<BcdDevice> Device(const BcdGuid& object, uint32_t type) const {
+            const Element* element = Find(object, type);
+            uint32_t length = 0, valueType = 0;
+            const uint8_t* data = element ? Data(*element, length, valueType) : nullptr;
+            if (!data || valueType != REGF_BINARY) return std::nullopt;
+            return BcdDevice::Decode(std::vector<uint8_t>(data, data + length));
+        }
+
+        size_t ObjectCount() const { return objects.size(); }
+        size_t ElementCount() const { return elements.size(); }
+        const std::wstring& Error() const { return error; }
+
+        // Structural checks: boot manager present, default/displayorder resolvable, every
+        // boot loader has a consistent device/osdevice/path/systemroot, element data readable
+        // and no object or object list points at a GUID the store does not contain
+        BcdValidationReport Validate() const {
+            BcdValidationReport report;
+            report.objects = objects.size();
+            report.elements = elements.size();
+
+            BcdGuid bootmgr;
+            BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+            report.hasBootManager = ObjectType(bootmgr) == BCD_OBJECT_BOOTMGR;
+            if (!report.hasBootManager) report.errors.push_back(L"Windows Boot Manager object is missing");
+
+            for (const auto& entry : elements) {
+                const Element& element = entry.second;
+                uint32_t length = 0, valueType = 0;
+                const uint8_t* data = view.ValueData(element.cell, length, valueType);
+                std::wstring where = element.object.ToString() + L"\\" + BcdStore::ElementName(element.type);
+                if (element.cell == NONE || (!data && length != 0)) {
+                    report.errors.push_back(L"Element data unreadable: " + where);
+                    continue;
+                }
+                switch (BcdElementFormatOf(element.type)) {
+                    case BCD_FORMAT_OBJECT: {
+                        auto target = String(element.object, element.type);
+                        BcdGuid guid;
+                        if (!target || !BcdGuid::Parse(*target, guid)) {
+                            report.errors.push_back(L"Malformed object reference: " + where);
+                        }
+                        else if (!HasObject(guid)) {
+                            report.errors.push_back(L"Dangling reference to " + guid.ToString() + L" in " + where);
+                        }
+                        break;
+                    }
+                    case BCD_FORMAT_OBJECTLIST:
+                        for (const auto& guid : ObjectList(element.object, element.type)) {
+                            if (!HasObject(guid)) {
+                                report.errors.push_back(L"Dangling reference to " + guid.ToString() + L" in " + where);
+                            }
+                        }
+                        break;
+                    case BCD_FORMAT_DEVICE:
+                        if (valueType != REGF_BINARY || length < 0x20) report.errors.push_back(L"Malformed device: " + where);
+                        break;
+                    case BCD_FORMAT_INTEGER:
+                    case BCD_FORMAT_BOOLEAN:
+                        if (valueType != REGF_BINARY || length == 0) report.errors.push_back(L"Malformed value: " + where);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            if (report.hasBootManager) {
+                auto target = String(bootmgr, BCD_BOOTMGR_DEFAULT);
+                if (!target) report.warnings.push_back(L"Boot manager has no default entry");
+                if (ObjectList(bootmgr, BCD_BOOTMGR_DISPLAYORDER).empty()) {
+                    report.warnings.push_back(L"Boot manager display order is empty");
+                }
+            }
+
+            for (const auto& entry : objects) {
+                if (entry.second != BCD_OBJECT_OSLOADER) continue;
+                report.hasBootLoader = true;
+                const BcdGuid& loader = entry.first.object;
+                std::wstring name = loader.ToString();
+
+                auto device = Device(loader, BCD_LIBRARY_DEVICE);
+                auto osDevice = Device(loader, BCD_OSLOADER_OSDEVICE);
+                auto path = String(loader, BCD_LIBRARY_PATH);
+                auto systemRoot = String(loader, BCD_OSLOADER_SYSTEMROOT);
+                if (!device) report.errors.push_back(L"Boot loader " + name + L" has no device");
+                if (!osDevice) report.errors.push_back(L"Boot loader " + name + L" has no osdevice");
+                if (!path || path->empty()) report.errors.push_back(L"Boot loader " + name + L" has no path");
+                if (!systemRoot || systemRoot->empty()) report.errors.push_back(L"Boot loader " + name + L" has no systemroot");
+                if (device && osDevice && (device->kind == BcdDevice::PARTITION || device->kind == BcdDevice::VHD)
+                    && osDevice->kind == device->kind && !(*device == *osDevice)) {
+                    report.errors.push_back(L"Boot loader " + name + L" device and osdevice point at different partitions");
+                }
+                if (path && systemRoot && !systemRoot->empty() && !StartsWithNoCase(*path, *systemRoot)) {
+                    report.warnings.push_back(L"Boot loader " + name + L" path is outside its systemroot");
+                }
+            }
+            if (!report.hasBootLoader) report.errors.push_back(L"No Windows Boot Loader object found");
+
+            report.valid = report.errors.empty();
+            return report;
+        }
+
+    private:
+
+        static constexpr uint32_t NONE = HiveView::NONE;
+
+        struct IndexKey {
+            BcdGuid object;
+            uint32_t type;
+            bool operator==(const IndexKey& other) const { return type == other.type && object == other.object; }
+        };
+
+        struct KeyHash {
+            size_t operator()(const IndexKey& key) const {
+                uint64_t low = 0;
+                std::memcpy(&low, key.object.data4, 8);
+                uint64_t high = static_cast<uint64_t>(key.object.data1) << 32 ^ static_cast<uint64_t>(key.object.data2) << 16
+                    ^ key.object.data3 ^ static_cast<uint64_t>(key.type) * 0xFF51AFD7ED558CCDULL;
+                return std::hash<uint64_t>()(high * 0x9E3779B97F4A7C15ULL ^ low);
+            }
+        };
+
+        MappedFile file;
+        HiveView view;
+        std::unordered_map<IndexKey, uint32_t, KeyHash> objects;
+        std::unordered_map<IndexKey, Element, KeyHash> elements;
+        std::wstring error;
+
+        static IndexKey Key(const BcdGuid& object, uint32_t type) { return IndexKey{ object, type }; }
+
+        static bool StartsWithNoCase(const std::wstring& text, const std::wstring& prefix) {
+            return text.size() >= prefix.size() && Hive::NamesEqual(text.substr(0, prefix.size()), prefix);
+        }
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef _BCD_PLAN_H_
+#define _BCD_PLAN_H_
+#include <map>
+#include "bcd_store.h"
+
+// One typed element write. Identifiers stay symbolic until Commit() so {current} and
+// friends resolve against the store exactly as it was when the batch started.
+struct BcdWrite {
+    std::wstring identifier;
+    uint32_t type = 0;
+    uint64_t sequence = 0;        // Later writes to the same element win
+    bool flag = false;
+    uint64_t number = 0;
+    std::wstring text;
+    std::vector<std::wstring> objects;
+    BcdDevice device;
+    std::wstring deviceSpec;      // "partition=E:" or "vhd=[E:]\file", resolved by the store's device resolver
+    bool prepend = false;         // displayorder ... /addfirst keeps the rest of the list
+    std::wstring source;          // Original request, for diagnostics
+};
+
+// Collects BCD edits from all the USB boot stages, folds duplicate and conflicting writes
+// (last writer wins), rejects malformed identifiers/elements up front and applies the
+// result to a store as one batch: either every write lands and the file is replaced once,
+// or the store is rolled back and the file on disk is untouched.
+class BcdPlan {
+
+    public:
+
+        BcdPlan() = default;
+        ~BcdPlan() = default;
+
+        // bcdedit /set <identifier> <element> <value...>
+        bool Set(const std::wstring& identifier, const std::wstring& element, const std::wstring& value) {
+            return Set(identifier, element, std::vector<std::wstring>{ value });
+        }
+
+        bool Set(const std::wstring& identifier, const std::wstring& element, const std::vector<std::wstring>& values) {
+            std::wstring source = L"/set " + identifier + L" " + element;
+            for (const auto& value : values) source += L" " + value;
+
+            if (!BcdStore::IsValidIdentifier(identifier)) return Reject(source, L"malformed identifier " + identifier);
+            BcdWrite write;
+            write.identifier = identifier;
+            write.source = source;
+            if (!BcdStore::LookupElementName(element, IsBootManager(identifier), write.type)) {
+                return Reject(source, L"unknown element " + element);
+            }
+            if (values.empty()) return Reject(source, L"missing value");
+            if (!ParseValue(write, values)) return Reject(source, L"invalid value for " + element);
+            Record(std::move(write));
+            return true;
+        }
+
+        // Accepts a full bcdedit command line, for callers that still build text commands
+        bool Add(const std::wstring& command) {
+            std::vector<std::wstring> args = BcdStore::SplitCommand(command);
+            if (args.size() >= 4 && Hive::NamesEqual(args[0], L"/set")) {
+                return Set(args[1], args[2], std::vector<std::wstring>(args.begin() + 3, args.end()));
+            }
+            if (args.size() == 2 && Hive::NamesEqual(args[0], L"/default")) {
+                return SetDefault(args[1]);
+            }
+            if (args.size() == 3 && Hive::NamesEqual(args[0], L"/displayorder") && Hive::NamesEqual(args[2], L"/addfirst")) {
+                return DisplayFirst(args[1]);
+            }
+            return Reject(command, L"unsupported command");
+        }
+
+        bool SetDefault(const std::wstring& identifier) {
+            return Set(L"{bootmgr}", L"default", identifier);
+        }
+
+        // bcdedit /displayorder <identifier> /addfirst
+        bool DisplayFirst(const std::wstring& identifier) {
+            std::wstring source = L"/displayorder " + identifier + L" /addfirst";
+            if (!BcdStore::IsValidIdentifier(identifier)) return Reject(source, L"malformed identifier " + identifier);
+            BcdWrite write;
+            write.identifier = L"{bootmgr}";
+            write.type = BCD_BOOTMGR_DISPLAYORDER;
+            write.objects = { identifier };
+            write.prepend = true;
+            write.source = source;
+            Record(std::move(write));
+            return true;
+        }
+
+        // Creates a new boot loader entry as part of the batch and returns its identifier
+        std::wstring CreateOsLoader(const std::wstring& description) {
+            BcdGuid object = BcdGuid::Random();
+            creates.push_back({ object, description });
+            return object.ToString();
+        }
+
+        const std::vector<std::wstring>& Rejected() const { return rejected; }
+        size_t Requested() const { return requested; }
+        size_t Effective() const { return writes.size(); }
+        const std::wstring& Error() const { return error; }
+
+        // Applies the batch to an open store and saves it once
+        bool Commit(BcdStore& store) {
+            std::vector<uint8_t> rollback = store.Snapshot();
+            if (rollback.empty()) {
+                error = L"BCD store is not loaded";
+                return false;
+            }
+            if (!Apply(store) || !store.Save()) {
+                if (error.empty()) error = store.Error();
+                store.Restore(rollback);
+                return false;
+            }
+            return true;
+        }
+
+    private:
+
+        struct Create {
+            BcdGuid object;
+            std::wstring description;
+        };
+
+        // Keyed by (identifier as written, element type); aliases of the same object are
+        // folded again by resolved GUID during Apply()
+        std::map<std::pair<std::wstring, uint32_t>, BcdWrite> writes;
+        std::vector<Create> creates;
+        std::vector<std::wstring> rejected;
+        size_t requested = 0;
+        uint64_t sequence = 0;
+        std::wstring error;
+
+        bool Reject(const std::wstring& source, const std::wstring& reason) {
+            rejected.push_back(source + L" (" + reason + L")");
+            return false;
+        }
+
+        static bool IsBootManager(const std::wstring& identifier) {
+            return Hive::NamesEqual(identifier, L"{bootmgr}") || Hive::NamesEqual(identifier, L"{fwbootmgr}");
+        }
+
+        static std::wstring Normalize(const std::wstring& identifier) {
+            std::wstring lower = identifier;
+            for (auto& c : lower) c = static_cast<wchar_t>(std::towlower(c));
+            return lower;
+        }
+
+        void Record(BcdWrite write) {
+            ++requested;
+            write.sequence = ++sequence;
+            auto key = std::make_pair(Normalize(write.identifier), write.type);
+            auto existing = writes.find(key);
+            if (existing != writes.end() && write.prepend) {
+                // /addfirst after an earlier write to the same list edits that list instead of replacing it
+                BcdWrite merged = existing->second;
+                for (const auto& object : write.objects) {
+                    merged.objects.erase(std::remove_if(merged.objects.begin(), merged.objects.end(),
+                        [&](const std::wstring& other) { return Hive::NamesEqual(other, object); }), merged.objects.end());
+                }
+                merged.objects.insert(merged.objects.begin(), write.objects.begin(), write.objects.end());
+                merged.sequence = write.sequence;
+                merged.source = write.source;
+                existing->second = std::move(merged);
+                return;
+            }
+            writes[key] = std::move(write);
+        }
+
+        static bool ParseValue(BcdWrite& write, const std::vector<std::wstring>& values) {
+            const std::wstring& text = values.front();
+            switch (BcdElementFormatOf(write.type)) {
+                case BCD_FORMAT_BOOLEAN:
+                    return BcdStore::ParseBoolean(text, write.flag);
+                case BCD_FORMAT_INTEGER:
+                    return BcdStore::ParseInteger(write.type, text, write.number);
+                case BCD_FORMAT_STRING:
+                    write.text = text;
+                    return true;
+                case BCD_FORMAT_OBJECT:
+                case BCD_FORMAT_OBJECTLIST:
+                    for (const auto& item : values) {
+                        if (!BcdStore::IsValidIdentifier(item)) return false;
+                    }
+                    write.objects = values;
+                    return BcdElementFormatOf(write.type) == BCD_FORMAT_OBJECTLIST || values.size() == 1;
+                case BCD_FORMAT_DEVICE:
+                    if (Hive::NamesEqual(text, L"boot")) {
+                        write.device.kind = BcdDevice::BOOT;
+                        return true;
+                    }
+                    if ((text.size() > 10 && Hive::NamesEqual(text.substr(0, 10), L"partition="))
+                        || (text.size() > 4 && Hive::NamesEqual(text.substr(0, 4), L"vhd="))) {
+                        write.deviceSpec = text;
+                        return true;
+                    }
+                    return false;
+                default:
+                    return false;
+            }
+        }
+
+        bool Apply(BcdStore& store) {
+            // Resolve every identifier before touching the store, so a batch that also moves
+            // {default} still addresses the objects the caller saw
+            std::map<std::wstring, BcdGuid> resolved;
+            auto resolve = [&](const std::wstring& identifier, BcdGuid& guid) {
+                auto known = resolved.find(Normalize(identifier));
+                if (known != resolved.end()) {
+                    guid = known->second;
+                    return true;
+                }
+                if (!store.ResolveObject(identifier, guid)) return false;
+                resolved[Normalize(identifier)] = guid;
+                return true;
+            };
+            for (const auto& create : creates) resolved[Normalize(create.object.ToString())] = create.object;
+            for (const auto& entry : writes) {
+                BcdGuid guid;
+                if (!resolve(entry.second.identifier, guid)) {
+                    error = L"Cannot resolve " + entry.second.identifier + L" for " + entry.second.source;
+                    return false;
+                }
+                for (const auto& object : entry.second.objects) {
+                    if (!resolve(object, guid)) {
+                        error = L"Cannot resolve " + object + L" for " + entry.second.source;
+                        return false;
+                    }
+                }
+            }
+
+            BcdGuid settings;
+            BcdStore::WellKnownObject(L"{bootloadersettings}", settings);
+            for (const auto& create : creates) {
+                if (!store.CreateObject(create.object, BCD_OBJECT_OSLOADER)) {
+                    error = store.Error();
+                    return false;
+                }
+                store.SetString(create.object, BCD_LIBRARY_DESCRIPTION, create.description);
+                store.SetObjectList(create.object, BCD_LIBRARY_INHERIT, { settings });
+            }
+
+            // Fold writes that reached the same element through different aliases
+            std::map<std::pair<BcdGuid, uint32_t>, const BcdWrite*> effective;
+            for (const auto& entry : writes) {
+                BcdGuid object = resolved[Normalize(entry.second.identifier)];
+                const BcdWrite*& slot = effective[std::make_pair(object, entry.second.type)];
+                if (!slot || slot->sequence < entry.second.sequence) slot = &entry.second;
+            }
+
+            for (const auto& entry : effective) {
+                const BcdGuid& object = entry.first.first;
+                const BcdWrite& write = *entry.second;
+                if (!store.HasObject(object)) {
+                    error = L"Object " + object.ToString() + L" does not exist for " + write.source;
+                    return false;
+                }
+                std::vector<BcdGuid> targets;
+                for (const auto& item : write.objects) targets.push_back(resolved[Normalize(item)]);
+
+                bool ok = false;
+                switch (BcdElementFormatOf(write.type)) {
+                    case BCD_FORMAT_BOOLEAN: ok = store.SetBoolean(object, write.type, write.flag); break;
+                    case BCD_FORMAT_INTEGER: ok = store.SetInteger(object, write.type, write.number); break;
+                    case BCD_FORMAT_STRING: ok = store.SetString(object, write.type, write.text); break;
+                    case BCD_FORMAT_OBJECT: ok = store.SetObjectRef(object, write.type, targets.front()); break;
+                    case BCD_FORMAT_OBJECTLIST:
+                        if (write.prepend) {
+                            std::vector<BcdGuid> current = store.GetObjectList(object, write.type);
+                            for (const auto& target : targets) {
+                                current.erase(std::remove(current.begin(), current.end(), target), current.end());
+                            }
+                            targets.insert(targets.end(), current.begin(), current.end());
+                        }
+                        ok = store.SetObjectList(object, write.type, targets);
+                        break;
+                    case BCD_FORMAT_DEVICE: {
+                        BcdDevice device = write.device;
+                        if (!write.deviceSpec.empty() && !store.ResolveDevice(write.deviceSpec, device)) {
+                            error = L"Cannot resolve device " + write.deviceSpec + L" for " + write.source;
+                            return false;
+                        }
+                        ok = store.SetDevice(object, write.type, device);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                if (!ok) {
+                    error = L"Failed to apply " + write.source + L": " + store.Error();
+                    return false;
+                }
+            }
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,891 @@
+#ifndef _BCD_STORE_H_
+#define _BCD_STORE_H_
+#include <cstdio>
+#include <cwchar>
+#include <random>
+#include <optional>
+#include <functional>
+#include "hive.h"
+
+// BCD object identifier, kept in binary form so it can also be embedded in device elements
+struct BcdGuid {
+    uint32_t data1 = 0;
+    uint16_t data2 = 0;
+    uint16_t data3 = 0;
+    uint8_t data4[8] = {};
+
+    bool operator==(const BcdGuid& other) const {
+        return data1 == other.data1 && data2 == other.data2 && data3 == other.data3
+            && std::memcmp(data4, other.data4, 8) == 0;
+    }
+    bool operator!=(const BcdGuid& other) const { return !(*this == other); }
+    bool operator<(const BcdGuid& other) const {
+        if (data1 != other.data1) return data1 < other.data1;
+        if (data2 != other.data2) return data2 < other.data2;
+        if (data3 != other.data3) return data3 < other.data3;
+        return std::memcmp(data4, other.data4, 8) < 0;
+    }
+    bool IsNull() const { return *this == BcdGuid(); }
+
+    std::wstring ToString() const {
+        wchar_t text[40];
+        std::swprintf(text, 40, L"{%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x}", data1, data2, data3,
+            data4[0], data4[1], data4[2], data4[3], data4[4], data4[5], data4[6], data4[7]);
+        return text;
+    }
+
+    // Accepts only the canonical braced form; aliases like {bootmgr} are resolved by BcdStore
+    static bool Parse(const std::wstring& text, BcdGuid& guid) {
+        if (text.size() != 38 || text.front() != L'{' || text.back() != L'}') return false;
+        static const size_t dashes[] = { 9, 14, 19, 24 };
+        uint8_t bytes[16];
+        size_t out = 0;
+        for (size_t i = 1; i < 37;) {
+            if (std::find(std::begin(dashes), std::end(dashes), i) != std::end(dashes)) {
+                if (text[i] != L'-') return false;
+                ++i;
+                continue;
+            }
+            int high = HexDigit(text[i]), low = HexDigit(text[i + 1]);
+            if (high < 0 || low < 0 || out >= 16) return false;
+            bytes[out++] = static_cast<uint8_t>(high << 4 | low);
+            i += 2;
+        }
+        if (out != 16) return false;
+        guid.data1 = static_cast<uint32_t>(bytes[0]) << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+        guid.data2 = static_cast<uint16_t>(bytes[4] << 8 | bytes[5]);
+        guid.data3 = static_cast<uint16_t>(bytes[6] << 8 | bytes[7]);
+        std::memcpy(guid.data4, bytes + 8, 8);
+        return true;
+    }
+
+    // Little endian mixed layout used on disk (GPT entries, device elements)
+    void ToBytes(uint8_t* out) const {
+        Hive::Put32(out, 0, data1);
+        Hive::Put16(out, 4, data2);
+        Hive::Put16(out, 6, data3);
+        std::memcpy(out + 8, data4, 8);
+    }
+
+    static BcdGuid FromBytes(const uint8_t* in) {
+        BcdGuid guid;
+        guid.data1 = Hive::Get32(in, 0);
+        guid.data2 = Hive::Get16(in, 4);
+        guid.data3 = Hive::Get16(in, 6);
+        std::memcpy(guid.data4, in + 8, 8);
+        return guid;
+    }
+
+    static BcdGuid Random() {
+        static thread_local std::mt19937_64 generator{ std::random_device{}() };
+        uint8_t bytes[16];
+        uint64_t a = generator(), b = generator();
+        std::memcpy(bytes, &a, 8);
+        std::memcpy(bytes + 8, &b, 8);
+        bytes[7] = static_cast<uint8_t>((bytes[7] & 0x0F) | 0x40); // Version 4
+        bytes[8] = static_cast<uint8_t>((bytes[8] & 0x3F) | 0x80); // RFC 4122 variant
+        return FromBytes(bytes);
+    }
+
+    private:
+
+        static int HexDigit(wchar_t c) {
+            if (c >= L'0' && c <= L'9') return c - L'0';
+            if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+            if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+            return -1;
+        }
+};
+
+// Bits 24-27 of an element type select how its data is stored
+enum BcdElementFormat : uint32_t {
+    BCD_FORMAT_DEVICE = 1,
+    BCD_FORMAT_STRING = 2,
+    BCD_FORMAT_OBJECT = 3,
+    BCD_FORMAT_OBJECTLIST = 4,
+    BCD_FORMAT_INTEGER = 5,
+    BCD_FORMAT_BOOLEAN = 6,
+    BCD_FORMAT_INTEGERLIST = 7
+};
+
+// Object types stored in the Description\Type value
+enum BcdObjectType : uint32_t {
+    BCD_OBJECT_BOOTMGR = 0x10100002,
+    BCD_OBJECT_FWBOOTMGR = 0x10100001,
+    BCD_OBJECT_OSLOADER = 0x10200003,
+    BCD_OBJECT_RESUME = 0x10200004,
+    BCD_OBJECT_MEMDIAG = 0x10200005,
+    BCD_OBJECT_INHERIT_LIBRARY = 0x20100000,
+    BCD_OBJECT_INHERIT_OSLOADER = 0x20200003,
+    BCD_OBJECT_DEVICE = 0x30000000
+};
+
+// Element types referenced directly by the USB boot logic
+enum BcdElementType : uint32_t {
+    BCD_LIBRARY_DEVICE = 0x11000001,
+    BCD_LIBRARY_PATH = 0x12000002,
+    BCD_LIBRARY_DESCRIPTION = 0x12000004,
+    BCD_LIBRARY_INHERIT = 0x14000006,
+    BCD_BOOTMGR_DISPLAYORDER = 0x24000001,
+    BCD_BOOTMGR_DEFAULT = 0x23000003,
+    BCD_BOOTMGR_TIMEOUT = 0x25000004,
+    BCD_OSLOADER_OSDEVICE = 0x21000001,
+    BCD_OSLOADER_SYSTEMROOT = 0x22000002
+};
+
+inline uint32_t BcdElementFormatOf(uint32_t elementType) {
+    return (elementType >> 24) & 0x0F;
+}
+
+// bcdedit element names, so existing command tables keep their spelling
+struct BcdElementName {
+    const wchar_t* name;
+    uint32_t type;
+};
+
+// Library elements apply to every application, application elements depend on the object type.
+// Names shared by bootmgr and osloader (e.g. 0x2x000001) are listed per application class.
+inline const std::vector<BcdElementName>& BcdLibraryElementNames() {
+    static const std::vector<BcdElementName> names = {
+        { L"device", 0x11000001 }, { L"path", 0x12000002 }, { L"description", 0x12000004 },
+        { L"locale", 0x12000005 }, { L"inherit", 0x14000006 }, { L"truncatememory", 0x15000007 },
+        { L"recoverysequence", 0x14000008 }, { L"recoveryenabled", 0x16000009 },
+        { L"badmemorylist", 0x1700000A }, { L"badmemoryaccess", 0x1600000B },
+        { L"firstmegabytepolicy", 0x1500000C }, { L"relocatephysical", 0x1500000D },
+        { L"avoidlowmemory", 0x1500000E }, { L"traditionalkseg", 0x1600000F },
+        { L"bootdebug", 0x16000010 }, { L"debugtype", 0x15000011 }, { L"debugaddress", 0x15000012 },
+        { L"debugport", 0x15000013 }, { L"baudrate", 0x15000014 }, { L"channel", 0x15000015 },
+        { L"targetname", 0x12000016 }, { L"noumex", 0x16000017 }, { L"debugstart", 0x15000018 },
+        { L"busparams", 0x12000019 }, { L"hostip", 0x1500001A }, { L"port", 0x1500001B },
+        { L"dhcp", 0x1600001C }, { L"key", 0x1200001D }, { L"vm", 0x1600001E },
+        { L"bootems", 0x16000020 }, { L"emsport", 0x15000022 }, { L"emsbaudrate", 0x15000023 },
+        { L"loadoptions", 0x12000030 }, { L"advancedoptions", 0x16000040 }, { L"optionsedit", 0x16000041 },
+        { L"keyringaddress", 0x15000042 }, { L"bootstatdevice", 0x11000043 },
+        { L"bootstatfilepath", 0x12000044 }, { L"preservebootstat", 0x16000045 },
+        { L"graphicsmodedisabled", 0x16000046 }, { L"configaccesspolicy", 0x15000047 },
+        { L"nointegritychecks", 0x16000048 }, { L"testsigning", 0x16000049 },
+        { L"fontpath", 0x1200004A }, { L"integrityservices", 0x1500004B }, { L"volumebandid", 0x1500004C },
+        { L"extendedinput", 0x16000050 }, { L"initialconsoleinput", 0x15000051 },
+        { L"graphicsresolution", 0x15000052 }, { L"restartonfailure", 0x16000053 },
+        { L"highestmode", 0x16000054 }, { L"isolatedcontext", 0x16000060 },
+        { L"displaymessage", 0x15000065 }, { L"displaymessageoverride", 0x15000066 },
+        { L"nobootuxlogo", 0x16000067 }, { L"nobootuxtext", 0x16000068 },
+        { L"nobootuxprogress", 0x16000069 }, { L"nobootuxfade", 0x1600006A },
+        { L"bootuxdisabled", 0x1600006C }, { L"multibootsystem", 0x16000071 },
+        { L"nokeyboard", 0x16000072 }, { L"bootshutdowndisabled", 0x16000074 },
+        { L"performancefrequency", 0x15000075 }, { L"flightsigning", 0x1600007E },
+        { L"nofirmwaresync", 0x16000082 }, { L"windowssyspart", 0x11000084 }, { L"numlock", 0x16000087 }
+    };
+    return names;
+}
+
+inline const std::vector<BcdElementName>& BcdBootMgrElementNames() {
+    static const std::vector<BcdElementName> names = {
+        { L"displayorder", 0x24000001 }, { L"bootsequence", 0x24000002 }, { L"default", 0x23000003 },
+        { L"timeout", 0x25000004 }, { L"resume", 0x26000005 }, { L"resumeobject", 0x23000006 },
+        { L"toolsdisplayorder", 0x24000010 }, { L"displaybootmenu", 0x26000020 },
+        { L"noerrordisplay", 0x26000021 }, { L"bcddevice", 0x21000022 }, { L"bcdfilepath", 0x22000023 },
+        { L"customactions", 0x27000030 }, { L"persistbootsequence", 0x26000031 }
+    };
+    return names;
+}
+
+inline const std::vector<BcdElementName>& BcdOsLoaderElementNames() {
+    static const std::vector<BcdElementName> names = {
+        { L"osdevice", 0x21000001 }, { L"systemroot", 0x22000002 }, { L"resumeobject", 0x23000003 },
+        { L"detecthal", 0x26000010 }, { L"kernel", 0x22000011 }, { L"hal", 0x22000012 },
+        { L"dbgtransport", 0x22000013 }, { L"nx", 0x25000020 }, { L"pae", 0x25000021 },
+        { L"winpe", 0x26000022 }, { L"nocrashautoreboot", 0x26000024 }, { L"lastknowngood", 0x26000025 },
+        { L"nolowmem", 0x26000030 }, { L"removememory", 0x25000031 }, { L"increaseuserva", 0x25000032 },
+        { L"perfmem", 0x25000033 }, { L"vga", 0x26000040 }, { L"quietboot", 0x26000041 },
+        { L"novesa", 0x26000042 }, { L"novga", 0x26000043 }, { L"clustermodeaddressing", 0x25000050 },
+        { L"usephysicaldestination", 0x26000051 }, { L"restrictapiccluster", 0x25000052 },
+        { L"evstore", 0x22000053 }, { L"uselegacyapicmode", 0x26000054 }, { L"onecpu", 0x26000060 },
+        { L"numproc", 0x25000061 }, { L"maxproc", 0x26000062 }, { L"configflags", 0x25000063 },
+        { L"maxgroup", 0x26000064 }, { L"groupaware", 0x26000065 }, { L"groupsize", 0x25000066 },
+        { L"usefirmwarepcisettings", 0x26000070 }, { L"msi", 0x25000071 }, { L"pciexpress", 0x25000072 },
+        { L"safeboot", 0x25000080 }, { L"safebootalternateshell", 0x26000081 }, { L"bootlog", 0x26000090 },
+        { L"sos", 0x26000091 }, { L"debug", 0x260000A0 }, { L"halbreakpoint", 0x260000A1 },
+        { L"useplatformclock", 0x260000A2 }, { L"forcelegacyplatform", 0x260000A3 },
+        { L"useplatformtick", 0x260000A4 }, { L"disabledynamictick", 0x260000A5 },
+        { L"tscsyncpolicy", 0x250000A6 }, { L"ems", 0x260000B0 }, { L"driverloadfailurepolicy", 0x250000C1 },
+        { L"bootmenupolicy", 0x250000C2 }, { L"onetimeadvancedoptions", 0x260000C3 },
+        { L"onetimeoptionsedit", 0x260000C4 }, { L"bootstatuspolicy", 0x250000E0 },
+        { L"disableelamdrivers", 0x260000E1 }, { L"hypervisorlaunchtype", 0x250000F0 },
+        { L"hypervisorpath", 0x220000F1 }, { L"hypervisordebug", 0x260000F2 },
+        { L"hypervisordebugtype", 0x250000F3 }, { L"hypervisordebugport", 0x250000F4 },
+        { L"hypervisorbaudrate", 0x250000F5 }, { L"hypervisorchannel", 0x250000F6 },
+        { L"bootux", 0x250000F7 }, { L"hypervisordisableslat", 0x260000F8 },
+        { L"hypervisorbusparams", 0x220000F9 }, { L"hypervisornumproc", 0x250000FA },
+        { L"hypervisorrootprocpernode", 0x250000FB }, { L"hypervisoruselargevtlb", 0x260000FC },
+        { L"tpmbootentropy", 0x25000100 }, { L"hypervisoriommupolicy", 0x25000115 },
+        { L"xsavedisable", 0x2500012B }, { L"vsmlaunchtype", 0x25000142 }
+    };
+    return names;
+}
+
+// Symbolic values bcdedit accepts for enumerated integer elements
+struct BcdEnumValue {
+    uint32_t type;
+    const wchar_t* name;
+    uint64_t value;
+};
+
+inline const std::vector<BcdEnumValue>& BcdEnumValues() {
+    static const std::vector<BcdEnumValue> values = {
+        { 0x25000020, L"OptIn", 0 }, { 0x25000020, L"OptOut", 1 },
+        { 0x25000020, L"AlwaysOff", 2 }, { 0x25000020, L"AlwaysOn", 3 },
+        { 0x25000021, L"Default", 0 }, { 0x25000021, L"ForceEnable", 1 }, { 0x25000021, L"ForceDisable", 2 },
+        { 0x250000C2, L"Legacy", 0 }, { 0x250000C2, L"Standard", 1 },
+        { 0x250000F0, L"Off", 0 }, { 0x250000F0, L"Auto", 1 },
+        { 0x25000142, L"Off", 0 }, { 0x25000142, L"Auto", 1 },
+        { 0x15000011, L"Serial", 0 }, { 0x15000011, L"1394", 1 }, { 0x15000011, L"USB", 2 },
+        { 0x15000011, L"Net", 6 }, { 0x15000011, L"Local", 5 },
+        { 0x250000E0, L"DisplayAllFailures", 0 }, { 0x250000E0, L"IgnoreAllFailures", 1 }
+    };
+    return values;
+}
+
+// Decoded form of a device element (BCD_DEVICE_OPTION followed by a partition descriptor).
+// A VHD is a partition descriptor whose disk is a virtual disk, followed by a file
+// descriptor: the partition holding the VHD, then its path there. Its host partition is
+// kept in the partition fields below.
+struct BcdDevice {
+    enum Kind : uint32_t {
+        NONE = 0,
+        BOOT = 5,
+        PARTITION = 6,
+        VHD = 0x100                  // Not a descriptor type: PARTITION over VIRTUAL_DISK
+    };
+    enum Style : uint32_t {
+        GPT = 0,
+        MBR = 1
+    };
+
+    Kind kind = NONE;
+    Style style = MBR;
+    uint32_t mbrSignature = 0;   // MBR disk signature
+    uint64_t partitionOffset = 0; // MBR partition byte offset
+    BcdGuid diskGuid;            // GPT disk identifier
+    BcdGuid partitionGuid;       // GPT partition identifier
+    std::wstring file;           // VHD: path of the image on the partition, "\WindowsToGo.vhdx"
+    std::vector<uint8_t> raw;    // Opaque data for device kinds we do not model (ramdisk, locate)
+
+    static constexpr uint32_t DESCRIPTOR_SIZE = 0x48;
+    static constexpr uint32_t VIRTUAL_DISK = 6;          // Disk type of a VHD's partition descriptor, at 0x24
+    static constexpr uint32_t FILE_DEVICE = 3;
+
+    std::vector<uint8_t> Encode() const {
+        if (kind == VHD) {
+            BcdDevice host = *this;
+            host.kind = PARTITION;
+            std::vector<uint8_t> parent = host.Encode();
+            uint32_t fileSize = 0x10 + DESCRIPTOR_SIZE + 2 * static_cast<uint32_t>(file.size() + 1);
+            std::vector<uint8_t> out(0x10 + DESCRIPTOR_SIZE + fileSize, 0);
+            uint8_t* descriptor = out.data() + 0x10;
+            Hive::Put32(descriptor, 0x00, PARTITION);
+            Hive::Put32(descriptor, 0x08, DESCRIPTOR_SIZE + fileSize);
+            Hive::Put32(descriptor, 0x24, VIRTUAL_DISK);
+            uint8_t* nested = descriptor + DESCRIPTOR_SIZE;
+            Hive::Put32(nested, 0x00, FILE_DEVICE);
+            Hive::Put32(nested, 0x08, fileSize);
+            std::memcpy(nested + 0x10, parent.data() + 0x10, DESCRIPTOR_SIZE);
+            for (size_t c = 0; c < file.size(); ++c) Hive::Put16(nested + 0x10 + DESCRIPTOR_SIZE, 2 * c, static_cast<uint16_t>(file[c]));
+            return out;
+        }
+        if (kind != BOOT && kind != PARTITION) return raw;
+        std::vector<uint8_t> out(0x10 + DESCRIPTOR_SIZE, 0);
+        uint8_t* descriptor = out.data() + 0x10;
+        Hive::Put32(descriptor, 0x00, kind);
+        Hive::Put32(descriptor, 0x08, kind == BOOT ? 0x18 : DESCRIPTOR_SIZE);
+        if (kind == BOOT) {
+            out.resize(0x10 + 0x18);
+            return out;
+        }
+        if (style == GPT) {
+            partitionGuid.ToBytes(descriptor + 0x10);
+            Hive::Put32(descriptor, 0x28, GPT);
+            diskGuid.ToBytes(descriptor + 0x2C);
+        }
+        else {
+            Hive::Put64(descriptor, 0x10, partitionOffset);
+            Hive::Put32(descriptor, 0x28, MBR);
+            Hive::Put32(descriptor, 0x2C, mbrSignature);
+        }
+        return out;
+    }
+
+    static BcdDevice Decode(const std::vector<uint8_t>& data) {
+        BcdDevice device;
+        device.raw = data;
+        if (data.size() < 0x20) return device;
+        const uint8_t* descriptor = data.data() + 0x10;
+        uint32_t type = Hive::Get32(descriptor, 0);
+        if (type == BOOT) {
+            device.kind = BOOT;
+        }
+        else if (type == PARTITION && data.size() > 0x20 + 2 * DESCRIPTOR_SIZE && Hive::Get32(descriptor, 0x24) == VIRTUAL_DISK
+                 && Hive::Get32(descriptor + DESCRIPTOR_SIZE, 0) == FILE_DEVICE) {
+            const uint8_t* nested = descriptor + DESCRIPTOR_SIZE;
+            size_t end = std::min<size_t>(data.size(), 0x10 + DESCRIPTOR_SIZE + Hive::Get32(nested, 0x08));
+            device = Decode(std::vector<uint8_t>(nested, nested + 0x10 + DESCRIPTOR_SIZE));
+            device.raw = data;
+            device.kind = VHD;
+            for (size_t at = 0x20 + 2 * DESCRIPTOR_SIZE; at + 2 <= end; at += 2) {
+                uint16_t c = Hive::Get16(data.data(), at);
+                if (c == 0) break;
+                device.file.push_back(static_cast<wchar_t>(c));
+            }
+        }
+        else if (type == PARTITION && data.size() >= 0x10 + 0x3C) {
+            device.kind = PARTITION;
+            device.style = Hive::Get32(descriptor, 0x28) == GPT ? GPT : MBR;
+            if (device.style == GPT) {
+                device.partitionGuid = BcdGuid::FromBytes(descriptor + 0x10);
+                device.diskGuid = BcdGuid::FromBytes(descriptor + 0x2C);
+            }
+            else {
+                device.partitionOffset = Hive::Get64(descriptor, 0x10);
+                device.mbrSignature = Hive::Get32(descriptor, 0x2C);
+            }
+        }
+        return device;
+    }
+
+    bool operator==(const BcdDevice& other) const {
+        if (kind != other.kind) return false;
+        if (kind == BOOT) return true;
+        if (kind == VHD && !Hive::NamesEqual(file, other.file)) return false;
+        if (kind != PARTITION && kind != VHD) return raw == other.raw;
+        if (style != other.style) return false;
+        if (style == GPT) return diskGuid == other.diskGuid && partitionGuid == other.partitionGuid;
+        return mbrSignature == other.mbrSignature && partitionOffset == other.partitionOffset;
+    }
+};
+
+// Object/element view over a BCD hive. The layout is
+//   <root>\Description\KeyName
+//   <root>\Objects\{guid}\Description\Type
+//   <root>\Objects\{guid}\Elements\<type as 8 hex digits>\Element
+// so every bcdedit /set becomes one value write in memory and Save() writes the store once.
+class BcdStore {
+
+    public:
+
+        BcdStore() = default;
+        ~BcdStore() = default;
+
+        bool Open(const std::filesystem::path& storePath) {
+            path = storePath;
+            if (!hive.Load(storePath)) {
+                error = hive.Error();
+                return false;
+            }
+            if (!hive.Open(L"Objects")) {
+                error = L"Hive is not a BCD store: " + storePath.wstring();
+                return false;
+            }
+            return true;
+        }
+
+        // A fresh store with only the skeleton keys bcdedit /createstore writes
+        void Create(const std::filesystem::path& storePath) {
+            path = storePath;
+            hive.CreateEmpty(L"NewStoreRoot");
+            hive.CreatePath(L"Description")->SetValue(L"KeyName", REGF_SZ, Hive::EncodeString(L"BCD00000000"));
+            hive.CreatePath(L"Objects");
+        }
+
+        bool Save() { return SaveAs(path); }
+
+        bool SaveAs(const std::filesystem::path& storePath) {
+            if (!hive.Save(storePath)) {
+                error = hive.Error();
+                return false;
+            }
+            return true;
+        }
+
+        std::vector<uint8_t> Serialize() const { return hive.Serialize(); }
+
+        const std::wstring& Error() const { return error; }
+        const std::filesystem::path& Path() const { return path; }
+
+        // Well known aliases bcdedit accepts in place of a GUID
+        static bool WellKnownObject(const std::wstring& alias, BcdGuid& guid) {
+            static const std::vector<std::pair<const wchar_t*, const wchar_t*>> aliases = {
+                { L"{bootmgr}", L"{9dea862c-5cdd-4e70-acc1-f32b344d4795}" },
+                { L"{fwbootmgr}", L"{a5a30fa2-3d06-4e9f-b5f4-a01df9d1fcba}" },
+                { L"{memdiag}", L"{b2721d73-1db4-4c62-bf78-c548a880142d}" },
+                { L"{ntldr}", L"{466f5a88-0af2-4f76-9038-095b170dc21c}" },
+                { L"{resumeloadersettings}", L"{1afa9c49-16ab-4a5c-901b-212802da9460}" },
+                { L"{globalsettings}", L"{7ea2e1ac-2e61-4728-aaa3-896d9d0a9f0e}" },
+                { L"{bootloadersettings}", L"{6efb52bf-1766-41db-a6b3-0ee5eff72bd7}" },
+                { L"{dbgsettings}", L"{4636856e-540f-4170-a130-a84776f4c654}" },
+                { L"{emssettings}", L"{0ce4991b-e6b3-4b16-b23c-5e0d9250e5d9}" },
+                { L"{badmemory}", L"{5189b25c-5558-4bf2-bca4-289b11bd29e2}" },
+                { L"{hypervisorsettings}", L"{7ff607e0-4395-11db-b0de-0800200c9a66}" },
+                { L"{ramdiskoptions}", L"{ae5534e0-a924-466c-b836-758539a3ee3a}" }
+            };
+            for (const auto& entry : aliases) {
+                if (Hive::NamesEqual(alias, entry.first)) return BcdGuid::Parse(entry.second, guid);
+            }
+            return false;
+        }
+
+        // Resolves a bcdedit identifier. {current} and {default} both map to the boot manager's
+        // default entry because an offline store has no running OS to be "current".
+        bool ResolveObject(const std::wstring& identifier, BcdGuid& guid) const {
+            if (BcdGuid::Parse(identifier, guid)) return true;
+            if (WellKnownObject(identifier, guid)) return true;
+            if (Hive::NamesEqual(identifier, L"{current}") || Hive::NamesEqual(identifier, L"{default}")) {
+                BcdGuid bootmgr;
+                WellKnownObject(L"{bootmgr}", bootmgr);
+                auto target = GetObjectRef(bootmgr, BCD_BOOTMGR_DEFAULT);
+                if (target) {
+                    guid = *target;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<BcdGuid> Objects() const {
+            std::vector<BcdGuid> objects;
+            if (Hive::Key* root = hive.Open(L"Objects")) {
+                for (const auto& key : root->subkeys) {
+                    BcdGuid guid;
+                    if (BcdGuid::Parse(key->name, guid)) objects.push_back(guid);
+                }
+            }
+            return objects;
+        }
+
+        bool HasObject(const BcdGuid& object) const { return ObjectKey(object) != nullptr; }
+
+        uint32_t ObjectType(const BcdGuid& object) const {
+            Hive::Key* key = ObjectKey(object);
+            Hive::Key* description = key ? key->Find(L"Description") : nullptr;
+            const Hive::Value* type = description ? description->FindValue(L"Type") : nullptr;
+            if (!type || type->data.size() < 4) return 0;
+            return Hive::Get32(type->data.data(), 0);
+        }
+
+        bool CreateObject(const BcdGuid& object, uint32_t type) {
+            Hive::Key* objects = hive.Open(L"Objects");
+            if (!objects) {
+                error = L"BCD store has no Objects key";
+                return false;
+            }
+            if (objects->Find(object.ToString())) {
+                error = L"Object already exists: " + object.ToString();
+                return false;
+            }
+            Hive::Key* key = objects->Create(object.ToString());
+            key->Create(L"Description")->SetValue(L"Type", REGF_DWORD, Hive::EncodeDword(type));
+            key->Create(L"Elements");
+            return true;
+        }
+
+        bool DeleteObject(const BcdGuid& object) {
+            Hive::Key* objects = hive.Open(L"Objects");
+            return objects && objects->Delete(object.ToString());
+        }
+
+        std::vector<uint32_t> Elements(const BcdGuid& object) const {
+            std::vector<uint32_t> types;
+            Hive::Key* elements = ElementsKey(object);
+            if (!elements) return types;
+            for (const auto& key : elements->subkeys) {
+                uint32_t type;
+                if (ParseElementName(key->name, type)) types.push_back(type);
+            }
+            return types;
+        }
+
+        bool HasElement(const BcdGuid& object, uint32_t type) const { return ElementValue(object, type) != nullptr; }
+
+        bool DeleteElement(const BcdGuid& object, uint32_t type) {
+            Hive::Key* elements = ElementsKey(object);
+            return elements && elements->Delete(ElementName(type));
+        }
+
+        // Typed setters, each checks the element type's format bits before writing
+        bool SetString(const BcdGuid& object, uint32_t type, const std::wstring& text) {
+            return Write(object, type, BCD_FORMAT_STRING, REGF_SZ, Hive::EncodeString(text));
+        }
+
+        bool SetInteger(const BcdGuid& object, uint32_t type, uint64_t number) {
+            return Write(object, type, BCD_FORMAT_INTEGER, REGF_BINARY, Hive::EncodeQword(number));
+        }
+
+        bool SetBoolean(const BcdGuid& object, uint32_t type, bool flag) {
+            return Write(object, type, BCD_FORMAT_BOOLEAN, REGF_BINARY, std::vector<uint8_t>{ static_cast<uint8_t>(flag ? 1 : 0) });
+        }
+
+        bool SetObjectRef(const BcdGuid& object, uint32_t type, const BcdGuid& target) {
+            return Write(object, type, BCD_FORMAT_OBJECT, REGF_SZ, Hive::EncodeString(target.ToString()));
+        }
+
+        bool SetObjectList(const BcdGuid& object, uint32_t type, const std::vector<BcdGuid>& targets) {
+            std::vector<std::wstring> strings;
+            for (const auto& target : targets) strings.push_back(target.ToString());
+            return Write(object, type, BCD_FORMAT_OBJECTLIST, REGF_MULTI_SZ, Hive::EncodeMultiString(strings));
+        }
+
+        bool SetDevice(const BcdGuid& object, uint32_t type, const BcdDevice& device) {
+            return Write(object, type, BCD_FORMAT_DEVICE, REGF_BINARY, device.Encode());
+        }
+
+        std::optional<std::wstring> GetString(const BcdGuid& object, uint32_t type) const {
+            const Hive::Value* value = ElementValue(object, type);
+            if (!value) return std::nullopt;
+            return Hive::DecodeString(value->data);
+        }
+
+        std::optional<uint64_t> GetInteger(const BcdGuid& object, uint32_t type) const {
+            const Hive::Value* value = ElementValue(object, type);
+            if (!value || value->data.empty()) return std::nullopt;
+            uint8_t bytes[8] = {};
+            std::memcpy(bytes, value->data.data(), std::min<size_t>(8, value->data.size()));
+            return Hive::Get64(bytes, 0);
+        }
+
+        std::optional<bool> GetBoolean(const BcdGuid& object, uint32_t type) const {
+            const Hive::Value* value = ElementValue(object, type);
+            if (!value || value->data.empty()) return std::nullopt;
+            return value->data[0] != 0;
+        }
+
+        std::optional<BcdGuid> GetObjectRef(const BcdGuid& object, uint32_t type) const {
+            auto text = GetString(object, type);
+            BcdGuid guid;
+            if (!text || !BcdGuid::Parse(*text, guid)) return std::nullopt;
+            return guid;
+        }
+
+        std::vector<BcdGuid> GetObjectList(const BcdGuid& object, uint32_t type) const {
+            std::vector<BcdGuid> targets;
+            const Hive::Value* value = ElementValue(object, type);
+            if (!value) return targets;
+            for (const auto& text : Hive::DecodeMultiString(value->data)) {
+                BcdGuid guid;
+                if (BcdGuid::Parse(text, guid)) targets.push_back(guid);
+            }
+            return targets;
+        }
+
+        std::optional<BcdDevice> GetDevice(const BcdGuid& object, uint32_t type) const {
+            const Hive::Value* value = ElementValue(object, type);
+            if (!value) return std::nullopt;
+            return BcdDevice::Decode(value->data);
+        }
+
+        // Maps a bcdedit element name (or custom:XXXXXXXX) to its type for the given object
+        bool LookupElement(const BcdGuid& object, const std::wstring& name, uint32_t& type) const {
+            return LookupElementName(name, (ObjectType(object) & 0xF00000) == 0x100000, type);
+        }
+
+        static bool LookupElementName(const std::wstring& name, bool bootManager, uint32_t& type) {
+            if (name.size() == 15 && Hive::NamesEqual(name.substr(0, 7), L"custom:")) {
+                return ParseElementName(name.substr(7), type);
+            }
+            const auto& specific = bootManager ? BcdBootMgrElementNames() : BcdOsLoaderElementNames();
+            for (const auto& entry : specific) {
+                if (Hive::NamesEqual(name, entry.name)) {
+                    type = entry.type;
+                    return true;
+                }
+            }
+            for (const auto& entry : BcdLibraryElementNames()) {
+                if (Hive::NamesEqual(name, entry.name)) {
+                    type = entry.type;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // True for anything ResolveObject could accept, without needing a loaded store
+        static bool IsValidIdentifier(const std::wstring& identifier) {
+            BcdGuid guid;
+            return BcdGuid::Parse(identifier, guid) || WellKnownObject(identifier, guid)
+                || Hive::NamesEqual(identifier, L"{current}") || Hive::NamesEqual(identifier, L"{default}");
+        }
+
+        // In-memory copy of the whole store, used as a rollback point for batched edits
+        std::vector<uint8_t> Snapshot() const { return hive.Serialize(); }
+
+        bool Restore(const std::vector<uint8_t>& snapshot) {
+            if (!hive.Parse(snapshot.data(), snapshot.size())) {
+                error = hive.Error();
+                return false;
+            }
+            return true;
+        }
+
+        // Turns "partition=E:" style device arguments into a BcdDevice. Drive letters only mean
+        // something on a live Windows system, so the Win32 layer installs the real resolver.
+        std::function<bool(const std::wstring&, BcdDevice&)> deviceResolver;
+
+        // bcdedit's device syntax: "boot", "partition=E:", or "vhd=[E:]\path" for a VHD on a
+        // partition; the partitions go through deviceResolver
+        bool ResolveDevice(const std::wstring& text, BcdDevice& device) const {
+            device = BcdDevice();
+            if (Hive::NamesEqual(text, L"boot")) {
+                device.kind = BcdDevice::BOOT;
+                return true;
+            }
+            std::wstring partition = text, file;
+            if (text.size() > 4 && Hive::NamesEqual(text.substr(0, 4), L"vhd=")) {
+                size_t close = text.find(L']');
+                if (text[4] != L'[' || close == std::wstring::npos || close + 1 >= text.size()) return false;
+                partition = L"partition=" + text.substr(5, close - 5);
+                file = text.substr(close + 1);
+            }
+            if (!deviceResolver || !deviceResolver(partition, device) || device.kind != BcdDevice::PARTITION) return false;
+            if (!file.empty()) {
+                device.kind = BcdDevice::VHD;
+                device.file = file;
+            }
+            return true;
+        }
+
+        // Applies one bcdedit style command line to the in-memory store. Supported verbs are the
+        // ones the USB boot logic uses: /set, /default, /displayorder ... /addfirst and /create.
+        bool ApplyCommand(const std::wstring& command, std::wstring& output) {
+            std::vector<std::wstring> args = SplitCommand(command);
+            output.clear();
+            if (args.empty()) {
+                error = L"Empty BCD command";
+                return false;
+            }
+
+            BcdGuid bootmgr;
+            WellKnownObject(L"{bootmgr}", bootmgr);
+
+            if (Hive::NamesEqual(args[0], L"/set") && args.size() >= 4) {
+                BcdGuid object;
+                uint32_t type;
+                if (!ResolveObject(args[1], object) || !HasObject(object)) {
+                    error = L"Unknown BCD identifier " + args[1];
+                    return false;
+                }
+                if (!LookupElement(object, args[2], type)) {
+                    error = L"Unknown BCD element " + args[2];
+                    return false;
+                }
+                std::vector<std::wstring> values(args.begin() + 3, args.end());
+                return SetFromText(object, type, values);
+            }
+
+            if (Hive::NamesEqual(args[0], L"/default") && args.size() == 2) {
+                BcdGuid object;
+                if (!ResolveObject(args[1], object) || !HasObject(object)) {
+                    error = L"Unknown BCD identifier " + args[1];
+                    return false;
+                }
+                return SetObjectRef(bootmgr, BCD_BOOTMGR_DEFAULT, object);
+            }
+
+            if (Hive::NamesEqual(args[0], L"/displayorder") && args.size() >= 2) {
+                bool addFirst = Hive::NamesEqual(args.back(), L"/addfirst");
+                bool addLast = Hive::NamesEqual(args.back(), L"/addlast");
+                size_t count = args.size() - ((addFirst || addLast) ? 2 : 1);
+                std::vector<BcdGuid> order = (addFirst || addLast) ? GetObjectList(bootmgr, BCD_BOOTMGR_DISPLAYORDER) : std::vector<BcdGuid>{};
+                std::vector<BcdGuid> added;
+                for (size_t i = 1; i <= count; ++i) {
+                    BcdGuid object;
+                    if (!ResolveObject(args[i], object)) {
+                        error = L"Unknown BCD identifier " + args[i];
+                        return false;
+                    }
+                    order.erase(std::remove(order.begin(), order.end(), object), order.end());
+                    added.push_back(object);
+                }
+                order.insert(addFirst ? order.begin() : order.end(), added.begin(), added.end());
+                return SetObjectList(bootmgr, BCD_BOOTMGR_DISPLAYORDER, order);
+            }
+
+            if (Hive::NamesEqual(args[0], L"/create")) {
+                std::wstring description;
+                bool osLoader = false;
+                for (size_t i = 1; i + 1 < args.size(); ++i) {
+                    if (Hive::NamesEqual(args[i], L"/d")) description = args[i + 1];
+                    if (Hive::NamesEqual(args[i], L"/application") && Hive::NamesEqual(args[i + 1], L"osloader")) osLoader = true;
+                }
+                if (!osLoader) {
+                    error = L"Only /create /application osloader is supported";
+                    return false;
+                }
+                BcdGuid object = BcdGuid::Random();
+                BcdGuid settings;
+                WellKnownObject(L"{bootloadersettings}", settings);
+                if (!CreateObject(object, BCD_OBJECT_OSLOADER)) return false;
+                SetString(object, BCD_LIBRARY_DESCRIPTION, description);
+                SetObjectList(object, BCD_LIBRARY_INHERIT, { settings });
+                output = L"The entry " + object.ToString() + L" was successfully created.";
+                return true;
+            }
+
+            error = L"Unsupported BCD command: " + command;
+            return false;
+        }
+
+        // Converts bcdedit's textual value(s) to the element's storage format and writes it
+        bool SetFromText(const BcdGuid& object, uint32_t type, const std::vector<std::wstring>& values) {
+            const std::wstring& text = values.front();
+            switch (BcdElementFormatOf(type)) {
+                case BCD_FORMAT_BOOLEAN: {
+                    bool flag;
+                    if (!ParseBoolean(text, flag)) break;
+                    return SetBoolean(object, type, flag);
+                }
+                case BCD_FORMAT_INTEGER: {
+                    uint64_t number;
+                    if (!ParseInteger(type, text, number)) break;
+                    return SetInteger(object, type, number);
+                }
+                case BCD_FORMAT_STRING:
+                    return SetString(object, type, text);
+                case BCD_FORMAT_OBJECT: {
+                    BcdGuid target;
+                    if (!ResolveObject(text, target)) break;
+                    return SetObjectRef(object, type, target);
+                }
+                case BCD_FORMAT_OBJECTLIST: {
+                    std::vector<BcdGuid> targets;
+                    for (const auto& item : values) {
+                        BcdGuid target;
+                        if (!ResolveObject(item, target)) {
+                            error = L"Invalid value " + item + L" for element " + ElementName(type);
+                            return false;
+                        }
+                        targets.push_back(target);
+                    }
+                    return SetObjectList(object, type, targets);
+                }
+                case BCD_FORMAT_DEVICE: {
+                    BcdDevice device;
+                    if (!ResolveDevice(text, device)) break;
+                    return SetDevice(object, type, device);
+                }
+                default:
+                    break;
+            }
+            error = L"Invalid value " + text + L" for element " + ElementName(type);
+            return false;
+        }
+
+        static bool ParseBoolean(const std::wstring& text, bool& flag) {
+            for (const wchar_t* yes : { L"on", L"yes", L"true", L"1" }) {
+                if (Hive::NamesEqual(text, yes)) {
+                    flag = true;
+                    return true;
+                }
+            }
+            for (const wchar_t* no : { L"off", L"no", L"false", L"0" }) {
+                if (Hive::NamesEqual(text, no)) {
+                    flag = false;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static bool ParseInteger(uint32_t type, const std::wstring& text, uint64_t& number) {
+            for (const auto& entry : BcdEnumValues()) {
+                if (entry.type == type && Hive::NamesEqual(text, entry.name)) {
+                    number = entry.value;
+                    return true;
+                }
+            }
+            if (text.empty()) return false;
+            wchar_t* end = nullptr;
+            number = std::wcstoull(text.c_str(), &end, 0);
+            return end && *end == L'\0';
+        }
+
+        // Splits a command line on blanks, keeping "quoted strings" together
+        static std::vector<std::wstring> SplitCommand(const std::wstring& command) {
+            std::vector<std::wstring> args;
+            std::wstring current;
+            bool quoted = false, pending = false;
+            for (wchar_t c : command) {
+                if (c == L'"') {
+                    quoted = !quoted;
+                    pending = true;
+                }
+                else if (!quoted && (c == L' ' || c == L'\t')) {
+                    if (pending) args.push_back(current);
+                    current.clear();
+                    pending = false;
+                }
+                else {
+                    current.push_back(c);
+                    pending = true;
+                }
+            }
+            if (pending) args.push_back(current);
+            return args;
+        }
+
+        static bool ParseElementName(const std::wstring& text, uint32_t& type) {
+            if (text.size() != 8) return false;
+            uint32_t result = 0;
+            for (wchar_t c : text) {
+                int digit = -1;
+                if (c >= L'0' && c <= L'9') digit = c - L'0';
+                else if (c >= L'a' && c <= L'f') digit = c - L'a' + 10;
+                else if (c >= L'A' && c <= L'F') digit = c - L'A' + 10;
+                if (digit < 0) return false;
+                result = result << 4 | static_cast<uint32_t>(digit);
+            }
+            type = result;
+            return true;
+        }
+
+        static std::wstring ElementName(uint32_t type) {
+            wchar_t text[9];
+            std::swprintf(text, 9, L"%08X", type);
+            return text;
+        }
+
+    private:
+
+        Hive hive;
+        std::filesystem::path path;
+        std::wstring error;
+
+        Hive::Key* ObjectKey(const BcdGuid& object) const {
+            Hive::Key* objects = hive.Open(L"Objects");
+            return objects ? objects->Find(object.ToString()) : nullptr;
+        }
+
+        Hive::Key* ElementsKey(const BcdGuid& object) const {
+            Hive::Key* key = ObjectKey(object);
+            return key ? key->Find(L"Elements") : nullptr;
+        }
+
+        const Hive::Value* ElementValue(const BcdGuid& object, uint32_t type) const {
+            Hive::Key* elements = ElementsKey(object);
+            Hive::Key* element = elements ? elements->Find(ElementName(type)) : nullptr;
+            return element ? element->FindValue(L"Element") : nullptr;
+        }
+
+        bool Write(const BcdGuid& object, uint32_t type, uint32_t format, uint32_t valueType, const std::vector<uint8_t>& data) {
+            if (BcdElementFormatOf(type) != format) {
+                error = L"Element " + ElementName(type) + L" has a different data format";
+                return false;
+            }
+            Hive::Key* key = ObjectKey(object);
+            if (!key) {
+                error = L"Object not found: " + object.ToString();
+                return false;
+            }
+            key->Create(L"Elements")->Create(ElementName(type))->SetValue(L"Element", valueType, data);
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,861 @@
+#ifndef _HIVE_H_
+#define _HIVE_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+#include <cwctype>
+
+// Registry value types we care about in BCD and the offline system hives
+enum HiveValueType : uint32_t {
+    REGF_NONE = 0,
+    REGF_SZ = 1,
+    REGF_EXPAND_SZ = 2,
+    REGF_BINARY = 3,
+    REGF_DWORD = 4,
+    REGF_MULTI_SZ = 7,
+    REGF_QWORD = 11
+};
+
+// In-memory reader/writer for the registry hive (regf) file format.
+// The whole hive is parsed into a key tree, edited in memory and then
+// serialized back as a freshly packed hive in a single write.
+// Nothing here touches the Win32 registry API so it works on plain files on any platform.
+class Hive {
+
+    public:
+
+        struct Value {
+            std::wstring name;
+            uint32_t type = REGF_NONE;
+            std::vector<uint8_t> data;
+        };
+
+        struct Key {
+            std::wstring name;
+            uint16_t flags = 0;
+            uint64_t timestamp = 0;
+            uint32_t security = 0; // Index into Hive::securities
+            std::vector<uint8_t> className;
+            std::vector<Value> values;
+            std::vector<std::unique_ptr<Key>> subkeys;
+            Key* parent = nullptr;
+
+            Key* Find(const std::wstring& keyName) const {
+                for (const auto& subkey : subkeys) {
+                    if (NamesEqual(subkey->name, keyName)) return subkey.get();
+                }
+                return nullptr;
+            }
+
+            Key* Create(const std::wstring& keyName) {
+                if (Key* existing = Find(keyName)) return existing;
+                auto key = std::make_unique<Key>();
+                key->name = keyName;
+                key->flags = 0;
+                key->timestamp = Hive::Now();
+                key->security = security; // New keys inherit their parent's descriptor
+                key->parent = this;
+                subkeys.push_back(std::move(key));
+                timestamp = Hive::Now();
+                return subkeys.back().get();
+            }
+
+            bool Delete(const std::wstring& keyName) {
+                for (auto it = subkeys.begin(); it != subkeys.end(); ++it) {
+                    if (NamesEqual((*it)->name, keyName)) {
+                        subkeys.erase(it);
+                        timestamp = Hive::Now();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            const Value* FindValue(const std::wstring& valueName) const {
+                for (const auto& value : values) {
+                    if (NamesEqual(value.name, valueName)) return &value;
+                }
+                return nullptr;
+            }
+
+            void SetValue(const std::wstring& valueName, uint32_t type, const std::vector<uint8_t>& data) {
+                timestamp = Hive::Now();
+                for (auto& value : values) {
+                    if (NamesEqual(value.name, valueName)) {
+                        value.type = type;
+                        value.data = data;
+                        return;
+                    }
+                }
+                values.push_back(Value{ valueName, type, data });
+            }
+
+            bool DeleteValue(const std::wstring& valueName) {
+                for (auto it = values.begin(); it != values.end(); ++it) {
+                    if (NamesEqual(it->name, valueName)) {
+                        values.erase(it);
+                        timestamp = Hive::Now();
+                        return true;
+                    }
+                }
+                return false;
+            }
+        };
+
+        Hive() = default;
+        ~Hive() = default;
+
+        // Creates an empty hive with a single root key, used for new stores and synthetic test hives
+        void CreateEmpty(const std::wstring& rootName) {
+            baseBlock.assign(BASE_BLOCK_SIZE, 0);
+            std::memcpy(baseBlock.data(), "regf", 4);
+            Put32(baseBlock.data(), 0x14, 1); // Major version
+            Put32(baseBlock.data(), 0x18, 3); // Minor version
+            Put32(baseBlock.data(), 0x1C, 0); // Primary file
+            Put32(baseBlock.data(), 0x20, 1); // Direct memory load
+            Put32(baseBlock.data(), 0x2C, 1); // Clustering factor
+            securities.assign(1, DefaultSecurityDescriptor());
+            root = std::make_unique<Key>();
+            root->name = rootName;
+            root->flags = KEY_HIVE_ENTRY | KEY_NO_DELETE;
+            root->timestamp = Now();
+            root->security = 0;
+            rootParent = 0;
+            error.clear();
+        }
+
+        bool Load(const std::filesystem::path& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                error = L"Cannot open hive " + path.wstring();
+                return false;
+            }
+            std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            return Parse(image.data(), image.size());
+        }
+
+        bool Parse(const uint8_t* image, size_t size) {
+            error.clear();
+            securities.clear();
+            securityByOffset.clear();
+            root.reset();
+
+            if (size < BASE_BLOCK_SIZE + HBIN_HEADER_SIZE || std::memcmp(image, "regf", 4) != 0) {
+                error = L"Not a registry hive";
+                return false;
+            }
+            if (Get32(image, 0x14) != 1) {
+                error = L"Unsupported hive major version";
+                return false;
+            }
+            if (Get32(image, 0x04) != Get32(image, 0x08)) {
+                // Dirty hive: the .LOG files hold changes we would silently drop on save
+                error = L"Hive was not cleanly unloaded (pending transaction log)";
+                return false;
+            }
+
+            baseBlock.assign(image, image + BASE_BLOCK_SIZE);
+            minorVersion = Get32(image, 0x18);
+            data = image + BASE_BLOCK_SIZE;
+            dataSize = std::min<size_t>(Get32(image, 0x28), size - BASE_BLOCK_SIZE);
+
+            uint32_t rootOffset = Get32(image, 0x24);
+            const uint8_t* rootCell = Cell(rootOffset, 0x4C);
+            if (!rootCell || std::memcmp(rootCell, "nk", 2) != 0) {
+                error = L"Hive root key is invalid";
+                return false;
+            }
+            rootParent = Get32(rootCell, 0x10);
+            root = ParseKey(rootOffset, nullptr, 0);
+            data = nullptr;
+            if (!root) {
+                if (error.empty()) error = L"Hive key tree is corrupted";
+                return false;
+            }
+            return true;
+        }
+
+        // Packs the whole tree into a new hive image; cells are laid out sequentially so
+        // the result is both defragmented and written with one sequential write
+        std::vector<uint8_t> Serialize() const {
+            Writer writer;
+            std::vector<uint8_t> image = baseBlock;
+            if (image.size() != BASE_BLOCK_SIZE || !root) return {};
+
+            // Security cells first, only the descriptors still referenced by a key
+            std::vector<uint32_t> refCount(securities.size(), 0);
+            CountSecurity(*root, refCount);
+            std::vector<uint32_t> securityCell(securities.size(), 0);
+            std::vector<uint32_t> used;
+            for (uint32_t i = 0; i < securities.size(); ++i) {
+                if (refCount[i] == 0) continue;
+                const auto& descriptor = securities[i];
+                uint32_t offset = writer.Alloc(0x14 + static_cast<uint32_t>(descriptor.size()));
+                uint8_t* cell = writer.At(offset);
+                std::memcpy(cell, "sk", 2);
+                Put32(cell, 0x0C, refCount[i]);
+                Put32(cell, 0x10, static_cast<uint32_t>(descriptor.size()));
+                std::memcpy(cell + 0x14, descriptor.data(), descriptor.size());
+                securityCell[i] = offset;
+                used.push_back(i);
+            }
+            for (size_t i = 0; i < used.size(); ++i) {
+                uint8_t* cell = writer.At(securityCell[used[i]]);
+                Put32(cell, 0x04, securityCell[used[(i + 1) % used.size()]]);
+                Put32(cell, 0x08, securityCell[used[(i + used.size() - 1) % used.size()]]);
+            }
+
+            uint32_t rootOffset = WriteKey(writer, *root, rootParent, securityCell);
+            writer.Finish();
+
+            Put32(image.data(), 0x04, Get32(image.data(), 0x04) + 1);
+            Put32(image.data(), 0x08, Get32(image.data(), 0x04));
+            Put64(image.data(), 0x0C, Now());
+            Put32(image.data(), 0x24, rootOffset);
+            Put32(image.data(), 0x28, static_cast<uint32_t>(writer.bins.size()));
+            Put32(image.data(), 0x1FC, Checksum(image.data()));
+            image.insert(image.end(), writer.bins.begin(), writer.bins.end());
+            return image;
+        }
+
+        // Serializes and replaces the file through a temporary so a failed write never leaves a half hive
+        bool Save(const std::filesystem::path& path) const {
+            std::vector<uint8_t> image = Serialize();
+            if (image.empty()) {
+                error = L"Nothing to save, hive is not loaded";
+                return false;
+            }
+            std::filesystem::path temp = path;
+            temp += L".tmp";
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                if (!file.write(reinterpret_cast<const char*>(image.data()), image.size()) || !file.flush()) {
+                    error = L"Cannot write hive " + temp.wstring();
+                    return false;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(temp, path, ec);
+            if (ec) {
+                std::filesystem::remove(temp, ec);
+                error = L"Cannot replace hive " + path.wstring();
+                return false;
+            }
+            return true;
+        }
+
+        Key* Root() const { return root.get(); }
+
+        // Opens a key below the root by a backslash separated path
+        Key* Open(const std::wstring& path) const {
+            Key* key = root.get();
+            size_t start = 0;
+            while (key && start < path.size()) {
+                size_t end = path.find(L'\\', start);
+                if (end == std::wstring::npos) end = path.size();
+                if (end > start) key = key->Find(path.substr(start, end - start));
+                start = end + 1;
+            }
+            return key;
+        }
+
+        Key* CreatePath(const std::wstring& path) {
+            Key* key = root.get();
+            size_t start = 0;
+            while (key && start < path.size()) {
+                size_t end = path.find(L'\\', start);
+                if (end == std::wstring::npos) end = path.size();
+                if (end > start) key = key->Create(path.substr(start, end - start));
+                start = end + 1;
+            }
+            return key;
+        }
+
+        const std::wstring& Error() const { return error; }
+
+        // Value encoding helpers shared by the BCD and offline hive editors
+        static std::vector<uint8_t> EncodeString(const std::wstring& text) {
+            std::vector<uint8_t> out;
+            AppendUtf16(out, text);
+            out.push_back(0);
+            out.push_back(0);
+            return out;
+        }
+
+        static std::vector<uint8_t> EncodeMultiString(const std::vector<std::wstring>& strings) {
+            std::vector<uint8_t> out;
+            for (const auto& text : strings) {
+                AppendUtf16(out, text);
+                out.push_back(0);
+                out.push_back(0);
+            }
+            out.push_back(0);
+            out.push_back(0);
+            return out;
+        }
+
+        static std::vector<uint8_t> EncodeDword(uint32_t number) {
+            std::vector<uint8_t> out(4);
+            Put32(out.data(), 0, number);
+            return out;
+        }
+
+        static std::vector<uint8_t> EncodeQword(uint64_t number) {
+            std::vector<uint8_t> out(8);
+            Put64(out.data(), 0, number);
+            return out;
+        }
+
+        static std::wstring DecodeString(const std::vector<uint8_t>& bytes) {
+            std::wstring text = DecodeUtf16(bytes.data(), bytes.size());
+            size_t nul = text.find(L'\0');
+            if (nul != std::wstring::npos) text.resize(nul);
+            return text;
+        }
+
+        static std::vector<std::wstring> DecodeMultiString(const std::vector<uint8_t>& bytes) {
+            std::vector<std::wstring> strings;
+            std::wstring text = DecodeUtf16(bytes.data(), bytes.size());
+            size_t start = 0;
+            while (start < text.size()) {
+                size_t end = text.find(L'\0', start);
+                if (end == std::wstring::npos) end = text.size();
+                if (end == start) break;
+                strings.push_back(text.substr(start, end - start));
+                start = end + 1;
+            }
+            return strings;
+        }
+
+        static bool NamesEqual(const std::wstring& a, const std::wstring& b) {
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (std::towupper(a[i]) != std::towupper(b[i])) return false;
+            }
+            return true;
+        }
+
+        // Current time as a Windows FILETIME
+        static uint64_t Now() {
+            auto since = std::chrono::system_clock::now().time_since_epoch();
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(since).count()) * 10
+                + 116444736000000000ULL;
+        }
+
+        static uint32_t Get32(const uint8_t* p, size_t offset) {
+            return static_cast<uint32_t>(p[offset]) | static_cast<uint32_t>(p[offset + 1]) << 8
+                | static_cast<uint32_t>(p[offset + 2]) << 16 | static_cast<uint32_t>(p[offset + 3]) << 24;
+        }
+
+        static uint16_t Get16(const uint8_t* p, size_t offset) {
+            return static_cast<uint16_t>(p[offset] | p[offset + 1] << 8);
+        }
+
+        static uint64_t Get64(const uint8_t* p, size_t offset) {
+            return Get32(p, offset) | static_cast<uint64_t>(Get32(p, offset + 4)) << 32;
+        }
+
+        static void Put16(uint8_t* p, size_t offset, uint16_t v) {
+            p[offset] = static_cast<uint8_t>(v);
+            p[offset + 1] = static_cast<uint8_t>(v >> 8);
+        }
+
+        static void Put32(uint8_t* p, size_t offset, uint32_t v) {
+            for (int i = 0; i < 4; ++i) p[offset + i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+
+        static void Put64(uint8_t* p, size_t offset, uint64_t v) {
+            Put32(p, offset, static_cast<uint32_t>(v));
+            Put32(p, offset + 4, static_cast<uint32_t>(v >> 32));
+        }
+
+        // XOR of the first 127 dwords of the base block, with the two reserved results remapped
+        static uint32_t Checksum(const uint8_t* block) {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < 0x1FC; i += 4) sum ^= Get32(block, i);
+            if (sum == 0xFFFFFFFF) sum = 0xFFFFFFFE;
+            if (sum == 0) sum = 1;
+            return sum;
+        }
+
+        static constexpr size_t BASE_BLOCK_SIZE = 4096;
+        static constexpr size_t HBIN_HEADER_SIZE = 32;
+
+    private:
+
+        static constexpr uint16_t KEY_HIVE_EXIT = 0x0002;
+        static constexpr uint16_t KEY_HIVE_ENTRY = 0x0004;
+        static constexpr uint16_t KEY_NO_DELETE = 0x0008;
+        static constexpr uint16_t KEY_COMP_NAME = 0x0020;
+        static constexpr uint16_t VALUE_COMP_NAME = 0x0001;
+        static constexpr uint32_t BIG_DATA_SEGMENT = 16344;
+        static constexpr int MAX_DEPTH = 512;
+
+        std::vector<uint8_t> baseBlock;
+        uint32_t minorVersion = 3;
+        uint32_t rootParent = 0;
+        std::unique_ptr<Key> root;
+        std::vector<std::vector<uint8_t>> securities;
+        mutable std::wstring error;
+
+        // Parse state, only valid inside Parse()
+        const uint8_t* data = nullptr;
+        size_t dataSize = 0;
+        std::unordered_map<uint32_t, uint32_t> securityByOffset;   // sk cell -> index in securities
+
+        // Returns the body of an allocated cell with at least `need` bytes, or nullptr
+        const uint8_t* Cell(uint32_t offset, size_t need, uint32_t* bodySize = nullptr) const {
+            if (offset == 0xFFFFFFFF || static_cast<size_t>(offset) + 4 > dataSize) return nullptr;
+            int32_t size = static_cast<int32_t>(Get32(data, offset));
+            if (size >= 0) return nullptr; // Free cell
+            size_t length = static_cast<size_t>(-static_cast<int64_t>(size));
+            if (length < 4 + need || offset + length > dataSize) return nullptr;
+            if (bodySize) *bodySize = static_cast<uint32_t>(length - 4);
+            return data + offset + 4;
+        }
+
+        std::unique_ptr<Key> ParseKey(uint32_t offset, Key* parent, int depth) {
+            uint32_t cellSize = 0;
+            const uint8_t* nk = Cell(offset, 0x4C, &cellSize);
+            if (!nk || std::memcmp(nk, "nk", 2) != 0 || depth > MAX_DEPTH) return nullptr;
+
+            auto key = std::make_unique<Key>();
+            key->parent = parent;
+            key->flags = Get16(nk, 0x02) & ~KEY_COMP_NAME;
+            key->timestamp = Get64(nk, 0x04);
+            uint16_t nameLength = Get16(nk, 0x48);
+            if (0x4CU + nameLength > cellSize) return nullptr;
+            key->name = DecodeName(nk + 0x4C, nameLength, Get16(nk, 0x02) & KEY_COMP_NAME);
+
+            uint16_t classLength = Get16(nk, 0x4A);
+            if (classLength) {
+                if (const uint8_t* cls = Cell(Get32(nk, 0x30), classLength)) {
+                    key->className.assign(cls, cls + classLength);
+                }
+            }
+
+            if (!ParseSecurity(Get32(nk, 0x2C), key->security)) return nullptr;
+
+            uint32_t valueCount = Get32(nk, 0x24);
+            if (valueCount) {
+                uint32_t listSize = 0;
+                const uint8_t* list = Cell(Get32(nk, 0x28), 0, &listSize);
+                if (!list || static_cast<uint64_t>(valueCount) * 4 > listSize) return nullptr;
+                for (uint32_t i = 0; i < valueCount; ++i) {
+                    Value value;
+                    if (!ParseValue(Get32(list, i * 4), value)) return nullptr;
+                    key->values.push_back(std::move(value));
+                }
+            }
+
+            if (Get32(nk, 0x14)) {
+                std::vector<uint32_t> children;
+                if (!ParseSubkeyList(Get32(nk, 0x1C), children, 0)) return nullptr;
+                if (children.size() != Get32(nk, 0x14)) return nullptr;
+                for (uint32_t child : children) {
+                    auto subkey = ParseKey(child, key.get(), depth + 1);
+                    if (!subkey) return nullptr;
+                    key->subkeys.push_back(std::move(subkey));
+                }
+            }
+            return key;
+        }
+
+        bool ParseSubkeyList(uint32_t offset, std::vector<uint32_t>& children, int depth) {
+            uint32_t listSize = 0;
+            const uint8_t* list = Cell(offset, 4, &listSize);
+            if (!list || depth > 2) return false;
+            uint16_t count = Get16(list, 2);
+            if (std::memcmp(list, "lf", 2) == 0 || std::memcmp(list, "lh", 2) == 0) {
+                if (4 + static_cast<size_t>(count) * 8 > listSize) return false;
+                for (uint16_t i = 0; i < count; ++i) children.push_back(Get32(list, 4 + i * 8));
+                return true;
+            }
+            if (std::memcmp(list, "li", 2) == 0 || std::memcmp(list, "ri", 2) == 0) {
+                if (4 + static_cast<size_t>(count) * 4 > listSize) return false;
+                for (uint16_t i = 0; i < count; ++i) {
+                    if (list[1] == 'i' && list[0] == 'l') {
+                        children.push_back(Get32(list, 4 + i * 4));
+                    }
+                    else if (!ParseSubkeyList(Get32(list, 4 + i * 4), children, depth + 1)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseValue(uint32_t offset, Value& value) {
+            uint32_t cellSize = 0;
+            const uint8_t* vk = Cell(offset, 0x14, &cellSize);
+            if (!vk || std::memcmp(vk, "vk", 2) != 0) return false;
+            uint16_t nameLength = Get16(vk, 0x02);
+            if (0x14U + nameLength > cellSize) return false;
+            value.name = DecodeName(vk + 0x14, nameLength, Get16(vk, 0x10) & VALUE_COMP_NAME);
+            value.type = Get32(vk, 0x0C);
+
+            uint32_t length = Get32(vk, 0x04);
+            if (length & 0x80000000) {
+                // Small data lives in the offset field itself
+                length &= 0x7FFFFFFF;
+                if (length > 4) return false;
+                value.data.assign(vk + 0x08, vk + 0x08 + length);
+                return true;
+            }
+            if (length == 0) return true;
+
+            uint32_t dataCellSize = 0;
+            const uint8_t* cell = Cell(Get32(vk, 0x08), 0, &dataCellSize);
+            if (!cell) return false;
+            if (minorVersion >= 4 && length > BIG_DATA_SEGMENT && dataCellSize >= 8 && std::memcmp(cell, "db", 2) == 0) {
+                uint16_t segments = Get16(cell, 2);
+                uint32_t listSize = 0;
+                const uint8_t* list = Cell(Get32(cell, 4), 0, &listSize);
+                if (!list || static_cast<size_t>(segments) * 4 > listSize) return false;
+                for (uint16_t i = 0; i < segments && value.data.size() < length; ++i) {
+                    uint32_t segmentSize = 0;
+                    const uint8_t* segment = Cell(Get32(list, i * 4), 0, &segmentSize);
+                    if (!segment) return false;
+                    size_t take = std::min<size_t>({ segmentSize, BIG_DATA_SEGMENT, length - value.data.size() });
+                    value.data.insert(value.data.end(), segment, segment + take);
+                }
+                return value.data.size() == length;
+            }
+            if (length > dataCellSize) return false;
+            value.data.assign(cell, cell + length);
+            return true;
+        }
+
+        bool ParseSecurity(uint32_t offset, uint32_t& index) {
+            auto known = securityByOffset.find(offset);
+            if (known != securityByOffset.end()) {
+                index = known->second;
+                return true;
+            }
+            uint32_t cellSize = 0;
+            const uint8_t* sk = Cell(offset, 0x14, &cellSize);
+            if (!sk || std::memcmp(sk, "sk", 2) != 0) return false;
+            uint32_t length = Get32(sk, 0x10);
+            if (0x14ULL + length > cellSize) return false;
+            index = static_cast<uint32_t>(securities.size());
+            securities.emplace_back(sk + 0x14, sk + 0x14 + length);
+            securityByOffset.emplace(offset, index);
+            return true;
+        }
+
+        static void CountSecurity(const Key& key, std::vector<uint32_t>& refCount) {
+            if (key.security < refCount.size()) refCount[key.security]++;
+            for (const auto& subkey : key.subkeys) CountSecurity(*subkey, refCount);
+        }
+
+        // Sequential cell allocator over a growing set of 4K hive bins
+        struct Writer {
+            std::vector<uint8_t> bins;
+            size_t binStart = 0;
+            size_t cursor = 0;
+
+            uint32_t Alloc(uint32_t bodySize) {
+                uint32_t size = (bodySize + 4 + 7) & ~7U;
+                if (bins.empty() || cursor + size > bins.size()) {
+                    CloseBin();
+                    size_t binSize = (size + HBIN_HEADER_SIZE + 4095) & ~static_cast<size_t>(4095);
+                    binStart = bins.size();
+                    bins.resize(binStart + binSize, 0);
+                    std::memcpy(&bins[binStart], "hbin", 4);
+                    Put32(&bins[binStart], 0x04, static_cast<uint32_t>(binStart));
+                    Put32(&bins[binStart], 0x08, static_cast<uint32_t>(binSize));
+                    Put64(&bins[binStart], 0x14, Hive::Now());
+                    cursor = binStart + HBIN_HEADER_SIZE;
+                }
+                uint32_t offset = static_cast<uint32_t>(cursor);
+                Put32(&bins[cursor], 0, static_cast<uint32_t>(-static_cast<int32_t>(size)));
+                cursor += size;
+                return offset;
+            }
+
+            uint8_t* At(uint32_t offset) { return &bins[offset + 4]; }
+
+            // The unused tail of a bin must be a free cell
+            void CloseBin() {
+                if (!bins.empty() && cursor < bins.size()) {
+                    Put32(&bins[cursor], 0, static_cast<uint32_t>(bins.size() - cursor));
+                }
+                cursor = bins.size();
+            }
+
+            void Finish() { CloseBin(); }
+        };
+
+        uint32_t WriteKey(Writer& writer, const Key& key, uint32_t parentOffset, const std::vector<uint32_t>& securityCell) const {
+            bool compName = CanCompress(key.name);
+            size_t nameBytes = compName ? key.name.size() : key.name.size() * 2;
+            uint32_t offset = writer.Alloc(static_cast<uint32_t>(0x4C + nameBytes));
+            {
+                uint8_t* nk = writer.At(offset);
+                std::memcpy(nk, "nk", 2);
+                Put16(nk, 0x02, static_cast<uint16_t>(key.flags | (compName ? KEY_COMP_NAME : 0)));
+                Put64(nk, 0x04, key.timestamp);
+                Put32(nk, 0x10, parentOffset);
+                Put32(nk, 0x14, static_cast<uint32_t>(key.subkeys.size()));
+                Put32(nk, 0x1C, 0xFFFFFFFF);
+                Put32(nk, 0x20, 0xFFFFFFFF);
+                Put32(nk, 0x24, static_cast<uint32_t>(key.values.size()));
+                Put32(nk, 0x28, 0xFFFFFFFF);
+                Put32(nk, 0x2C, key.security < securityCell.size() ? securityCell[key.security] : 0xFFFFFFFF);
+                Put32(nk, 0x30, 0xFFFFFFFF);
+                Put16(nk, 0x48, static_cast<uint16_t>(nameBytes));
+                Put16(nk, 0x4A, static_cast<uint16_t>(key.className.size()));
+                EncodeName(nk + 0x4C, key.name, compName);
+            }
+
+            uint32_t maxValueName = 0, maxValueData = 0;
+            if (!key.values.empty()) {
+                std::vector<uint32_t> valueCells;
+                for (const auto& value : key.values) {
+                    valueCells.push_back(WriteValue(writer, value));
+                    maxValueName = std::max<uint32_t>(maxValueName, static_cast<uint32_t>(value.name.size() * 2));
+                    maxValueData = std::max<uint32_t>(maxValueData, static_cast<uint32_t>(value.data.size()));
+                }
+                uint32_t list = writer.Alloc(static_cast<uint32_t>(valueCells.size() * 4));
+                for (size_t i = 0; i < valueCells.size(); ++i) Put32(writer.At(list), i * 4, valueCells[i]);
+                Put32(writer.At(offset), 0x28, list);
+            }
+
+            if (!key.className.empty()) {
+                uint32_t cls = writer.Alloc(static_cast<uint32_t>(key.className.size()));
+                std::memcpy(writer.At(cls), key.className.data(), key.className.size());
+                Put32(writer.At(offset), 0x30, cls);
+            }
+
+            uint32_t maxSubkeyName = 0, maxSubkeyClass = 0;
+            if (!key.subkeys.empty()) {
+                // The kernel binary searches subkey lists, so they must be sorted by upcased name
+                std::vector<const Key*> sorted;
+                for (const auto& subkey : key.subkeys) sorted.push_back(subkey.get());
+                std::sort(sorted.begin(), sorted.end(), [](const Key* a, const Key* b) {
+                    return CompareNames(a->name, b->name) < 0;
+                });
+                std::vector<uint32_t> children;
+                for (const Key* subkey : sorted) {
+                    children.push_back(WriteKey(writer, *subkey, offset, securityCell));
+                    maxSubkeyName = std::max<uint32_t>(maxSubkeyName, static_cast<uint32_t>(subkey->name.size() * 2));
+                    maxSubkeyClass = std::max<uint32_t>(maxSubkeyClass, static_cast<uint32_t>(subkey->className.size()));
+                }
+                Put32(writer.At(offset), 0x1C, WriteSubkeyList(writer, sorted, children));
+            }
+
+            uint8_t* nk = writer.At(offset);
+            Put32(nk, 0x34, maxSubkeyName);
+            Put32(nk, 0x38, maxSubkeyClass);
+            Put32(nk, 0x3C, maxValueName);
+            Put32(nk, 0x40, maxValueData);
+            return offset;
+        }
+
+        // Large keys get split into an "ri" index of "lh" leaves like the kernel does
+        static uint32_t WriteSubkeyList(Writer& writer, const std::vector<const Key*>& sorted, const std::vector<uint32_t>& children) {
+            constexpr size_t LEAF_LIMIT = 511;
+            auto writeLeaf = [&](size_t begin, size_t end) {
+                uint32_t leaf = writer.Alloc(static_cast<uint32_t>(4 + (end - begin) * 8));
+                uint8_t* lh = writer.At(leaf);
+                std::memcpy(lh, "lh", 2);
+                Put16(lh, 2, static_cast<uint16_t>(end - begin));
+                for (size_t i = begin; i < end; ++i) {
+                    Put32(lh, 4 + (i - begin) * 8, children[i]);
+                    Put32(lh, 8 + (i - begin) * 8, NameHash(sorted[i]->name));
+                }
+                return leaf;
+            };
+            if (children.size() <= LEAF_LIMIT) return writeLeaf(0, children.size());
+
+            std::vector<uint32_t> leaves;
+            for (size_t begin = 0; begin < children.size(); begin += LEAF_LIMIT) {
+                leaves.push_back(writeLeaf(begin, std::min(children.size(), begin + LEAF_LIMIT)));
+            }
+            uint32_t index = writer.Alloc(static_cast<uint32_t>(4 + leaves.size() * 4));
+            uint8_t* ri = writer.At(index);
+            std::memcpy(ri, "ri", 2);
+            Put16(ri, 2, static_cast<uint16_t>(leaves.size()));
+            for (size_t i = 0; i < leaves.size(); ++i) Put32(ri, 4 + i * 4, leaves[i]);
+            return index;
+        }
+
+        uint32_t WriteValue(Writer& writer, const Value& value) const {
+            bool compName = CanCompress(value.name);
+            size_t nameBytes = compName ? value.name.size() : value.name.size() * 2;
+            uint32_t offset = writer.Alloc(static_cast<uint32_t>(0x14 + nameBytes));
+            {
+                uint8_t* vk = writer.At(offset);
+                std::memcpy(vk, "vk", 2);
+                Put16(vk, 0x02, static_cast<uint16_t>(nameBytes));
+                Put32(vk, 0x0C, value.type);
+                Put16(vk, 0x10, compName ? VALUE_COMP_NAME : 0);
+                EncodeName(vk + 0x14, value.name, compName);
+            }
+
+            uint32_t length = static_cast<uint32_t>(value.data.size());
+            if (length <= 4) {
+                uint8_t* vk = writer.At(offset);
+                Put32(vk, 0x04, length | 0x80000000);
+                Put32(vk, 0x08, 0);
+                if (length) std::memcpy(vk + 0x08, value.data.data(), length);
+                return offset;
+            }
+
+            uint32_t dataCell;
+            if (minorVersion >= 4 && length > BIG_DATA_SEGMENT) {
+                std::vector<uint32_t> segments;
+                for (uint32_t done = 0; done < length; done += BIG_DATA_SEGMENT) {
+                    uint32_t take = std::min(BIG_DATA_SEGMENT, length - done);
+                    uint32_t segment = writer.Alloc(take);
+                    std::memcpy(writer.At(segment), value.data.data() + done, take);
+                    segments.push_back(segment);
+                }
+                uint32_t list = writer.Alloc(static_cast<uint32_t>(segments.size() * 4));
+                for (size_t i = 0; i < segments.size(); ++i) Put32(writer.At(list), i * 4, segments[i]);
+                dataCell = writer.Alloc(8);
+                uint8_t* db = writer.At(dataCell);
+                std::memcpy(db, "db", 2);
+                Put16(db, 2, static_cast<uint16_t>(segments.size()));
+                Put32(db, 4, list);
+            }
+            else {
+                dataCell = writer.Alloc(length);
+                std::memcpy(writer.At(dataCell), value.data.data(), length);
+            }
+            uint8_t* vk = writer.At(offset);
+            Put32(vk, 0x04, length);
+            Put32(vk, 0x08, dataCell);
+            return offset;
+        }
+
+        static bool CanCompress(const std::wstring& name) {
+            for (wchar_t c : name) {
+                if (static_cast<uint32_t>(c) > 0xFF) return false;
+            }
+            return true;
+        }
+
+        static void EncodeName(uint8_t* out, const std::wstring& name, bool compressed) {
+            for (size_t i = 0; i < name.size(); ++i) {
+                if (compressed) {
+                    out[i] = static_cast<uint8_t>(name[i]);
+                }
+                else {
+                    Put16(out, i * 2, static_cast<uint16_t>(name[i]));
+                }
+            }
+        }
+
+        static std::wstring DecodeName(const uint8_t* in, size_t length, bool compressed) {
+            if (!compressed) return DecodeUtf16(in, length);
+            return std::wstring(in, in + length);
+        }
+
+        static std::wstring DecodeUtf16(const uint8_t* in, size_t length) {
+            std::wstring out;
+            out.reserve(length / 2);
+            for (size_t i = 0; i + 1 < length; i += 2) {
+                uint32_t unit = Get16(in, i);
+                if (sizeof(wchar_t) == 4 && unit >= 0xD800 && unit < 0xDC00 && i + 3 < length) {
+                    uint32_t low = Get16(in, i + 2);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        out.push_back(static_cast<wchar_t>(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00)));
+                        i += 2;
+                        continue;
+                    }
+                }
+                out.push_back(static_cast<wchar_t>(unit));
+            }
+            return out;
+        }
+
+        static void AppendUtf16(std::vector<uint8_t>& out, const std::wstring& text) {
+            for (wchar_t c : text) {
+                uint32_t point = static_cast<uint32_t>(c);
+                if (point >= 0x10000) {
+                    point -= 0x10000;
+                    uint16_t high = static_cast<uint16_t>(0xD800 + (point >> 10));
+                    uint16_t low = static_cast<uint16_t>(0xDC00 + (point & 0x3FF));
+                    out.push_back(static_cast<uint8_t>(high));
+                    out.push_back(static_cast<uint8_t>(high >> 8));
+                    out.push_back(static_cast<uint8_t>(low));
+                    out.push_back(static_cast<uint8_t>(low >> 8));
+                }
+                else {
+                    out.push_back(static_cast<uint8_t>(point));
+                    out.push_back(static_cast<uint8_t>(point >> 8));
+                }
+            }
+        }
+
+        static int CompareNames(const std::wstring& a, const std::wstring& b) {
+            size_t n = std::min(a.size(), b.size());
+            for (size_t i = 0; i < n; ++i) {
+                wint_t x = std::towupper(a[i]), y = std::towupper(b[i]);
+                if (x != y) return x < y ? -1 : 1;
+            }
+            return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+        }
+
+        static uint32_t NameHash(const std::wstring& name) {
+            uint32_t hash = 0;
+            for (wchar_t c : name) hash = hash * 37 + static_cast<uint32_t>(std::towupper(c));
+            return hash;
+        }
+
+        // O:BA G:SY D:P(A;CI;KA;;;SY)(A;CI;KA;;;BA), close to what bcdedit puts on a new store
+        static std::vector<uint8_t> DefaultSecurityDescriptor() {
+            auto sid = [](std::vector<uint8_t>& out, uint8_t authority, std::initializer_list<uint32_t> subs) {
+                out.push_back(1);
+                out.push_back(static_cast<uint8_t>(subs.size()));
+                for (int i = 0; i < 5; ++i) out.push_back(0);
+                out.push_back(authority);
+                for (uint32_t sub : subs) {
+                    for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(sub >> (8 * i)));
+                }
+            };
+            std::vector<uint8_t> system, admins;
+            sid(system, 5, { 18 });
+            sid(admins, 5, { 32, 544 });
+
+            std::vector<uint8_t> dacl = { 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00 };
+            for (const auto* trustee : { &system, &admins }) {
+                uint16_t aceSize = static_cast<uint16_t>(8 + trustee->size());
+                dacl.push_back(0x00);             // ACCESS_ALLOWED_ACE_TYPE
+                dacl.push_back(0x02);             // CONTAINER_INHERIT_ACE
+                dacl.push_back(static_cast<uint8_t>(aceSize));
+                dacl.push_back(static_cast<uint8_t>(aceSize >> 8));
+                for (uint32_t mask = 0xF003F, i = 0; i < 4; ++i) dacl.push_back(static_cast<uint8_t>(mask >> (8 * i)));
+                dacl.insert(dacl.end(), trustee->begin(), trustee->end());
+            }
+            Put16(dacl.data(), 2, static_cast<uint16_t>(dacl.size()));
+
+            // Self-relative: the 20-byte header, then owner, group and DACL, sized up front
+            uint32_t ownerOffset = 20;
+            uint32_t groupOffset = ownerOffset + static_cast<uint32_t>(admins.size());
+            uint32_t daclOffset = groupOffset + static_cast<uint32_t>(system.size());
+            std::vector<uint8_t> sd(daclOffset + dacl.size(), 0);
+            sd[0] = 1; // Revision
+            Put16(sd.data(), 2, 0x9004); // SE_SELF_RELATIVE | SE_DACL_PROTECTED | SE_DACL_PRESENT
+            Put32(sd.data(), 4, ownerOffset);
+            Put32(sd.data(), 8, groupOffset);
+            Put32(sd.data(), 12, 0);
+            Put32(sd.data(), 16, daclOffset);
+            std::copy(admins.begin(), admins.end(), sd.begin() + ownerOffset);
+            std::copy(system.begin(), system.end(), sd.begin() + groupOffset);
+            std::copy(dacl.begin(), dacl.end(), sd.begin() + daclOffset);
+            return sd;
+        }
+};
+
+#endif
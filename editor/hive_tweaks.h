@@ -0,0 +1,177 @@
+#ifndef _HIVE_TWEAKS_H_
+#define _HIVE_TWEAKS_H_
+#include <chrono>
+#include "hive.h"
+#include "windows_version.h"
+
+// One registry value a Windows To Go install gets on the stick. Rows apply to the releases
+// in [since, until] and are compiled in, so the whole set goes through in one pass over
+// each hive instead of a reg.exe process per value.
+struct HiveTweak {
+    const wchar_t* hive;                   // File under Windows\System32\config
+    const wchar_t* key;                    // From the hive root; CurrentControlSet is the set Select\Current names
+    const wchar_t* value;
+    HiveValueType type;
+    uint32_t number;                       // REGF_DWORD
+    const wchar_t* text;                   // REGF_SZ, or the only string of a REGF_MULTI_SZ ("" for none)
+    WindowsVersion since;
+    WindowsVersion until;                  // WIN_UNKNOWN for no upper bound
+    bool existingKey;                      // Only set where the key is already there (a service)
+    const wchar_t* purpose;
+};
+
+struct HiveTweakStats {
+    WindowsVersion version = WIN_UNKNOWN;
+    size_t applied = 0;                    // Values written
+    size_t unchanged = 0;                  // Already set as wanted
+    size_t skipped = 0;                    // Other releases, or a service the install does not have
+    size_t hivesWritten = 0;
+    uint64_t bytes = 0;                    // Size of the hives written back
+    double seconds = 0;
+
+    std::wstring ToString() const {
+        return std::to_wstring(applied) + L" value(s) set, " + std::to_wstring(unchanged) + L" already set, "
+            + std::to_wstring(skipped) + L" skipped; " + std::to_wstring(hivesWritten) + L" hive(s) written ("
+            + std::to_wstring(bytes / 1024) + L" KB) in " + std::to_wstring(seconds) + L" s";
+    }
+};
+
+// Applies the tweak table to the offline SYSTEM and SOFTWARE hives of the Windows under a
+// volume root. Each hive is parsed from a read-only mapping into Hive's key tree, every row
+// for it is applied, and it is written back once, repacked with a fresh base block checksum
+// and through a temporary file. A hive where nothing changed is not rewritten. Works on
+// plain files, so a mounted image or an extracted tree on Linux is edited the same way.
+class HiveTweaker {
+
+    public:
+
+        static const std::vector<HiveTweak>& Table() {
+            static const std::vector<HiveTweak> table = {
+                { L"SYSTEM", L"CurrentControlSet\\Control\\Session Manager\\Memory Management", L"PagingFiles", REGF_MULTI_SZ, 0, L"",
+                  WIN_XP, WIN_UNKNOWN, false, L"No pagefile on the stick" },
+                { L"SYSTEM", L"CurrentControlSet\\Control\\Power", L"HibernateEnabled", REGF_DWORD, 0, nullptr,
+                  WIN_VISTA, WIN_UNKNOWN, false, L"No hiberfil.sys" },
+                { L"SYSTEM", L"CurrentControlSet\\Control\\Power", L"HibernateEnabledDefault", REGF_DWORD, 0, nullptr,
+                  WIN_10, WIN_UNKNOWN, false, L"Hibernation stays off when the power policy is reset" },
+                { L"SYSTEM", L"CurrentControlSet\\Services\\SysMain", L"Start", REGF_DWORD, 4, nullptr,
+                  WIN_VISTA, WIN_UNKNOWN, true, L"SysMain (Superfetch) disabled" },
+                { L"SYSTEM", L"CurrentControlSet\\Control\\Session Manager\\Memory Management\\PrefetchParameters", L"EnablePrefetcher", REGF_DWORD, 0, nullptr,
+                  WIN_XP, WIN_UNKNOWN, false, L"No prefetch traces" },
+                { L"SYSTEM", L"CurrentControlSet\\Control\\Session Manager\\Memory Management\\PrefetchParameters", L"EnableSuperfetch", REGF_DWORD, 0, nullptr,
+                  WIN_VISTA, WIN_UNKNOWN, false, L"No Superfetch preloading" },
+                { L"SYSTEM", L"CurrentControlSet\\Control\\FileSystem", L"NtfsDisableLastAccessUpdate", REGF_DWORD, 1, nullptr,
+                  WIN_XP, WIN_UNKNOWN, false, L"No last access time writes" },
+                { L"SYSTEM", L"CurrentControlSet\\Services\\partmgr\\Parameters", L"SanPolicy", REGF_DWORD, 4, nullptr,
+                  WIN_7, WIN_UNKNOWN, false, L"The host's internal disks stay offline" },
+                { L"SYSTEM", L"CurrentControlSet\\Control", L"PortableOperatingSystem", REGF_DWORD, 1, nullptr,
+                  WIN_8, WIN_UNKNOWN, false, L"Runs as Windows To Go" },
+                { L"SOFTWARE", L"Microsoft\\Windows NT\\CurrentVersion\\Schedule\\Maintenance", L"MaintenanceDisabled", REGF_DWORD, 1, nullptr,
+                  WIN_8, WIN_UNKNOWN, false, L"No automatic maintenance, which runs the scheduled defrag" },
+                { L"SOFTWARE", L"Microsoft\\Dfrg\\BootOptimizeFunction", L"Enable", REGF_SZ, 0, L"N",
+                  WIN_XP, WIN_UNKNOWN, false, L"No boot file defrag" },
+                { L"SOFTWARE", L"Microsoft\\Windows\\CurrentVersion\\OptimalLayout", L"EnableAutoLayout", REGF_DWORD, 0, nullptr,
+                  WIN_XP, WIN_UNKNOWN, false, L"No idle layout optimisation" },
+            };
+            return table;
+        }
+
+        static bool Applies(const HiveTweak& tweak, WindowsVersion version) {
+            return version >= tweak.since && (tweak.until == WIN_UNKNOWN || version <= tweak.until);
+        }
+
+        static std::vector<uint8_t> Encode(const HiveTweak& tweak) {
+            switch (tweak.type) {
+                case REGF_DWORD: return Hive::EncodeDword(tweak.number);
+                case REGF_MULTI_SZ: return Hive::EncodeMultiString(*tweak.text ? std::vector<std::wstring>{ tweak.text } : std::vector<std::wstring>());
+                default: return Hive::EncodeString(tweak.text);
+            }
+        }
+
+        // `version` picks the rows; WIN_UNKNOWN reads it from the SOFTWARE hive under `root`
+        bool Apply(const std::filesystem::path& root, WindowsVersion version = WIN_UNKNOWN) {
+            stats = HiveTweakStats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+            if (version == WIN_UNKNOWN) {
+                WindowsBuild build;
+                auto software = FindPathNoCase(root, L"Windows\\System32\\config\\SOFTWARE");
+                if (software && WindowsVersionDetector::ReadRegistryVersion(*software, build)) {
+                    version = WindowsVersionDetector::Classify(build.major, build.minor, build.build);
+                }
+                if (version == WIN_UNKNOWN) return Fail(L"Cannot tell which Windows is under " + root.wstring());
+            }
+            stats.version = version;
+            for (const wchar_t* name : { L"SYSTEM", L"SOFTWARE" }) {
+                if (!ApplyHive(root, name, version)) return false;
+            }
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        const HiveTweakStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        HiveTweakStats stats;
+        std::wstring error;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        bool ApplyHive(const std::filesystem::path& root, const std::wstring& name, WindowsVersion version) {
+            auto path = FindPathNoCase(root, L"Windows\\System32\\config\\" + name);
+            if (!path) return Fail(L"No " + name + L" hive under " + root.wstring());
+            Hive hive;
+            {
+                MappedFile file;
+                if (!file.Open(*path)) return Fail(file.Error());
+                if (!hive.Parse(file.Data(), file.Size())) return Fail(name + L": " + hive.Error());
+            }
+            std::wstring controlSet = ControlSet(hive);
+            size_t applied = stats.applied;
+            for (const auto& tweak : Table()) {
+                if (name != tweak.hive) continue;
+                if (!Applies(tweak, version)) {
+                    stats.skipped++;
+                    continue;
+                }
+                std::wstring keyPath = tweak.key;
+                const std::wstring current = L"CurrentControlSet";
+                if (keyPath.compare(0, current.size(), current) == 0) keyPath = controlSet + keyPath.substr(current.size());
+                Hive::Key* key = tweak.existingKey ? hive.Open(keyPath) : hive.CreatePath(keyPath);
+                if (!key) {
+                    stats.skipped++;
+                    continue;
+                }
+                std::vector<uint8_t> data = Encode(tweak);
+                const Hive::Value* existing = key->FindValue(tweak.value);
+                if (existing && existing->type == static_cast<uint32_t>(tweak.type) && existing->data == data) {
+                    stats.unchanged++;
+                    continue;
+                }
+                key->SetValue(tweak.value, tweak.type, data);
+                stats.applied++;
+            }
+            if (stats.applied == applied) return true;
+            if (!hive.Save(*path)) return Fail(name + L": " + hive.Error());
+            std::error_code ec;
+            stats.bytes += std::filesystem::file_size(*path, ec);
+            stats.hivesWritten++;
+            return true;
+        }
+
+        // The control set the next boot uses; an offline SYSTEM hive has no CurrentControlSet link
+        static std::wstring ControlSet(const Hive& hive) {
+            uint32_t current = 1;
+            const Hive::Key* select = hive.Open(L"Select");
+            const Hive::Value* value = select ? select->FindValue(L"Current") : nullptr;
+            if (value && value->type == REGF_DWORD && value->data.size() >= 4) current = Hive::Get32(value->data.data(), 0);
+            std::wstring number = std::to_wstring(current);
+            return L"ControlSet" + std::wstring(number.size() < 3 ? 3 - number.size() : 0, L'0') + number;
+        }
+};
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef _HIVE_VIEW_H_
+#define _HIVE_VIEW_H_
+#include <optional>
+#include "hive.h"
+
+// Read-only navigation over a hive image that stays where it is (usually a file mapping).
+// Unlike Hive it never builds the key tree, so a lookup in a 100 MB SOFTWARE hive only
+// touches the handful of cells on the path. Keys and values are addressed by cell offset.
+class HiveView {
+
+    public:
+
+        static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+        HiveView() = default;
+        ~HiveView() = default;
+
+        // `verifyChecksum` is off for hives copied from a live system, those are often dirty
+        bool Attach(const uint8_t* image, size_t size, bool verifyChecksum = true) {
+            bins = nullptr;
+            binsSize = 0;
+            root = NONE;
+            if (!image || size < Hive::BASE_BLOCK_SIZE + Hive::HBIN_HEADER_SIZE || std::memcmp(image, "regf", 4) != 0) {
+                error = L"Not a registry hive";
+                return false;
+            }
+            if (verifyChecksum && Hive::Checksum(image) != Hive::Get32(image, 0x1FC)) {
+                error = L"Hive base block checksum mismatch";
+                return false;
+            }
+            bins = image + Hive::BASE_BLOCK_SIZE;
+            binsSize = std::min<size_t>(Hive::Get32(image, 0x28), size - Hive::BASE_BLOCK_SIZE);
+            root = Hive::Get32(image, 0x24);
+            if (!Cell(root, 0x4C)) {
+                error = L"Hive root key is invalid";
+                return false;
+            }
+            return true;
+        }
+
+        uint32_t Root() const { return root; }
+        const std::wstring& Error() const { return error; }
+
+        // Body of an allocated cell with at least `need` bytes, or nullptr
+        const uint8_t* Cell(uint32_t offset, size_t need, uint32_t* bodySize = nullptr) const {
+            if (offset == NONE || static_cast<size_t>(offset) + 4 > binsSize) return nullptr;
+            int32_t size = static_cast<int32_t>(Hive::Get32(bins, offset));
+            if (size >= 0) return nullptr;
+            size_t length = static_cast<size_t>(-static_cast<int64_t>(size));
+            if (length < 4 + need || offset + length > binsSize) return nullptr;
+            if (bodySize) *bodySize = static_cast<uint32_t>(length - 4);
+            return bins + offset + 4;
+        }
+
+        std::wstring KeyName(uint32_t key) const {
+            uint32_t size = 0;
+            const uint8_t* nk = Cell(key, 0x4C, &size);
+            if (!nk) return std::wstring();
+            return DecodeName(nk + 0x4C, std::min<size_t>(Hive::Get16(nk, 0x48), size - 0x4C), Hive::Get16(nk, 0x02) & 0x20);
+        }
+
+        bool Subkeys(uint32_t key, std::vector<uint32_t>& children) const {
+            const uint8_t* nk = Cell(key, 0x4C);
+            if (!nk || std::memcmp(nk, "nk", 2) != 0) return false;
+            if (Hive::Get32(nk, 0x14) == 0) return true;
+            return CollectList(Hive::Get32(nk, 0x1C), children, 0);
+        }
+
+        uint32_t Subkey(uint32_t key, const std::wstring& name) const {
+            std::vector<uint32_t> children;
+            if (key == NONE || !Subkeys(key, children)) return NONE;
+            for (uint32_t child : children) {
+                uint32_t size = 0;
+                const uint8_t* nk = Cell(child, 0x4C, &size);
+                if (nk && NameMatches(nk + 0x4C, std::min<size_t>(Hive::Get16(nk, 0x48), size - 0x4C),
+                                      Hive::Get16(nk, 0x02) & 0x20, name)) {
+                    return child;
+                }
+            }
+            return NONE;
+        }
+
+        // Backslash separated path below `key` (the root when omitted)
+        uint32_t Open(const std::wstring& path, uint32_t key = NONE) const {
+            if (key == NONE) key = root;
+            size_t start = 0;
+            while (key != NONE && start < path.size()) {
+                size_t end = path.find(L'\\', start);
+                if (end == std::wstring::npos) end = path.size();
+                if (end > start) key = Subkey(key, path.substr(start, end - start));
+                start = end + 1;
+            }
+            return key;
+        }
+
+        // Cell offset of the named value's vk cell
+        uint32_t Value(uint32_t key, const std::wstring& name) const {
+            const uint8_t* nk = Cell(key, 0x4C);
+            if (!nk) return NONE;
+            uint32_t count = Hive::Get32(nk, 0x24);
+            uint32_t size = 0;
+            const uint8_t* list = count ? Cell(Hive::Get32(nk, 0x28), 0, &size) : nullptr;
+            if (!list || static_cast<uint64_t>(count) * 4 > size) return NONE;
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t cell = Hive::Get32(list, i * 4);
+                uint32_t vkSize = 0;
+                const uint8_t* vk = Cell(cell, 0x14, &vkSize);
+                if (!vk || std::memcmp(vk, "vk", 2) != 0) continue;
+                uint16_t length = Hive::Get16(vk, 0x02);
+                if (0x14U + length > vkSize) continue;
+                if (NameMatches(vk + 0x14, length, Hive::Get16(vk, 0x10) & 1, name)) return cell;
+            }
+            return NONE;
+        }
+
+        // Value bytes in place. Resident (<= 4 byte) data points into the vk cell itself;
+        // big-data (db) values are not supported and come back as nullptr.
+        const uint8_t* ValueData(uint32_t cell, uint32_t& length, uint32_t& type) const {
+            length = 0;
+            const uint8_t* vk = Cell(cell, 0x14);
+            if (!vk || std::memcmp(vk, "vk", 2) != 0) return nullptr;
+            type = Hive::Get32(vk, 0x0C);
+            uint32_t raw = Hive::Get32(vk, 0x04);
+            if (raw & 0x80000000) {
+                length = std::min<uint32_t>(raw & 0x7FFFFFFF, 4);
+                return vk + 0x08;
+            }
+            length = raw;
+            uint32_t size = 0;
+            const uint8_t* data = Cell(Hive::Get32(vk, 0x08), 0, &size);
+            if (!data || length > size) return nullptr;
+            return data;
+        }
+
+        std::optional<uint32_t> Dword(uint32_t key, const std::wstring& name) const {
+            uint32_t length = 0, type = 0;
+            const uint8_t* data = ValueData(Value(key, name), length, type);
+            if (!data || type != REGF_DWORD || length < 4) return std::nullopt;
+            return Hive::Get32(data, 0);
+        }
+
+        std::optional<std::wstring> String(uint32_t key, const std::wstring& name) const {
+            uint32_t length = 0, type = 0;
+            const uint8_t* data = ValueData(Value(key, name), length, type);
+            if (!data || (type != REGF_SZ && type != REGF_EXPAND_SZ && type != REGF_MULTI_SZ)) return std::nullopt;
+            return Hive::DecodeString(std::vector<uint8_t>(data, data + length));
+        }
+
+    private:
+
+        const uint8_t* bins = nullptr;
+        size_t binsSize = 0;
+        uint32_t root = NONE;
+        std::wstring error;
+
+        bool CollectList(uint32_t offset, std::vector<uint32_t>& children, int depth) const {
+            uint32_t size = 0;
+            const uint8_t* list = Cell(offset, 4, &size);
+            if (!list || depth > 2) return false;
+            uint16_t count = Hive::Get16(list, 2);
+            bool hashed = std::memcmp(list, "lf", 2) == 0 || std::memcmp(list, "lh", 2) == 0;
+            bool indexed = std::memcmp(list, "li", 2) == 0 || std::memcmp(list, "ri", 2) == 0;
+            size_t stride = hashed ? 8 : 4;
+            if ((!hashed && !indexed) || 4 + count * stride > size) return false;
+            for (uint16_t i = 0; i < count; ++i) {
+                uint32_t child = Hive::Get32(list, 4 + i * stride);
+                if (list[0] == 'r') {
+                    if (!CollectList(child, children, depth + 1)) return false;
+                }
+                else {
+                    children.push_back(child);
+                }
+            }
+            return true;
+        }
+
+        static std::wstring DecodeName(const uint8_t* in, size_t length, bool compressed) {
+            if (compressed) return std::wstring(in, in + length);
+            return Hive::DecodeString(std::vector<uint8_t>(in, in + length));
+        }
+
+        // Compares a stored name against `name` without allocating
+        static bool NameMatches(const uint8_t* in, size_t length, bool compressed, const std::wstring& name) {
+            size_t units = compressed ? length : length / 2;
+            if (units != name.size()) return false;
+            for (size_t i = 0; i < units; ++i) {
+                wchar_t c = compressed ? static_cast<wchar_t>(in[i]) : static_cast<wchar_t>(Hive::Get16(in, i * 2));
+                if (std::towupper(c) != std::towupper(name[i])) return false;
+            }
+            return true;
+        }
+};
+
+#endif
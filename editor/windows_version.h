@@ -0,0 +1,287 @@
+#ifndef _WINDOWS_VERSION_H_
+#define _WINDOWS_VERSION_H_
+#include <map>
+#include <mutex>
+#include "hive_view.h"
+#include "../platform/mapped_file.h"
+#include "../platform/paths.h"
+
+// Check Windows version by examining system files on the target drive
+enum WindowsVersion {
+    WIN_UNKNOWN,
+    WIN_XP,
+    WIN_VISTA,
+    WIN_7,
+    WIN_8,
+    WIN_8_1,
+    WIN_10,
+    WIN_11
+};
+
+struct WindowsBuild {
+    uint16_t major = 0;
+    uint16_t minor = 0;
+    uint32_t build = 0;
+    uint32_t ubr = 0;                 // Update build revision, the 2006 in 19045.2006
+    WindowsVersion version = WIN_UNKNOWN;
+    std::wstring productName;
+    bool fromKernel = false;
+    bool fromRegistry = false;
+
+    bool Known() const { return major != 0; }
+
+    std::wstring ToString() const {
+        return std::to_wstring(major) + L"." + std::to_wstring(minor) + L"." + std::to_wstring(build) + L"." + std::to_wstring(ubr);
+    }
+};
+
+// Identifies the Windows installation under a volume root without running anything from
+// it: the kernel's VS_FIXEDFILEINFO is read straight out of the mapped PE resource section
+// and build/UBR come from the offline SOFTWARE hive. Works the same on a Windows drive
+// letter and on a Linux mount or extracted image. Results are cached per root and dropped
+// when the kernel or the hive changes.
+class WindowsVersionDetector {
+
+    public:
+
+        static constexpr uint32_t VS_FIXEDFILEINFO_SIGNATURE = 0xFEEF04BD;
+
+        static bool Detect(const std::wstring& drive, WindowsBuild& result) {
+            std::filesystem::path root = VolumeRoot(drive);
+            std::error_code ec;
+            std::filesystem::path absolute = std::filesystem::absolute(root, ec);
+            std::wstring key = (ec ? root : absolute).lexically_normal().wstring();
+            for (auto& c : key) c = static_cast<wchar_t>(std::towlower(c));
+
+            Cache& cache = GetCache();
+            {
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                auto found = cache.entries.find(key);
+                if (found != cache.entries.end() && found->second.stamp == Stamp(found->second.kernel, found->second.software)) {
+                    result = found->second.result;
+                    return result.Known();
+                }
+            }
+
+            CacheEntry entry;
+            entry.kernel = FindPathNoCase(root, L"Windows\\System32\\ntoskrnl.exe").value_or(std::filesystem::path());
+            entry.software = FindPathNoCase(root, L"Windows\\System32\\config\\SOFTWARE").value_or(std::filesystem::path());
+            entry.stamp = Stamp(entry.kernel, entry.software);
+            Read(entry.kernel, entry.software, entry.result);
+            result = entry.result;
+
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.entries[key] = std::move(entry);
+            return result.Known();
+        }
+
+        static WindowsVersion DetectVersion(const std::wstring& drive) {
+            WindowsBuild result;
+            Detect(drive, result);
+            return result.version;
+        }
+
+        // Same as Detect() but always goes to disk, for benchmarks and one-off probes
+        static bool DetectUncached(const std::wstring& drive, WindowsBuild& result) {
+            std::filesystem::path root = VolumeRoot(drive);
+            result = WindowsBuild();
+            Read(FindPathNoCase(root, L"Windows\\System32\\ntoskrnl.exe").value_or(std::filesystem::path()),
+                 FindPathNoCase(root, L"Windows\\System32\\config\\SOFTWARE").value_or(std::filesystem::path()), result);
+            return result.Known();
+        }
+
+        static void ClearCache() {
+            Cache& cache = GetCache();
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.entries.clear();
+        }
+
+        static bool ReadKernelVersion(const std::filesystem::path& kernel, WindowsBuild& result) {
+            MappedFile file;
+            if (kernel.empty() || !file.Open(kernel)) return false;
+            return ReadPeVersion(file.Data(), file.Size(), result);
+        }
+
+        // Walks DOS/PE headers -> resource directory -> RT_VERSION -> first name -> first
+        // language -> VS_VERSIONINFO and takes FileVersion from its VS_FIXEDFILEINFO
+        static bool ReadPeVersion(const uint8_t* image, size_t size, WindowsBuild& result) {
+            if (!image || size < 0x40 || image[0] != 'M' || image[1] != 'Z') return false;
+            uint32_t pe = Hive::Get32(image, 0x3C);
+            if (static_cast<uint64_t>(pe) + 24 > size || std::memcmp(image + pe, "PE\0\0", 4) != 0) return false;
+            uint16_t sectionCount = Hive::Get16(image, pe + 6);
+            uint16_t optionalSize = Hive::Get16(image, pe + 20);
+            size_t optional = pe + 24;
+            if (optional + optionalSize > size || optionalSize < 2) return false;
+
+            size_t directories, directoryCount;
+            switch (Hive::Get16(image, optional)) {
+                case 0x10B: directories = optional + 96; directoryCount = optional + 92; break;    // PE32
+                case 0x20B: directories = optional + 112; directoryCount = optional + 108; break;  // PE32+
+                default: return false;
+            }
+            const uint32_t resourceIndex = 2;
+            if (directories + (resourceIndex + 1) * 8 > optional + optionalSize
+                || Hive::Get32(image, directoryCount) <= resourceIndex) {
+                return false;
+            }
+            uint32_t resourceRva = Hive::Get32(image, directories + resourceIndex * 8);
+            if (resourceRva == 0) return false;
+
+            size_t sections = optional + optionalSize;
+            if (sections + static_cast<size_t>(sectionCount) * 40 > size) return false;
+            auto toOffset = [&](uint32_t rva, size_t& offset) {
+                for (uint16_t i = 0; i < sectionCount; ++i) {
+                    const uint8_t* section = image + sections + i * 40;
+                    uint32_t virtualAddress = Hive::Get32(section, 12);
+                    uint32_t extent = std::max(Hive::Get32(section, 8), Hive::Get32(section, 16));
+                    if (rva >= virtualAddress && rva - virtualAddress < extent) {
+                        offset = static_cast<size_t>(Hive::Get32(section, 20)) + (rva - virtualAddress);
+                        return offset < size;
+                    }
+                }
+                return false;
+            };
+
+            size_t root;
+            if (!toOffset(resourceRva, root)) return false;
+            // Directory entries are relative to the start of the resource section
+            auto entry = [&](size_t directory, bool byId, uint32_t id, uint32_t& target) {
+                if (directory + 16 > size) return false;
+                uint16_t named = Hive::Get16(image, directory + 12);
+                uint16_t ids = Hive::Get16(image, directory + 14);
+                size_t first = directory + 16;
+                if (first + (static_cast<size_t>(named) + ids) * 8 > size) return false;
+                for (uint32_t i = 0; i < static_cast<uint32_t>(named) + ids; ++i) {
+                    uint32_t name = Hive::Get32(image, first + i * 8);
+                    if (!byId || name == id) {
+                        target = Hive::Get32(image, first + i * 8 + 4);
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            const uint32_t RT_VERSION_ID = 16;
+            const uint32_t SUBDIRECTORY = 0x80000000;
+            uint32_t target;
+            if (!entry(root, true, RT_VERSION_ID, target) || !(target & SUBDIRECTORY)) return false;
+            if (!entry(root + (target & ~SUBDIRECTORY), false, 0, target) || !(target & SUBDIRECTORY)) return false;
+            if (!entry(root + (target & ~SUBDIRECTORY), false, 0, target) || (target & SUBDIRECTORY)) return false;
+
+            size_t dataEntry = root + target;
+            if (dataEntry + 16 > size) return false;
+            size_t info;
+            uint32_t infoSize = Hive::Get32(image, dataEntry + 4);
+            if (!toOffset(Hive::Get32(image, dataEntry), info)) return false;
+            infoSize = static_cast<uint32_t>(std::min<size_t>(infoSize, size - info));
+
+            // VS_VERSIONINFO header + L"VS_VERSION_INFO" puts the fixed info at 0x28, scan
+            // a little further in case of odd padding
+            for (size_t at = 0; at + 52 <= infoSize && at <= 0x80; at += 4) {
+                const uint8_t* fixed = image + info + at;
+                if (Hive::Get32(fixed, 0) != VS_FIXEDFILEINFO_SIGNATURE) continue;
+                uint32_t versionMS = Hive::Get32(fixed, 8);
+                uint32_t versionLS = Hive::Get32(fixed, 12);
+                result.major = static_cast<uint16_t>(versionMS >> 16);
+                result.minor = static_cast<uint16_t>(versionMS & 0xFFFF);
+                result.build = versionLS >> 16;
+                result.ubr = versionLS & 0xFFFF;
+                result.fromKernel = true;
+                return true;
+            }
+            return false;
+        }
+
+        // HKLM\SOFTWARE\Microsoft\Windows NT\CurrentVersion from the offline hive. Beats the
+        // kernel's file version on Windows 10+, where enablement packages bump the build
+        // (19041 -> 19045) without replacing ntoskrnl.exe.
+        static bool ReadRegistryVersion(const std::filesystem::path& software, WindowsBuild& result) {
+            MappedFile file;
+            HiveView view;
+            if (software.empty() || !file.Open(software) || !view.Attach(file.Data(), file.Size(), false)) return false;
+            uint32_t key = view.Open(L"Microsoft\\Windows NT\\CurrentVersion");
+            if (key == HiveView::NONE) return false;
+
+            auto build = view.String(key, L"CurrentBuildNumber");
+            if (!build) build = view.String(key, L"CurrentBuild");
+            auto major = view.Dword(key, L"CurrentMajorVersionNumber");
+            auto minor = view.Dword(key, L"CurrentMinorVersionNumber");
+            if (!major) {
+                // Before Windows 10 there is only CurrentVersion = "6.1"
+                auto current = view.String(key, L"CurrentVersion");
+                size_t dot = current ? current->find(L'.') : std::wstring::npos;
+                if (dot == std::wstring::npos) return false;
+                major = static_cast<uint32_t>(std::wcstoul(current->c_str(), nullptr, 10));
+                minor = static_cast<uint32_t>(std::wcstoul(current->c_str() + dot + 1, nullptr, 10));
+            }
+            if (!build || *major == 0) return false;
+
+            result.major = static_cast<uint16_t>(*major);
+            result.minor = static_cast<uint16_t>(minor.value_or(0));
+            result.build = static_cast<uint32_t>(std::wcstoul(build->c_str(), nullptr, 10));
+            if (auto ubr = view.Dword(key, L"UBR")) result.ubr = *ubr;
+            if (auto product = view.String(key, L"ProductName")) result.productName = *product;
+            result.fromRegistry = true;
+            return true;
+        }
+
+        // Windows 11 kept 10.0 and is only told apart by the build number
+        static WindowsVersion Classify(uint32_t major, uint32_t minor, uint32_t build) {
+            if (major == 10) return build >= 22000 ? WIN_11 : WIN_10;
+            if (major == 6) {
+                switch (minor) {
+                    case 0: return WIN_VISTA;
+                    case 1: return WIN_7;
+                    case 2: return WIN_8;
+                    case 3: return WIN_8_1;
+                    default: return WIN_UNKNOWN;
+                }
+            }
+            if (major == 5 && minor >= 1) return WIN_XP;
+            return WIN_UNKNOWN;
+        }
+
+    private:
+
+        struct CacheEntry {
+            std::filesystem::path kernel;
+            std::filesystem::path software;
+            std::pair<std::filesystem::file_time_type, std::filesystem::file_time_type> stamp;
+            WindowsBuild result;
+        };
+
+        struct Cache {
+            std::mutex mutex;
+            std::map<std::wstring, CacheEntry> entries;
+        };
+
+        static Cache& GetCache() {
+            static Cache cache;
+            return cache;
+        }
+
+        static std::pair<std::filesystem::file_time_type, std::filesystem::file_time_type> Stamp(
+            const std::filesystem::path& kernel, const std::filesystem::path& software) {
+            std::error_code ec;
+            auto kernelTime = kernel.empty() ? std::filesystem::file_time_type() : std::filesystem::last_write_time(kernel, ec);
+            auto softwareTime = software.empty() ? std::filesystem::file_time_type() : std::filesystem::last_write_time(software, ec);
+            return std::make_pair(kernelTime, softwareTime);
+        }
+
+        static void Read(const std::filesystem::path& kernel, const std::filesystem::path& software, WindowsBuild& result) {
+            WindowsBuild registry;
+            if (ReadRegistryVersion(software, registry)) {
+                result = registry;
+                WindowsBuild image;
+                result.fromKernel = ReadKernelVersion(kernel, image);
+                // No UBR value before Windows 10, the kernel's revision is the closest thing
+                if (result.fromKernel && result.ubr == 0 && image.build == result.build) result.ubr = image.ubr;
+            }
+            else {
+                ReadKernelVersion(kernel, result);
+            }
+            result.version = Classify(result.major, result.minor, result.build);
+        }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+#include "crc32c.h"
+#include "xxhash.h"
+
+// Chunk hashes kept in a manifest. The kind is stored with the manifest, so a verify pass
+// reads whatever the writer chose:
+//   HASH_XXH64   64 bits, for change detection where a missed collision means a stale chunk
+//   HASH_CRC32C  32 bits with the CPU's crc instruction, for catching corruption on the way
+//                to the stick; every burst error up to 32 bits is caught
+enum HashKind {
+    HASH_XXH64 = 0,
+    HASH_CRC32C = 1
+};
+
+inline uint64_t ContentHash(HashKind kind, const void* data, size_t length) {
+    return kind == HASH_CRC32C ? Crc32c::Of(data, length) : XxHash64::Hash(data, length);
+}
+
+inline const wchar_t* HashKindName(HashKind kind) {
+    return kind == HASH_CRC32C ? L"crc32c" : L"xxh64";
+}
+
+#endif
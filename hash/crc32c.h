@@ -0,0 +1,208 @@
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_TARGET
+#else
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+// CRC-32C (Castagnoli), the checksum iSCSI, ext4 and Btrfs use. Detects every burst error up
+// to 32 bits, which is what a flaky stick or cable produces, and has an instruction on
+// x86 (SSE4.2) and ARMv8. Kernels, picked once at runtime:
+//   sse4.2 / armv8  three interleaved streams, recombined with a zero-shift table, so the
+//                   3 cycle latency of the instruction is hidden (~3x one stream)
+//   table           slice-by-8 everywhere else
+// Update() takes and returns the finalized value, so Update(Update(0, a), b) == Of(a + b).
+class Crc32c {
+
+    public:
+
+        enum Kernel {
+            KERNEL_TABLE,
+            KERNEL_HARDWARE
+        };
+
+        static uint32_t Of(const void* data, size_t length) { return Update(0, data, length); }
+
+        static uint32_t Update(uint32_t crc, const void* data, size_t length) {
+            return Update(crc, data, length, HardwareAvailable() ? KERNEL_HARDWARE : KERNEL_TABLE);
+        }
+
+        // Explicit kernel, for the benchmark; KERNEL_HARDWARE falls back to the table where missing
+        static uint32_t Update(uint32_t crc, const void* data, size_t length, Kernel kernel) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            uint32_t state = ~crc;
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+            if (kernel == KERNEL_HARDWARE && HardwareAvailable()) return ~Hardware(state, p, length);
+#endif
+            (void)kernel;
+            return ~Table(state, p, length);
+        }
+
+        static bool HardwareAvailable() {
+#if defined(CRC32C_X86)
+            static const bool available = [] {
+#ifdef _MSC_VER
+                int info[4];
+                __cpuid(info, 1);
+                return (info[2] & (1 << 20)) != 0;
+#else
+                unsigned eax, ebx, ecx, edx;
+                return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+            }();
+            return available;
+#elif defined(CRC32C_ARM)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        static const wchar_t* KernelName(Kernel kernel) {
+            if (kernel == KERNEL_TABLE || !HardwareAvailable()) return L"table";
+#if defined(CRC32C_ARM)
+            return L"armv8";
+#else
+            return L"sse4.2";
+#endif
+        }
+
+    private:
+
+        static constexpr uint32_t POLYNOMIAL = 0x82F63B78;    // Reflected
+        static constexpr size_t STREAM = 8192;                 // Bytes per interleaved stream
+
+        using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+        static const Tables& SliceTables() {
+            static const Tables tables = [] {
+                Tables t = {};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t crc = i;
+                    for (int bit = 0; bit < 8; ++bit) crc = crc & 1 ? crc >> 1 ^ POLYNOMIAL : crc >> 1;
+                    t[0][i] = crc;
+                }
+                for (uint32_t i = 0; i < 256; ++i) {
+                    for (size_t k = 1; k < 8; ++k) t[k][i] = t[k - 1][i] >> 8 ^ t[0][t[k - 1][i] & 0xFF];
+                }
+                return t;
+            }();
+            return tables;
+        }
+
+        // Works on the raw register (no pre/post inversion)
+        static uint32_t Table(uint32_t crc, const uint8_t* p, size_t length) {
+            const Tables& t = SliceTables();
+            for (; length >= 8; p += 8, length -= 8) {
+                uint32_t low, high;
+                std::memcpy(&low, p, 4);
+                std::memcpy(&high, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                low = __builtin_bswap32(low);
+                high = __builtin_bswap32(high);
+#endif
+                low ^= crc;
+                crc = t[7][low & 0xFF] ^ t[6][low >> 8 & 0xFF] ^ t[5][low >> 16 & 0xFF] ^ t[4][low >> 24]
+                    ^ t[3][high & 0xFF] ^ t[2][high >> 8 & 0xFF] ^ t[1][high >> 16 & 0xFF] ^ t[0][high >> 24];
+            }
+            for (; length > 0; ++p, --length) crc = crc >> 8 ^ t[0][(crc ^ *p) & 0xFF];
+            return crc;
+        }
+
+        // The register after STREAM zero bytes, as four byte-indexed tables: the CRC is linear,
+        // so crc(a + b) = Shift(crc(a)) ^ crc(b) for |b| == STREAM, b's run starting from 0
+        static const std::array<std::array<uint32_t, 256>, 4>& ShiftTables() {
+            static const std::array<std::array<uint32_t, 256>, 4> tables = [] {
+                std::array<uint32_t, 32> basis = {};
+                static const uint8_t zeros[STREAM] = {};
+                for (int bit = 0; bit < 32; ++bit) basis[bit] = Table(1u << bit, zeros, STREAM);
+                std::array<std::array<uint32_t, 256>, 4> t = {};
+                for (int k = 0; k < 4; ++k) {
+                    for (uint32_t b = 0; b < 256; ++b) {
+                        uint32_t value = 0;
+                        for (int bit = 0; bit < 8; ++bit) {
+                            if (b >> bit & 1) value ^= basis[k * 8 + bit];
+                        }
+                        t[k][b] = value;
+                    }
+                }
+                return t;
+            }();
+            return tables;
+        }
+
+        static uint32_t Shift(uint32_t crc) {
+            const auto& t = ShiftTables();
+            return t[0][crc & 0xFF] ^ t[1][crc >> 8 & 0xFF] ^ t[2][crc >> 16 & 0xFF] ^ t[3][crc >> 24];
+        }
+
+#if defined(CRC32C_X86)
+        static CRC32C_TARGET uint32_t Hardware(uint32_t crc, const uint8_t* p, size_t length) {
+            if (length >= 3 * STREAM) ShiftTables();
+            for (; length >= 3 * STREAM; p += 3 * STREAM, length -= 3 * STREAM) {
+                uint64_t a = crc, b = 0, c = 0;
+                for (size_t i = 0; i < STREAM; i += 8) {
+                    uint64_t x, y, z;
+                    std::memcpy(&x, p + i, 8);
+                    std::memcpy(&y, p + STREAM + i, 8);
+                    std::memcpy(&z, p + 2 * STREAM + i, 8);
+                    a = _mm_crc32_u64(a, x);
+                    b = _mm_crc32_u64(b, y);
+                    c = _mm_crc32_u64(c, z);
+                }
+                crc = Shift(Shift(static_cast<uint32_t>(a)) ^ static_cast<uint32_t>(b)) ^ static_cast<uint32_t>(c);
+            }
+            uint64_t state = crc;
+            for (; length >= 8; p += 8, length -= 8) {
+                uint64_t x;
+                std::memcpy(&x, p, 8);
+                state = _mm_crc32_u64(state, x);
+            }
+            crc = static_cast<uint32_t>(state);
+            for (; length > 0; ++p, --length) crc = _mm_crc32_u8(crc, *p);
+            return crc;
+        }
+#elif defined(CRC32C_ARM)
+        static uint32_t Hardware(uint32_t crc, const uint8_t* p, size_t length) {
+            if (length >= 3 * STREAM) ShiftTables();
+            for (; length >= 3 * STREAM; p += 3 * STREAM, length -= 3 * STREAM) {
+                uint32_t a = crc, b = 0, c = 0;
+                for (size_t i = 0; i < STREAM; i += 8) {
+                    uint64_t x, y, z;
+                    std::memcpy(&x, p + i, 8);
+                    std::memcpy(&y, p + STREAM + i, 8);
+                    std::memcpy(&z, p + 2 * STREAM + i, 8);
+                    a = __crc32cd(a, x);
+                    b = __crc32cd(b, y);
+                    c = __crc32cd(c, z);
+                }
+                crc = Shift(Shift(a) ^ b) ^ c;
+            }
+            for (; length >= 8; p += 8, length -= 8) {
+                uint64_t x;
+                std::memcpy(&x, p, 8);
+                crc = __crc32cd(crc, x);
+            }
+            for (; length > 0; ++p, --length) crc = __crc32cb(crc, *p);
+            return crc;
+        }
+#endif
+};
+
+#endif
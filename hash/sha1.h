@@ -0,0 +1,126 @@
+#ifndef _SHA1_H_
+#define _SHA1_H_
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using Sha1Digest = std::array<uint8_t, 20>;
+
+struct Sha1DigestHash {
+    size_t operator()(const Sha1Digest& digest) const {
+        // Already uniformly distributed, the first bytes are as good as any
+        size_t value;
+        std::memcpy(&value, digest.data(), sizeof(value));
+        return value;
+    }
+};
+
+// SHA-1 (FIPS 180-4). WIM names every stream by its SHA-1, so the apply engine hashes
+// what it decompresses to check it against the blob table.
+class Sha1 {
+
+    public:
+
+        Sha1() { Reset(); }
+
+        void Reset() {
+            state[0] = 0x67452301;
+            state[1] = 0xEFCDAB89;
+            state[2] = 0x98BADCFE;
+            state[3] = 0x10325476;
+            state[4] = 0xC3D2E1F0;
+            total = 0;
+            used = 0;
+        }
+
+        void Update(const void* data, size_t length) {
+            const uint8_t* in = static_cast<const uint8_t*>(data);
+            total += length;
+            if (used > 0) {
+                size_t take = std::min(length, sizeof(block) - used);
+                std::memcpy(block + used, in, take);
+                used += take;
+                in += take;
+                length -= take;
+                if (used < sizeof(block)) return;
+                Transform(block);
+                used = 0;
+            }
+            for (; length >= sizeof(block); in += sizeof(block), length -= sizeof(block)) Transform(in);
+            std::memcpy(block, in, length);
+            used = length;
+        }
+
+        Sha1Digest Final() {
+            uint64_t bits = total * 8;
+            uint8_t pad[72] = { 0x80 };
+            size_t padLength = (used < 56 ? 56 : 120) - used;
+            for (int i = 0; i < 8; ++i) pad[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+            Update(pad, padLength + 8);
+            Sha1Digest digest;
+            for (int i = 0; i < 20; ++i) digest[i] = static_cast<uint8_t>(state[i / 4] >> (24 - 8 * (i % 4)));
+            Reset();
+            return digest;
+        }
+
+        static Sha1Digest Of(const void* data, size_t length) {
+            Sha1 sha;
+            sha.Update(data, length);
+            return sha.Final();
+        }
+
+        static std::wstring ToString(const Sha1Digest& digest) {
+            static const wchar_t hex[] = L"0123456789abcdef";
+            std::wstring text;
+            for (uint8_t byte : digest) {
+                text += hex[byte >> 4];
+                text += hex[byte & 0x0F];
+            }
+            return text;
+        }
+
+    private:
+
+        uint32_t state[5];
+        uint64_t total;
+        uint8_t block[64];
+        size_t used;
+
+        static uint32_t Rotate(uint32_t value, int bits) { return value << bits | value >> (32 - bits); }
+
+        // One round group per function, so each loop has a fixed f and k and unrolls cleanly
+        template <typename F>
+        static void Rounds(uint32_t* w, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d, uint32_t& e, int first, uint32_t k, F f) {
+            for (int i = first; i < first + 20; ++i) {
+                if (i >= 16) w[i & 15] = Rotate(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15], 1);
+                uint32_t temp = Rotate(a, 5) + f(b, c, d) + e + k + w[i & 15];
+                e = d;
+                d = c;
+                c = Rotate(b, 30);
+                b = a;
+                a = temp;
+            }
+        }
+
+        void Transform(const uint8_t* in) {
+            uint32_t w[16];
+            for (int i = 0; i < 16; ++i) {
+                w[i] = static_cast<uint32_t>(in[i * 4]) << 24 | static_cast<uint32_t>(in[i * 4 + 1]) << 16
+                    | static_cast<uint32_t>(in[i * 4 + 2]) << 8 | in[i * 4 + 3];
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+            Rounds(w, a, b, c, d, e, 0, 0x5A827999, [](uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); });
+            Rounds(w, a, b, c, d, e, 20, 0x6ED9EBA1, [](uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; });
+            Rounds(w, a, b, c, d, e, 40, 0x8F1BBCDC, [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); });
+            Rounds(w, a, b, c, d, e, 60, 0xCA62C1D6, [](uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; });
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
+};
+
+#endif
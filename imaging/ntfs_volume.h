@@ -0,0 +1,224 @@
+#ifndef _NTFS_VOLUME_H_
+#define _NTFS_VOLUME_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../platform/file.h"
+
+// Contiguous range of clusters, `lcn` is the first cluster on the volume
+struct ClusterRun {
+    uint64_t lcn = 0;
+    uint64_t count = 0;
+};
+
+// Just enough NTFS to answer "which clusters are in use": the boot sector geometry, the
+// $MFT data runs, and the $Bitmap file (MFT record 6) decoded into allocated runs.
+// Works on anything File can open: \\.\C:, a partition device, or a raw image file at an
+// offset.
+class NtfsVolume {
+
+    public:
+
+        static constexpr uint32_t MFT_RECORD_MFT = 0;
+        static constexpr uint32_t MFT_RECORD_BITMAP = 6;
+        static constexpr uint32_t ATTRIBUTE_DATA = 0x80;
+        static constexpr uint32_t ATTRIBUTE_END = 0xFFFFFFFF;
+
+        NtfsVolume() = default;
+        ~NtfsVolume() = default;
+
+        // `offset` is where the volume starts inside `volume` (0 for a partition device)
+        bool Open(File& volume, uint64_t offset = 0) {
+            file = &volume;
+            base = offset;
+            std::vector<uint8_t> boot(512);
+            if (!ReadBytes(0, boot.data(), boot.size())) return Fail(L"Cannot read the boot sector");
+            if (std::memcmp(boot.data() + 3, "NTFS    ", 8) != 0) return Fail(L"Not an NTFS volume");
+
+            bytesPerSector = Get16(boot.data(), 0x0B);
+            uint8_t sectorsPerClusterCode = boot[0x0D];
+            uint32_t sectorsPerCluster = sectorsPerClusterCode <= 0x80 ? sectorsPerClusterCode : 1U << (256 - sectorsPerClusterCode);
+            if (bytesPerSector < 256 || (bytesPerSector & (bytesPerSector - 1)) || sectorsPerCluster == 0) {
+                return Fail(L"Invalid NTFS geometry");
+            }
+            clusterSize = bytesPerSector * sectorsPerCluster;
+            totalSectors = Get64(boot.data(), 0x28);
+            mftLcn = Get64(boot.data(), 0x30);
+            int8_t recordCode = static_cast<int8_t>(boot[0x40]);
+            recordSize = recordCode > 0 ? static_cast<uint32_t>(recordCode) * clusterSize : 1U << (-recordCode);
+            if (recordSize < 512 || recordSize > 65536 || totalSectors == 0) return Fail(L"Invalid NTFS geometry");
+            clusterCount = totalSectors * bytesPerSector / clusterSize;
+
+            // Records 0-15 are always inside the first $MFT extent; read $MFT's own runs
+            // anyway so record 6 is found even on a volume whose MFT was moved
+            std::vector<uint8_t> record;
+            if (!ReadRecordAt(mftLcn * clusterSize, record)) return false;
+            if (!DataRuns(record, mftRuns)) return Fail(L"$MFT has no data runs");
+            return true;
+        }
+
+        // Decodes $Bitmap into allocated cluster runs, merged and sorted
+        bool AllocatedRuns(std::vector<ClusterRun>& runs) {
+            runs.clear();
+            std::vector<uint8_t> record;
+            uint64_t recordOffset;
+            if (!RecordOffset(MFT_RECORD_BITMAP, recordOffset) || !ReadRecordAt(recordOffset, record)) return false;
+            std::vector<ClusterRun> bitmapRuns;
+            uint64_t bitmapSize = 0;
+            if (!DataRuns(record, bitmapRuns, &bitmapSize)) return Fail(L"$Bitmap has no data runs");
+
+            // The bitmap may be padded past the last cluster
+            uint64_t limit = std::min(clusterCount, bitmapSize * 8);
+            uint64_t cluster = 0;
+            uint64_t runStart = 0;
+            bool inRun = false;
+            std::vector<uint8_t> buffer;
+            for (const auto& extent : bitmapRuns) {
+                uint64_t extentBytes = extent.count * clusterSize;
+                for (uint64_t done = 0; done < extentBytes && cluster < limit; ) {
+                    size_t chunk = static_cast<size_t>(std::min<uint64_t>(extentBytes - done, 4 << 20));
+                    buffer.resize(chunk);
+                    if (extent.lcn == SPARSE) std::fill(buffer.begin(), buffer.end(), 0);
+                    else if (!ReadBytes(extent.lcn * clusterSize + done, buffer.data(), chunk)) return Fail(L"Cannot read $Bitmap");
+                    for (size_t i = 0; i < chunk && cluster < limit; ++i) {
+                        uint8_t bits = buffer[i];
+                        // Whole bytes of 0x00 / 0xFF are the common case on real volumes
+                        if (((bits == 0x00 && !inRun) || (bits == 0xFF && inRun)) && cluster + 8 <= limit) {
+                            cluster += 8;
+                            continue;
+                        }
+                        for (int bit = 0; bit < 8 && cluster < limit; ++bit, ++cluster) {
+                            bool used = (bits >> bit) & 1;
+                            if (used && !inRun) {
+                                runStart = cluster;
+                                inRun = true;
+                            }
+                            else if (!used && inRun) {
+                                runs.push_back(ClusterRun{ runStart, cluster - runStart });
+                                inRun = false;
+                            }
+                        }
+                    }
+                    done += chunk;
+                }
+            }
+            if (inRun) runs.push_back(ClusterRun{ runStart, cluster - runStart });
+            return true;
+        }
+
+        uint32_t ClusterSize() const { return clusterSize; }
+        uint32_t BytesPerSector() const { return bytesPerSector; }
+        uint64_t ClusterCount() const { return clusterCount; }
+        uint64_t VolumeBytes() const { return totalSectors * bytesPerSector; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        static constexpr uint64_t SPARSE = ~0ULL;
+
+        File* file = nullptr;
+        uint64_t base = 0;
+        uint32_t bytesPerSector = 0;
+        uint32_t clusterSize = 0;
+        uint32_t recordSize = 0;
+        uint64_t totalSectors = 0;
+        uint64_t clusterCount = 0;
+        uint64_t mftLcn = 0;
+        std::vector<ClusterRun> mftRuns;
+        std::wstring error;
+
+        static uint16_t Get16(const uint8_t* p, size_t offset) { return static_cast<uint16_t>(p[offset] | p[offset + 1] << 8); }
+        static uint32_t Get32(const uint8_t* p, size_t offset) { return Get16(p, offset) | static_cast<uint32_t>(Get16(p, offset + 2)) << 16; }
+        static uint64_t Get64(const uint8_t* p, size_t offset) { return Get32(p, offset) | static_cast<uint64_t>(Get32(p, offset + 4)) << 32; }
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        bool ReadBytes(uint64_t offset, uint8_t* buffer, size_t length) {
+            size_t done = 0;
+            return file->ReadAt(buffer, length, base + offset, done) && done == length;
+        }
+
+        bool RecordOffset(uint32_t index, uint64_t& offset) const {
+            uint64_t byte = static_cast<uint64_t>(index) * recordSize;
+            for (const auto& run : mftRuns) {
+                uint64_t runBytes = run.count * clusterSize;
+                if (byte < runBytes) {
+                    if (run.lcn == SPARSE) return false;
+                    offset = run.lcn * clusterSize + byte;
+                    return true;
+                }
+                byte -= runBytes;
+            }
+            return false;
+        }
+
+        // Reads one FILE record and undoes the update sequence fixups
+        bool ReadRecordAt(uint64_t offset, std::vector<uint8_t>& record) {
+            record.resize(recordSize);
+            if (!ReadBytes(offset, record.data(), recordSize)) return Fail(L"Cannot read MFT record");
+            if (std::memcmp(record.data(), "FILE", 4) != 0) return Fail(L"Bad MFT record signature");
+            uint16_t usaOffset = Get16(record.data(), 0x04);
+            uint16_t usaCount = Get16(record.data(), 0x06);
+            if (usaCount < 2 || usaOffset + usaCount * 2U > recordSize) return Fail(L"Bad MFT update sequence");
+            uint32_t stride = recordSize / (usaCount - 1);
+            if (stride < 256) return Fail(L"Bad MFT update sequence");
+            uint16_t usn = Get16(record.data(), usaOffset);
+            for (uint16_t i = 1; i < usaCount; ++i) {
+                size_t tail = static_cast<size_t>(i) * stride - 2;
+                if (Get16(record.data(), tail) != usn) return Fail(L"Torn MFT record (update sequence mismatch)");
+                record[tail] = record[usaOffset + i * 2];
+                record[tail + 1] = record[usaOffset + i * 2 + 1];
+            }
+            return true;
+        }
+
+        // Unnamed non-resident $DATA runs of a record
+        bool DataRuns(const std::vector<uint8_t>& record, std::vector<ClusterRun>& runs, uint64_t* dataSize = nullptr) const {
+            runs.clear();
+            size_t at = Get16(record.data(), 0x14);
+            while (at + 16 <= record.size()) {
+                uint32_t type = Get32(record.data(), at);
+                uint32_t length = Get32(record.data(), at + 4);
+                if (type == ATTRIBUTE_END || length < 16 || at + length > record.size()) break;
+                bool nonResident = record[at + 8] != 0;
+                uint8_t nameLength = record[at + 9];
+                if (type == ATTRIBUTE_DATA && nameLength == 0 && nonResident && length >= 0x40) {
+                    if (dataSize) *dataSize = Get64(record.data(), at + 0x30);
+                    return DecodeRuns(record.data() + at, length, Get16(record.data(), at + 0x20), runs);
+                }
+                at += length;
+            }
+            return false;
+        }
+
+        static bool DecodeRuns(const uint8_t* attribute, size_t length, size_t at, std::vector<ClusterRun>& runs) {
+            int64_t lcn = 0;
+            while (at < length && attribute[at] != 0) {
+                uint8_t header = attribute[at++];
+                size_t lengthBytes = header & 0x0F;
+                size_t offsetBytes = header >> 4;
+                if (lengthBytes == 0 || lengthBytes > 8 || offsetBytes > 8 || at + lengthBytes + offsetBytes > length) return false;
+                uint64_t count = 0;
+                for (size_t i = 0; i < lengthBytes; ++i) count |= static_cast<uint64_t>(attribute[at + i]) << (8 * i);
+                at += lengthBytes;
+                if (offsetBytes == 0) {
+                    runs.push_back(ClusterRun{ SPARSE, count });
+                    continue;
+                }
+                int64_t delta = 0;
+                for (size_t i = 0; i < offsetBytes; ++i) delta |= static_cast<int64_t>(attribute[at + i]) << (8 * i);
+                if (attribute[at + offsetBytes - 1] & 0x80 && offsetBytes < 8) delta -= static_cast<int64_t>(1) << (8 * offsetBytes);
+                at += offsetBytes;
+                lcn += delta;
+                if (lcn < 0) return false;
+                runs.push_back(ClusterRun{ static_cast<uint64_t>(lcn), count });
+            }
+            return !runs.empty();
+        }
+};
+
+#endif
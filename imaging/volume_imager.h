@@ -0,0 +1,356 @@
+#ifndef _VOLUME_IMAGER_H_
+#define _VOLUME_IMAGER_H_
+#include <chrono>
+#include "ntfs_volume.h"
+#include "../disk/vhdx_writer.h"
+#include "../io/fan_out.h"
+#include "../io/io_backend.h"
+#include "../io/stream_copy.h"
+#include "../pipeline/journal.h"
+
+struct ImageOptions {
+    IoOptions io;                          // Queue depth, block size and DIRECT for the target
+    uint64_t sourceOffset = 0;             // Volume start inside the source, for whole-disk images
+    uint64_t targetOffset = 0;             // Partition start inside the target
+    uint64_t targetCapacity = 0;           // Bytes available at targetOffset, 0 if unknown
+    uint64_t alignment = 1 << 20;          // Runs are widened out to this boundary
+    uint64_t mergeGap = 4 << 20;           // Free gaps smaller than this are copied through
+    bool sparse = true;                    // Zero blocks become holes in images and discards on devices, not writes
+    size_t memory = 256 << 20;             // Buffers shared by the targets when imaging several at once
+    double stallSeconds = 120;             // A target that makes no progress for this long is dropped
+    Journal* journal = nullptr;            // Single target: segments it has are not copied again
+    uint64_t segmentBytes = 256ULL << 20;  // Journaled unit: the target is flushed and the segment recorded
+};
+
+struct ImageStats {
+    uint64_t volumeBytes = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t bytesSkipped = 0;
+    uint64_t zeroBytes = 0;                // Allocated but zero, part of bytesSkipped
+    uint64_t runs = 0;                     // Sequential runs after widening and merging
+    uint64_t resumedBytes = 0;             // Segments an earlier run finished, per the journal
+    double seconds = 0;
+    std::vector<FanOutTargetStats> targets;  // One per target when imaging several at once
+
+    double MBPerSecond() const { return seconds > 0 ? bytesWritten / seconds / 1e6 : 0; }
+
+    std::wstring ToString() const {
+        return std::to_wstring(bytesWritten / 1000000) + L" MB written, " + std::to_wstring(bytesSkipped / 1000000)
+            + L" MB skipped (" + std::to_wstring(zeroBytes / 1000000) + L" MB of them zeros) in " + std::to_wstring(runs) + L" runs, " + std::to_wstring(seconds) + L" s ("
+            + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s)"
+            + (resumedBytes ? L", " + std::to_wstring(resumedBytes / 1000000) + L" MB resumed" : L"");
+    }
+};
+
+// Block-level clone of an NTFS volume that only moves allocated clusters. The $Bitmap runs
+// are widened to `alignment` and merged across small free gaps so the target sees long
+// sequential writes, then streamed through the async I/O layer. Source and target can be
+// volumes, partitions or plain image files. Allocated blocks that read as zeros are left as
+// holes in a new image and discarded on an existing target (options.sparse). The filesystem
+// itself is not resized: the target must hold the whole source volume, a larger one can be
+// extended afterwards. With a journal the single-target copy goes in segments that are
+// flushed and recorded as they finish, so a rerun picks up at the first missing one.
+class VolumeImager {
+
+    public:
+
+        explicit VolumeImager(const ImageOptions& imageOptions = ImageOptions()) : options(imageOptions) {}
+        ~VolumeImager() = default;
+
+        bool Run(const std::filesystem::path& source, const std::filesystem::path& target) {
+            stats = ImageStats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+
+            File input;
+            NtfsVolume volume;
+            std::vector<IoRange> ranges;
+            uint64_t span = 0;
+            if (!OpenSource(source, input, volume, ranges, span)) return false;
+            File output;
+            IoOptions io = options.io;
+            if (!OpenTarget(target, output, span, io.zeros)) return false;
+
+            std::unique_ptr<AsyncIo> backend = CreateAsyncIo(io);
+            if (!backend) return Fail(L"No async I/O backend available");
+            StreamCopier copier(*backend, io);
+            if (!options.journal) {
+                if (!copier.CopyRanges(input, output, ranges, Shift())) return Fail(copier.Error());
+                stats.bytesWritten = copier.Stats().bytes;
+                stats.zeroBytes = copier.Stats().zeroBytes;
+            }
+            else {
+                // Segment by segment, each on the target before the journal says so
+                for (const auto& segment : Segments(ranges, options.segmentBytes)) {
+                    uint64_t begin = segment.front().offset;
+                    uint64_t length = segment.back().offset + segment.back().length - begin;
+                    if (options.journal->RangeDone(begin, length)) {
+                        for (const auto& range : segment) stats.resumedBytes += range.length;
+                        continue;
+                    }
+                    if (!copier.CopyRanges(input, output, segment, Shift())) return Fail(copier.Error());
+                    if (!output.Sync()) return Fail(output.Error());
+                    stats.bytesWritten += copier.Stats().bytes;
+                    stats.zeroBytes += copier.Stats().zeroBytes;
+                    options.journal->RecordRange(begin, length, true);
+                }
+            }
+            output.Close();
+
+            if (!CopyBackupBootSector(input, target, volume)) return false;
+            stats.bytesSkipped = stats.volumeBytes - std::min(stats.volumeBytes, stats.bytesWritten + stats.resumedBytes);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        // Clones the source onto every target in one pass: each block is read once and
+        // broadcast to per-target writers (FanOutCopier). A target that cannot be opened or
+        // fails part way is reported in Stats().targets and left behind while the others
+        // finish; the run fails only when no target completes. bytesWritten counts all of them.
+        // A single target with a journal takes the resumable path above.
+        bool Run(const std::filesystem::path& source, const std::vector<std::filesystem::path>& targets) {
+            if (targets.size() == 1 && options.journal) {
+                bool ok = Run(source, targets.front());
+                FanOutTargetStats result;
+                result.name = targets.front().wstring();
+                result.bytes = stats.bytesWritten;
+                result.zeroBytes = stats.zeroBytes;
+                result.seconds = stats.seconds;
+                result.failed = !ok;
+                result.error = error;
+                stats.targets = { result };
+                return ok;
+            }
+            stats = ImageStats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+
+            File input;
+            NtfsVolume volume;
+            std::vector<IoRange> ranges;
+            uint64_t span = 0;
+            if (!OpenSource(source, input, volume, ranges, span)) return false;
+
+            std::vector<std::unique_ptr<File>> outputs;
+            std::vector<FanOutTarget> live;
+            std::vector<size_t> index;             // live -> targets
+            std::vector<FanOutTargetStats> results(targets.size());
+            for (size_t i = 0; i < targets.size(); ++i) {
+                results[i].name = targets[i].wstring();
+                outputs.push_back(std::make_unique<File>());
+                FanOutTarget output{ outputs.back().get(), options.io.zeros };
+                if (!OpenTarget(targets[i], *outputs.back(), span, output.zeros)) {
+                    results[i].failed = true;
+                    results[i].error = error;
+                    continue;
+                }
+                live.push_back(output);
+                index.push_back(i);
+            }
+
+            if (!live.empty()) {
+                FanOutOptions fanOut;
+                fanOut.io = options.io;
+                fanOut.memory = options.memory;
+                fanOut.stallSeconds = options.stallSeconds;
+                FanOutCopier copier(fanOut);
+                bool copied = copier.CopyRanges(input, live, ranges, Shift());
+                for (size_t k = 0; k < live.size(); ++k) {
+                    FanOutTargetStats& result = results[index[k]];
+                    std::wstring name = result.name;
+                    result = copier.Stats().targets[k];
+                    result.name = name;
+                    if (!copied && !result.failed) {
+                        result.failed = true;
+                        result.error = copier.Error();
+                    }
+                }
+                if (!copied) error = copier.Error();
+            }
+
+            uint64_t best = 0;
+            for (size_t i = 0; i < targets.size(); ++i) {
+                FanOutTargetStats& result = results[i];
+                outputs[i]->Close();
+                if (result.failed) continue;
+                uint64_t before = stats.bytesWritten;
+                if (!CopyBackupBootSector(input, targets[i], volume)) {
+                    result.failed = true;
+                    result.error = error;
+                    continue;
+                }
+                result.bytes += stats.bytesWritten - before;
+                stats.bytesWritten = before + result.bytes;
+                if (result.bytes >= best) {
+                    best = result.bytes;
+                    stats.zeroBytes = result.zeroBytes;
+                }
+            }
+            stats.targets = results;
+            stats.bytesSkipped = stats.volumeBytes - std::min(stats.volumeBytes, best);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (const auto& result : results) {
+                if (!result.failed) return true;
+            }
+            return Fail(error.empty() ? L"Every target failed" : error);
+        }
+
+        // Clones the source into a partition of a VHDX (options.targetOffset). The ranges go in
+        // ascending order, so the writer lays the payload blocks out in disk order, and zeros
+        // allocate no block. The caller closes the VHDX.
+        bool Run(const std::filesystem::path& source, VhdxWriter& target) {
+            stats = ImageStats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+
+            File input;
+            NtfsVolume volume;
+            std::vector<IoRange> ranges;
+            uint64_t span = 0;
+            if (!OpenSource(source, input, volume, ranges, span)) return false;
+            if (options.targetOffset + span > target.Size()) return Fail(L"The virtual disk is smaller than the source volume");
+
+            VhdxStats before = target.Stats();
+            std::vector<uint8_t> buffer(static_cast<size_t>(std::max<uint64_t>(options.io.blockSize, 1 << 20)));
+            auto copy = [&](uint64_t offset, uint64_t length) {
+                while (length > 0) {
+                    size_t want = static_cast<size_t>(std::min<uint64_t>(length, buffer.size())), got = 0;
+                    if (!input.ReadAt(buffer.data(), want, offset, got) || got != want) return Fail(L"Cannot read the source at " + std::to_wstring(offset));
+                    if (!target.Write(offset + Shift(), buffer.data(), want)) return Fail(target.Error());
+                    offset += want;
+                    length -= want;
+                }
+                return true;
+            };
+            for (const auto& range : ranges) {
+                if (!copy(range.offset, range.length)) return false;
+            }
+            // The backup boot sector, right after the volume; absent when the source ends with it
+            size_t got = 0;
+            std::vector<uint8_t> sector(volume.BytesPerSector());
+            if (input.ReadAt(sector.data(), sector.size(), options.sourceOffset + volume.VolumeBytes(), got) && got == sector.size()
+                && !target.Write(options.targetOffset + volume.VolumeBytes(), sector.data(), sector.size())) {
+                return Fail(target.Error());
+            }
+
+            stats.bytesWritten = target.Stats().bytesWritten - before.bytesWritten;
+            stats.zeroBytes = target.Stats().zeroBytes - before.zeroBytes;
+            stats.bytesSkipped = stats.volumeBytes - std::min(stats.volumeBytes, stats.bytesWritten);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        // Allocated cluster runs -> sorted byte ranges, widened to `alignment`, clipped to
+        // the volume and merged where the free gap between them is below `mergeGap`
+        static std::vector<IoRange> Plan(const std::vector<ClusterRun>& clusters, uint32_t clusterSize, uint64_t volumeBytes,
+                                         uint64_t alignment, uint64_t mergeGap) {
+            std::vector<IoRange> ranges;
+            alignment = std::max<uint64_t>(alignment, 1);
+            for (const auto& run : clusters) {
+                uint64_t begin = run.lcn * clusterSize / alignment * alignment;
+                uint64_t end = std::min(volumeBytes, ((run.lcn + run.count) * clusterSize + alignment - 1) / alignment * alignment);
+                if (begin >= end) continue;
+                if (!ranges.empty() && begin <= ranges.back().offset + ranges.back().length + mergeGap) {
+                    IoRange& last = ranges.back();
+                    last.length = std::max(last.offset + last.length, end) - last.offset;
+                }
+                else {
+                    ranges.push_back(IoRange{ begin, end - begin });
+                }
+            }
+            return ranges;
+        }
+
+        // Consecutive ranges grouped into units of about `limit` bytes; a longer range is cut
+        static std::vector<std::vector<IoRange>> Segments(const std::vector<IoRange>& ranges, uint64_t limit) {
+            std::vector<std::vector<IoRange>> segments(1);
+            uint64_t filled = 0;
+            limit = std::max<uint64_t>(limit, 1);
+            for (IoRange range : ranges) {
+                while (range.length > 0) {
+                    if (filled == limit) {
+                        segments.emplace_back();
+                        filled = 0;
+                    }
+                    uint64_t take = std::min(range.length, limit - filled);
+                    segments.back().push_back(IoRange{ range.offset, take });
+                    filled += take;
+                    range.offset += take;
+                    range.length -= take;
+                }
+            }
+            if (segments.back().empty()) segments.pop_back();
+            return segments;
+        }
+
+        const ImageStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        ImageOptions options;
+        ImageStats stats;
+        std::wstring error;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        int64_t Shift() const {
+            return static_cast<int64_t>(options.targetOffset) - static_cast<int64_t>(options.sourceOffset);
+        }
+
+        // Opens the source volume and plans the ranges to copy, shifted onto the source offset.
+        // `span` is what the target needs: NTFS keeps a backup boot sector right after the
+        // last cluster of the volume.
+        bool OpenSource(const std::filesystem::path& source, File& input, NtfsVolume& volume, std::vector<IoRange>& ranges, uint64_t& span) {
+            if (!input.Open(source, File::READ, File::ASYNC)) return Fail(input.Error());
+            std::vector<ClusterRun> clusters;
+            if (!volume.Open(input, options.sourceOffset) || !volume.AllocatedRuns(clusters)) return Fail(volume.Error());
+            stats.volumeBytes = volume.VolumeBytes();
+            span = stats.volumeBytes + volume.BytesPerSector();
+            if (options.targetCapacity && options.targetCapacity < span) {
+                return Fail(L"Target partition is smaller than the source volume");
+            }
+            ranges = Plan(clusters, volume.ClusterSize(), stats.volumeBytes, options.alignment, options.mergeGap);
+            for (const auto& run : clusters) stats.allocatedBytes += run.count * volume.ClusterSize();
+            stats.runs = ranges.size();
+            for (auto& range : ranges) range.offset += options.sourceOffset;
+            return true;
+        }
+
+        // Opens a target for the copy and picks what its zero blocks become
+        bool OpenTarget(const std::filesystem::path& target, File& output, uint64_t span, ZeroPolicy& zeros) {
+            std::error_code ec;
+            bool existing = std::filesystem::exists(target, ec);
+            unsigned flags = File::ASYNC | (options.io.direct ? File::DIRECT : 0);
+            if (!output.Open(target, existing ? File::UPDATE : File::WRITE, flags)) return Fail(output.Error());
+            // A new or short image file gets its full length up front, as a hole where supported
+            bool image = std::filesystem::is_regular_file(target, ec);
+            if (image && options.sparse) output.SetSparse();
+            if (image && output.Size() < options.targetOffset + span && !output.Resize(options.targetOffset + span)) {
+                return Fail(output.Error());
+            }
+            if (options.sparse) zeros = existing ? ZEROS_DISCARD : ZEROS_SKIP;
+            return true;
+        }
+
+        // Outside the cluster bitmap, so it is copied on its own through a buffered handle
+        bool CopyBackupBootSector(File& input, const std::filesystem::path& target, const NtfsVolume& volume) {
+            std::vector<uint8_t> sector(volume.BytesPerSector());
+            size_t got = 0;
+            if (!input.ReadAt(sector.data(), sector.size(), options.sourceOffset + volume.VolumeBytes(), got) || got != sector.size()) {
+                return true;   // Source image ends with the volume, nothing to copy
+            }
+            File output;
+            if (!output.Open(target, File::UPDATE) || !output.WriteAt(sector.data(), sector.size(), options.targetOffset + volume.VolumeBytes())) {
+                return Fail(L"Cannot write the backup boot sector");
+            }
+            stats.bytesWritten += sector.size();
+            return true;
+        }
+};
+
+#endif
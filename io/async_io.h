@@ -0,0 +1,82 @@
+#ifndef _ASYNC_IO_H_
+#define _ASYNC_IO_H_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../platform/file.h"
+
+enum IoBackendKind {
+    IO_AUTO,
+    IO_URING,          // Linux io_uring
+    IO_OVERLAPPED,     // Windows overlapped I/O on a completion port
+    IO_THREADS         // Blocking positional I/O on a small thread pool, works everywhere
+};
+
+// What the block-writing paths do with all-zero blocks
+enum ZeroPolicy {
+    ZEROS_WRITE,       // Write them like any other block
+    ZEROS_SKIP,        // Leave them out, the target already reads zeros (a new sparse image)
+    ZEROS_DISCARD      // Punch a hole or unmap instead; written after all where the target cannot
+};
+
+struct IoOptions {
+    IoBackendKind backend = IO_AUTO;
+    size_t queueDepth = 32;            // Requests in flight at once
+    size_t blockSize = 1 << 20;        // Size of one request, a multiple of 4096 for DIRECT files
+    size_t threads = 4;                // IO_THREADS only
+    bool direct = false;               // Open targets unbuffered
+    ZeroPolicy zeros = ZEROS_WRITE;
+};
+
+struct IoRequest {
+    enum Op { READ, WRITE };
+    Op op = READ;
+    File* file = nullptr;
+    void* buffer = nullptr;
+    size_t length = 0;
+    uint64_t offset = 0;
+    uint64_t tag = 0;                  // Handed back in the completion
+    int bufferIndex = -1;              // Index into RegisterBuffers(), -1 if not registered
+};
+
+struct IoCompletion {
+    uint64_t tag = 0;
+    int64_t result = 0;                // Bytes transferred, negative on error
+};
+
+// Minimal submit/reap interface shared by the copy and imaging paths. Submit() only queues;
+// Flush() hands the queue to the kernel in one call; Reap() waits for completions. A backend
+// never has more than queueDepth requests in flight, Submit() returns false when full.
+class AsyncIo {
+
+    public:
+
+        virtual ~AsyncIo() = default;
+
+        virtual bool Submit(const IoRequest& request) = 0;
+        virtual bool Flush() = 0;
+        // Appends at least `minimum` completions to `completions` (fewer only on error)
+        virtual size_t Reap(std::vector<IoCompletion>& completions, size_t minimum) = 0;
+
+        // Lets the backend pin buffers once instead of per request; optional
+        virtual bool RegisterBuffers(const std::vector<std::pair<void*, size_t>>& buffers) { (void)buffers; return false; }
+
+        virtual IoBackendKind Kind() const = 0;
+        virtual size_t InFlight() const = 0;
+        const std::wstring& Error() const { return error; }
+
+        static const wchar_t* KindName(IoBackendKind kind) {
+            switch (kind) {
+                case IO_URING: return L"io_uring";
+                case IO_OVERLAPPED: return L"overlapped";
+                case IO_THREADS: return L"threads";
+                default: return L"auto";
+            }
+        }
+
+    protected:
+
+        std::wstring error;
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef _FAN_OUT_H_
+#define _FAN_OUT_H_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "io_backend.h"
+#include "stream_copy.h"
+
+struct FanOutOptions {
+    IoOptions io;                          // Block size, requests in flight per target, DIRECT
+    size_t memory = 256 << 20;             // Blocks alive at once across all targets: how far the
+                                           // fastest target can run ahead of the slowest
+    double stallSeconds = 120;             // A target that completes no write for this long is dropped
+};
+
+// One output of a fan-out and how it treats zero blocks (a new image skips them, an
+// existing device discards them)
+struct FanOutTarget {
+    File* file = nullptr;
+    ZeroPolicy zeros = ZEROS_WRITE;
+};
+
+struct FanOutTargetStats {
+    std::wstring name;                     // Filled in by the caller
+    uint64_t bytes = 0;                    // Written
+    uint64_t zeroBytes = 0;                // Skipped or discarded instead of written
+    uint64_t requests = 0;
+    double seconds = 0;                    // Until its last write completed
+    bool failed = false;
+    std::wstring error;
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+
+    std::wstring ToString() const {
+        if (failed) return name + L": failed, " + error;
+        return name + L": " + std::to_wstring(bytes / 1000000) + L" MB in " + std::to_wstring(seconds) + L" s ("
+            + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s)";
+    }
+};
+
+struct FanOutStats {
+    uint64_t bytesRead = 0;
+    uint64_t blocks = 0;
+    uint64_t readerWaits = 0;              // Reads held back until the slowest target freed a block
+    double seconds = 0;
+    std::vector<FanOutTargetStats> targets;
+
+    size_t Succeeded() const {
+        size_t count = 0;
+        for (const auto& target : targets) count += !target.failed;
+        return count;
+    }
+};
+
+// Copies ranges of one input to several outputs, reading every block once. A block is
+// read into a buffer from a fixed pool, checked for zeros once, and handed by reference to
+// every target's queue; each target has its own writer thread and async backend, and the
+// buffer goes back to the pool when the last target has written it. The pool is the only
+// coupling between targets: a slow stick holds the others back only once it is a whole
+// pool behind. A target whose write fails, or that makes no progress for stallSeconds, is
+// dropped and reported while the others carry on; the copy fails only when all are gone
+// or the source cannot be read.
+class FanOutCopier {
+
+    public:
+
+        static constexpr size_t ALIGNMENT = StreamCopier::ALIGNMENT;
+
+        explicit FanOutCopier(const FanOutOptions& fanOutOptions = FanOutOptions()) : options(fanOutOptions) {
+            options.io.blockSize = std::max<size_t>(ALIGNMENT, (options.io.blockSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+            options.io.queueDepth = std::max<size_t>(1, options.io.queueDepth);
+            size_t count = std::max<size_t>(2, options.memory / options.io.blockSize);
+            for (size_t i = 0; i < count; ++i) {
+                buffers.emplace_back(static_cast<uint8_t*>(operator new[](options.io.blockSize, std::align_val_t(ALIGNMENT))));
+                available.push_back(buffers.back().get());
+            }
+        }
+
+        // Copies every range of `input` to each target at range.offset + shift
+        bool CopyRanges(File& input, const std::vector<FanOutTarget>& outputs, const std::vector<IoRange>& ranges, int64_t shift = 0) {
+            stats = FanOutStats();
+            error.clear();
+            start = std::chrono::steady_clock::now();
+            stats.targets.resize(outputs.size());
+            uint64_t end = 0;
+            for (const auto& range : ranges) end = std::max(end, range.offset + range.length);
+
+            std::vector<std::unique_ptr<Target>> targets;
+            for (size_t i = 0; i < outputs.size(); ++i) {
+                targets.push_back(std::make_unique<Target>());
+                Target& target = *targets.back();
+                target.output = outputs[i];
+                target.stats = &stats.targets[i];
+                target.sizeBefore = outputs[i].file->Size();
+                target.progress = Now();
+            }
+            for (auto& target : targets) target->thread = std::thread(&FanOutCopier::Write, this, std::ref(*target));
+
+            bool readFailed = false;
+            for (const auto& range : ranges) {
+                for (uint64_t next = 0; next < range.length && !readFailed && Live(targets); ) {
+                    uint8_t* buffer = Acquire(targets);
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(options.io.blockSize, range.length - next));
+                    size_t got = 0;
+                    if (!input.ReadAt(buffer, length, range.offset + next, got) || got != length) {
+                        Release(buffer);
+                        error = L"Read failed at offset " + std::to_wstring(range.offset + next);
+                        readFailed = true;
+                        break;
+                    }
+                    std::shared_ptr<Block> block(new Block{ buffer, range.offset + next + shift, length, 0, length },
+                                                 [this](Block* done) { Release(done->data); delete done; });
+                    if (options.io.direct && length % ALIGNMENT != 0) {
+                        // Unbuffered writes are whole sectors: the pad is zeros, trimmed afterwards
+                        std::memset(buffer + length, 0, (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT - length);
+                    }
+                    ScanZeros(*block);
+                    for (auto& target : targets) {
+                        std::lock_guard<std::mutex> lock(target->mutex);
+                        if (target->failed) continue;
+                        target->queue.push_back(block);
+                        target->wake.notify_one();
+                    }
+                    stats.bytesRead += length;
+                    stats.blocks++;
+                    next += length;
+                }
+            }
+            for (auto& target : targets) {
+                {
+                    std::lock_guard<std::mutex> lock(target->mutex);
+                    target->done = true;
+                    if (readFailed) {
+                        target->queue.clear();
+                        target->failed = true;
+                        target->stats->failed = true;
+                        target->stats->error = error;
+                    }
+                }
+                target->wake.notify_one();
+            }
+            for (auto& target : targets) target->thread.join();
+
+            // Padded tails grew image files; devices never grow
+            for (auto& target : targets) {
+                uint64_t size = std::max(target->sizeBefore, end + shift);
+                if (!target->failed && target->output.file->Size() > size) target->output.file->Resize(size);
+            }
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!readFailed && stats.Succeeded() == 0) error = L"Every target failed";
+            return !readFailed && stats.Succeeded() > 0;
+        }
+
+        const FanOutStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        struct AlignedDelete {
+            void operator()(uint8_t* buffer) const { operator delete[](buffer, std::align_val_t(ALIGNMENT)); }
+        };
+
+        struct Block {
+            uint8_t* data;
+            uint64_t target;                       // Offset on the targets
+            size_t length;
+            size_t begin;                          // Non-zero part, whole granules except at the end
+            size_t end;
+        };
+
+        struct Target {
+            FanOutTarget output;
+            FanOutTargetStats* stats = nullptr;
+            std::thread thread;
+            std::mutex mutex;                      // Guards queue, done and failed
+            std::condition_variable wake;
+            std::deque<std::shared_ptr<Block>> queue;
+            bool done = false;                     // No more blocks will be queued
+            bool failed = false;
+            bool busy = false;                     // Has queued or in-flight blocks, guarded by mutex
+            uint64_t sizeBefore = 0;
+            std::atomic<int64_t> progress{ 0 };    // Last completed write, steady clock nanoseconds
+        };
+
+        FanOutOptions options;
+        std::vector<std::unique_ptr<uint8_t[], AlignedDelete>> buffers;
+        std::vector<uint8_t*> available;
+        std::mutex poolMutex;
+        std::condition_variable returned;
+        std::chrono::steady_clock::time_point start;
+        FanOutStats stats;
+        std::wstring error;
+
+        static int64_t Now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static bool Live(const std::vector<std::unique_ptr<Target>>& targets) {
+            for (const auto& target : targets) {
+                std::lock_guard<std::mutex> lock(target->mutex);
+                if (!target->failed) return true;
+            }
+            return false;
+        }
+
+        // Waits for a free buffer. While waiting, a target with work that has not completed a
+        // write for stallSeconds is dropped, which frees its queued blocks.
+        uint8_t* Acquire(const std::vector<std::unique_ptr<Target>>& targets) {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            if (available.empty()) stats.readerWaits++;
+            while (available.empty()) {
+                if (returned.wait_for(lock, std::chrono::seconds(1), [&] { return !available.empty(); })) break;
+                lock.unlock();
+                int64_t limit = Now() - static_cast<int64_t>(options.stallSeconds * 1e9);
+                for (const auto& target : targets) {
+                    std::lock_guard<std::mutex> targetLock(target->mutex);
+                    if (!target->failed && target->busy && target->progress < limit) {
+                        Drop(*target, L"No progress for " + std::to_wstring(static_cast<int>(options.stallSeconds)) + L" s");
+                    }
+                }
+                lock.lock();
+            }
+            uint8_t* buffer = available.back();
+            available.pop_back();
+            return buffer;
+        }
+
+        void Release(uint8_t* buffer) {
+            {
+                std::lock_guard<std::mutex> lock(poolMutex);
+                available.push_back(buffer);
+            }
+            returned.notify_one();
+        }
+
+        // Caller holds target.mutex
+        static void Drop(Target& target, const std::wstring& message) {
+            target.failed = true;
+            target.queue.clear();
+            target.stats->failed = true;
+            if (target.stats->error.empty()) target.stats->error = message;
+            target.wake.notify_one();
+        }
+
+        void ScanZeros(Block& block) const {
+            const uint8_t* data = block.data;
+            block.begin = ZeroScan::ZeroPrefix(data, block.length, ALIGNMENT);
+            block.end = block.begin == block.length ? block.begin
+                : block.length - ZeroScan::ZeroSuffix(data + block.begin, block.length - block.begin, ALIGNMENT);
+        }
+
+        // One target's writer: keeps up to queueDepth writes in flight from its queue
+        void Write(Target& target) {
+            std::unique_ptr<AsyncIo> io = CreateAsyncIo(options.io);
+            if (!io) {
+                std::lock_guard<std::mutex> lock(target.mutex);
+                Drop(target, L"No async I/O backend available");
+                return;
+            }
+            struct Slot {
+                std::shared_ptr<Block> block;
+                size_t length = 0;                 // Requested, padded for DIRECT
+                size_t bytes = 0;                  // Counted as written
+            };
+            std::vector<Slot> slots(options.io.queueDepth);
+            std::vector<size_t> idle;
+            for (size_t i = slots.size(); i-- > 0;) idle.push_back(i);
+            ZeroPolicy zeros = target.output.zeros;
+            std::vector<IoCompletion> completions;
+            for (;;) {
+                bool finished = false;
+                while (!idle.empty()) {
+                    std::shared_ptr<Block> block;
+                    {
+                        std::unique_lock<std::mutex> lock(target.mutex);
+                        target.busy = !target.queue.empty() || idle.size() < slots.size();
+                        if (target.queue.empty() && idle.size() < slots.size()) break;
+                        target.wake.wait(lock, [&] { return !target.queue.empty() || target.done || target.failed; });
+                        if (target.failed || target.queue.empty()) {
+                            finished = true;
+                            break;
+                        }
+                        block = std::move(target.queue.front());
+                        target.queue.pop_front();
+                        target.busy = true;
+                        if (idle.size() == slots.size()) target.progress = Now();
+                    }
+                    size_t begin = 0, end = block->length;
+                    if (zeros != ZEROS_WRITE && (block->begin != 0 || block->end != block->length)) {
+                        if (zeros == ZEROS_DISCARD && (!target.output.file->Discard(block->target, block->begin)
+                            || !target.output.file->Discard(block->target + block->end, block->length - block->end))) {
+                            zeros = ZEROS_WRITE;
+                        }
+                        else {
+                            begin = block->begin;
+                            end = block->end;
+                            target.stats->zeroBytes += block->length - (end - begin);
+                        }
+                    }
+                    if (begin == end) continue;
+                    size_t index = idle.back();
+                    idle.pop_back();
+                    Slot& slot = slots[index];
+                    slot.bytes = end - begin;
+                    slot.length = options.io.direct ? (slot.bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT : slot.bytes;
+                    IoRequest request;
+                    request.op = IoRequest::WRITE;
+                    request.file = target.output.file;
+                    request.buffer = block->data + begin;
+                    request.length = slot.length;
+                    request.offset = block->target + begin;
+                    request.tag = index;
+                    slot.block = std::move(block);
+                    if (!io->Submit(request)) {
+                        slot.block.reset();
+                        idle.push_back(index);
+                        std::lock_guard<std::mutex> lock(target.mutex);
+                        Drop(target, L"Cannot queue write");
+                        finished = true;
+                        break;
+                    }
+                }
+                io->Flush();
+                if (idle.size() == slots.size()) {
+                    if (finished) break;
+                    continue;
+                }
+                completions.clear();
+                if (io->Reap(completions, 1) == 0) {
+                    // Nothing can complete anymore; the buffers are no longer referenced by the kernel
+                    std::lock_guard<std::mutex> lock(target.mutex);
+                    Drop(target, io->Error().empty() ? L"I/O backend stalled" : io->Error());
+                    break;
+                }
+                for (const auto& completion : completions) {
+                    size_t index = static_cast<size_t>(completion.tag);
+                    Slot& slot = slots[index];
+                    target.stats->requests++;
+                    if (completion.result != static_cast<int64_t>(slot.length)) {
+                        std::lock_guard<std::mutex> lock(target.mutex);
+                        Drop(target, L"Write failed at offset " + std::to_wstring(slot.block->target));
+                    }
+                    else {
+                        target.stats->bytes += slot.bytes;
+                    }
+                    slot.block.reset();
+                    idle.push_back(index);
+                }
+                target.progress = Now();
+                target.stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::lock_guard<std::mutex> lock(target.mutex);
+            target.busy = false;
+        }
+};
+
+#endif
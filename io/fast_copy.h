@@ -0,0 +1,79 @@
+#ifndef _FAST_COPY_H_
+#define _FAST_COPY_H_
+#include "../platform/file.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+enum FastCopyResult {
+    FAST_COPY_DONE,
+    FAST_COPY_UNSUPPORTED,    // This filesystem pair can't do it, stop trying
+    FAST_COPY_FAILED          // Try the ordinary read/write path for this range
+};
+
+// Copies that never move the data through user space: a reflink clone where the filesystem
+// shares extents (btrfs, XFS), otherwise copy_file_range so the kernel copies page cache to
+// page cache or offloads to the device. Windows has no equivalent outside ReFS block
+// cloning, so both report unsupported there and the copy engine uses its buffers.
+class FastCopy {
+
+    public:
+
+        // Whole-file clone, `output` must be empty
+        static FastCopyResult Clone(File& input, File& output) {
+#if defined(__linux__) && defined(FICLONE)
+            if (ioctl(output.Native(), FICLONE, input.Native()) == 0) return FAST_COPY_DONE;
+            return Classify(errno);
+#else
+            (void)input;
+            (void)output;
+            return FAST_COPY_UNSUPPORTED;
+#endif
+        }
+
+        // Same range in both files
+        static FastCopyResult CopyRange(File& input, File& output, uint64_t offset, uint64_t length) {
+#ifdef __linux__
+            loff_t from = static_cast<loff_t>(offset);
+            loff_t to = static_cast<loff_t>(offset);
+            while (length > 0) {
+                ssize_t copied = copy_file_range(input.Native(), &from, output.Native(), &to,
+                    static_cast<size_t>(std::min<uint64_t>(length, 1ULL << 30)), 0);
+                if (copied < 0) {
+                    if (errno == EINTR) continue;
+                    // Only "unsupported" if nothing was copied yet, a partial copy is just redone
+                    return static_cast<uint64_t>(from) == offset ? Classify(errno) : FAST_COPY_FAILED;
+                }
+                if (copied == 0) return FAST_COPY_FAILED;   // Source shorter than expected
+                length -= static_cast<uint64_t>(copied);
+            }
+            return FAST_COPY_DONE;
+#else
+            (void)input;
+            (void)output;
+            (void)offset;
+            (void)length;
+            return FAST_COPY_UNSUPPORTED;
+#endif
+        }
+
+    private:
+
+        static FastCopyResult Classify(int code) {
+            switch (code) {
+                case EXDEV:
+                case EINVAL:
+                case ENOSYS:
+                case EOPNOTSUPP:
+                case EPERM:
+                case EBADF:
+                    return FAST_COPY_UNSUPPORTED;
+                default:
+                    return FAST_COPY_FAILED;
+            }
+        }
+};
+
+#endif
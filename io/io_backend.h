@@ -0,0 +1,29 @@
+#ifndef _IO_BACKEND_H_
+#define _IO_BACKEND_H_
+#include <memory>
+#include "thread_io.h"
+#include "uring_io.h"
+#include "overlapped_io.h"
+
+// Picks the native backend for IO_AUTO and falls back to threads when it cannot be set up
+// (old kernel, io_uring disabled by sysctl or a container's seccomp profile)
+inline std::unique_ptr<AsyncIo> CreateAsyncIo(const IoOptions& options) {
+#ifdef __linux__
+    if (options.backend == IO_AUTO || options.backend == IO_URING) {
+        auto uring = std::make_unique<UringIo>();
+        if (uring->Open(options)) return uring;
+        if (options.backend == IO_URING) return nullptr;
+    }
+#endif
+#ifdef _WIN32
+    if (options.backend == IO_AUTO || options.backend == IO_OVERLAPPED) {
+        auto overlapped = std::make_unique<OverlappedIo>();
+        if (overlapped->Open(options)) return overlapped;
+        if (options.backend == IO_OVERLAPPED) return nullptr;
+    }
+#endif
+    if (options.backend != IO_AUTO && options.backend != IO_THREADS) return nullptr;
+    return std::make_unique<ThreadIo>(options);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef _OVERLAPPED_IO_H_
+#define _OVERLAPPED_IO_H_
+#include "async_io.h"
+
+#ifdef _WIN32
+#include <unordered_set>
+
+// Overlapped ReadFile/WriteFile completing on a private I/O completion port. Files must be
+// opened with File::ASYNC; each handle is bound to the port the first time it is used.
+class OverlappedIo : public AsyncIo {
+
+    public:
+
+        OverlappedIo() = default;
+
+        ~OverlappedIo() override { Close(); }
+
+        OverlappedIo(const OverlappedIo&) = delete;
+        OverlappedIo& operator=(const OverlappedIo&) = delete;
+
+        bool Open(const IoOptions& options) {
+            Close();
+            port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            if (!port) {
+                error = L"CreateIoCompletionPort failed: " + std::to_wstring(GetLastError());
+                return false;
+            }
+            slots.assign(std::max<size_t>(1, options.queueDepth), Slot());
+            freeSlots.clear();
+            for (size_t i = slots.size(); i > 0; --i) freeSlots.push_back(i - 1);
+            return true;
+        }
+
+        void Close() {
+            if (port) CloseHandle(port);
+            port = NULL;
+            associated.clear();
+        }
+
+        bool Submit(const IoRequest& request) override {
+            if (!port || freeSlots.empty()) return false;
+            HANDLE handle = request.file->Native();
+            if (!associated.count(handle)) {
+                if (!CreateIoCompletionPort(handle, port, 0, 0)) {
+                    error = L"Cannot bind handle to completion port: " + std::to_wstring(GetLastError());
+                    return false;
+                }
+                associated.insert(handle);
+            }
+
+            size_t index = freeSlots.back();
+            freeSlots.pop_back();
+            Slot& slot = slots[index];
+            std::memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+            slot.overlapped.Offset = static_cast<DWORD>(request.offset);
+            slot.overlapped.OffsetHigh = static_cast<DWORD>(request.offset >> 32);
+            slot.tag = request.tag;
+
+            DWORD length = static_cast<DWORD>(request.length);
+            BOOL ok = request.op == IoRequest::READ
+                ? ReadFile(handle, request.buffer, length, NULL, &slot.overlapped)
+                : WriteFile(handle, request.buffer, length, NULL, &slot.overlapped);
+            if (!ok && GetLastError() != ERROR_IO_PENDING) {
+                // Failed synchronously, nothing will be queued on the port for it
+                DWORD code = GetLastError();
+                failed.push_back(IoCompletion{ request.tag, code == ERROR_HANDLE_EOF ? 0 : -static_cast<int64_t>(code) });
+                freeSlots.push_back(index);
+            }
+            return true;
+        }
+
+        // ReadFile/WriteFile already started the transfer
+        bool Flush() override { return true; }
+
+        size_t Reap(std::vector<IoCompletion>& completions, size_t minimum) override {
+            size_t count = failed.size();
+            completions.insert(completions.end(), failed.begin(), failed.end());
+            failed.clear();
+            minimum = std::min(minimum, count + InFlight());
+            OVERLAPPED_ENTRY entries[64];
+            while (InFlight() > 0) {
+                ULONG removed = 0;
+                if (!GetQueuedCompletionStatusEx(port, entries, 64, &removed, count >= minimum ? 0 : INFINITE, FALSE)) {
+                    if (GetLastError() != WAIT_TIMEOUT) error = L"GetQueuedCompletionStatusEx failed: " + std::to_wstring(GetLastError());
+                    break;
+                }
+                for (ULONG i = 0; i < removed; ++i) {
+                    Slot* slot = CONTAINING_RECORD(entries[i].lpOverlapped, Slot, overlapped);
+                    // Internal holds the NTSTATUS; STATUS_END_OF_FILE is a zero byte read, not an error
+                    ULONG_PTR status = slot->overlapped.Internal;
+                    int64_t result = static_cast<int64_t>(entries[i].dwNumberOfBytesTransferred);
+                    if (status != 0 && status != 0xC0000011 && result == 0) result = -1;
+                    completions.push_back(IoCompletion{ slot->tag, result });
+                    freeSlots.push_back(static_cast<size_t>(slot - slots.data()));
+                    count++;
+                }
+                if (count >= minimum) break;
+            }
+            return count;
+        }
+
+        IoBackendKind Kind() const override { return IO_OVERLAPPED; }
+        size_t InFlight() const override { return slots.size() - freeSlots.size(); }
+
+    private:
+
+        struct Slot {
+            OVERLAPPED overlapped = {};
+            uint64_t tag = 0;
+        };
+
+        HANDLE port = NULL;
+        std::vector<Slot> slots;
+        std::vector<size_t> freeSlots;
+        std::vector<IoCompletion> failed;
+        std::unordered_set<HANDLE> associated;
+};
+#endif
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef _STREAM_COPY_H_
+#define _STREAM_COPY_H_
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include "async_io.h"
+#include "zero_scan.h"
+
+struct IoRange {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+struct StreamStats {
+    uint64_t bytes = 0;                // Written
+    uint64_t zeroBytes = 0;            // Read as zeros and skipped or discarded instead of written
+    uint64_t requests = 0;
+    double seconds = 0;
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+};
+
+// Keeps queueDepth block-sized requests in flight between two files (or a file and a device)
+// through an AsyncIo backend. Each slot owns an aligned buffer and cycles read -> write ->
+// next read, so the device always has a full queue instead of one buffer at a time.
+// Unless options.zeros says to write them, zero 4 KiB granules at either end of a block are
+// cut off its write, and a block that is all zeros is not written at all.
+class StreamCopier {
+
+    public:
+
+        static constexpr size_t ALIGNMENT = 4096;
+
+        StreamCopier(AsyncIo& backend, const IoOptions& ioOptions) : io(backend), options(ioOptions) {
+            options.blockSize = std::max<size_t>(ALIGNMENT, (options.blockSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+            size_t count = std::max<size_t>(1, options.queueDepth);
+            std::vector<std::pair<void*, size_t>> registered;
+            for (size_t i = 0; i < count; ++i) {
+                slots.emplace_back();
+                slots.back().buffer.reset(static_cast<uint8_t*>(operator new[](options.blockSize, std::align_val_t(ALIGNMENT))));
+                registered.emplace_back(slots.back().buffer.get(), options.blockSize);
+            }
+            registeredBuffers = io.RegisterBuffers(registered);
+        }
+
+        // Copies [offset, offset + length) of `input` to the same range of `output`
+        bool Copy(File& input, File& output, uint64_t offset, uint64_t length) {
+            return CopyRanges(input, output, { IoRange{ offset, length } });
+        }
+
+        // Copies every range of `input` to `output` at range.offset + shift, in order, without
+        // draining the queue between ranges. With a DIRECT output the offsets must be aligned;
+        // an unaligned tail is written padded and the file trimmed afterwards.
+        bool CopyRanges(File& input, File& output, const std::vector<IoRange>& ranges, int64_t shift = 0) {
+            stats = StreamStats();
+            error.clear();
+            auto start = std::chrono::steady_clock::now();
+            size_t range = 0;
+            uint64_t next = 0;       // Progress inside ranges[range]
+            uint64_t end = 0;
+            size_t active = 0;
+            bool failed = false;
+            bool padded = false;
+            for (const auto& item : ranges) end = std::max(end, item.offset + item.length);
+
+            auto more = [&] {
+                while (range < ranges.size() && next >= ranges[range].length) {
+                    range++;
+                    next = 0;
+                }
+                return range < ranges.size();
+            };
+            auto startRead = [&](size_t index) {
+                Slot& slot = slots[index];
+                slot.writing = false;
+                slot.offset = ranges[range].offset + next;
+                slot.target = slot.offset + shift;
+                slot.length = static_cast<size_t>(std::min<uint64_t>(options.blockSize, ranges[range].length - next));
+                next += slot.length;
+                return Queue(IoRequest::READ, input, index);
+            };
+
+            for (size_t i = 0; i < slots.size() && more(); ++i, ++active) {
+                if (!startRead(i)) {
+                    Fail(L"Cannot queue read");
+                    failed = true;
+                    break;
+                }
+            }
+            io.Flush();
+
+            std::vector<IoCompletion> completions;
+            while (active > 0) {
+                completions.clear();
+                if (io.Reap(completions, 1) == 0) {
+                    // Nothing can complete anymore; the buffers are no longer referenced by the kernel
+                    return Fail(io.Error().empty() ? L"I/O backend stalled" : io.Error());
+                }
+                for (const auto& completion : completions) {
+                    size_t index = static_cast<size_t>(completion.tag);
+                    Slot& slot = slots[index];
+                    stats.requests++;
+                    if (!slot.writing) {
+                        if (completion.result != static_cast<int64_t>(slot.length) || failed) {
+                            if (!failed) error = L"Read failed at offset " + std::to_wstring(slot.offset);
+                            failed = true;
+                            active--;
+                            continue;
+                        }
+                        slot.writing = true;
+                        slot.begin = 0;
+                        slot.end = slot.length;
+                        if (options.zeros != ZEROS_WRITE) SkipZeros(output, slot);
+                        if (slot.begin == slot.end) {
+                            // Nothing left to write, the slot moves on as if it had
+                            if (failed || !more()) active--;
+                            else if (!startRead(index)) {
+                                error = L"Cannot queue read";
+                                failed = true;
+                                active--;
+                            }
+                            continue;
+                        }
+                        slot.written = slot.end - slot.begin;
+                        if (options.direct && slot.written % ALIGNMENT != 0) {
+                            // Unbuffered writes must be whole sectors; zero the pad, trim afterwards
+                            size_t aligned = (slot.written + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                            std::memset(slot.buffer.get() + slot.end, 0, aligned - slot.written);
+                            slot.written = aligned;
+                            padded = true;
+                        }
+                        if (!Queue(IoRequest::WRITE, output, index)) {
+                            error = L"Cannot queue write";
+                            failed = true;
+                            active--;
+                        }
+                        continue;
+                    }
+                    if (completion.result != static_cast<int64_t>(slot.written)) {
+                        if (!failed) error = L"Write failed at offset " + std::to_wstring(slot.target + slot.begin);
+                        failed = true;
+                    }
+                    else {
+                        stats.bytes += slot.end - slot.begin;
+                    }
+                    if (failed || !more()) {
+                        active--;
+                    }
+                    else if (!startRead(index)) {
+                        error = L"Cannot queue read";
+                        failed = true;
+                        active--;
+                    }
+                }
+                io.Flush();
+            }
+
+            if (!failed && padded && !output.Resize(end + shift)) return Fail(L"Cannot trim padded tail");
+            // Skipped zeros at the end of a file that was not sized up front must still count
+            if (!failed && stats.zeroBytes > 0 && output.Size() < end + shift && !output.Resize(end + shift)) {
+                return Fail(L"Cannot extend over trailing zeros");
+            }
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return !failed;
+        }
+
+        const StreamStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+        bool RegisteredBuffers() const { return registeredBuffers; }
+
+    private:
+
+        struct AlignedDelete {
+            void operator()(uint8_t* buffer) const { operator delete[](buffer, std::align_val_t(ALIGNMENT)); }
+        };
+
+        struct Slot {
+            std::unique_ptr<uint8_t[], AlignedDelete> buffer;
+            uint64_t offset = 0;
+            uint64_t target = 0;
+            size_t length = 0;
+            size_t begin = 0;                  // Part of the block that is written, the rest is zeros
+            size_t end = 0;
+            size_t written = 0;                // end - begin, padded for DIRECT
+            bool writing = false;
+        };
+
+        AsyncIo& io;
+        IoOptions options;
+        std::vector<Slot> slots;
+        bool registeredBuffers = false;
+        StreamStats stats;
+        std::wstring error;
+
+        bool Queue(IoRequest::Op op, File& file, size_t index) {
+            Slot& slot = slots[index];
+            IoRequest request;
+            request.op = op;
+            request.file = &file;
+            request.buffer = slot.buffer.get() + (op == IoRequest::READ ? 0 : slot.begin);
+            request.length = op == IoRequest::READ ? slot.length : slot.written;
+            request.offset = op == IoRequest::READ ? slot.offset : slot.target + slot.begin;
+            request.tag = index;
+            request.bufferIndex = registeredBuffers ? static_cast<int>(index) : -1;
+            return io.Submit(request);
+        }
+
+        bool Fail(const std::wstring& message) {
+            if (error.empty()) error = message;
+            return false;
+        }
+
+        // Narrows [begin, end) to the block's non-zero granules. A target that cannot discard
+        // gets the whole block written, and zeros written from then on.
+        void SkipZeros(File& output, Slot& slot) {
+            const uint8_t* data = slot.buffer.get();
+            size_t begin = ZeroScan::ZeroPrefix(data, slot.length, ALIGNMENT);
+            size_t end = begin == slot.length ? begin : slot.length - ZeroScan::ZeroSuffix(data + begin, slot.length - begin, ALIGNMENT);
+            if (begin == 0 && end == slot.length) return;
+            if (options.zeros == ZEROS_DISCARD
+                && (!output.Discard(slot.target, begin) || !output.Discard(slot.target + end, slot.length - end))) {
+                options.zeros = ZEROS_WRITE;
+                return;
+            }
+            slot.begin = begin;
+            slot.end = end;
+            stats.zeroBytes += slot.length - (end - begin);
+        }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef _THREAD_IO_H_
+#define _THREAD_IO_H_
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "async_io.h"
+
+// Fallback backend: blocking pread/pwrite (or positional ReadFile/WriteFile) on a few
+// threads. Used where io_uring is missing or blocked by seccomp, and in tests.
+class ThreadIo : public AsyncIo {
+
+    public:
+
+        explicit ThreadIo(const IoOptions& options) : depth(std::max<size_t>(1, options.queueDepth)) {
+            size_t threads = std::max<size_t>(1, std::min(options.threads, depth));
+            for (size_t i = 0; i < threads; ++i) workers.emplace_back(&ThreadIo::Worker, this);
+        }
+
+        ~ThreadIo() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queuedSignal.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        bool Submit(const IoRequest& request) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (inFlight >= depth) return false;
+            inFlight++;
+            staged.push_back(request);
+            return true;
+        }
+
+        bool Flush() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (staged.empty()) return true;
+                queued.insert(queued.end(), staged.begin(), staged.end());
+                staged.clear();
+            }
+            queuedSignal.notify_all();
+            return true;
+        }
+
+        size_t Reap(std::vector<IoCompletion>& completions, size_t minimum) override {
+            Flush();
+            std::unique_lock<std::mutex> lock(mutex);
+            completedSignal.wait(lock, [&] { return completed.size() >= std::min(minimum, inFlight); });
+            size_t count = completed.size();
+            completions.insert(completions.end(), completed.begin(), completed.end());
+            completed.clear();
+            inFlight -= count;
+            return count;
+        }
+
+        IoBackendKind Kind() const override { return IO_THREADS; }
+
+        size_t InFlight() const override {
+            std::lock_guard<std::mutex> lock(mutex);
+            return inFlight;
+        }
+
+    private:
+
+        const size_t depth;
+        std::vector<std::thread> workers;
+        mutable std::mutex mutex;
+        std::condition_variable queuedSignal;
+        std::condition_variable completedSignal;
+        std::vector<IoRequest> staged;
+        std::deque<IoRequest> queued;
+        std::vector<IoCompletion> completed;
+        size_t inFlight = 0;
+        bool stopping = false;
+
+        void Worker() {
+            for (;;) {
+                IoRequest request;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    queuedSignal.wait(lock, [&] { return stopping || !queued.empty(); });
+                    if (queued.empty()) return;
+                    request = queued.front();
+                    queued.pop_front();
+                }
+                IoCompletion completion;
+                completion.tag = request.tag;
+                if (request.op == IoRequest::READ) {
+                    size_t done = 0;
+                    completion.result = request.file->ReadAt(request.buffer, request.length, request.offset, done)
+                        ? static_cast<int64_t>(done) : -1;
+                }
+                else {
+                    completion.result = request.file->WriteAt(request.buffer, request.length, request.offset)
+                        ? static_cast<int64_t>(request.length) : -1;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    completed.push_back(completion);
+                }
+                completedSignal.notify_all();
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef _URING_IO_H_
+#define _URING_IO_H_
+#include "async_io.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// io_uring through the raw syscalls (no liburing dependency). One submission ring sized to
+// the queue depth; Flush() is a single io_uring_enter for everything queued since the last
+// one, Reap() drains the completion ring and only enters the kernel when it has to wait.
+class UringIo : public AsyncIo {
+
+    public:
+
+        UringIo() = default;
+
+        ~UringIo() override { Close(); }
+
+        UringIo(const UringIo&) = delete;
+        UringIo& operator=(const UringIo&) = delete;
+
+        bool Open(const IoOptions& options) {
+            Close();
+            depth = std::max<size_t>(1, options.queueDepth);
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+            if (ring < 0) {
+                error = L"io_uring_setup failed: errno " + std::to_wstring(errno);
+                ring = -1;
+                return false;
+            }
+            depth = std::min<size_t>(depth, params.sq_entries);
+
+            sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+            sqMap = Map(sqSize, IORING_OFF_SQ_RING);
+            cqMap = single ? sqMap : Map(cqSize, IORING_OFF_CQ_RING);
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(Map(sqesSize, IORING_OFF_SQES));
+            if (!sqMap || !cqMap || !sqes) {
+                error = L"io_uring ring mmap failed";
+                Close();
+                return false;
+            }
+
+            uint8_t* sq = static_cast<uint8_t*>(sqMap);
+            sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            uint8_t* cq = static_cast<uint8_t*>(cqMap);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        void Close() {
+            if (sqes) munmap(sqes, sqesSize);
+            if (cqMap && cqMap != sqMap) munmap(cqMap, cqSize);
+            if (sqMap) munmap(sqMap, sqSize);
+            if (ring >= 0) ::close(ring);
+            sqes = nullptr;
+            sqMap = cqMap = nullptr;
+            ring = -1;
+            inFlight = unsubmitted = 0;
+        }
+
+        bool Submit(const IoRequest& request) override {
+            if (ring < 0 || inFlight >= depth) return false;
+            unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > sqMask) return false;
+            unsigned index = tail & sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            bool fixed = request.bufferIndex >= 0;
+            if (request.op == IoRequest::READ) sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            else sqe.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe.fd = request.file->Native();
+            sqe.off = request.offset;
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe.len = static_cast<uint32_t>(request.length);
+            sqe.user_data = request.tag;
+            if (fixed) sqe.buf_index = static_cast<uint16_t>(request.bufferIndex);
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            inFlight++;
+            unsubmitted++;
+            return true;
+        }
+
+        bool Flush() override {
+            while (unsubmitted > 0) {
+                int submitted = Enter(unsubmitted, 0, 0);
+                if (submitted < 0) {
+                    if (errno == EINTR || errno == EAGAIN) continue;
+                    error = L"io_uring_enter failed: errno " + std::to_wstring(errno);
+                    return false;
+                }
+                unsubmitted -= std::min<size_t>(unsubmitted, static_cast<size_t>(submitted));
+            }
+            return true;
+        }
+
+        size_t Reap(std::vector<IoCompletion>& completions, size_t minimum) override {
+            if (!Flush()) return 0;
+            minimum = std::min(minimum, inFlight);
+            size_t count = 0;
+            for (;;) {
+                unsigned head = *cqHead;
+                unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail; ++head, ++count) {
+                    const io_uring_cqe& cqe = cqes[head & cqMask];
+                    completions.push_back(IoCompletion{ cqe.user_data, cqe.res });
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+                if (count >= minimum) break;
+                if (Enter(0, static_cast<unsigned>(minimum - count), IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                    error = L"io_uring_enter failed: errno " + std::to_wstring(errno);
+                    break;
+                }
+            }
+            inFlight -= count;
+            return count;
+        }
+
+        bool RegisterBuffers(const std::vector<std::pair<void*, size_t>>& buffers) override {
+            std::vector<iovec> vectors;
+            for (const auto& buffer : buffers) vectors.push_back(iovec{ buffer.first, buffer.second });
+            return ring >= 0 && syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS,
+                vectors.data(), static_cast<unsigned>(vectors.size())) == 0;
+        }
+
+        IoBackendKind Kind() const override { return IO_URING; }
+        size_t InFlight() const override { return inFlight; }
+
+    private:
+
+        int ring = -1;
+        size_t depth = 0;
+        size_t inFlight = 0;
+        size_t unsubmitted = 0;
+        void* sqMap = nullptr;
+        void* cqMap = nullptr;
+        size_t sqSize = 0;
+        size_t cqSize = 0;
+        size_t sqesSize = 0;
+        io_uring_sqe* sqes = nullptr;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        void* Map(size_t size, uint64_t offset) {
+            void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, static_cast<off_t>(offset));
+            return view == MAP_FAILED ? nullptr : view;
+        }
+
+        int Enter(size_t submit, unsigned wait, unsigned flags) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, ring, static_cast<unsigned>(submit), wait, flags, nullptr, 0));
+        }
+};
+#endif
+
+#endif
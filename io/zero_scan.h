@@ -0,0 +1,162 @@
+#ifndef _ZERO_SCAN_H_
+#define _ZERO_SCAN_H_
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZERO_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ZERO_SCAN_TARGET
+#else
+#include <cpuid.h>
+#define ZERO_SCAN_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ZERO_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+// All-zero test for blocks on their way to a target, so they can become holes or discards
+// instead of writes. Zero blocks are scanned to the end and non-zero ones usually fail on
+// the first cache line, so the cost that matters is the full scan: OR-folding 256 bytes
+// between branches keeps it at memory bandwidth. Kernels, picked once at runtime:
+//   avx2    eight 32-byte loads per test, vptest
+//   neon    sixteen 16-byte loads per test, horizontal max
+//   scalar  32 words per test; compilers vectorize it to SSE2 on any x86-64
+class ZeroScan {
+
+    public:
+
+        enum Kernel {
+            KERNEL_SCALAR,
+            KERNEL_SIMD
+        };
+
+        static bool IsZero(const void* data, size_t length) { return IsZero(data, length, SimdAvailable() ? KERNEL_SIMD : KERNEL_SCALAR); }
+
+        // Explicit kernel, for the benchmark; KERNEL_SIMD falls back to scalar where missing
+        static bool IsZero(const void* data, size_t length, Kernel kernel) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(ZERO_SCAN_X86) || defined(ZERO_SCAN_NEON)
+            if (kernel == KERNEL_SIMD && SimdAvailable()) return Simd(p, length);
+#endif
+            (void)kernel;
+            return Scalar(p, length);
+        }
+
+        // Bytes of whole zero `granule`s at the start of the block; all of it when it is all zero
+        static size_t ZeroPrefix(const uint8_t* data, size_t length, size_t granule) {
+            size_t at = 0;
+            while (at < length && IsZero(data + at, std::min(granule, length - at))) at += std::min(granule, length - at);
+            return at;
+        }
+
+        // Bytes of zero granules at the end, granules counted from the start so they stay aligned
+        static size_t ZeroSuffix(const uint8_t* data, size_t length, size_t granule) {
+            size_t end = length;
+            while (end > 0) {
+                size_t begin = (end - 1) / granule * granule;
+                if (!IsZero(data + begin, end - begin)) break;
+                end = begin;
+            }
+            return length - end;
+        }
+
+        static bool SimdAvailable() {
+#if defined(ZERO_SCAN_X86)
+            static const bool available = [] {
+#ifdef _MSC_VER
+                int info[4];
+                __cpuid(info, 1);
+                bool osxsave = (info[2] & (1 << 27)) != 0;
+                __cpuidex(info, 7, 0);
+                return osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+                unsigned eax, ebx, ecx, edx;
+                if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)) return false;
+                unsigned low, high;
+                __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+                if ((low & 6) != 6) return false;    // OS saves the YMM registers
+                return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2) != 0;
+#endif
+            }();
+            return available;
+#elif defined(ZERO_SCAN_NEON)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        static const wchar_t* KernelName(Kernel kernel) {
+            if (kernel == KERNEL_SCALAR || !SimdAvailable()) return L"scalar";
+#if defined(ZERO_SCAN_NEON)
+            return L"neon";
+#else
+            return L"avx2";
+#endif
+        }
+
+    private:
+
+        static constexpr size_t STEP = 128;                 // Half the bytes folded per test
+
+        static bool Scalar(const uint8_t* p, size_t length) {
+            for (; length >= 2 * STEP; p += 2 * STEP, length -= 2 * STEP) {
+                uint64_t words[2 * STEP / 8];
+                std::memcpy(words, p, sizeof(words));
+                uint64_t any = 0;
+                for (uint64_t word : words) any |= word;
+                if (any) return false;
+            }
+            return Tail(p, length);
+        }
+
+        static bool Tail(const uint8_t* p, size_t length) {
+            uint64_t any = 0;
+            for (; length >= 8; p += 8, length -= 8) {
+                uint64_t word;
+                std::memcpy(&word, p, 8);
+                any |= word;
+            }
+            for (; length > 0; ++p, --length) any |= *p;
+            return any == 0;
+        }
+
+#if defined(ZERO_SCAN_X86)
+        ZERO_SCAN_TARGET static bool Simd(const uint8_t* p, size_t length) {
+            for (; length >= 2 * STEP; p += 2 * STEP, length -= 2 * STEP) {
+                __m256i any = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32))),
+                    _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96))));
+                any = _mm256_or_si256(any, _mm256_or_si256(
+                    _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 128)),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 160))),
+                    _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 192)),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 224)))));
+                if (!_mm256_testz_si256(any, any)) return false;
+            }
+            return Tail(p, length);
+        }
+#elif defined(ZERO_SCAN_NEON)
+        static bool Simd(const uint8_t* p, size_t length) {
+            for (; length >= 2 * STEP; p += 2 * STEP, length -= 2 * STEP) {
+                uint8x16_t any = vdupq_n_u8(0);
+                for (size_t i = 0; i < 2 * STEP; i += 64) {
+                    any = vorrq_u8(any, vorrq_u8(vorrq_u8(vld1q_u8(p + i), vld1q_u8(p + i + 16)),
+                                                 vorrq_u8(vld1q_u8(p + i + 32), vld1q_u8(p + i + 48))));
+                }
+                if (vmaxvq_u32(vreinterpretq_u32_u8(any)) != 0) return false;
+            }
+            return Tail(p, length);
+        }
+#endif
+};
+
+#endif
@@ -1,33 +1,56 @@
-#include "windows.h"
+#include "windows/WindowsToGo.h"
 #include <iostream>
 #include <string>
 #include <vector>
 
 int main() {
-    std::wstring drive, wimPath;
+    std::wstring drives, wimPath, copyMode, compression;
     
     std::wcout << L"Windows To Go USB Creator" << std::endl;
     std::wcout << L"=========================" << std::endl;
     std::wcout << L"Warning: This will erase all data on the target USB drive!" << std::endl;
     std::wcout << std::endl;
     
-    std::wcout << L"Enter USB drive's Letter:";
-    std::wcin >> drive;
+    std::wcout << L"Enter USB drive's Letter (several separated by commas, e.g. E:,F:,G:):";
+    std::wcin >> drives;
     
     std::wcout << L"Enter path to Windows Operating System Letter:";
     std::wcin >> wimPath;
+
+    std::wcout << L"Copy mode (files, blocks, resync, vhdx):";
+    std::wcin >> copyMode;
+
+    std::wcout << L"Compress system files (none, xpress4k, xpress8k, xpress16k, lzx):";
+    std::wcin >> compression;
     
     // Verify inputs
-    if (drive.length() < 2 || drive[1] != L':') {
-        std::wcerr << L"Invalid drive format. Use format like E:" << std::endl;
+    std::vector<std::wstring> batch;
+    for (size_t start = 0; start <= drives.size(); ) {
+        size_t comma = std::min(drives.find(L',', start), drives.size());
+        std::wstring drive = drives.substr(start, comma - start);
+        if (drive.length() < 2 || drive[1] != L':') {
+            std::wcerr << L"Invalid drive format. Use format like E:" << std::endl;
+            return 1;
+        }
+        batch.push_back(drive);
+        start = comma + 1;
+    }
+    CopyMode mode = COPY_FILES;
+    if (!ParseCopyMode(copyMode, mode)) {
+        std::wcerr << L"Unknown copy mode " << copyMode << std::endl;
+        return 1;
+    }
+    WofFormat format = WOF_NONE;
+    if (!WofCodec::Parse(compression, format)) {
+        std::wcerr << L"Unknown compression " << compression << std::endl;
         return 1;
     }
 
     std::wcout << L"Starting creation process..." << std::endl;
     std::wcout << L"This may take 15-30 minutes depending on USB speed." << std::endl;
     
-    WindowsToGoCreator creator(drive, wimPath);
-    creator.
+    // The creator runs every stage from its constructor and reports through the progress channel
+    WindowsToGoCreator creator(batch, wimPath, mode, 1, format);
     
     return 0;
 }
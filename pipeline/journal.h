@@ -0,0 +1,414 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../hash/crc32c.h"
+#include "../hash/xxhash.h"
+#include "../platform/file.h"
+
+// A file finished in an earlier run: what its source looked like, and the chunk hashes a
+// manifest needs if `hash` names a kind (NO_HASH when it went through a fast path)
+struct JournalFile {
+    uint64_t size = 0;
+    int64_t sourceTime = 0;
+    uint8_t hash = 0;
+    std::vector<uint64_t> chunks;
+};
+
+// One finished chunk of a large file
+struct JournalChunk {
+    uint32_t length = 0;
+    uint8_t hash = 0;
+    uint64_t value = 0;
+};
+
+struct JournalStats {
+    uint64_t replayed = 0;                 // Records read back from an earlier run
+    uint64_t tornBytes = 0;                // Cut off its end: a record the crash left half written
+    uint64_t appended = 0;                 // Records this run
+    uint64_t commits = 0;
+    uint64_t bytes = 0;                    // Written this run
+    double commitSeconds = 0;              // Spent flushing and writing, off the copy's threads
+
+    std::wstring ToString() const {
+        return std::to_wstring(replayed) + L" record(s) replayed" + (tornBytes ? L" (" + std::to_wstring(tornBytes) + L" torn bytes cut)" : L"")
+            + L", " + std::to_wstring(appended) + L" appended in " + std::to_wstring(commits) + L" commit(s), "
+            + std::to_wstring(bytes / 1024) + L" KB, " + std::to_wstring(commitSeconds) + L" s committing";
+    }
+};
+
+// Append-only checkpoint log of a run, so an interrupted run continues where it stopped.
+// Stages, files and chunk or block ranges are recorded as they finish; appending only
+// copies into a buffer. A committer thread writes the buffer out in groups (every
+// groupSeconds, or sooner once groupBytes are pending) behind a single flush, so the cost
+// is one sync per group rather than one per file. A record must never be durable before
+// the data it vouches for: with `flushData` each commit first flushes the filesystem the
+// journal is on, which covers every file written before the records were appended.
+//   header: "WTGJRNL1", u32 version, u32 reserved, u64 XXH64 of the run's identity
+//   record: u32 payload length, u8 type, payload, u32 CRC-32C of type and payload
+// Open() replays records up to the first one that does not check out and cuts the file
+// there, which is what a crash in the middle of a commit leaves behind.
+class Journal {
+
+    public:
+
+        static constexpr const char* FILE_NAME = ".wtg_journal";
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint8_t NO_HASH = 0xFF;
+
+        enum RecordType : uint8_t {
+            RECORD_STAGE = 1,                  // name
+            RECORD_FILE = 2,                   // key, size, source time, hash kind, chunk hashes
+            RECORD_CHUNK = 3,                  // key, size, source time, offset, length, hash kind, hash
+            RECORD_RANGE = 4                   // offset, length
+        };
+
+        explicit Journal(size_t groupBytes = 64 << 10, double groupSeconds = 0.5) : groupLimit(groupBytes), groupInterval(groupSeconds) {}
+        ~Journal() { Close(); }
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        // Opens `path`, or creates it. A journal written for another `identity` (other source,
+        // mode or options) is started over.
+        bool Open(const std::filesystem::path& path, const std::string& identity, bool flushData) {
+            return Open(path, XxHash64::Hash(identity.data(), identity.size()), flushData);
+        }
+
+        // Whether `path` holds a journal of the run with this `identity`, without opening it
+        static bool Matches(const std::filesystem::path& path, const std::string& identity) {
+            File input;
+            uint8_t header[HEADER_SIZE];
+            size_t got = 0;
+            return input.Open(path, File::READ) && input.ReadAt(header, sizeof(header), 0, got) && got == sizeof(header)
+                && std::memcmp(header, "WTGJRNL1", 8) == 0 && Get<uint32_t>(header + 8) == VERSION
+                && Get<uint64_t>(header + 16) == XxHash64::Hash(identity.data(), identity.size());
+        }
+
+        // Carries the journal and what it recorded to `path`, off a volume that is about to be
+        // cloned; commits go on there. On failure the old file may still be in place.
+        bool Move(const std::filesystem::path& path, bool flushData) {
+            Close();
+            std::error_code ec;
+            std::filesystem::copy_file(location, path, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec) {
+                error = L"Cannot move journal to " + path.wstring();
+                return false;
+            }
+            std::filesystem::remove(location, ec);
+            return Open(path, id, flushData);
+        }
+
+        // Commits what is pending and stops the committer
+        void Close() {
+            if (committer.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_one();
+                committer.join();
+                Commit();
+            }
+            file.Close();
+        }
+
+        // For a run that finished: the next one starts from scratch
+        bool Remove() {
+            Close();
+            std::error_code ec;
+            return std::filesystem::remove(location, ec) || !std::filesystem::exists(location, ec);
+        }
+
+        bool IsOpen() const { return file.IsOpen(); }
+        bool Resumed() const { return stats.replayed > 0; }
+
+        // What earlier runs finished; fixed once Open() returns, so safe from any thread
+        bool StageDone(const std::string& name) const { return stages.count(name) != 0; }
+
+        const JournalFile* FileDone(const std::string& key) const {
+            auto it = files.find(key);
+            return it == files.end() ? nullptr : &it->second;
+        }
+
+        // Chunks of `key` finished while the source had this size and time, by offset
+        std::map<uint64_t, JournalChunk> Chunks(const std::string& key, uint64_t size, int64_t sourceTime) const {
+            auto it = chunks.find(key);
+            if (it == chunks.end() || it->second.size != size || it->second.sourceTime != sourceTime) return {};
+            return it->second.done;
+        }
+
+        bool RangeDone(uint64_t offset, uint64_t length) const { return ranges.count(std::make_pair(offset, length)) != 0; }
+
+        // A stage is a point a restart skips to, so it is committed before this returns
+        bool RecordStage(const std::string& name) {
+            std::vector<uint8_t> payload;
+            PutString(payload, name);
+            Append(RECORD_STAGE, payload);
+            return Commit();
+        }
+
+        void RecordFile(const std::string& key, const JournalFile& entry) {
+            std::vector<uint8_t> payload;
+            PutString(payload, key);
+            Put(payload, entry.size);
+            Put(payload, entry.sourceTime);
+            payload.push_back(entry.hash);
+            Put(payload, static_cast<uint32_t>(entry.chunks.size()));
+            for (uint64_t value : entry.chunks) Put(payload, value);
+            Append(RECORD_FILE, payload);
+        }
+
+        void RecordChunk(const std::string& key, uint64_t size, int64_t sourceTime, uint64_t offset, const JournalChunk& chunk) {
+            std::vector<uint8_t> payload;
+            PutString(payload, key);
+            Put(payload, size);
+            Put(payload, sourceTime);
+            Put(payload, offset);
+            Put(payload, chunk.length);
+            payload.push_back(chunk.hash);
+            Put(payload, chunk.value);
+            Append(RECORD_CHUNK, payload);
+        }
+
+        void RecordRange(uint64_t offset, uint64_t length, bool commit) {
+            std::vector<uint8_t> payload;
+            Put(payload, offset);
+            Put(payload, length);
+            Append(RECORD_RANGE, payload);
+            if (commit) Commit();
+        }
+
+        // Writes out everything appended so far, after flushing the data it describes
+        bool Commit() {
+            std::lock_guard<std::mutex> commitLock(commitMutex);
+            std::vector<uint8_t> batch;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch.swap(pending);
+            }
+            if (batch.empty() || failed || !file.IsOpen()) return !failed;
+            auto start = std::chrono::steady_clock::now();
+            if ((flush && !file.SyncFilesystem()) || !file.WriteAt(batch.data(), batch.size(), end) || !file.Sync()) {
+                // Further records could claim data a lost batch depended on; stop recording
+                failed = true;
+                error = L"Cannot commit journal " + location.wstring() + L": " + file.Error();
+                return false;
+            }
+            end += batch.size();
+            stats.commits++;
+            stats.bytes += batch.size();
+            stats.commitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        const JournalStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        // The run's identity already hashed, for Move
+        bool Open(const std::filesystem::path& path, uint64_t identity, bool flushData) {
+            Close();
+            stats = JournalStats();
+            error.clear();
+            failed = false;
+            stages.clear();
+            files.clear();
+            chunks.clear();
+            ranges.clear();
+            location = path;
+            flush = flushData;
+            id = identity;
+
+            std::error_code ec;
+            bool existing = std::filesystem::exists(path, ec);
+            if (!file.Open(path, existing ? File::UPDATE : File::WRITE)) {
+                error = file.Error();
+                return false;
+            }
+            end = 0;
+            if (existing && !Replay(id)) {
+                // Not ours or unreadable from the start: nothing to resume
+                stages.clear();
+                files.clear();
+                chunks.clear();
+                ranges.clear();
+                stats.replayed = 0;
+                end = 0;
+            }
+            if (end == 0) {
+                std::vector<uint8_t> header(8);
+                std::memcpy(header.data(), "WTGJRNL1", 8);
+                Put(header, VERSION);
+                Put(header, static_cast<uint32_t>(0));
+                Put(header, id);
+                if (!file.Resize(0) || !file.WriteAt(header.data(), header.size(), 0) || !file.Sync()) {
+                    error = L"Cannot write journal " + path.wstring();
+                    file.Close();
+                    return false;
+                }
+                end = header.size();
+            }
+            stopping = false;
+            committer = std::thread([this] { Run(); });
+            return true;
+        }
+
+        struct ChunkSet {
+            uint64_t size = 0;
+            int64_t sourceTime = 0;
+            std::map<uint64_t, JournalChunk> done;
+        };
+
+        static constexpr size_t HEADER_SIZE = 24;
+
+        size_t groupLimit;
+        double groupInterval;
+        File file;
+        std::filesystem::path location;
+        uint64_t id = 0;                       // XXH64 of the run's identity
+        bool flush = false;
+        uint64_t end = 0;                      // Where the next batch goes
+        std::mutex mutex;                      // Guards pending and stopping
+        std::mutex commitMutex;                // One batch at a time, in order
+        std::condition_variable wake;
+        std::vector<uint8_t> pending;
+        bool stopping = false;
+        std::thread committer;
+        std::atomic<bool> failed{ false };
+        std::set<std::string> stages;
+        std::unordered_map<std::string, JournalFile> files;
+        std::unordered_map<std::string, ChunkSet> chunks;
+        std::set<std::pair<uint64_t, uint64_t>> ranges;
+        JournalStats stats;
+        std::wstring error;
+
+        void Run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping) {
+                wake.wait_for(lock, std::chrono::duration<double>(groupInterval), [this] { return stopping || pending.size() >= groupLimit; });
+                if (pending.empty() || stopping) continue;
+                lock.unlock();
+                Commit();
+                lock.lock();
+            }
+        }
+
+        void Append(RecordType type, const std::vector<uint8_t>& payload) {
+            size_t size;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t start = pending.size();
+                Put(pending, static_cast<uint32_t>(payload.size()));
+                pending.push_back(type);
+                pending.insert(pending.end(), payload.begin(), payload.end());
+                Put(pending, Crc32c::Of(pending.data() + start + 4, payload.size() + 1));
+                stats.appended++;
+                size = pending.size();
+            }
+            if (size >= groupLimit) wake.notify_one();
+        }
+
+        // Loads the records of an earlier run; false if the header is not this run's
+        bool Replay(uint64_t id) {
+            uint64_t size = file.Size();
+            std::vector<uint8_t> image(static_cast<size_t>(size));
+            size_t got = 0;
+            if (size < HEADER_SIZE || !file.ReadAt(image.data(), image.size(), 0, got) || got != image.size()
+                || std::memcmp(image.data(), "WTGJRNL1", 8) != 0 || Get<uint32_t>(image.data() + 8) != VERSION
+                || Get<uint64_t>(image.data() + 16) != id) {
+                return false;
+            }
+            size_t at = HEADER_SIZE;
+            while (at + 9 <= image.size()) {
+                uint32_t length = Get<uint32_t>(image.data() + at);
+                if (image.size() - at - 9 < length) break;
+                const uint8_t* record = image.data() + at + 4;
+                if (Crc32c::Of(record, length + 1) != Get<uint32_t>(record + length + 1)) break;
+                if (!Load(static_cast<RecordType>(record[0]), record + 1, length)) break;
+                stats.replayed++;
+                at += 9 + length;
+            }
+            end = at;
+            stats.tornBytes = image.size() - at;
+            if (stats.tornBytes && !file.Resize(end)) return false;
+            return true;
+        }
+
+        bool Load(RecordType type, const uint8_t* payload, size_t length) {
+            size_t at = 0;
+            auto need = [&](size_t bytes) { return length - at >= bytes; };
+            std::string key;
+            if (type != RECORD_RANGE) {
+                if (!need(4) || length - at - 4 < Get<uint32_t>(payload)) return false;
+                key.assign(reinterpret_cast<const char*>(payload + 4), Get<uint32_t>(payload));
+                at = 4 + key.size();
+            }
+            switch (type) {
+                case RECORD_STAGE:
+                    stages.insert(key);
+                    return true;
+                case RECORD_FILE: {
+                    if (!need(21)) return false;
+                    JournalFile entry;
+                    entry.size = Get<uint64_t>(payload + at);
+                    entry.sourceTime = Get<int64_t>(payload + at + 8);
+                    entry.hash = payload[at + 16];
+                    uint32_t count = Get<uint32_t>(payload + at + 17);
+                    at += 21;
+                    if ((length - at) / 8 < count) return false;
+                    for (uint32_t i = 0; i < count; ++i, at += 8) entry.chunks.push_back(Get<uint64_t>(payload + at));
+                    chunks.erase(key);
+                    files[key] = std::move(entry);
+                    return true;
+                }
+                case RECORD_CHUNK: {
+                    if (!need(37)) return false;
+                    uint64_t size = Get<uint64_t>(payload + at);
+                    int64_t sourceTime = Get<int64_t>(payload + at + 8);
+                    uint64_t offset = Get<uint64_t>(payload + at + 16);
+                    JournalChunk chunk{ Get<uint32_t>(payload + at + 24), payload[at + 28], Get<uint64_t>(payload + at + 29) };
+                    ChunkSet& set = chunks[key];
+                    // The source changed between runs: what was copied of it no longer counts
+                    if (set.size != size || set.sourceTime != sourceTime) set = ChunkSet{ size, sourceTime, {} };
+                    set.done[offset] = chunk;
+                    return true;
+                }
+                case RECORD_RANGE:
+                    if (!need(16)) return false;
+                    ranges.insert(std::make_pair(Get<uint64_t>(payload), Get<uint64_t>(payload + 8)));
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        static void PutString(std::vector<uint8_t>& out, const std::string& text) {
+            Put(out, static_cast<uint32_t>(text.size()));
+            out.insert(out.end(), text.begin(), text.end());
+        }
+
+        template <typename T>
+        static T Get(const uint8_t* p) {
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); ++i) value |= static_cast<T>(static_cast<uint64_t>(p[i]) << (8 * i));
+            return value;
+        }
+
+        template <typename T>
+        static void Put(std::vector<uint8_t>& out, T value) {
+            for (size_t i = 0; i < sizeof(T); ++i) out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef _TASK_GRAPH_H_
+#define _TASK_GRAPH_H_
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum TaskState {
+    TASK_PENDING,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_FAILED,
+    TASK_SKIPPED                                         // Cancelled before it started
+};
+
+// Runs a handful of coarse stages as soon as the stages they depend on are done, each on
+// its own thread, so stages with no data between them overlap. A stage fails by returning
+// false or throwing; that cancels the graph: nothing else starts, and stages already
+// running see Cancelled() and may stop early. Run() returns once every started stage has
+// returned. Not meant for fine-grained work, that is what WorkStealingPool is for.
+class TaskGraph {
+
+    public:
+
+        using Id = size_t;
+        using Task = std::function<bool()>;
+
+        TaskGraph() = default;
+        TaskGraph(const TaskGraph&) = delete;
+        TaskGraph& operator=(const TaskGraph&) = delete;
+
+        // Dependencies must have been added before
+        Id Add(const std::wstring& name, Task task, const std::vector<Id>& after = {}) {
+            Id id = nodes.size();
+            nodes.push_back(Node{ name, std::move(task), {}, after.size(), TASK_PENDING });
+            for (Id dependency : after) nodes[dependency].dependents.push_back(id);
+            return id;
+        }
+
+        // `threads` caps the stages running at once, 0 = no cap
+        bool Run(size_t threads = 0) {
+            if (threads == 0) threads = std::max<size_t>(1, nodes.size());
+            std::deque<Id> ready;
+            for (Id id = 0; id < nodes.size(); ++id) {
+                if (nodes[id].waiting == 0) ready.push_back(id);
+            }
+            size_t running = 0;
+            std::vector<std::thread> workers;
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                while (!ready.empty() && running < threads && !cancelled) {
+                    Id id = ready.front();
+                    ready.pop_front();
+                    nodes[id].state = TASK_RUNNING;
+                    running++;
+                    workers.emplace_back([this, id, &running, &ready] {
+                        bool ok = Execute(id);
+                        std::lock_guard<std::mutex> guard(mutex);
+                        nodes[id].state = ok ? TASK_DONE : TASK_FAILED;
+                        if (ok) {
+                            for (Id dependent : nodes[id].dependents) {
+                                if (--nodes[dependent].waiting == 0) ready.push_back(dependent);
+                            }
+                        }
+                        running--;
+                        changed.notify_all();
+                    });
+                }
+                if (running == 0 && (ready.empty() || cancelled)) break;
+                changed.wait(lock);
+            }
+            lock.unlock();
+            for (auto& worker : workers) worker.join();
+            for (auto& node : nodes) {
+                if (node.state == TASK_PENDING) node.state = TASK_SKIPPED;
+            }
+            return failed.empty() && !cancelled;
+        }
+
+        // From any thread, also from inside a stage
+        void Cancel() {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            changed.notify_all();
+        }
+
+        bool Cancelled() const { return cancelled; }
+        const std::atomic<bool>& CancelFlag() const { return cancelled; }
+        TaskState State(Id id) const { return nodes[id].state; }     // After Run()
+
+        // "<stage>: <reason>" for the first stage that failed
+        std::wstring Error() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return failed;
+        }
+
+    private:
+
+        struct Node {
+            std::wstring name;
+            Task task;
+            std::vector<Id> dependents;
+            size_t waiting;                              // Dependencies not done yet
+            TaskState state;
+        };
+
+        std::vector<Node> nodes;
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        std::atomic<bool> cancelled{ false };
+        std::wstring failed;
+
+        bool Execute(Id id) {
+            std::wstring reason;
+            try {
+                if (nodes[id].task()) return true;
+                reason = L"failed";
+            }
+            catch (const std::exception& exception) {
+                std::string what = exception.what();
+                reason = std::wstring(what.begin(), what.end());
+            }
+            catch (...) {
+                reason = L"unknown exception";
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failed.empty()) failed = nodes[id].name + L": " + reason;
+            cancelled = true;
+            changed.notify_all();
+            return false;
+        }
+};
+
+#endif
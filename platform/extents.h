@@ -0,0 +1,103 @@
+#ifndef _EXTENTS_H_
+#define _EXTENTS_H_
+#include <cstdint>
+#include <vector>
+#include "file.h"
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#endif
+
+// Where a run of a file's data lies on the disk
+struct FileExtent {
+    uint64_t logical = 0;                  // Offset in the file
+    uint64_t physical = 0;                 // Byte offset on the volume (Windows) or the filesystem's device (Linux)
+    uint64_t length = 0;
+};
+
+// Physical layout of open files, for reading them in disk order: FIEMAP on Linux,
+// FSCTL_GET_RETRIEVAL_POINTERS on Windows. Holes, data still in the page cache without
+// blocks and data kept inside the metadata (resident NTFS files, inline ext4 data) have no
+// extent; a file with none of its data on the disk yet returns true with `extents` empty.
+class FileExtents {
+
+    public:
+
+        // The first `limit` extents in file order, all of them if 0
+        static bool Query(File& file, std::vector<FileExtent>& extents, size_t limit = 0) {
+            extents.clear();
+#ifdef _WIN32
+            uint64_t cluster = ClusterSize(file);
+            if (cluster == 0) return false;
+            STARTING_VCN_INPUT_BUFFER start = {};
+            std::vector<uint8_t> buffer(16 << 10);
+            for (;;) {
+                DWORD returned = 0;
+                BOOL ok = DeviceIoControl(file.Native(), FSCTL_GET_RETRIEVAL_POINTERS, &start, sizeof(start), buffer.data(),
+                                          static_cast<DWORD>(buffer.size()), &returned, NULL);
+                DWORD status = ok ? ERROR_SUCCESS : GetLastError();
+                if (status == ERROR_HANDLE_EOF) return true;     // Resident or empty
+                if (status != ERROR_SUCCESS && status != ERROR_MORE_DATA) return false;
+                const RETRIEVAL_POINTERS_BUFFER* pointers = reinterpret_cast<const RETRIEVAL_POINTERS_BUFFER*>(buffer.data());
+                LONGLONG vcn = pointers->StartingVcn.QuadPart;
+                for (DWORD i = 0; i < pointers->ExtentCount; ++i) {
+                    LONGLONG next = pointers->Extents[i].NextVcn.QuadPart;
+                    LONGLONG lcn = pointers->Extents[i].Lcn.QuadPart;
+                    // LCN -1 is a hole, or the unused tail of a compression unit
+                    if (lcn != -1) {
+                        extents.push_back(FileExtent{ static_cast<uint64_t>(vcn) * cluster, static_cast<uint64_t>(lcn) * cluster,
+                                                      static_cast<uint64_t>(next - vcn) * cluster });
+                        if (limit && extents.size() >= limit) return true;
+                    }
+                    vcn = next;
+                }
+                if (status == ERROR_SUCCESS) return true;
+                start.StartingVcn.QuadPart = vcn;
+            }
+#elif defined(__linux__)
+            constexpr size_t BATCH = 64;
+            std::vector<uint8_t> buffer(sizeof(struct fiemap) + BATCH * sizeof(struct fiemap_extent));
+            uint64_t next = 0;
+            for (;;) {
+                std::fill(buffer.begin(), buffer.end(), 0);
+                struct fiemap* map = reinterpret_cast<struct fiemap*>(buffer.data());
+                map->fm_start = next;
+                map->fm_length = FIEMAP_MAX_OFFSET - next;
+                map->fm_extent_count = BATCH;
+                if (ioctl(file.Native(), FS_IOC_FIEMAP, map) != 0) return false;
+                if (map->fm_mapped_extents == 0) return true;
+                for (uint32_t i = 0; i < map->fm_mapped_extents; ++i) {
+                    const struct fiemap_extent& extent = map->fm_extents[i];
+                    next = extent.fe_logical + extent.fe_length;
+                    if (!(extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE))) {
+                        extents.push_back(FileExtent{ extent.fe_logical, extent.fe_physical, extent.fe_length });
+                        if (limit && extents.size() >= limit) return true;
+                    }
+                    if (extent.fe_flags & FIEMAP_EXTENT_LAST) return true;
+                }
+            }
+#else
+            (void)file;
+            (void)limit;
+            return false;
+#endif
+        }
+
+    private:
+
+#ifdef _WIN32
+        static uint64_t ClusterSize(File& file) {
+            wchar_t name[MAX_PATH];
+            DWORD length = GetFinalPathNameByHandleW(file.Native(), name, MAX_PATH, FILE_NAME_NORMALIZED | VOLUME_NAME_GUID);
+            std::wstring path(name, length < MAX_PATH ? length : 0);
+            size_t end = path.find(L'\\', 4);       // \\?\Volume{...}\ is the root
+            DWORD sectorsPerCluster = 0, bytesPerSector = 0, freeClusters = 0, clusters = 0;
+            if (end == std::wstring::npos || !GetDiskFreeSpaceW(path.substr(0, end + 1).c_str(), &sectorsPerCluster, &bytesPerSector, &freeClusters, &clusters)) {
+                return 0;
+            }
+            return static_cast<uint64_t>(sectorsPerCluster) * bytesPerSector;
+        }
+#endif
+};
+
+#endif
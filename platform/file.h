@@ -0,0 +1,329 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/falloc.h>
+#endif
+#endif
+
+// Plain file handle with positional reads and writes, so several threads can work on
+// different ranges of the same file without sharing a file pointer.
+class File {
+
+    public:
+
+        enum Mode {
+            READ,
+            WRITE,    // Create or truncate
+            UPDATE    // Existing file or device, read/write, no truncation
+        };
+
+        enum Flags {
+            DIRECT = 1,    // Bypass the page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING), offsets and lengths must be aligned
+            ASYNC = 2      // Handle is used with overlapped I/O on Windows, no effect elsewhere
+        };
+
+#ifdef _WIN32
+        using NativeHandle = HANDLE;
+#else
+        using NativeHandle = int;
+#endif
+
+        File() = default;
+        ~File() { Close(); }
+
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        bool Open(const std::filesystem::path& path, Mode mode, unsigned flags = 0) {
+            Close();
+            unbuffered = (flags & DIRECT) != 0;
+#ifdef _WIN32
+            DWORD attributes = FILE_ATTRIBUTE_NORMAL;
+            if (flags & DIRECT) attributes |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+            if (flags & ASYNC) attributes |= FILE_FLAG_OVERLAPPED;
+            overlapped = (flags & ASYNC) != 0;
+            handle = CreateFileW(path.c_str(), mode == READ ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ | (mode != WRITE ? FILE_SHARE_WRITE : 0), NULL,
+                mode == WRITE ? CREATE_ALWAYS : OPEN_EXISTING, attributes, NULL);
+            if (handle == INVALID_HANDLE_VALUE) {
+#else
+            int access = mode == READ ? O_RDONLY : mode == WRITE ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR;
+#ifdef O_DIRECT
+            if (flags & DIRECT) access |= O_DIRECT;
+#endif
+            fd = ::open(path.c_str(), access | O_CLOEXEC, 0644);
+            if (fd < 0) {
+#endif
+                error = L"Cannot open " + path.wstring();
+                return false;
+            }
+            return true;
+        }
+
+        void Close() {
+#ifdef _WIN32
+            if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+#else
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+        }
+
+        NativeHandle Native() const {
+#ifdef _WIN32
+            return handle;
+#else
+            return fd;
+#endif
+        }
+
+        bool IsOpen() const {
+#ifdef _WIN32
+            return handle != INVALID_HANDLE_VALUE;
+#else
+            return fd >= 0;
+#endif
+        }
+
+        // Length of a file, or the capacity of a disk, partition or volume handle
+        uint64_t Size() const {
+#ifdef _WIN32
+            LARGE_INTEGER size;
+            if (GetFileSizeEx(handle, &size)) return static_cast<uint64_t>(size.QuadPart);
+            GET_LENGTH_INFORMATION length = {};
+            DWORD returned = 0;
+            return DeviceIoControl(handle, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length), &returned, NULL)
+                ? static_cast<uint64_t>(length.Length.QuadPart) : 0;
+#else
+            struct stat info;
+            if (fstat(fd, &info) != 0) return 0;
+#ifdef BLKGETSIZE64
+            uint64_t bytes = 0;
+            if (S_ISBLK(info.st_mode) && ioctl(fd, BLKGETSIZE64, &bytes) == 0) return bytes;
+#endif
+            return static_cast<uint64_t>(info.st_size);
+#endif
+        }
+
+        // Waits until written data has reached the device
+        bool Sync() {
+#ifdef _WIN32
+            if (!FlushFileBuffers(handle)) {
+#else
+            if (::fsync(fd) != 0) {
+#endif
+                error = L"Flush failed";
+                return false;
+            }
+            return true;
+        }
+
+        // Waits until everything written to the filesystem this file is on has reached the
+        // device, other files included: one flush for a whole batch of copied files. Windows
+        // flushes the volume, which takes an administrator.
+        bool SyncFilesystem() {
+#ifdef _WIN32
+            wchar_t name[MAX_PATH];
+            DWORD length = GetFinalPathNameByHandleW(handle, name, MAX_PATH, FILE_NAME_NORMALIZED | VOLUME_NAME_GUID);
+            std::wstring path(name, length < MAX_PATH ? length : 0);
+            size_t end = path.find(L'\\', 4);       // \\?\Volume{...} without the trailing backslash
+            HANDLE volume = end == std::wstring::npos ? INVALID_HANDLE_VALUE
+                : CreateFileW(path.substr(0, end).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            bool ok = volume != INVALID_HANDLE_VALUE && FlushFileBuffers(volume);
+            if (volume != INVALID_HANDLE_VALUE) CloseHandle(volume);
+            if (!ok) {
+#elif defined(__linux__)
+            if (::syncfs(fd) != 0) {
+#else
+            ::sync();
+            if (::fsync(fd) != 0) {
+#endif
+                error = L"Filesystem flush failed";
+                return false;
+            }
+            return true;
+        }
+
+        // Asks for [offset, offset + length) to be read into the page cache in the background.
+        // Requests for files that sit next to each other on the disk are merged into large
+        // reads. Windows has no per-range equivalent and relies on its own read-ahead.
+        bool Prefetch(uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+            return ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_WILLNEED) == 0;
+#else
+            (void)offset;
+            (void)length;
+            return false;
+#endif
+        }
+
+        // Reads up to `length` bytes at `offset`; `done` is short only at end of file
+        bool ReadAt(void* buffer, size_t length, uint64_t offset, size_t& done) {
+            done = 0;
+            while (done < length) {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                uint64_t at = offset + done;
+                position.Offset = static_cast<DWORD>(at);
+                position.OffsetHigh = static_cast<DWORD>(at >> 32);
+                DWORD got = 0;
+                DWORD want = static_cast<DWORD>(std::min<size_t>(length - done, 0x40000000));
+                if (!ReadFile(handle, static_cast<uint8_t*>(buffer) + done, want, &got, &position)
+                    && !(overlapped && GetLastError() == ERROR_IO_PENDING && GetOverlappedResult(handle, &position, &got, TRUE))) {
+                    if (GetLastError() == ERROR_HANDLE_EOF) break;
+                    error = L"Read failed";
+                    return false;
+                }
+#else
+                ssize_t got = ::pread(fd, static_cast<uint8_t*>(buffer) + done, length - done, static_cast<off_t>(offset + done));
+                if (got < 0) {
+                    if (errno == EINTR) continue;
+                    error = L"Read failed";
+                    return false;
+                }
+#endif
+                if (got == 0) break;
+                done += static_cast<size_t>(got);
+                // An unbuffered read ending off a sector boundary hit the end of the file; another
+                // request from there would be unaligned and fail
+                if (unbuffered && done % 512 != 0) break;
+            }
+            return true;
+        }
+
+        bool WriteAt(const void* buffer, size_t length, uint64_t offset) {
+            size_t done = 0;
+            while (done < length) {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                uint64_t at = offset + done;
+                position.Offset = static_cast<DWORD>(at);
+                position.OffsetHigh = static_cast<DWORD>(at >> 32);
+                DWORD put = 0;
+                DWORD want = static_cast<DWORD>(std::min<size_t>(length - done, 0x40000000));
+                if ((!WriteFile(handle, static_cast<const uint8_t*>(buffer) + done, want, &put, &position)
+                     && !(overlapped && GetLastError() == ERROR_IO_PENDING && GetOverlappedResult(handle, &position, &put, TRUE)))
+                    || put == 0) {
+                    error = L"Write failed";
+                    return false;
+                }
+#else
+                ssize_t put = ::pwrite(fd, static_cast<const uint8_t*>(buffer) + done, length - done, static_cast<off_t>(offset + done));
+                if (put < 0 && errno == EINTR) continue;
+                if (put <= 0) {
+                    error = L"Write failed";
+                    return false;
+                }
+#endif
+                done += static_cast<size_t>(put);
+            }
+            return true;
+        }
+
+        // Sets the final length up front so parallel chunk writes never extend the file
+        bool Resize(uint64_t size) {
+#ifdef _WIN32
+            FILE_END_OF_FILE_INFO end = {};
+            end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+            if (!SetFileInformationByHandle(handle, FileEndOfFileInfo, &end, sizeof(end))) {
+#else
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+#endif
+                error = L"Cannot resize file";
+                return false;
+            }
+            return true;
+        }
+
+        // Lets a file on NTFS keep unwritten ranges as holes, which Discard() and a Resize()
+        // past the written data then produce. Other filesystems do that without being asked.
+        bool SetSparse() {
+#ifdef _WIN32
+            DWORD returned = 0;
+            return Control(FSCTL_SET_SPARSE, NULL, 0, &returned);
+#else
+            return true;
+#endif
+        }
+
+        // Reserves `size` bytes of disk for the file without writing them, so the filesystem
+        // lays it out in one piece before the data arrives; the length is left alone
+        bool Allocate(uint64_t size) {
+            if (size == 0) return true;
+#ifdef _WIN32
+            FILE_ALLOCATION_INFO allocation = {};
+            allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+            return SetFileInformationByHandle(handle, FileAllocationInfo, &allocation, sizeof(allocation)) != 0;
+#elif defined(__linux__)
+            return ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+#else
+            return false;
+#endif
+        }
+
+        // Makes [offset, offset + length) read back as zeros without writing them: a hole in a
+        // sparse file, an unmap that guarantees zeros on a block device. False where neither
+        // is supported, and the caller writes the zeros itself.
+        bool Discard(uint64_t offset, uint64_t length) {
+            if (length == 0) return true;
+#ifdef _WIN32
+            FILE_ZERO_DATA_INFORMATION range = {};
+            range.FileOffset.QuadPart = static_cast<LONGLONG>(offset);
+            range.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(offset + length);
+            BY_HANDLE_FILE_INFORMATION information = {};
+            // On a non-sparse file FSCTL_SET_ZERO_DATA writes the zeros, no better than doing it ourselves
+            if (!GetFileInformationByHandle(handle, &information) || !(information.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE)) {
+                return false;
+            }
+            DWORD returned = 0;
+            return Control(FSCTL_SET_ZERO_DATA, &range, sizeof(range), &returned);
+#elif defined(__linux__)
+            // Block devices take this as a zeroing unmap since Linux 4.9
+            return ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+#else
+            (void)offset;
+            return false;
+#endif
+        }
+
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        std::wstring error;
+        bool unbuffered = false;
+#ifdef _WIN32
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        bool overlapped = false;
+
+        // DeviceIoControl that also waits on handles opened for overlapped I/O
+        bool Control(DWORD code, void* input, DWORD inputSize, DWORD* returned) {
+            OVERLAPPED pending = {};
+            pending.hEvent = overlapped ? CreateEventW(NULL, TRUE, FALSE, NULL) : NULL;
+            bool ok = DeviceIoControl(handle, code, input, inputSize, NULL, 0, returned, overlapped ? &pending : NULL)
+                || (overlapped && GetLastError() == ERROR_IO_PENDING && GetOverlappedResult(handle, &pending, returned, TRUE));
+            if (pending.hEvent) CloseHandle(pending.hEvent);
+            return ok;
+        }
+#else
+        int fd = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+#include <cstdint>
+#include <string>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only memory mapping of a whole file. Lets the hive, PE and image parsers work
+// on the page cache directly instead of copying files into std::vector first.
+class MappedFile {
+
+    public:
+
+        MappedFile() = default;
+        explicit MappedFile(const std::filesystem::path& path) { Open(path); }
+        ~MappedFile() { Close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const std::filesystem::path& path) {
+            Close();
+#ifdef _WIN32
+            file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                error = L"Cannot open " + path.wstring();
+                return false;
+            }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize)) {
+                error = L"Cannot size " + path.wstring();
+                Close();
+                return false;
+            }
+            size = static_cast<size_t>(fileSize.QuadPart);
+            opened = true;
+            if (size == 0) return true;
+            mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (!mapping) {
+                error = L"Cannot map " + path.wstring();
+                Close();
+                return false;
+            }
+            data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                error = L"Cannot open " + path.wstring();
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                error = L"Cannot size " + path.wstring();
+                Close();
+                return false;
+            }
+            size = static_cast<size_t>(info.st_size);
+            opened = true;
+            if (size == 0) return true;
+            void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = view == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(view);
+#endif
+            if (!data) {
+                error = L"Cannot map " + path.wstring();
+                Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close() {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data) munmap(const_cast<uint8_t*>(data), size);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+            data = nullptr;
+            size = 0;
+            opened = false;
+        }
+
+        // Hint that the mapping will be read front to back
+        void Sequential() const {
+#ifndef _WIN32
+            if (data) madvise(const_cast<uint8_t*>(data), size, MADV_SEQUENTIAL);
+#endif
+        }
+
+        bool IsOpen() const { return opened; }
+        const uint8_t* Data() const { return data; }
+        size_t Size() const { return size; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        bool opened = false;
+        std::wstring error;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#else
+        int fd = -1;
+#endif
+};
+
+#endif
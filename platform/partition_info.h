@@ -0,0 +1,121 @@
+#ifndef _PARTITION_INFO_H_
+#define _PARTITION_INFO_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include "file.h"
+
+#ifndef _WIN32
+#include <sys/sysmacros.h>
+#endif
+
+// Where a volume sits on its disk, as a BCD device element names it: the disk signature and
+// byte offset on MBR, the disk and partition GUIDs (in their on-disk byte order) on GPT.
+struct PartitionInfo {
+    bool gpt = false;
+    uint64_t offset = 0;                                 // Byte offset of the partition on the disk
+    uint32_t mbrSignature = 0;
+    uint8_t diskGuid[16] = {};
+    uint8_t partitionGuid[16] = {};
+};
+
+// `volume` is a drive letter ("E:") on Windows. Elsewhere it is a partition device, or any
+// path on a mounted partition, and the layout is read from sysfs and the disk's own tables.
+inline bool QueryPartition(const std::wstring& volume, PartitionInfo& info) {
+#ifdef _WIN32
+    if (volume.size() < 2 || volume[1] != L':') return false;
+    std::wstring volumePath = L"\\\\.\\" + volume.substr(0, 2);
+    HANDLE handle = CreateFileW(volumePath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    PARTITION_INFORMATION_EX partition = {};
+    STORAGE_DEVICE_NUMBER number = {};
+    DWORD bytes = 0;
+    bool ok = DeviceIoControl(handle, IOCTL_DISK_GET_PARTITION_INFO_EX, NULL, 0, &partition, sizeof(partition), &bytes, NULL)
+        && DeviceIoControl(handle, IOCTL_STORAGE_GET_DEVICE_NUMBER, NULL, 0, &number, sizeof(number), &bytes, NULL);
+    CloseHandle(handle);
+    if (!ok) return false;
+
+    std::wstring diskPath = L"\\\\.\\PhysicalDrive" + std::to_wstring(number.DeviceNumber);
+    HANDLE disk = CreateFileW(diskPath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (disk == INVALID_HANDLE_VALUE) return false;
+    std::vector<BYTE> layoutBuffer(sizeof(DRIVE_LAYOUT_INFORMATION_EX) + 128 * sizeof(PARTITION_INFORMATION_EX));
+    ok = DeviceIoControl(disk, IOCTL_DISK_GET_DRIVE_LAYOUT_EX, NULL, 0, layoutBuffer.data(),
+        static_cast<DWORD>(layoutBuffer.size()), &bytes, NULL);
+    CloseHandle(disk);
+    if (!ok) return false;
+    const DRIVE_LAYOUT_INFORMATION_EX* layout = reinterpret_cast<const DRIVE_LAYOUT_INFORMATION_EX*>(layoutBuffer.data());
+
+    info.offset = static_cast<uint64_t>(partition.StartingOffset.QuadPart);
+    info.gpt = partition.PartitionStyle == PARTITION_STYLE_GPT;
+    if (info.gpt) {
+        std::memcpy(info.partitionGuid, &partition.Gpt.PartitionId, 16);
+        std::memcpy(info.diskGuid, &layout->Gpt.DiskId, 16);
+    }
+    else {
+        info.mbrSignature = layout->Mbr.Signature;
+    }
+    return true;
+#else
+    // The partition behind the path: itself if it is a block device, else the one it is mounted from
+    struct stat st;
+    std::filesystem::path path(volume);
+    if (stat(path.c_str(), &st) != 0) return false;
+    dev_t device = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    std::error_code ec;
+    std::filesystem::path node = std::filesystem::canonical("/sys/dev/block/" + std::to_string(major(device)) + ":"
+        + std::to_string(minor(device)), ec);
+    if (ec || !std::filesystem::exists(node / "partition", ec)) return false;
+
+    auto readNumber = [](const std::filesystem::path& file, uint64_t& value) {
+        std::ifstream in(file);
+        return static_cast<bool>(in >> value);
+    };
+    uint64_t start = 0, sectorSize = 512;
+    if (!readNumber(node / "start", start)) return false;
+    std::filesystem::path diskNode = node.parent_path();
+    readNumber(diskNode / "queue" / "logical_block_size", sectorSize);
+    info.offset = start * 512;                           // sysfs counts 512-byte units whatever the sector size
+
+    File disk;
+    std::vector<uint8_t> sector(static_cast<size_t>(sectorSize));
+    size_t got = 0;
+    if (!disk.Open(std::filesystem::path("/dev") / diskNode.filename(), File::READ)
+        || !disk.ReadAt(sector.data(), sector.size(), 0, got) || got != sector.size()
+        || sector[510] != 0x55 || sector[511] != 0xAA) {
+        return false;
+    }
+    auto get32 = [](const uint8_t* p) { return static_cast<uint32_t>(p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24); };
+    auto get64 = [&](const uint8_t* p) { return get32(p) | static_cast<uint64_t>(get32(p + 4)) << 32; };
+    info.gpt = sector[0x1C2] == 0xEE;                    // Protective MBR
+    if (!info.gpt) {
+        info.mbrSignature = get32(&sector[0x1B8]);
+        return true;
+    }
+
+    if (!disk.ReadAt(sector.data(), sector.size(), sectorSize, got) || got != sector.size()
+        || std::memcmp(sector.data(), "EFI PART", 8) != 0) {
+        return false;
+    }
+    std::memcpy(info.diskGuid, &sector[0x38], 16);
+    uint64_t entriesAt = get64(&sector[0x48]) * sectorSize;
+    uint32_t count = get32(&sector[0x50]);
+    uint32_t entrySize = get32(&sector[0x54]);
+    if (entrySize < 128 || count > 1024) return false;
+    std::vector<uint8_t> entries(static_cast<size_t>(count) * entrySize);
+    if (!disk.ReadAt(entries.data(), entries.size(), entriesAt, got) || got != entries.size()) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t* entry = &entries[static_cast<size_t>(i) * entrySize];
+        if (get64(entry + 0x20) * sectorSize == info.offset) {
+            std::memcpy(info.partitionGuid, entry + 0x10, 16);
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _PATHS_H_
+#define _PATHS_H_
+#include <cwctype>
+#include <string>
+#include <optional>
+#include <vector>
+#include <filesystem>
+
+// Root of a Windows installation as a filesystem path. A bare drive letter ("E:") means
+// the drive-relative current directory to Win32, so it gets its backslash; anything else
+// (a Linux mount point or an extracted image) is used as is.
+inline std::filesystem::path VolumeRoot(const std::wstring& drive) {
+    if (drive.size() == 2 && drive[1] == L':') return std::filesystem::path(drive + L"\\");
+    return std::filesystem::path(drive);
+}
+
+// Raw volume for block-level access: \\.\E: for a drive letter on Windows. On Linux the
+// caller passes a partition device or an image file, which is used as is.
+inline std::filesystem::path VolumeDevice(const std::wstring& drive) {
+#ifdef _WIN32
+    if (drive.size() >= 2 && drive[1] == L':') return std::filesystem::path(L"\\\\.\\" + drive.substr(0, 2));
+#endif
+    return std::filesystem::path(drive);
+}
+
+inline bool PathComponentsEqual(const std::wstring& left, const std::wstring& right) {
+    if (left.size() != right.size()) return false;
+    for (size_t i = 0; i < left.size(); ++i) {
+        if (std::towupper(left[i]) != std::towupper(right[i])) return false;
+    }
+    return true;
+}
+
+// True if `relative` is one of `list` (backslash separated, any case), e.g. the excludes
+// of a copy
+inline bool PathListed(const std::filesystem::path& relative, const std::vector<std::wstring>& list) {
+#ifdef _WIN32
+    std::wstring text = relative.wstring();
+#else
+    // Widened byte by byte: wstring() throws on non-ASCII names under the C locale, and the lists are ASCII
+    auto bytes = relative.generic_u8string();
+    std::wstring text(bytes.begin(), bytes.end());
+#endif
+    for (auto& c : text) {
+        if (c == L'/') c = L'\\';
+    }
+    for (const auto& item : list) {
+        if (PathComponentsEqual(text, item)) return true;
+    }
+    return false;
+}
+
+// Resolves `relative` (backslash or slash separated) below `root` ignoring case, the way
+// Windows would. An NTFS volume mounted with ntfs-3g or an extracted image on ext4 is case
+// sensitive, and "System32" vs "system32" differs between releases. The exact spelling is
+// tried first so the common case costs one stat.
+inline std::optional<std::filesystem::path> FindPathNoCase(const std::filesystem::path& root, const std::wstring& relative) {
+    std::wstring normalized = relative;
+    for (auto& c : normalized) {
+        if (c == L'\\' || c == L'/') c = std::filesystem::path::preferred_separator;
+    }
+    std::error_code ec;
+    std::filesystem::path exact = root / normalized;
+    if (std::filesystem::exists(exact, ec)) return exact;
+
+    std::filesystem::path current = root;
+    for (const auto& part : std::filesystem::path(normalized)) {
+        std::filesystem::path next = current / part;
+        if (!std::filesystem::exists(next, ec)) {
+            std::optional<std::filesystem::path> match;
+            for (auto it = std::filesystem::directory_iterator(current, ec);
+                 !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+                if (PathComponentsEqual(it->path().filename().wstring(), part.wstring())) {
+                    match = it->path();
+                    break;
+                }
+            }
+            if (!match) return std::nullopt;
+            next = *match;
+        }
+        current = next;
+    }
+    return current;
+}
+
+#endif
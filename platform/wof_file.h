@@ -0,0 +1,122 @@
+#ifndef _WOF_FILE_H_
+#define _WOF_FILE_H_
+#include <cstdint>
+#include <string>
+#include <filesystem>
+#include "file.h"
+#include "../compression/wof_codec.h"
+
+#ifndef _WIN32
+#include <sys/vfs.h>
+#include <sys/xattr.h>
+#endif
+
+// Writes a CompactOS file directly, the way the WOF driver leaves one after compact.exe:
+// a sparse unnamed stream of the original size, the compressed data in the
+// WofCompressedData stream, and a WOF reparse point naming the algorithm. Windows then
+// reads the file transparently. On Linux this needs an ntfs-3g mount with
+// streams_interface=windows for the named stream; the reparse point goes through ntfs-3g's
+// system.ntfs_reparse_data attribute.
+class WofFile {
+
+    public:
+
+        static constexpr uint32_t IO_REPARSE_TAG_WOF_VALUE = 0x80000017;
+        static constexpr uint32_t WOF_VERSION = 1;
+        static constexpr uint32_t WOF_PROVIDER_FILE_VALUE = 2;
+        static constexpr uint32_t FILE_PROVIDER_VERSION = 1;
+
+        // NTFS on Windows; a FUSE mount that answers ntfs-3g's attributes elsewhere
+        static bool Supported(const std::filesystem::path& directory) {
+#ifdef _WIN32
+            wchar_t volume[MAX_PATH], name[MAX_PATH];
+            std::error_code ec;
+            std::filesystem::path absolute = std::filesystem::absolute(directory, ec);
+            if (ec || !GetVolumePathNameW(absolute.c_str(), volume, MAX_PATH)) return false;
+            return GetVolumeInformationW(volume, NULL, 0, NULL, NULL, NULL, name, MAX_PATH) && std::wstring(name) == L"NTFS";
+#else
+            struct statfs info;
+            if (statfs(directory.c_str(), &info) != 0 || static_cast<uint32_t>(info.f_type) != FUSE_MAGIC) return false;
+            uint32_t attributes = 0;
+            return getxattr(directory.c_str(), "system.ntfs_attrib", &attributes, sizeof(attributes)) >= 0;
+#endif
+        }
+
+        // Creates `path` as a placeholder of `size` bytes and opens its compressed stream
+        bool Open(const std::filesystem::path& path, WofFormat wofFormat, uint64_t size) {
+            file = path;
+            format = wofFormat;
+            File placeholder;
+            if (!placeholder.Open(path, File::WRITE) || !placeholder.SetSparse() || !placeholder.Resize(size)) {
+                error = L"Cannot create " + path.wstring();
+                return false;
+            }
+            placeholder.Close();
+            if (!stream.Open(StreamPath(), File::WRITE)) {
+                error = L"Cannot create the compressed stream of " + path.wstring();
+                return false;
+            }
+            return true;
+        }
+
+        // Offsets are within the compressed stream: chunk table first, then the chunks
+        bool WriteAt(const void* data, size_t length, uint64_t offset) {
+            if (stream.WriteAt(data, length, offset)) return true;
+            error = L"Write failed: " + StreamPath().wstring();
+            return false;
+        }
+
+        // Closes the stream and turns the file into a WOF file
+        bool Commit() {
+            stream.Close();
+            uint8_t buffer[24] = {};
+            Put32(buffer, IO_REPARSE_TAG_WOF_VALUE);
+            buffer[4] = 16;                                  // ReparseDataLength; Reserved stays zero
+            Put32(buffer + 8, WOF_VERSION);
+            Put32(buffer + 12, WOF_PROVIDER_FILE_VALUE);
+            Put32(buffer + 16, FILE_PROVIDER_VERSION);
+            Put32(buffer + 20, static_cast<uint32_t>(format));
+#ifdef _WIN32
+            HANDLE handle = CreateFileW(file.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, NULL);
+            DWORD returned = 0;
+            bool ok = handle != INVALID_HANDLE_VALUE
+                && DeviceIoControl(handle, FSCTL_SET_REPARSE_POINT, buffer, sizeof(buffer), NULL, 0, &returned, NULL);
+            if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+#else
+            bool ok = setxattr(file.c_str(), "system.ntfs_reparse_data", buffer, sizeof(buffer), 0) == 0;
+#endif
+            if (!ok) error = L"Cannot set the WOF reparse point on " + file.wstring();
+            return ok;
+        }
+
+        // Drops a half-written stream so a plain copy can take the file's place
+        void Abort() {
+            stream.Close();
+            std::error_code ec;
+            std::filesystem::remove(StreamPath(), ec);
+        }
+
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        static constexpr uint32_t FUSE_MAGIC = 0x65735546;
+
+        std::filesystem::path file;
+        WofFormat format = WOF_NONE;
+        File stream;
+        std::wstring error;
+
+        std::filesystem::path StreamPath() const {
+            std::filesystem::path path = file;
+            path += ":WofCompressedData";
+            return path;
+        }
+
+        static void Put32(uint8_t* at, uint32_t value) {
+            for (int i = 0; i < 4; ++i) at[i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _EVENT_RING_H_
+#define _EVENT_RING_H_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+// Bounded multi-producer multi-consumer queue (Vyukov): every slot carries a sequence number
+// that says whose turn it is, so a push or pop is one compare-exchange on the shared index
+// and a release store on the slot. Nothing waits and nothing allocates after construction;
+// a push into a full ring fails instead of blocking the producer.
+template <typename T>
+class EventRing {
+
+        static_assert(std::is_trivially_copyable<T>::value, "events are copied in and out of slots");
+
+    public:
+
+        // Capacity is rounded up to a power of two
+        explicit EventRing(size_t capacity = 1024) {
+            size_t size = 2;
+            while (size < capacity) size <<= 1;
+            mask = size - 1;
+            slots.reset(new Slot[size]);
+            for (size_t i = 0; i < size; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        EventRing(const EventRing&) = delete;
+        EventRing& operator=(const EventRing&) = delete;
+
+        bool TryPush(const T& value) {
+            size_t position = tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot& slot = slots[position & mask];
+                size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        slot.value = value;
+                        slot.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0) {
+                    return false;                                // Full
+                }
+                else {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool TryPop(T& value) {
+            size_t position = head.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot& slot = slots[position & mask];
+                size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (difference == 0) {
+                    if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        value = slot.value;
+                        slot.sequence.store(position + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0) {
+                    return false;                                // Empty
+                }
+                else {
+                    position = head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        size_t Capacity() const { return mask + 1; }
+
+    private:
+
+        struct alignas(64) Slot {
+            std::atomic<size_t> sequence{ 0 };
+            T value;
+        };
+
+        std::unique_ptr<Slot[]> slots;
+        size_t mask = 0;
+        alignas(64) std::atomic<size_t> tail{ 0 };
+        alignas(64) std::atomic<size_t> head{ 0 };
+};
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef _PROGRESS_CHANNEL_H_
+#define _PROGRESS_CHANNEL_H_
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "event_ring.h"
+
+enum ProgressStage : uint8_t {
+    STAGE_NONE,
+    STAGE_BCD,
+    STAGE_PROBE,
+    STAGE_APPLY,
+    STAGE_IMAGE,
+    STAGE_COPY,
+    STAGE_RESYNC,
+    STAGE_VERIFY,
+    STAGE_OPTIMIZE,
+    STAGE_BOOT
+};
+
+enum ProgressKind : uint8_t {
+    EVENT_STAGE,                                         // A stage starts; text is its description
+    EVENT_PROGRESS,                                      // Cumulative counters of the running stage
+    EVENT_MESSAGE,
+    EVENT_WARNING,
+    EVENT_ERROR
+};
+
+inline const wchar_t* StageName(ProgressStage stage) {
+    switch (stage) {
+        case STAGE_BCD: return L"bcd";
+        case STAGE_PROBE: return L"probe";
+        case STAGE_APPLY: return L"apply";
+        case STAGE_IMAGE: return L"image";
+        case STAGE_COPY: return L"copy";
+        case STAGE_RESYNC: return L"resync";
+        case STAGE_VERIFY: return L"verify";
+        case STAGE_OPTIMIZE: return L"optimize";
+        case STAGE_BOOT: return L"boot";
+        default: return L"";
+    }
+}
+
+// Fixed size so it can sit in a ring slot; text longer than the buffer is cut
+struct ProgressEvent {
+    static constexpr size_t TEXT_LENGTH = 96;
+
+    ProgressKind kind = EVENT_MESSAGE;
+    ProgressStage stage = STAGE_NONE;
+    uint64_t time = 0;                                   // Steady clock, ns
+    uint64_t bytesDone = 0;
+    uint64_t bytesTotal = 0;                             // 0 = unknown, or the stage's total for EVENT_PROGRESS
+    uint64_t filesDone = 0;
+    uint64_t filesTotal = 0;
+    wchar_t text[TEXT_LENGTH] = {};
+};
+
+// Stages report here instead of through shared strings. Producers only ever try to push
+// into the ring: a full ring drops the event and counts it, which loses nothing for
+// EVENT_PROGRESS since the counters are cumulative and the next update supersedes it.
+// Advance() is for hot paths: it builds the event on the stack and lets one producer
+// through per interval, so a copy of 200k small files does not flood the ring.
+class ProgressChannel {
+
+    public:
+
+        explicit ProgressChannel(size_t capacity = 1024, std::chrono::milliseconds advanceInterval = std::chrono::milliseconds(20))
+            : ring(capacity), interval(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(advanceInterval).count())) {}
+
+        static uint64_t Now() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void Stage(ProgressStage stage, const wchar_t* text, uint64_t bytesTotal = 0, uint64_t filesTotal = 0) {
+            ProgressEvent event;
+            event.kind = EVENT_STAGE;
+            event.stage = stage;
+            event.bytesTotal = bytesTotal;
+            event.filesTotal = filesTotal;
+            Post(event, text);
+        }
+
+        void Stage(ProgressStage stage, const std::wstring& text, uint64_t bytesTotal = 0, uint64_t filesTotal = 0) {
+            Stage(stage, text.c_str(), bytesTotal, filesTotal);
+        }
+
+        // `last` bypasses the rate limit, for the final counts of a stage
+        void Advance(ProgressStage stage, uint64_t bytesDone, uint64_t filesDone, uint64_t bytesTotal = 0, bool last = false) {
+            uint64_t now = Now();
+            uint64_t previous = lastAdvance.load(std::memory_order_relaxed);
+            if (!last && (now - previous < interval || !lastAdvance.compare_exchange_strong(previous, now, std::memory_order_relaxed))) {
+                return;
+            }
+            ProgressEvent event;
+            event.kind = EVENT_PROGRESS;
+            event.stage = stage;
+            event.time = now;
+            event.bytesDone = bytesDone;
+            event.bytesTotal = bytesTotal;
+            event.filesDone = filesDone;
+            Push(event);
+        }
+
+        void Message(const wchar_t* text) { Note(EVENT_MESSAGE, text); }
+        void Message(const std::wstring& text) { Note(EVENT_MESSAGE, text.c_str()); }
+        void Warning(const wchar_t* text) { Note(EVENT_WARNING, text); }
+        void Warning(const std::wstring& text) { Note(EVENT_WARNING, text.c_str()); }
+        void Error(const wchar_t* text) { Note(EVENT_ERROR, text); }
+        void Error(const std::wstring& text) { Note(EVENT_ERROR, text.c_str()); }
+
+        // Consumer side; stops at one ring's worth so producers cannot keep it spinning
+        template <typename Handler>
+        size_t Drain(Handler&& handler) {
+            ProgressEvent event;
+            size_t count = 0;
+            while (count < ring.Capacity() && ring.TryPop(event)) {
+                handler(static_cast<const ProgressEvent&>(event));
+                ++count;
+            }
+            return count;
+        }
+
+        uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+
+        EventRing<ProgressEvent> ring;
+        uint64_t interval;
+        std::atomic<uint64_t> lastAdvance{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+
+        void Note(ProgressKind kind, const wchar_t* text) {
+            ProgressEvent event;
+            event.kind = kind;
+            Post(event, text);
+        }
+
+        void Post(ProgressEvent& event, const wchar_t* text) {
+            size_t length = 0;
+            while (length + 1 < ProgressEvent::TEXT_LENGTH && text[length] != 0) {
+                event.text[length] = text[length];
+                ++length;
+            }
+            event.text[length] = 0;
+            event.time = Now();
+            Push(event);
+        }
+
+        void Push(const ProgressEvent& event) {
+            if (!ring.TryPush(event)) dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+};
+
+// The process-wide channel the stages and the BCD editor report through
+inline ProgressChannel& Progress() {
+    static ProgressChannel channel;
+    return channel;
+}
+
+// What the UI shows, folded from the events. The rate is sampled by the UI at its own fixed
+// rate rather than per event, so it keeps falling while a stage stalls.
+class ProgressView {
+
+    public:
+
+        void Apply(const ProgressEvent& event) {
+            if (event.kind == EVENT_STAGE) {
+                stage = event.stage;
+                title.assign(event.text);
+                bytesTotal = event.bytesTotal;
+                filesTotal = event.filesTotal;
+                bytesDone = filesDone = 0;
+                sampleTime = event.time;
+                sampleBytes = 0;
+                rate = 0;
+            }
+            else if (event.kind == EVENT_PROGRESS && event.stage == stage) {
+                // Producers race to publish, so an older count can arrive after a newer one
+                bytesDone = std::max(bytesDone, event.bytesDone);
+                filesDone = std::max(filesDone, event.filesDone);
+                if (event.bytesTotal != 0) bytesTotal = event.bytesTotal;
+            }
+        }
+
+        // Exponentially weighted over samples at least a quarter second apart
+        void Sample(uint64_t now) {
+            if (sampleTime == 0) sampleTime = now;
+            if (now - sampleTime < 250000000ULL) return;
+            double instant = (bytesDone - sampleBytes) / ((now - sampleTime) / 1e9);
+            rate = rate > 0 ? rate * 0.7 + instant * 0.3 : instant;
+            sampleTime = now;
+            sampleBytes = bytesDone;
+        }
+
+        double MBPerSecond() const { return rate / 1e6; }
+
+        // -1 while the total or the rate is unknown
+        int64_t EtaSeconds() const {
+            if (bytesTotal == 0 || rate <= 0) return -1;
+            return static_cast<int64_t>((bytesTotal - std::min(bytesTotal, bytesDone)) / rate);
+        }
+
+        std::wstring ToString() const {
+            if (stage == STAGE_NONE) return title;
+            std::wstring line = L"[" + std::wstring(StageName(stage)) + L"] " + std::to_wstring(bytesDone / 1000000);
+            if (bytesTotal != 0) {
+                line += L"/" + std::to_wstring(bytesTotal / 1000000) + L" MB ("
+                    + std::to_wstring(std::min<uint64_t>(100, bytesDone * 100 / bytesTotal)) + L"%)";
+            }
+            else {
+                line += L" MB";
+            }
+            line += L", " + std::to_wstring(filesDone) + (filesTotal != 0 ? L"/" + std::to_wstring(filesTotal) : L"") + L" files, "
+                + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s";
+            int64_t eta = EtaSeconds();
+            if (eta >= 0) {
+                std::wstring seconds = std::to_wstring(eta % 60);
+                line += L", ETA " + std::to_wstring(eta / 60) + L":" + (seconds.size() < 2 ? L"0" : L"") + seconds;
+            }
+            return line;
+        }
+
+        ProgressStage stage = STAGE_NONE;
+        std::wstring title;
+        uint64_t bytesDone = 0;
+        uint64_t bytesTotal = 0;
+        uint64_t filesDone = 0;
+        uint64_t filesTotal = 0;
+
+    private:
+
+        uint64_t sampleTime = 0;
+        uint64_t sampleBytes = 0;
+        double rate = 0;                                 // Bytes per second
+};
+
+// The UI thread: drains the channel at a fixed rate, hands every non-progress event to
+// `notice` in order and then the folded view to `render`. Both run on this thread only.
+class ProgressMonitor {
+
+    public:
+
+        using Notice = std::function<void(const ProgressEvent&)>;
+        using Render = std::function<void(const ProgressView&)>;
+
+        ProgressMonitor(ProgressChannel& progressChannel, Notice onNotice, Render onRender,
+                        std::chrono::milliseconds tickPeriod = std::chrono::milliseconds(100))
+            : channel(progressChannel), notice(std::move(onNotice)), render(std::move(onRender)), period(tickPeriod) {}
+
+        ~ProgressMonitor() { Stop(); }
+
+        ProgressMonitor(const ProgressMonitor&) = delete;
+        ProgressMonitor& operator=(const ProgressMonitor&) = delete;
+
+        void Start() {
+            if (thread.joinable()) return;
+            stopping = false;
+            thread = std::thread([this] { Loop(); });
+        }
+
+        // Joins the thread and renders whatever was posted before the call
+        void Stop() {
+            if (!thread.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            thread.join();
+        }
+
+        // Only valid while the monitor is stopped
+        const ProgressView& View() const { return view; }
+
+    private:
+
+        ProgressChannel& channel;
+        Notice notice;
+        Render render;
+        std::chrono::milliseconds period;
+        ProgressView view;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        void Loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                bool last = stopping;
+                lock.unlock();
+                Tick();
+                lock.lock();
+                if (last) return;
+                wake.wait_for(lock, period, [this] { return stopping; });
+            }
+        }
+
+        void Tick() {
+            channel.Drain([this](const ProgressEvent& event) {
+                view.Apply(event);
+                if (event.kind != EVENT_PROGRESS && notice) notice(event);
+            });
+            view.Sample(ProgressChannel::Now());
+            if (render) render(view);
+        }
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _BCD_TEST_H_
+#define _BCD_TEST_H_
+#include <fstream>
+#include <iterator>
+#include "test.h"
+#include "../bench/synthetic.h"
+#include "../editor/bcd.h"
+
+inline std::vector<uint8_t> TestFileBytes(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// The boot edits for each stick of a batch land in that stick's own store: two sticks, each
+// with a copy of the source's store, come out pointing at themselves, and the source's store
+// is byte for byte what it was. Partitions resolve to a made-up device per drive.
+inline int RunBcdTests() {
+    TestDirectory work("bcd");
+    std::filesystem::path host = work.path / "host", first = work.path / "first", second = work.path / "second";
+    std::filesystem::create_directories(host / "Boot");
+    WTG_CHECK(SyntheticData::BcdHive(host / "Boot" / "BCD", 2));
+    std::filesystem::path boot = host / "Windows" / "Boot";
+    for (const auto& [name, seed] : { std::make_pair("EFI/bootmgfw.efi", 1), std::make_pair("PCAT/bootmgr", 2), std::make_pair("Fonts/wgl4_boot.ttf", 3) }) {
+        std::filesystem::create_directories((boot / name).parent_path());
+        std::vector<uint8_t> data = TestBytes(4096, seed);
+        std::ofstream(boot / name, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    for (const auto& stick : { first, second }) {
+        std::filesystem::create_directories(stick / "Boot");
+        std::filesystem::copy_file(host / "Boot" / "BCD", stick / "Boot" / "BCD");
+    }
+    std::vector<uint8_t> before = TestFileBytes(host / "Boot" / "BCD");
+
+    auto resolver = BCD::deviceResolver;
+    BCD::deviceResolver = [&](const std::wstring& text, BcdDevice& device) {
+        device = BcdDevice();
+        device.kind = BcdDevice::PARTITION;
+        device.style = BcdDevice::MBR;
+        device.mbrSignature = static_cast<uint32_t>(std::hash<std::wstring>()(text));
+        device.partitionOffset = 1 << 20;
+        return text.rfind(L"partition=", 0) == 0;
+    };
+    for (const auto& stick : { first, second }) {
+        BCD bcd(stick.wstring(), host.wstring());
+        WTG_CHECK(bcd.ModifyBootManager(stick.wstring()));
+    }
+    WTG_CHECK(TestFileBytes(host / "Boot" / "BCD") == before);
+
+    for (const auto& stick : { first, second }) {
+        BcdStore store;
+        WTG_CHECK(store.Open(stick / "Boot" / "BCD"));
+        BcdGuid bootmgr, loader;
+        BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+        BcdDevice expected;
+        WTG_CHECK(BCD::deviceResolver(L"partition=" + stick.wstring(), expected));
+        auto device = store.GetDevice(bootmgr, BCD_LIBRARY_DEVICE);
+        WTG_CHECK(device && *device == expected);
+        WTG_CHECK(store.ResolveObject(L"{default}", loader));
+        auto osDevice = store.GetDevice(loader, BCD_OSLOADER_OSDEVICE);
+        WTG_CHECK(osDevice && *osDevice == expected);
+    }
+
+    // A stick without a store (an applied WIM) gets a new one rather than editing the source's
+    std::filesystem::path bare = work.path / "bare";
+    std::filesystem::create_directories(bare);
+    BCD bcd(bare.wstring(), host.wstring());
+    WTG_CHECK(bcd.ModifyBootManager(bare.wstring()));
+    WTG_CHECK(std::filesystem::exists(bare / "Boot" / "BCD"));
+    WTG_CHECK(TestFileBytes(host / "Boot" / "BCD") == before);
+
+    // A VHDX copy's stick holds only the image: its new store boots the VHD, the boot managers
+    // are copied onto the stick, and nothing treats the stick's partition as the Windows volume
+    std::filesystem::path vhdStick = work.path / "vhd";
+    std::filesystem::create_directories(vhdStick);
+    WTG_CHECK(BCD::CreateUSBSpecificBootEntry(vhdStick.wstring(), L"\\WindowsToGo.vhdx"));
+    WTG_CHECK(TestFileBytes(host / "Boot" / "BCD") == before);
+    BcdStore vhdStore;
+    WTG_CHECK(vhdStore.Open(vhdStick / "Boot" / "BCD"));
+    BcdGuid bootmgr, loader;
+    BcdStore::WellKnownObject(L"{bootmgr}", bootmgr);
+    BcdDevice partition;
+    BCD::deviceResolver(L"partition=" + vhdStick.wstring(), partition);
+    auto managerDevice = vhdStore.GetDevice(bootmgr, BCD_LIBRARY_DEVICE);
+    WTG_CHECK(managerDevice && *managerDevice == partition);
+    WTG_CHECK(vhdStore.ResolveObject(L"{default}", loader));
+    for (uint32_t type : { BCD_LIBRARY_DEVICE, BCD_OSLOADER_OSDEVICE }) {
+        auto device = vhdStore.GetDevice(loader, type);
+        WTG_CHECK(device && device->kind == BcdDevice::VHD && device->file == L"\\WindowsToGo.vhdx");
+        WTG_CHECK(device && device->mbrSignature == partition.mbrSignature);
+    }
+    WTG_CHECK(vhdStore.Objects().size() == 2);
+
+    // It boots from BIOS and UEFI: both boot managers, the removable-media path, the fonts,
+    // and the finished store at the UEFI path too
+    WTG_CHECK(TestFileBytes(vhdStick / "bootmgr") == TestFileBytes(boot / "PCAT" / "bootmgr"));
+    for (const char* name : { "EFI/Microsoft/Boot/bootmgfw.efi", "EFI/Boot/bootx64.efi" }) {
+        WTG_CHECK(TestFileBytes(vhdStick / name) == TestFileBytes(boot / "EFI" / "bootmgfw.efi"));
+    }
+    WTG_CHECK(std::filesystem::exists(vhdStick / "EFI" / "Microsoft" / "Boot" / "Fonts" / "wgl4_boot.ttf"));
+    WTG_CHECK(TestFileBytes(vhdStick / "EFI" / "Microsoft" / "Boot" / "BCD") == TestFileBytes(vhdStick / "Boot" / "BCD"));
+    BCD::deviceResolver = resolver;
+    return TestFailures();
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _COMPRESSION_TEST_H_
+#define _COMPRESSION_TEST_H_
+#include "test.h"
+#include "../compression/wof_codec.h"
+
+// Every CompactOS format encodes and decodes back to the input: empty and one-byte inputs,
+// a partial last chunk, incompressible chunks stored raw, zeros, and text-like data
+inline int RunCompressionTests() {
+    WofCodec codec;
+    std::vector<std::vector<uint8_t>> inputs = {
+        {}, { 0x41 }, std::vector<uint8_t>(200000, 0), TestBytes(100000, 1), TestBytes(70001, 2, 16), TestBytes(40000, 3, 4)
+    };
+    std::vector<uint8_t> noise(50000);
+    std::mt19937_64 random(4);
+    for (auto& byte : noise) byte = static_cast<uint8_t>(random());
+    inputs.push_back(noise);
+
+    for (WofFormat format : { WOF_XPRESS4K, WOF_XPRESS8K, WOF_XPRESS16K, WOF_LZX }) {
+        for (const auto& input : inputs) {
+            std::vector<uint8_t> packed, back(input.size());
+            std::vector<uint32_t> sizes;
+            codec.Compress(format, input.data(), input.size(), packed, sizes);
+            WTG_CHECK(sizes.size() == WofCodec::ChunkCount(format, input.size()));
+            std::vector<uint8_t> stream = WofCodec::Table(format, input.size(), sizes);
+            WTG_CHECK(stream.size() == WofCodec::TableSize(format, input.size()));
+            stream.insert(stream.end(), packed.begin(), packed.end());
+            WTG_CHECK(codec.Decompress(format, stream.data(), stream.size(), back.data(), input.size()));
+            WTG_CHECK(back == input);
+        }
+        // Zeros shrink, noise is stored and never grows past its chunk table
+        std::vector<uint8_t> packed;
+        std::vector<uint32_t> sizes;
+        codec.Compress(format, inputs[2].data(), inputs[2].size(), packed, sizes);
+        WTG_CHECK(packed.size() < inputs[2].size() / 10);
+        packed.clear();
+        sizes.clear();
+        codec.Compress(format, noise.data(), noise.size(), packed, sizes);
+        WTG_CHECK(packed.size() <= noise.size());
+    }
+
+    // A corrupt stream fails instead of reading out of bounds
+    std::vector<uint8_t> input = TestBytes(20000, 5, 16), packed, back(input.size());
+    std::vector<uint32_t> sizes;
+    codec.Compress(WOF_XPRESS4K, input.data(), input.size(), packed, sizes);
+    std::vector<uint8_t> stream = WofCodec::Table(WOF_XPRESS4K, input.size(), sizes);
+    stream.insert(stream.end(), packed.begin(), packed.begin() + packed.size() / 2);
+    WTG_CHECK(!codec.Decompress(WOF_XPRESS4K, stream.data(), stream.size(), back.data(), input.size()));
+    return TestFailures();
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef _COPY_TEST_H_
+#define _COPY_TEST_H_
+#include <fstream>
+#include "test.h"
+#include "../copy/resync_engine.h"
+
+inline void WriteTestFile(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+inline std::vector<uint8_t> ReadTestFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// A tree with small files in a few directories and one file split into several chunks
+inline void MakeTestTree(const std::filesystem::path& root) {
+    for (int directory = 0; directory < 4; ++directory) {
+        for (int i = 0; i < 20; ++i) {
+            auto name = root / ("dir" + std::to_string(directory)) / ("file" + std::to_string(i) + ".bin");
+            WriteTestFile(name, TestBytes(100 + 997 * i, directory * 100 + i));
+        }
+    }
+    WriteTestFile(root / "large.bin", TestBytes(10 << 20, 7));
+}
+
+// The creator's manifest (CRC32C, probed chunk size) is picked up by a resync with default
+// options: nothing unchanged is read again and a changed file is updated chunk by chunk
+inline void TestCopyThenResync() {
+    TestDirectory source("copy_source"), target("copy_target");
+    MakeTestTree(source.path);
+
+    CopyOptions copyOptions;
+    copyOptions.threads = 4;
+    copyOptions.chunkSize = 4 << 20;
+    copyOptions.largeFileThreshold = 4 << 20;
+    copyOptions.manifest = true;
+    CopyEngine copy(copyOptions);
+    WTG_CHECK(copy.Run(source.path, target.path));
+
+    ResyncEngine resync;
+    WTG_CHECK(resync.Run(source.path, target.path));
+    WTG_CHECK(resync.Stats().files == 81);
+    WTG_CHECK(resync.Stats().unchanged == 81);
+    WTG_CHECK(resync.Stats().bytesRead == 0);
+    WTG_CHECK(resync.Stats().bytesWritten == 0);
+
+    Manifest kept;
+    WTG_CHECK(kept.LoadAny(target.path / Manifest::FILE_NAME));
+    WTG_CHECK(kept.ChunkSize() == copyOptions.chunkSize);
+    WTG_CHECK(kept.Hash() == HASH_CRC32C);
+
+    // One chunk of the large file changes; only that chunk is written
+    std::vector<uint8_t> large = ReadTestFile(source.path / "large.bin");
+    large[5 << 20] ^= 0xff;
+    WriteTestFile(source.path / "large.bin", large);
+    WTG_CHECK(resync.Run(source.path, target.path));
+    WTG_CHECK(resync.Stats().unchanged == 80);
+    WTG_CHECK(resync.Stats().updated == 1);
+    WTG_CHECK(resync.Stats().chunksWritten == 1);
+    WTG_CHECK(ReadTestFile(target.path / "large.bin") == large);
+}
+
+// Every file of the tree is on the target with the same bytes and modification time
+inline void CheckTestTree(const std::filesystem::path& source, const std::filesystem::path& target) {
+    size_t count = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(source)) {
+        if (!entry.is_regular_file()) continue;
+        auto copy = target / entry.path().lexically_relative(source);
+        WTG_CHECK(ReadTestFile(copy) == ReadTestFile(entry.path()));
+        WTG_CHECK(std::filesystem::last_write_time(copy) == entry.last_write_time());
+        count++;
+    }
+    WTG_CHECK(count == 81);
+}
+
+// An ordered copy (disk order from the read planner) still batches: the small files of each
+// planned batch go out a directory at a time and their metadata follows in its own pass
+inline void TestOrderedBatched() {
+    TestDirectory source("ordered_source"), target("ordered_target");
+    MakeTestTree(source.path);
+
+    CopyOptions options;
+    options.threads = 4;
+    options.chunkSize = 1 << 20;
+    options.largeFileThreshold = 4 << 20;
+    options.ordered = true;
+    options.batched = true;
+    options.readAhead = 256 << 10;
+    CopyEngine copy(options);
+    WTG_CHECK(copy.Run(source.path, target.path));
+    WTG_CHECK(copy.Stats().files == 81);
+    WTG_CHECK(copy.Stats().plan.files == 81);
+    WTG_CHECK(copy.Stats().clusters >= 4);
+    WTG_CHECK(copy.Stats().clusters < 80);
+    WTG_CHECK(copy.Stats().metadataSeconds > 0);
+    CheckTestTree(source.path, target.path);
+}
+
+inline int RunCopyTests() {
+    TestCopyThenResync();
+    TestOrderedBatched();
+    return TestFailures();
+}
+
+#endif
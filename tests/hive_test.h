@@ -0,0 +1,118 @@
+#ifndef _HIVE_TEST_H_
+#define _HIVE_TEST_H_
+#include <fstream>
+#include <iterator>
+#include "test.h"
+#include "../editor/hive_tweaks.h"
+
+// Same names, classes and values, and the same subkeys all the way down; subkeys are looked
+// up by name since a saved hive lists them sorted
+inline bool SameKey(const Hive::Key& a, const Hive::Key& b) {
+    if (a.name != b.name || a.className != b.className || a.values.size() != b.values.size() || a.subkeys.size() != b.subkeys.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.values.size(); ++i) {
+        if (a.values[i].name != b.values[i].name || a.values[i].type != b.values[i].type || a.values[i].data != b.values[i].data) return false;
+    }
+    for (const auto& subkey : a.subkeys) {
+        const Hive::Key* other = b.Find(subkey->name);
+        if (!other || !SameKey(*subkey, *other)) return false;
+    }
+    return true;
+}
+
+inline bool ChecksumValid(const std::vector<uint8_t>& image) {
+    return image.size() >= Hive::BASE_BLOCK_SIZE && Hive::Get32(image.data(), 0x1FC) == Hive::Checksum(image.data());
+}
+
+inline std::vector<uint8_t> HiveFileBytes(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// A Windows 10 SOFTWARE/SYSTEM pair as the version detector and the tweak table expect it,
+// with unrelated keys of every value type beside them that the tweaks must leave alone
+inline void MakeTestHives(Hive& software, Hive& system) {
+    software.CreateEmpty(L"ROOT");
+    Hive::Key* current = software.CreatePath(L"Microsoft\\Windows NT\\CurrentVersion");
+    current->SetValue(L"CurrentMajorVersionNumber", REGF_DWORD, Hive::EncodeDword(10));
+    current->SetValue(L"CurrentMinorVersionNumber", REGF_DWORD, Hive::EncodeDword(0));
+    current->SetValue(L"CurrentBuildNumber", REGF_SZ, Hive::EncodeString(L"19045"));
+    current->SetValue(L"UBR", REGF_DWORD, Hive::EncodeDword(1));
+    Hive::Key* classes = software.CreatePath(L"Classes");
+    for (int i = 0; i < 300; ++i) classes->Create(L".ext" + std::to_wstring(i))->SetValue(L"", REGF_SZ, Hive::EncodeString(L"file" + std::to_wstring(i)));
+
+    system.CreateEmpty(L"ROOT");
+    system.CreatePath(L"Select")->SetValue(L"Current", REGF_DWORD, Hive::EncodeDword(1));
+    system.CreatePath(L"ControlSet001\\Control\\Session Manager\\Memory Management")
+        ->SetValue(L"PagingFiles", REGF_MULTI_SZ, Hive::EncodeMultiString({ L"?:\\pagefile.sys" }));
+    system.CreatePath(L"ControlSet001\\Control\\Power")->SetValue(L"HibernateEnabled", REGF_DWORD, Hive::EncodeDword(1));
+    system.CreatePath(L"ControlSet001\\Services\\SysMain")->SetValue(L"Start", REGF_DWORD, Hive::EncodeDword(2));
+    Hive::Key* other = system.CreatePath(L"ControlSet001\\Services\\Tcpip\\Parameters");
+    other->className = { 'W', 0, 'T', 0, 'G', 0 };
+    other->SetValue(L"Hostname", REGF_SZ, Hive::EncodeString(L"wtg"));
+    other->SetValue(L"DataBasePath", REGF_EXPAND_SZ, Hive::EncodeString(L"%SystemRoot%\\System32\\drivers\\etc"));
+    other->SetValue(L"Blob", REGF_BINARY, TestBytes(20000, 1));
+    other->SetValue(L"Tiny", REGF_BINARY, { 0x5A });
+    other->SetValue(L"Stamp", REGF_QWORD, Hive::EncodeQword(0x0123456789ABCDEFULL));
+    other->SetValue(L"Empty", REGF_NONE, {});
+}
+
+// Parse(Serialize()) gives back the same tree and a valid base block checksum; the tweaks
+// apply once to a SYSTEM/SOFTWARE pair, keep the rest of each hive, and a second pass finds
+// nothing to change and writes nothing
+inline int RunHiveTests() {
+    Hive software, system;
+    MakeTestHives(software, system);
+    for (const Hive* hive : { &software, &system }) {
+        std::vector<uint8_t> image = hive->Serialize();
+        WTG_CHECK(ChecksumValid(image));
+        Hive back;
+        WTG_CHECK(back.Parse(image.data(), image.size()));
+        WTG_CHECK(back.Root() && SameKey(*hive->Root(), *back.Root()));
+    }
+
+    TestDirectory work("hive");
+    std::filesystem::path config = work.path / "Windows" / "System32" / "config";
+    std::filesystem::create_directories(config);
+    WTG_CHECK(software.Save(config / "SOFTWARE") && system.Save(config / "SYSTEM"));
+
+    HiveTweaker tweaker;
+    WTG_CHECK(tweaker.Apply(work.path));
+    WTG_CHECK(tweaker.Stats().version == WIN_10);
+    WTG_CHECK(tweaker.Stats().applied > 0);
+    WTG_CHECK(tweaker.Stats().hivesWritten == 2);
+
+    for (const auto& [name, before] : { std::make_pair("SYSTEM", &system), std::make_pair("SOFTWARE", &software) }) {
+        std::vector<uint8_t> image = HiveFileBytes(config / name);
+        WTG_CHECK(ChecksumValid(image));
+        Hive after;
+        WTG_CHECK(after.Parse(image.data(), image.size()));
+        for (const auto& tweak : HiveTweaker::Table()) {
+            if (std::wstring(tweak.hive) != std::wstring(name, name + std::strlen(name))) continue;
+            std::wstring path = tweak.key;
+            if (path.compare(0, 17, L"CurrentControlSet") == 0) path = L"ControlSet001" + path.substr(17);
+            Hive::Key* key = after.Open(path);
+            const Hive::Value* value = nullptr;
+            for (size_t i = 0; key && i < key->values.size(); ++i) {
+                if (key->values[i].name == tweak.value) value = &key->values[i];
+            }
+            WTG_CHECK(key && value);
+            WTG_CHECK(value && value->type == static_cast<uint32_t>(tweak.type) && value->data == HiveTweaker::Encode(tweak));
+        }
+        for (const wchar_t* untouched : { L"ControlSet001\\Services\\Tcpip", L"Classes", L"Select" }) {
+            Hive::Key* original = before->Open(untouched);
+            Hive::Key* kept = after.Open(untouched);
+            if (original) WTG_CHECK(kept && SameKey(*original, *kept));
+        }
+    }
+
+    std::vector<uint8_t> systemBytes = HiveFileBytes(config / "SYSTEM");
+    WTG_CHECK(tweaker.Apply(work.path));
+    WTG_CHECK(tweaker.Stats().applied == 0);
+    WTG_CHECK(tweaker.Stats().hivesWritten == 0);
+    WTG_CHECK(HiveFileBytes(config / "SYSTEM") == systemBytes);
+    return TestFailures();
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _JOURNAL_TEST_H_
+#define _JOURNAL_TEST_H_
+#include "test.h"
+#include "../pipeline/journal.h"
+
+// A journal moved off the volume a batch clones keeps what it recorded, goes on recording at
+// its new place, and leaves nothing behind at the old one; a rerun can tell whether a journal
+// it finds is its own
+inline int RunJournalTests() {
+    TestDirectory stick("journal_stick"), host("journal_host");
+    std::filesystem::path before = stick.path / Journal::FILE_NAME, after = host.path / Journal::FILE_NAME;
+    JournalFile entry;
+    entry.size = 4096;
+    entry.sourceTime = 7;
+
+    Journal journal;
+    WTG_CHECK(journal.Open(before, "run", true));
+    WTG_CHECK(journal.RecordStage("stage.prepare"));
+    journal.RecordFile("windows/system32/a.dll", entry);
+    WTG_CHECK(journal.Move(after, false));
+    WTG_CHECK(!std::filesystem::exists(before));
+    WTG_CHECK(journal.IsOpen());
+    WTG_CHECK(journal.StageDone("stage.prepare"));
+    WTG_CHECK(journal.FileDone("windows/system32/a.dll") != nullptr);
+    WTG_CHECK(journal.RecordStage("stage.replicate"));
+    journal.Close();
+
+    // A rerun with the same identity finds both stages; another identity starts over
+    Journal rerun;
+    WTG_CHECK(rerun.Open(after, "run", false));
+    WTG_CHECK(rerun.StageDone("stage.prepare") && rerun.StageDone("stage.replicate"));
+    WTG_CHECK(rerun.FileDone("windows/system32/a.dll") != nullptr);
+    WTG_CHECK(Journal::Matches(after, "run"));
+    WTG_CHECK(!Journal::Matches(after, "other run"));
+    WTG_CHECK(!Journal::Matches(before, "run"));
+    WTG_CHECK(rerun.Open(after, "other run", false));
+    WTG_CHECK(!rerun.StageDone("stage.prepare"));
+    WTG_CHECK(rerun.Remove());
+    WTG_CHECK(!std::filesystem::exists(after));
+
+    // A journal left on this machine by another run (a block copy, another drive list) is
+    // told apart before it is opened, and so is a file cut off inside its header
+    Journal stale;
+    WTG_CHECK(stale.Open(after, "block copy of E:", false));
+    WTG_CHECK(stale.RecordStage("stage.prepare"));
+    stale.Close();
+    WTG_CHECK(!Journal::Matches(after, "file copy of E:"));
+    WTG_CHECK(Journal::Matches(after, "block copy of E:"));
+    std::filesystem::resize_file(after, 12);
+    WTG_CHECK(!Journal::Matches(after, "block copy of E:"));
+    return TestFailures();
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _TEST_H_
+#define _TEST_H_
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Just enough of a test harness for CTest: a failed check prints where and what, the
+// suite keeps going, and the process exits non-zero if anything failed.
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define WTG_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::wcerr << __FILE__ << L":" << __LINE__ << L": check failed: " << #condition << std::endl; \
+            TestFailures()++; \
+        } \
+    } while (0)
+
+// A fresh directory under the temp directory, removed again when the test is done
+struct TestDirectory {
+    std::filesystem::path path;
+
+    explicit TestDirectory(const std::string& name) {
+        path = std::filesystem::temp_directory_path() / ("wtg_test_" + name + "_" + std::to_string(std::random_device()()));
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+        std::filesystem::create_directories(path, ec);
+    }
+
+    ~TestDirectory() {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+};
+
+// Deterministic bytes that compress somewhere between text and noise
+inline std::vector<uint8_t> TestBytes(size_t size, uint64_t seed, int alphabet = 256) {
+    std::mt19937_64 random(seed);
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (i >= 64 && random() % 4 == 0) data[i] = data[i - 1 - random() % 64];
+        else data[i] = static_cast<uint8_t>(random() % alphabet);
+    }
+    return data;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#include <iostream>
+#include <string>
+#include "bcd_test.h"
+#include "compression_test.h"
+#include "copy_test.h"
+#include "hive_test.h"
+#include "journal_test.h"
+
+// Unit tests for the portable engines, one suite per argument; CTest runs each on its own.
+//   wtg_tests bcd|compression|copy|hive|journal
+static void Usage() {
+    std::wcerr << L"usage: wtg_tests bcd|compression|copy|hive|journal" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        Usage();
+        return 1;
+    }
+    std::string suite = argv[1];
+    if (suite == "bcd") return RunBcdTests() == 0 ? 0 : 1;
+    if (suite == "compression") return RunCompressionTests() == 0 ? 0 : 1;
+    if (suite == "copy") return RunCopyTests() == 0 ? 0 : 1;
+    if (suite == "hive") return RunHiveTests() == 0 ? 0 : 1;
+    if (suite == "journal") return RunJournalTests() == 0 ? 0 : 1;
+    Usage();
+    return 1;
+}
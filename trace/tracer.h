@@ -0,0 +1,251 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// One timed span or counter sample. Names and categories are string literals, never copied.
+struct TraceEvent {
+    const char* name = nullptr;
+    const char* category = nullptr;
+    uint64_t start = 0;                                  // ns since the tracer's epoch
+    uint64_t duration = 0;                               // ns; UINT64_MAX marks a counter sample
+    uint64_t value = 0;                                  // Bytes for spans, the value for counters
+    uint32_t thread = 0;
+};
+
+// Latency and volume of every span with one name
+struct TraceSummary {
+    static constexpr size_t BUCKETS = 32;                // Powers of two of microseconds
+
+    std::string name;
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    double totalMs = 0;
+    double p50Ms = 0;
+    double p90Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+    uint64_t histogram[BUCKETS] = {};                    // [i] counts spans under 2^i us, [0] under 1 us
+
+    std::wstring ToString() const {
+        std::wstring text = std::wstring(name.begin(), name.end()) + L": " + std::to_wstring(count) + L" x, "
+            + std::to_wstring(totalMs) + L" ms, p50 " + std::to_wstring(p50Ms) + L" p90 " + std::to_wstring(p90Ms)
+            + L" p99 " + std::to_wstring(p99Ms) + L" max " + std::to_wstring(maxMs) + L" ms";
+        if (bytes != 0) {
+            text += L", " + std::to_wstring(bytes / 1000000) + L" MB ("
+                + std::to_wstring(static_cast<uint64_t>(totalMs > 0 ? bytes / totalMs / 1e3 : 0)) + L" MB/s per span)";
+        }
+        text += L"\n    us:";
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            if (histogram[i] != 0) text += L" <" + std::to_wstring(1ULL << i) + L":" + std::to_wstring(histogram[i]);
+        }
+        return text;
+    }
+};
+
+// Process-wide recorder for spans and counters. Off by default: a TraceScope then costs one
+// relaxed load. When on, every thread appends to a buffer of its own under a lock nobody
+// else takes until the trace is written, so workers do not contend.
+// WriteChromeTrace() emits the trace-event JSON chrome://tracing and Perfetto open;
+// Summarize() folds the spans into per-name latency histograms and byte totals.
+class Tracer {
+
+    public:
+
+        static Tracer& Instance() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        void Enable(bool on = true) { enabled.store(on, std::memory_order_relaxed); }
+        bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        uint64_t Now() const {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - epoch).count());
+        }
+
+        void Record(const TraceEvent& event) {
+            Buffer& buffer = Local();
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            buffer.events.push_back(event);
+            buffer.events.back().thread = buffer.thread;
+        }
+
+        void Counter(const char* name, uint64_t value, const char* category = "counter") {
+            if (!Enabled()) return;
+            TraceEvent event;
+            event.name = name;
+            event.category = category;
+            event.start = Now();
+            event.duration = UINT64_MAX;
+            event.value = value;
+            Record(event);
+        }
+
+        // Drops what was recorded, keeps the per-thread buffers
+        void Clear() {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            for (auto& buffer : buffers) {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                buffer->events.clear();
+            }
+        }
+
+        std::vector<TraceEvent> Events() const {
+            std::vector<TraceEvent> all;
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            for (const auto& buffer : buffers) {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                all.insert(all.end(), buffer->events.begin(), buffer->events.end());
+            }
+            std::sort(all.begin(), all.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+            return all;
+        }
+
+        bool WriteChromeTrace(const std::filesystem::path& path) const {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file) return false;
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            for (const TraceEvent& event : Events()) {
+                file << (first ? "" : ",\n") << "{\"name\":\"" << Escape(event.name) << "\",\"cat\":\"" << Escape(event.category)
+                     << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << Micros(event.start);
+                if (event.duration == UINT64_MAX) {
+                    file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+                }
+                else {
+                    file << ",\"ph\":\"X\",\"dur\":" << Micros(event.duration);
+                    if (event.value != 0) file << ",\"args\":{\"bytes\":" << event.value << "}";
+                    file << "}";
+                }
+                first = false;
+            }
+            file << "\n]}\n";
+            return static_cast<bool>(file.flush());
+        }
+
+        // Spans by name, in order of total time
+        std::vector<TraceSummary> Summarize() const {
+            std::map<std::string, std::vector<const TraceEvent*>> byName;
+            std::vector<TraceEvent> events = Events();
+            for (const TraceEvent& event : events) {
+                if (event.duration != UINT64_MAX) byName[event.name].push_back(&event);
+            }
+            std::vector<TraceSummary> summaries;
+            for (auto& [name, spans] : byName) {
+                std::sort(spans.begin(), spans.end(), [](const TraceEvent* a, const TraceEvent* b) { return a->duration < b->duration; });
+                TraceSummary summary;
+                summary.name = name;
+                summary.count = spans.size();
+                for (const TraceEvent* span : spans) {
+                    summary.bytes += span->value;
+                    summary.totalMs += span->duration / 1e6;
+                    uint64_t micros = span->duration / 1000;
+                    size_t bucket = 0;
+                    while (bucket + 1 < TraceSummary::BUCKETS && micros >= (1ULL << bucket)) bucket++;
+                    summary.histogram[bucket]++;
+                }
+                auto percentile = [&](double p) { return spans[std::min(spans.size() - 1, static_cast<size_t>(p * spans.size()))]->duration / 1e6; };
+                summary.p50Ms = percentile(0.50);
+                summary.p90Ms = percentile(0.90);
+                summary.p99Ms = percentile(0.99);
+                summary.maxMs = spans.back()->duration / 1e6;
+                summaries.push_back(std::move(summary));
+            }
+            std::sort(summaries.begin(), summaries.end(), [](const TraceSummary& a, const TraceSummary& b) { return a.totalMs > b.totalMs; });
+            return summaries;
+        }
+
+        std::wstring SummaryText() const {
+            std::wstring text;
+            for (const auto& summary : Summarize()) text += summary.ToString() + L"\n";
+            return text;
+        }
+
+    private:
+
+        struct Buffer {
+            std::mutex mutex;
+            std::vector<TraceEvent> events;
+            uint32_t thread = 0;
+        };
+
+        std::atomic<bool> enabled{ false };
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        mutable std::mutex buffersMutex;
+        std::vector<std::unique_ptr<Buffer>> buffers;    // Outlive their threads, tids are not reused
+
+        Tracer() = default;
+
+        Buffer& Local() {
+            thread_local Buffer* local = nullptr;
+            if (!local) {
+                std::lock_guard<std::mutex> lock(buffersMutex);
+                buffers.push_back(std::make_unique<Buffer>());
+                local = buffers.back().get();
+                local->thread = static_cast<uint32_t>(buffers.size());
+            }
+            return *local;
+        }
+
+        static std::string Micros(uint64_t ns) {
+            return std::to_string(ns / 1000) + "." + std::to_string(ns / 100 % 10);
+        }
+
+        static std::string Escape(const char* text) {
+            std::string escaped;
+            for (; text && *text; ++text) {
+                if (*text == '"' || *text == '\\') escaped += '\\';
+                escaped += *text;
+            }
+            return escaped;
+        }
+};
+
+// Times the enclosing block as one span. Bytes() attaches a volume, for MB/s in the summary.
+class TraceScope {
+
+    public:
+
+        explicit TraceScope(const char* spanName, const char* spanCategory = "stage") {
+            if (!Tracer::Instance().Enabled()) return;
+            name = spanName;
+            category = spanCategory;
+            start = Tracer::Instance().Now();
+        }
+
+        ~TraceScope() {
+            if (!name) return;
+            TraceEvent event;
+            event.name = name;
+            event.category = category;
+            event.start = start;
+            event.duration = Tracer::Instance().Now() - start;
+            event.value = bytes;
+            Tracer::Instance().Record(event);
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        void Bytes(uint64_t count) { bytes += count; }
+
+    private:
+
+        const char* name = nullptr;                      // Null while tracing is off
+        const char* category = nullptr;
+        uint64_t start = 0;
+        uint64_t bytes = 0;
+};
+
+#endif
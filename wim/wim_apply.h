@@ -0,0 +1,381 @@
+#ifndef _WIM_APPLY_H_
+#define _WIM_APPLY_H_
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <condition_variable>
+#include "wim_archive.h"
+#include "../copy/work_pool.h"
+#include "../io/fast_copy.h"
+#include "../platform/file.h"
+
+struct WimApplyOptions {
+    size_t threads = 0;             // Decompression workers, 0 = one per hardware thread
+    size_t window = 0;              // Chunks decoded ahead of the writer, 0 = 8 per worker
+    bool verify = true;             // Check every blob against its SHA-1
+    bool fastPaths = true;          // Reflink duplicate streams where the filesystem can
+};
+
+struct WimApplyStats {
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t hardLinks = 0;
+    uint64_t blobs = 0;             // Distinct streams decompressed
+    uint64_t duplicates = 0;        // Files served from a stream already decompressed for another file
+    uint64_t clones = 0;            // Duplicates reflinked instead of written
+    uint64_t skipped = 0;           // Reparse points and named streams, not applied
+    uint64_t chunks = 0;
+    uint64_t bytesRead = 0;         // Compressed bytes taken from the WIM
+    uint64_t bytesDecompressed = 0; // Distinct stream bytes
+    uint64_t bytes = 0;             // File bytes applied, duplicates included
+    double seconds = 0;
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+
+    std::wstring ToString() const {
+        return std::to_wstring(files) + L" files, " + std::to_wstring(bytes / 1000000) + L" MB ("
+            + std::to_wstring(bytesDecompressed / 1000000) + L" MB distinct) in " + std::to_wstring(seconds) + L" s ("
+            + std::to_wstring(static_cast<uint64_t>(MBPerSecond())) + L" MB/s)";
+    }
+};
+
+// Applies one image of a WIM to a directory without wimlib and without temporary files.
+// The tree is created first, then every distinct stream (blob) the image references is
+// decoded once, in WIM offset order so the archive is read front to back. Chunks are
+// decompressed on a work-stealing pool, up to `window` ahead, and handed back in order
+// to the calling thread, which hashes them and writes them straight into the target files.
+// A stream shared by several files is decompressed once: the first file is written and
+// the others are reflinked from it, or fed the same chunks where reflinks are not
+// available. Hard link groups become hard links.
+class WimApplier {
+
+    public:
+
+        explicit WimApplier(const WimApplyOptions& applyOptions = WimApplyOptions()) : options(applyOptions) {}
+        ~WimApplier() = default;
+
+        bool Run(const std::filesystem::path& wim, uint32_t image, const std::filesystem::path& target) {
+            stats = WimApplyStats();
+            error.clear();
+            cloneState = options.fastPaths ? CLONE_UNKNOWN : CLONE_NO;
+            auto start = std::chrono::steady_clock::now();
+
+            WimArchive archive;
+            std::vector<WimEntry> entries;
+            if (!archive.Open(wim) || !archive.ReadImage(image, entries)) return Fail(archive.Error());
+
+            std::vector<BlobPlan> plans;
+            std::vector<std::pair<size_t, size_t>> links;          // (leader, follower) entry indexes
+            if (!CreateTree(target, entries, archive, plans, links)) return false;
+            if (!ApplyBlobs(archive, target, entries, plans)) return false;
+
+            for (const auto& link : links) {
+                std::error_code ec;
+                std::filesystem::create_hard_link(target / entries[link.first].path, target / entries[link.second].path, ec);
+                if (ec) return Fail(L"Cannot create hard link " + entries[link.second].windowsPath);
+                stats.hardLinks++;
+            }
+            // Directories last and deepest first, creating their children touched them
+            for (const auto& entry : entries) {
+                if (!entry.Directory() && !entry.ReparsePoint()) ApplyMetadata(target / entry.path, entry);
+            }
+            for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+                if (it->Directory() && !it->ReparsePoint()) ApplyMetadata(target / it->path, *it);
+            }
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return true;
+        }
+
+        const WimApplyStats& Stats() const { return stats; }
+        const std::wstring& Error() const { return error; }
+
+    private:
+
+        enum CloneState {
+            CLONE_UNKNOWN,
+            CLONE_YES,
+            CLONE_NO
+        };
+
+        // A distinct stream and the entries that receive it
+        struct BlobPlan {
+            const WimBlob* blob = nullptr;
+            std::vector<size_t> targets;
+        };
+
+        // One chunk in the decode window
+        struct Slot {
+            size_t plan = 0;
+            uint64_t position = 0;          // Offset of the chunk inside the stream
+            bool last = false;
+            WimChunk chunk;
+            std::vector<uint8_t> buffer;
+            const uint8_t* data = nullptr;
+            bool done = false;
+            bool ok = false;
+        };
+
+        // Output side of the blob being written
+        struct Writer {
+            File primary;
+            std::vector<std::unique_ptr<File>> copies;        // Fed the same chunks
+            std::vector<size_t> clones;                       // Entries reflinked from the primary at the end
+            std::filesystem::path primaryPath;
+            std::wstring name;
+            Sha1 sha;
+        };
+
+        WimApplyOptions options;
+        WimApplyStats stats;
+        std::wstring error;
+        CloneState cloneState = CLONE_UNKNOWN;
+
+        bool Fail(const std::wstring& message) {
+            if (error.empty()) error = message;
+            return false;
+        }
+
+        bool CreateTree(const std::filesystem::path& target, const std::vector<WimEntry>& entries, WimArchive& archive,
+                        std::vector<BlobPlan>& plans, std::vector<std::pair<size_t, size_t>>& links) {
+            std::error_code ec;
+            std::filesystem::create_directories(target, ec);
+            if (ec) return Fail(L"Cannot create " + target.wstring());
+            std::unordered_map<Sha1Digest, size_t, Sha1DigestHash> planIndex;
+            std::unordered_map<uint64_t, size_t> groups;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const WimEntry& entry = entries[i];
+                stats.skipped += entry.namedStreams;
+                if (entry.ReparsePoint()) {
+                    // Junctions and symlinks need the reparse data applied natively; left out
+                    stats.skipped++;
+                    continue;
+                }
+                std::filesystem::path path = target / entry.path;
+                if (entry.Directory()) {
+                    std::filesystem::create_directory(path, ec);
+                    if (ec) return Fail(L"Cannot create " + entry.windowsPath);
+                    stats.directories++;
+                    continue;
+                }
+                if (entry.hardLinkGroup != 0) {
+                    auto group = groups.emplace(entry.hardLinkGroup, i);
+                    if (!group.second) {
+                        links.emplace_back(group.first->second, i);
+                        continue;
+                    }
+                }
+                stats.files++;
+                const WimBlob* blob = entry.HasData() ? archive.FindBlob(entry.hash) : nullptr;
+                if (entry.HasData() && !blob) return Fail(L"Stream " + Sha1::ToString(entry.hash) + L" of " + entry.windowsPath + L" is missing from the WIM");
+                if (!blob || blob->resource.originalSize == 0) {
+                    File empty;
+                    if (!empty.Open(path, File::WRITE)) return Fail(empty.Error());
+                    continue;
+                }
+                auto found = planIndex.emplace(entry.hash, plans.size());
+                if (found.second) plans.push_back(BlobPlan{ blob, {} });
+                plans[found.first->second].targets.push_back(i);
+            }
+            // Read the archive front to back
+            std::sort(plans.begin(), plans.end(), [](const BlobPlan& left, const BlobPlan& right) {
+                return left.blob->resource.offset < right.blob->resource.offset;
+            });
+            return true;
+        }
+
+        bool ApplyBlobs(WimArchive& archive, const std::filesystem::path& target, const std::vector<WimEntry>& entries, std::vector<BlobPlan>& plans) {
+            WorkStealingPool pool(options.threads);
+            size_t window = options.window ? options.window : pool.Threads() * 8;
+            std::vector<Slot> slots(window);
+            std::mutex mutex;
+            std::condition_variable ready;
+            archive.Sequential();
+
+            // Producer position
+            size_t plan = 0;
+            size_t chunkIndex = 0;
+            uint64_t position = 0;
+            std::vector<WimChunk> chunks;
+            bool loaded = false;
+            size_t submitted = 0;
+            size_t consumed = 0;
+            bool failed = false;
+
+            auto produce = [&](Slot& slot) {
+                while (plan < plans.size()) {
+                    if (!loaded) {
+                        if (!archive.Chunks(plans[plan].blob->resource, chunks)) return Fail(archive.Error());
+                        loaded = true;
+                        chunkIndex = 0;
+                        position = 0;
+                    }
+                    if (chunkIndex < chunks.size()) break;
+                    plan++;
+                    loaded = false;
+                }
+                if (plan >= plans.size()) return false;
+                slot.plan = plan;
+                slot.chunk = chunks[chunkIndex];
+                slot.position = position;
+                slot.last = chunkIndex + 1 == chunks.size();
+                position += slot.chunk.originalSize;
+                chunkIndex++;
+                stats.chunks++;
+                stats.bytesRead += slot.chunk.size;
+                if (slot.chunk.size == slot.chunk.originalSize) {
+                    // Stored raw: hand out the mapping itself, nothing to decode
+                    slot.data = archive.Data() + slot.chunk.offset;
+                    slot.ok = slot.done = true;
+                    return true;
+                }
+                slot.done = false;
+                if (slot.buffer.size() < slot.chunk.originalSize) slot.buffer.resize(archive.ChunkSize());
+                pool.Submit([&archive, &slot, &mutex, &ready] {
+                    static thread_local WimDecoder decoder;
+                    bool ok = archive.ReadChunk(slot.chunk, decoder, slot.buffer.data());
+                    std::lock_guard<std::mutex> lock(mutex);
+                    slot.data = slot.buffer.data();
+                    slot.ok = ok;
+                    slot.done = true;
+                    ready.notify_all();
+                });
+                return true;
+            };
+
+            Writer writer;
+            while (!failed) {
+                while (submitted - consumed < window && produce(slots[submitted % window])) submitted++;
+                if (consumed == submitted) break;
+                Slot& slot = slots[consumed % window];
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&] { return slot.done; });
+                }
+                consumed++;
+                if (!slot.ok) {
+                    Fail(L"Corrupt compressed chunk at offset " + std::to_wstring(slot.chunk.offset));
+                    failed = true;
+                    break;
+                }
+                BlobPlan& current = plans[slot.plan];
+                if (slot.position == 0 && !OpenWriter(target, entries, current, writer)) {
+                    failed = true;
+                    break;
+                }
+                if (!WriteChunk(writer, slot)) {
+                    failed = true;
+                    break;
+                }
+                if (slot.last && !CloseWriter(target, entries, current, writer)) failed = true;
+            }
+            // Workers still hold references to the slots
+            pool.Wait();
+            if (!failed && !error.empty()) failed = true;
+            return !failed;
+        }
+
+        bool OpenWriter(const std::filesystem::path& target, const std::vector<WimEntry>& entries, const BlobPlan& plan, Writer& writer) {
+            writer.copies.clear();
+            writer.clones.clear();
+            writer.sha.Reset();
+            writer.primaryPath = target / entries[plan.targets[0]].path;
+            writer.name = entries[plan.targets[0]].windowsPath;
+            if (!writer.primary.Open(writer.primaryPath, File::WRITE)) return Fail(writer.primary.Error());
+            if (plan.blob->resource.originalSize > 0) writer.primary.Resize(plan.blob->resource.originalSize);
+            for (size_t i = 1; i < plan.targets.size(); ++i) {
+                std::filesystem::path path = target / entries[plan.targets[i]].path;
+                if (cloneState != CLONE_NO) {
+                    writer.clones.push_back(plan.targets[i]);
+                    continue;
+                }
+                writer.copies.push_back(std::make_unique<File>());
+                if (!writer.copies.back()->Open(path, File::WRITE)) return Fail(writer.copies.back()->Error());
+            }
+            stats.blobs++;
+            stats.duplicates += plan.targets.size() - 1;
+            return true;
+        }
+
+        bool WriteChunk(Writer& writer, const Slot& slot) {
+            size_t length = slot.chunk.originalSize;
+            if (options.verify) writer.sha.Update(slot.data, length);
+            if (!writer.primary.WriteAt(slot.data, length, slot.position)) return Fail(L"Write failed: " + writer.name);
+            for (auto& copy : writer.copies) {
+                if (!copy->WriteAt(slot.data, length, slot.position)) return Fail(L"Write failed: " + writer.name);
+                stats.bytes += length;
+            }
+            stats.bytes += length;
+            stats.bytesDecompressed += length;
+            return true;
+        }
+
+        bool CloseWriter(const std::filesystem::path& target, const std::vector<WimEntry>& entries, const BlobPlan& plan, Writer& writer) {
+            writer.primary.Close();
+            writer.copies.clear();
+            if (options.verify && writer.sha.Final() != plan.blob->hash) {
+                return Fail(L"SHA-1 mismatch for " + entries[plan.targets[0]].windowsPath);
+            }
+            for (size_t index : writer.clones) {
+                std::filesystem::path path = target / entries[index].path;
+                uint64_t size = plan.blob->resource.originalSize;
+                File input;
+                File output;
+                if (!input.Open(writer.primaryPath, File::READ) || !output.Open(path, File::WRITE)) return Fail(L"Cannot create " + entries[index].windowsPath);
+                FastCopyResult result = FastCopy::Clone(input, output);
+                if (result == FAST_COPY_DONE) {
+                    cloneState = CLONE_YES;
+                    stats.clones++;
+                    stats.bytes += size;
+                    continue;
+                }
+                // No reflinks here: later duplicates are fed the chunks as they are decoded
+                if (result == FAST_COPY_UNSUPPORTED && cloneState == CLONE_UNKNOWN) cloneState = CLONE_NO;
+                output.Close();
+                std::error_code ec;
+                std::filesystem::copy_file(writer.primaryPath, path, std::filesystem::copy_options::overwrite_existing, ec);
+                if (ec) return Fail(L"Cannot copy " + writer.name + L" to " + entries[index].windowsPath);
+                stats.bytes += size;
+            }
+            return true;
+        }
+
+        // Timestamps, and on Windows the attributes; permissions and ACLs are left as created
+        static void ApplyMetadata(const std::filesystem::path& path, const WimEntry& entry) {
+#ifdef _WIN32
+            HANDLE handle = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+            if (handle != INVALID_HANDLE_VALUE) {
+                FILETIME times[3];
+                const uint64_t values[3] = { entry.creationTime, entry.lastAccessTime, entry.lastWriteTime };
+                for (int i = 0; i < 3; ++i) {
+                    times[i].dwLowDateTime = static_cast<DWORD>(values[i]);
+                    times[i].dwHighDateTime = static_cast<DWORD>(values[i] >> 32);
+                }
+                SetFileTime(handle, values[0] ? &times[0] : NULL, values[1] ? &times[1] : NULL, values[2] ? &times[2] : NULL);
+                CloseHandle(handle);
+            }
+            const DWORD settable = FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM
+                | FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+            if (entry.attributes & settable) SetFileAttributesW(path.c_str(), entry.attributes & settable);
+#else
+            if (entry.lastWriteTime == 0) return;
+            struct timespec times[2];
+            const uint64_t values[2] = { entry.lastAccessTime ? entry.lastAccessTime : entry.lastWriteTime, entry.lastWriteTime };
+            for (int i = 0; i < 2; ++i) {
+                // FILETIME counts 100 ns ticks from 1601
+                int64_t ticks = static_cast<int64_t>(values[i]) - 116444736000000000LL;
+                int64_t seconds = ticks / 10000000;
+                int64_t remainder = ticks % 10000000;
+                if (remainder < 0) {
+                    remainder += 10000000;
+                    seconds--;
+                }
+                times[i].tv_sec = static_cast<time_t>(seconds);
+                times[i].tv_nsec = static_cast<long>(remainder * 100);
+            }
+            utimensat(AT_FDCWD, path.c_str(), times, 0);
+#endif
+        }
+};
+
+#endif
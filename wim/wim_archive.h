@@ -0,0 +1,407 @@
+#ifndef _WIM_ARCHIVE_H_
+#define _WIM_ARCHIVE_H_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include "../compression/lzx.h"
+#include "../compression/xpress_huffman.h"
+#include "../hash/sha1.h"
+#include "../platform/mapped_file.h"
+
+// Where a resource (a file's data, an image's metadata, the blob table) sits in the WIM
+struct WimResource {
+    static constexpr uint8_t FREE = 0x01;
+    static constexpr uint8_t METADATA = 0x02;
+    static constexpr uint8_t COMPRESSED = 0x04;
+    static constexpr uint8_t SPANNED = 0x08;
+    static constexpr uint8_t SOLID = 0x10;
+
+    uint64_t sizeInWim = 0;
+    uint64_t offset = 0;
+    uint64_t originalSize = 0;
+    uint8_t flags = 0;
+};
+
+// Blob table entry: one stored stream, named by the SHA-1 of its contents
+struct WimBlob {
+    WimResource resource;
+    uint16_t part = 0;
+    uint32_t refCount = 0;
+    Sha1Digest hash{};
+};
+
+// One independently compressed piece of a resource. `size == originalSize` means stored raw.
+struct WimChunk {
+    uint64_t offset = 0;           // In the WIM file
+    uint32_t size = 0;
+    uint32_t originalSize = 0;
+};
+
+// A file or directory of an image, flattened from the metadata resource
+struct WimEntry {
+    static constexpr uint32_t ATTRIBUTE_DIRECTORY = 0x10;
+    static constexpr uint32_t ATTRIBUTE_REPARSE_POINT = 0x400;
+
+    std::filesystem::path path;    // Relative to the image root
+    std::wstring windowsPath;      // The same, backslash separated, for messages
+    uint32_t attributes = 0;
+    uint64_t creationTime = 0;     // FILETIME
+    uint64_t lastAccessTime = 0;
+    uint64_t lastWriteTime = 0;
+    Sha1Digest hash{};             // Unnamed data stream, all zero when empty
+    uint64_t hardLinkGroup = 0;    // Entries sharing a non-zero group are one file
+    uint32_t reparseTag = 0;
+    uint16_t namedStreams = 0;
+
+    bool Directory() const { return (attributes & ATTRIBUTE_DIRECTORY) != 0; }
+    bool ReparsePoint() const { return (attributes & ATTRIBUTE_REPARSE_POINT) != 0; }
+    bool HasData() const { return hash != Sha1Digest{}; }
+};
+
+// Per-thread decompression state; the LZX and XPRESS decoders keep their tables between chunks
+struct WimDecoder {
+    XpressHuffmanDecoder xpress;
+    LzxDecoder lzx;
+};
+
+// Reads a WIM (install.wim, boot.wim) through a memory mapping: the header, the blob table
+// and the directory trees in each image's metadata resource. Chunks are decoded on demand
+// into caller buffers so the apply engine can spread them over threads. Handles
+// uncompressed, XPRESS and LZX archives; LZMS, solid (ESD) and split WIMs are rejected
+// with a clear error.
+class WimArchive {
+
+    public:
+
+        enum Compression {
+            COMPRESSION_NONE,
+            COMPRESSION_XPRESS,
+            COMPRESSION_LZX,
+            COMPRESSION_LZMS
+        };
+
+        static constexpr size_t HEADER_SIZE = 208;
+        static constexpr size_t BLOB_ENTRY_SIZE = 50;
+        static constexpr size_t DENTRY_MIN_SIZE = 102;
+        static constexpr uint32_t FLAG_COMPRESSION = 0x00000002;
+        static constexpr uint32_t FLAG_XPRESS = 0x00020000;
+        static constexpr uint32_t FLAG_LZX = 0x00040000;
+        static constexpr uint32_t FLAG_LZMS = 0x00080000;
+
+        WimArchive() = default;
+        ~WimArchive() = default;
+
+        bool Open(const std::filesystem::path& path) {
+            blobs.clear();
+            metadata.clear();
+            if (!file.Open(path)) return Fail(file.Error());
+            const uint8_t* header = file.Data();
+            if (file.Size() < HEADER_SIZE) return Fail(L"Not a WIM file: " + path.wstring());
+            if (std::memcmp(header, "WLPWM\0\0\0", 8) == 0) return Fail(L"Pipable WIMs are not supported");
+            if (std::memcmp(header, "MSWIM\0\0\0", 8) != 0) return Fail(L"Not a WIM file: " + path.wstring());
+
+            uint32_t flags = Get32(header, 0x10);
+            chunkSize = Get32(header, 0x14);
+            if (chunkSize == 0) chunkSize = 32768;
+            compression = COMPRESSION_NONE;
+            if (flags & FLAG_COMPRESSION) {
+                if (flags & FLAG_LZMS) compression = COMPRESSION_LZMS;
+                else if (flags & FLAG_LZX) compression = COMPRESSION_LZX;
+                else if (flags & FLAG_XPRESS) compression = COMPRESSION_XPRESS;
+                else return Fail(L"Unknown WIM compression type");
+            }
+            if (compression == COMPRESSION_LZMS) return Fail(L"LZMS compressed WIMs (ESD) are not supported");
+            if (compression == COMPRESSION_LZX && chunkSize != LzxDecoder::CHUNK_SIZE) return Fail(L"Unsupported LZX chunk size");
+            if (compression == COMPRESSION_XPRESS && chunkSize > XpressHuffmanDecoder::MAX_CHUNK) return Fail(L"Unsupported XPRESS chunk size");
+            if (Get16(header, 0x2A) > 1) return Fail(L"Split WIMs are not supported");
+            imageCount = Get32(header, 0x2C);
+
+            std::vector<uint8_t> table;
+            WimDecoder decoder;
+            if (!ReadResource(ReadResourceHeader(header + 0x30), table, decoder)) return false;
+            for (size_t at = 0; at + BLOB_ENTRY_SIZE <= table.size(); at += BLOB_ENTRY_SIZE) {
+                WimBlob blob;
+                blob.resource = ReadResourceHeader(table.data() + at);
+                blob.part = Get16(table.data(), at + 24);
+                blob.refCount = Get32(table.data(), at + 26);
+                std::memcpy(blob.hash.data(), table.data() + at + 30, blob.hash.size());
+                // Metadata resources are listed in image order
+                if (blob.resource.flags & WimResource::METADATA) metadata.push_back(blob);
+                else if (!(blob.resource.flags & WimResource::FREE)) blobs.emplace(blob.hash, blob);
+            }
+            if (metadata.size() < imageCount) return Fail(L"WIM has fewer metadata resources than images");
+            return true;
+        }
+
+        uint32_t ImageCount() const { return imageCount; }
+        uint32_t ChunkSize() const { return chunkSize; }
+        Compression CompressionType() const { return compression; }
+        size_t BlobCount() const { return blobs.size(); }
+        const uint8_t* Data() const { return file.Data(); }
+        void Sequential() const { file.Sequential(); }
+        const std::wstring& Error() const { return error; }
+
+        const WimBlob* FindBlob(const Sha1Digest& hash) const {
+            auto found = blobs.find(hash);
+            return found == blobs.end() ? nullptr : &found->second;
+        }
+
+        // Splits a resource into its chunks by reading the chunk table in front of the data
+        bool Chunks(const WimResource& resource, std::vector<WimChunk>& chunks) {
+            chunks.clear();
+            if (resource.flags & WimResource::SOLID) return Fail(L"Solid resources are not supported");
+            if (resource.offset > file.Size() || resource.sizeInWim > file.Size() - resource.offset) {
+                return Fail(L"Resource lies outside the WIM file");
+            }
+            if (resource.originalSize == 0) return true;
+            size_t count = static_cast<size_t>((resource.originalSize + chunkSize - 1) / chunkSize);
+            if (!(resource.flags & WimResource::COMPRESSED)) {
+                if (resource.sizeInWim != resource.originalSize) return Fail(L"Uncompressed resource has the wrong size");
+                for (size_t i = 0; i < count; ++i) {
+                    uint64_t at = static_cast<uint64_t>(i) * chunkSize;
+                    uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(chunkSize, resource.originalSize - at));
+                    chunks.push_back(WimChunk{ resource.offset + at, length, length });
+                }
+                return true;
+            }
+            if (compression == COMPRESSION_NONE) return Fail(L"Compressed resource in an uncompressed WIM");
+
+            // (count - 1) offsets, relative to the end of the table; the first chunk starts at 0
+            size_t entrySize = resource.originalSize > 0xFFFFFFFFULL ? 8 : 4;
+            uint64_t tableSize = static_cast<uint64_t>(count - 1) * entrySize;
+            if (tableSize > resource.sizeInWim) return Fail(L"Corrupt chunk table");
+            const uint8_t* table = file.Data() + resource.offset;
+            uint64_t dataSize = resource.sizeInWim - tableSize;
+            uint64_t start = 0;
+            chunks.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t end = i + 1 < count ? (entrySize == 8 ? Get64(table, i * 8) : Get32(table, i * 4)) : dataSize;
+                uint64_t original = std::min<uint64_t>(chunkSize, resource.originalSize - static_cast<uint64_t>(i) * chunkSize);
+                if (end < start || end > dataSize || end - start > original || end == start) return Fail(L"Corrupt chunk table");
+                chunks.push_back(WimChunk{ resource.offset + tableSize + start, static_cast<uint32_t>(end - start), static_cast<uint32_t>(original) });
+                start = end;
+            }
+            return true;
+        }
+
+        // Decodes one chunk into `out` (chunk.originalSize bytes). Thread safe given a
+        // decoder per thread.
+        bool ReadChunk(const WimChunk& chunk, WimDecoder& decoder, uint8_t* out) const {
+            const uint8_t* in = file.Data() + chunk.offset;
+            if (chunk.size == chunk.originalSize) {
+                std::memcpy(out, in, chunk.size);
+                return true;
+            }
+            if (compression == COMPRESSION_LZX) return decoder.lzx.Decompress(in, chunk.size, out, chunk.originalSize);
+            if (compression == COMPRESSION_XPRESS) return decoder.xpress.Decompress(in, chunk.size, out, chunk.originalSize);
+            return false;
+        }
+
+        // Whole resource into memory, for the blob table and metadata
+        bool ReadResource(const WimResource& resource, std::vector<uint8_t>& out, WimDecoder& decoder) {
+            std::vector<WimChunk> chunks;
+            if (!Chunks(resource, chunks)) return false;
+            out.resize(static_cast<size_t>(resource.originalSize));
+            size_t at = 0;
+            for (const auto& chunk : chunks) {
+                if (!ReadChunk(chunk, decoder, out.data() + at)) return Fail(L"Corrupt compressed chunk at offset " + std::to_wstring(chunk.offset));
+                at += chunk.originalSize;
+            }
+            return true;
+        }
+
+        // Flattens the directory tree of image `index` (1-based); parents come before children
+        bool ReadImage(uint32_t index, std::vector<WimEntry>& entries) {
+            entries.clear();
+            if (index == 0 || index > imageCount) return Fail(L"Image " + std::to_wstring(index) + L" does not exist");
+            std::vector<uint8_t> tree;
+            WimDecoder decoder;
+            if (!ReadResource(metadata[index - 1].resource, tree, decoder)) return false;
+            if (tree.size() < 8) return Fail(L"Metadata resource is truncated");
+
+            // Security descriptors come first, then the root dentry
+            uint64_t securityLength = std::max<uint32_t>(Get32(tree.data(), 0), 8);
+            uint64_t root = (securityLength + 7) & ~7ULL;
+            Dentry dentry;
+            uint64_t next;
+            if (!ReadDentry(tree, root, dentry, next) || dentry.end) {
+                return Fail(L"Corrupt root directory entry");
+            }
+
+            // (child list offset, index of the directory entry or NO_PARENT for the root)
+            const size_t NO_PARENT = ~static_cast<size_t>(0);
+            std::vector<std::pair<uint64_t, size_t>> pending = { { dentry.subdirOffset, NO_PARENT } };
+            std::unordered_set<uint64_t> visited;
+            while (!pending.empty()) {
+                auto [offset, parent] = pending.back();
+                pending.pop_back();
+                if (offset == 0) continue;
+                if (!visited.insert(offset).second) return Fail(L"Directory cycle in image metadata");
+                while (true) {
+                    if (!ReadDentry(tree, offset, dentry, next)) return Fail(L"Corrupt directory entry at " + std::to_wstring(offset));
+                    if (dentry.end) break;
+                    if (!ValidName(dentry.name)) return Fail(L"Invalid file name in image metadata");
+                    if (parent == NO_PARENT) {
+                        dentry.entry.path = PathComponent(dentry.name);
+                        dentry.entry.windowsPath = dentry.name;
+                    }
+                    else {
+                        dentry.entry.path = entries[parent].path / PathComponent(dentry.name);
+                        dentry.entry.windowsPath = entries[parent].windowsPath + L"\\" + dentry.name;
+                    }
+                    if (dentry.entry.Directory() && !dentry.entry.ReparsePoint()) pending.emplace_back(dentry.subdirOffset, entries.size());
+                    entries.push_back(std::move(dentry.entry));
+                    offset = next;
+                }
+            }
+            return true;
+        }
+
+        static uint16_t Get16(const uint8_t* p, size_t offset) { return static_cast<uint16_t>(p[offset] | p[offset + 1] << 8); }
+        static uint32_t Get32(const uint8_t* p, size_t offset) { return Get16(p, offset) | static_cast<uint32_t>(Get16(p, offset + 2)) << 16; }
+        static uint64_t Get64(const uint8_t* p, size_t offset) { return Get32(p, offset) | static_cast<uint64_t>(Get32(p, offset + 4)) << 32; }
+
+    private:
+
+        struct Dentry {
+            WimEntry entry;
+            std::wstring name;
+            uint64_t subdirOffset = 0;
+            bool end = false;
+        };
+
+        MappedFile file;
+        uint32_t chunkSize = 32768;
+        uint32_t imageCount = 0;
+        Compression compression = COMPRESSION_NONE;
+        std::unordered_map<Sha1Digest, WimBlob, Sha1DigestHash> blobs;
+        std::vector<WimBlob> metadata;
+        std::wstring error;
+
+        bool Fail(const std::wstring& message) {
+            error = message;
+            return false;
+        }
+
+        // 7 bytes of stored size, a flags byte, the offset and the original size
+        static WimResource ReadResourceHeader(const uint8_t* p) {
+            WimResource resource;
+            resource.sizeInWim = Get64(p, 0) & 0x00FFFFFFFFFFFFFFULL;
+            resource.flags = p[7];
+            resource.offset = Get64(p, 8);
+            resource.originalSize = Get64(p, 16);
+            return resource;
+        }
+
+        // One dentry and its extra stream entries; `next` is where the following sibling starts
+        static bool ReadDentry(const std::vector<uint8_t>& tree, uint64_t offset, Dentry& dentry, uint64_t& next) {
+            dentry = Dentry();
+            if (offset > tree.size() || tree.size() - offset < 8) return false;
+            const uint8_t* p = tree.data() + offset;
+            uint64_t length = Get64(p, 0);
+            if (length <= 8) {
+                dentry.end = true;
+                return true;
+            }
+            if (length < DENTRY_MIN_SIZE || length > tree.size() - offset) return false;
+
+            WimEntry& entry = dentry.entry;
+            entry.attributes = Get32(p, 8);
+            dentry.subdirOffset = Get64(p, 16);
+            entry.creationTime = Get64(p, 40);
+            entry.lastAccessTime = Get64(p, 48);
+            entry.lastWriteTime = Get64(p, 56);
+            std::memcpy(entry.hash.data(), p + 64, entry.hash.size());
+            if (entry.ReparsePoint()) entry.reparseTag = Get32(p, 88);
+            else entry.hardLinkGroup = Get64(p, 88);
+            uint16_t streams = Get16(p, 96);
+            uint16_t nameBytes = Get16(p, 100);
+            if (DENTRY_MIN_SIZE + static_cast<uint64_t>(nameBytes) > length) return false;
+            dentry.name = DecodeUtf16(p + DENTRY_MIN_SIZE, nameBytes);
+
+            next = offset + ((length + 7) & ~7ULL);
+            for (uint16_t i = 0; i < streams; ++i) {
+                if (next > tree.size() || tree.size() - next < 38) return false;
+                const uint8_t* stream = tree.data() + next;
+                uint64_t streamLength = Get64(stream, 0);
+                if (streamLength < 38 || streamLength > tree.size() - next) return false;
+                Sha1Digest hash;
+                std::memcpy(hash.data(), stream + 16, hash.size());
+                // An unnamed extra stream carries the file data (or reparse data) instead
+                // of the dentry itself
+                if (Get16(stream, 36) == 0) {
+                    if (hash != Sha1Digest{}) entry.hash = hash;
+                }
+                else {
+                    entry.namedStreams++;
+                }
+                next += (streamLength + 7) & ~7ULL;
+            }
+            return true;
+        }
+
+        static std::wstring DecodeUtf16(const uint8_t* in, size_t length) {
+            std::wstring out;
+            out.reserve(length / 2);
+            for (size_t i = 0; i + 1 < length; i += 2) {
+                uint32_t unit = Get16(in, i);
+                if (sizeof(wchar_t) == 4 && unit >= 0xD800 && unit < 0xDC00 && i + 3 < length) {
+                    uint32_t low = Get16(in, i + 2);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        out += static_cast<wchar_t>(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                        i += 2;
+                        continue;
+                    }
+                }
+                out += static_cast<wchar_t>(unit);
+            }
+            return out;
+        }
+
+        // Windows takes the UTF-16 name as is. Elsewhere paths are UTF-8 bytes, and going
+        // through the narrow locale would fail for any non-ASCII name under LANG=C.
+        static std::filesystem::path PathComponent(const std::wstring& name) {
+#ifdef _WIN32
+            return std::filesystem::path(name);
+#else
+            std::string utf8;
+            for (wchar_t c : name) {
+                uint32_t code = static_cast<uint32_t>(c);
+                if (code < 0x80) {
+                    utf8 += static_cast<char>(code);
+                }
+                else if (code < 0x800) {
+                    utf8 += static_cast<char>(0xC0 | code >> 6);
+                    utf8 += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000) {
+                    utf8 += static_cast<char>(0xE0 | code >> 12);
+                    utf8 += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                    utf8 += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else {
+                    utf8 += static_cast<char>(0xF0 | code >> 18);
+                    utf8 += static_cast<char>(0x80 | (code >> 12 & 0x3F));
+                    utf8 += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                    utf8 += static_cast<char>(0x80 | (code & 0x3F));
+                }
+            }
+            return std::filesystem::path(utf8);
+#endif
+        }
+
+        // Names come from the archive; never let one climb out of the target directory
+        static bool ValidName(const std::wstring& name) {
+            if (name.empty() || name == L"." || name == L"..") return false;
+#ifdef _WIN32
+            if (name.find(L':') != std::wstring::npos) return false;
+#endif
+            return name.find_first_of(L"/\\") == std::wstring::npos && name.find(L'\0') == std::wstring::npos;
+        }
+};
+
+#endif
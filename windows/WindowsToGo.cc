@@ -1,25 +1,103 @@
 #include "WindowsToGo.h"
+#include <iostream>
 
 bool WindowsToGoCreator::ConfirmUserIntent() {
 
     return false;
 }
 
-void WindowsToGoCreator::ShowProgress(const std::wstring &message) {
-
+// Called after the monitor has stopped, so it has the console to itself
+void WindowsToGoCreator::WriteTrace(const std::string& path) {
+    if (!Tracer::Instance().WriteChromeTrace(path)) {
+        ShowError(L"Cannot write the trace to " + std::wstring(path.begin(), path.end()));
+        return;
+    }
+    std::wcout << L"Stage summary:" << std::endl << Tracer::Instance().SummaryText() << std::flush;
 }
 
-void WindowsToGoCreator::ShowError(const std::wstring &error) {
+// Stage starts and messages get a line each; the status line below them is redrawn in place
+void WindowsToGoCreator::ShowEvent(const ProgressEvent& event) {
+    ShowProgress(L"");
+    switch (event.kind) {
+        case EVENT_ERROR:
+            ShowError(event.text);
+            break;
+        case EVENT_WARNING:
+            std::wcout << L"\rWARNING: " << event.text << std::endl;
+            break;
+        default:
+            std::wcout << L"\r" << event.text << std::endl;
+            break;
+    }
+}
 
+void WindowsToGoCreator::ShowProgress(const std::wstring &message) {
+    static size_t width = 0;
+    std::wcout << L"\r" << message;
+    if (message.size() < width) std::wcout << std::wstring(width - message.size(), L' ');
+    std::wcout << std::flush;
+    width = message.size();
 }
 
-void WindowsToGoCreator::OptimzeWindows() {
+void WindowsToGoCreator::ShowError(const std::wstring &error) {
+    std::wcerr << L"\rERROR: " << error << std::endl;
+}
 
+bool WindowsToGoCreator::OptimizeWindows(const std::wstring& drive) {
 
+    // No pagefile or hibernation file on the stick, no prefetch or defrag wearing it out, and
+    // the host's own disks kept offline: one pass over the offline SYSTEM and SOFTWARE hives
+    // with the rows for the Windows release found on it
+    HiveTweaker tweaker;
+    Progress().Stage(STAGE_OPTIMIZE, L"Optimizing Windows on " + drive + L"...");
+    if (!tweaker.Apply(VolumeRoot(drive))) {
+        Progress().Warning(L"Cannot optimize Windows on " + drive + L": " + tweaker.Error());
+        return false;
+    }
+    Progress().Message(L"Optimized " + tweaker.Stats().ToString());
+    return true;
 }
 
-void WindowsToGoCreator::ValidateWindows() {
+bool WindowsToGoCreator::ValidateWindows() {
 
     // We need to check all the file premissions and make sure they match and are not corrupted 
     // If corrupted we fix it 
+    std::filesystem::path target = VolumeRoot(usb_drive);
+    std::error_code ec;
+    if (!std::filesystem::exists(target / Manifest::FILE_NAME, ec)) {
+        // WIM applies check every blob's SHA-1 as they go; block copies have no file list
+        return true;
+    }
+    VerifyOptions verifyOptions;
+    verifyOptions.progress = &Progress();
+    ManifestVerifier verifier(verifyOptions);
+    Progress().Stage(STAGE_VERIFY, L"Verifying " + usb_drive + L"...");
+    if (verifier.Run(target)) {
+        Progress().Message(L"Verified " + verifier.Stats().ToString());
+        return true;
+    }
+    if (verifier.Failed().empty()) {
+        Progress().Error(L"Cannot verify " + usb_drive + L": " + verifier.Error());
+        return false;
+    }
+
+    // Bad copies are removed and brought back by a resync that trusts the rest of the manifest
+    for (const auto& relative : verifier.Failed()) std::filesystem::remove(target / relative, ec);
+    ResyncOptions options;
+    options.excludes = Excludes();
+    options.deleteExtra = false;
+    options.progress = &Progress();
+    ResyncEngine repair(options);
+    Progress().Stage(STAGE_RESYNC, L"Copying " + std::to_wstring(verifier.Failed().size()) + L" corrupt file(s) again...");
+    if (!repair.Run(VolumeRoot(windows), target)) {
+        Progress().Error(L"Repair failed: " + repair.Error());
+        return false;
+    }
+    Progress().Stage(STAGE_VERIFY, L"Verifying " + usb_drive + L" again...");
+    if (!verifier.Run(target)) {
+        Progress().Error(L"Verification failed again: " + verifier.Stats().ToString());
+        return false;
+    }
+    Progress().Message(L"Verified after repair " + verifier.Stats().ToString());
+    return true;
 }
\ No newline at end of file
@@ -1,75 +1,520 @@
 #ifndef _WINDOWS_TO_GO_H_
 #define _WINDOWS_TO_GO_H_
 #include "editor/bcd.h"
+#include "editor/hive_tweaks.h"
+#include "copy/copy_engine.h"
+#include "copy/resync_engine.h"
+#include "copy/manifest_verifier.h"
+#include "copy/tree_scan.h"
+#include "disk/partitioner.h"
+#include "disk/usb_probe.h"
+#include "imaging/volume_imager.h"
+#include "wim/wim_apply.h"
+#include "pipeline/journal.h"
+#include "pipeline/task_graph.h"
 
 //#include <wimlib.h>
 
+#ifdef _WIN32
 #include <setupapi.h>
 #include <winioctl.h>
+#endif
 
 //#pragma comment(lib, "wimlib.lib")
 //#pragma comment(lib, "bcd.lib")
 
 
+// How the system volume gets onto the usb: file by file, a block image of the allocated
+// NTFS clusters (the source volume must not be in use), an update of a stick made earlier
+// that writes only the chunks that changed since, or the same block image inside a
+// dynamically expanding VHDX on the stick's own volume, booted natively
+enum CopyMode {
+    COPY_FILES,
+    COPY_BLOCKS,
+    COPY_RESYNC,
+    COPY_VHDX
+};
+
+// Mode from its name at the prompt: files, blocks, resync or vhdx
+inline bool ParseCopyMode(const std::wstring& name, CopyMode& mode) {
+    static const std::pair<const wchar_t*, CopyMode> names[] = {
+        { L"files", COPY_FILES }, { L"blocks", COPY_BLOCKS }, { L"resync", COPY_RESYNC }, { L"vhdx", COPY_VHDX }
+    };
+    for (const auto& candidate : names) {
+        if (name == candidate.first) {
+            mode = candidate.second;
+            return true;
+        }
+    }
+    return false;
+}
+
 class WindowsToGoCreator {
     // This is the cli ui and handles the usb formatting
           
     public:
 
-        explicit WindowsToGoCreator(const std::wstring& drive, const std::wstring& windows_drive) 
-        : usb_drive(drive), windows(windows_drive)  {
+        // `windows_drive` is either a running installation's drive or an install.wim to apply.
+        // `wof_compression` makes a file copy write CompactOS compressed files.
+        explicit WindowsToGoCreator(const std::wstring& drive, const std::wstring& windows_drive, CopyMode copy_mode = COPY_FILES,
+                                    uint32_t wim_image = 1, WofFormat wof_compression = WOF_NONE)
+        : WindowsToGoCreator(std::vector<std::wstring>{ drive }, windows_drive, copy_mode, wim_image, wof_compression) {}
+
+        // Makes a batch of sticks at once. The source is read (or the WIM decompressed) once:
+        // a block copy is broadcast to every stick, the other modes fill the first stick and
+        // clone its volume onto the rest. A stick that fails is reported and dropped, the
+        // others carry on.
+        explicit WindowsToGoCreator(const std::vector<std::wstring>& drives, const std::wstring& windows_drive, CopyMode copy_mode = COPY_FILES,
+                                    uint32_t wim_image = 1, WofFormat wof_compression = WOF_NONE)
+        : usb_drives(drives), usb_drive(drives.empty() ? std::wstring() : drives.front()),
+          windows(windows_drive), mode(copy_mode), image(wim_image), compression(wof_compression),
+          monitor(Progress(), [](const ProgressEvent& event) { ShowEvent(event); },
+                  [](const ProgressView& view) { if (view.bytesDone != 0 || view.bytesTotal != 0) ShowProgress(view.ToString()); })  {
             
-            // Validate the bcd and if it is corrupted, we will repair it 
-            ShowProgress(MESSAGE);
-            if (BCD::ValidateSystemBCD()) {
-                // Join the thread
-                try {
-                    // Every method here will be throw exceptions when needed
-                    // We need to create threads for each method called show_progress
-                    ShowProgress(MESSAGE);
-                    ValidateUSB(); // Check the health of the usb
-                    // join the thread here 
-                    ShowProgress(MESSAGE); 
-                    if (PrepareUSB()) {
-                        // Join the thread here
-                        ShowProgress(MESSAGE);
-                        BCD bcd(drive, windows);
-                        bcd.ModifyBootManager();
-                    }
-                }
-                catch(...) {
-                    ShowError(ERROR);
-                }
-            }
-             
+            // Stages post to the progress channel; only the monitor's thread writes to the console.
+            // WTG_TRACE=<file> records every stage, BCD operation and chunk for chrome://tracing.
+            const char* trace = std::getenv("WTG_TRACE");
+            if (trace) Tracer::Instance().Enable();
+            monitor.Start();
+            Create();
+            Report();
+            monitor.Stop();
+            if (trace) WriteTrace(trace);
         }
 
         ~WindowsToGoCreator() = default;
         
-        static void OptimizeWindows();
-        static void ValidateWindows();
+        static bool OptimizeWindows(const std::wstring& drive);
+        bool ValidateWindows();
         static bool ConfirmUserIntent();
  
     private:
 
-        std::wstring usb_drive;
+        std::vector<std::wstring> usb_drives;    // Sticks still in the batch, the primary first
+        std::wstring usb_drive;                  // The primary: copied, applied or resynced from the source
+        std::vector<std::pair<std::wstring, std::wstring>> failed;   // Dropped sticks and why
+        std::vector<FanOutTargetStats> written;  // Per stick throughput of the block copy
         std::wstring windows;
+        CopyMode mode;
+        uint32_t image;
+        WofFormat compression;   // COPY_FILES only
+        UsbProbeReport probe;    // Block size and queue depth for the copy come from here
+        ProgressMonitor monitor; // Drains Progress() and renders ETA and MB/s at a fixed rate
+        Journal journal;         // What an interrupted run with the same arguments already did
+
+        static constexpr const wchar_t* VHDX_NAME = L"\\WindowsToGo.vhdx";   // COPY_VHDX, at the root of the stick
+
+        WindowsBuild source;     // Filled by the detect stage
+        TreeScanStats scan;      // Filled by the scan stage, file copies only
 
-        static bool ValidateUSB() {
+        // Stages run as soon as what they read is there:
+        //   detect, bcd, scan and probe start together
+        //   prepare waits for bcd (a repair changes the store it copies), scan and probe
+        //   verify follows prepare, optimize edits the verified primary's hives (every stick's
+        //   after a block copy), replicate then clones the primary onto the rest of a batch
+        //   boot needs replicate (optimize for a block copy) and detect
+        // The first stage to fail cancels the rest; its error is already on the channel.
+        // Stages that change the sticks are journaled: a rerun after a crash or an unplugged
+        // stick skips the ones that finished, and the copy continues from its last commit.
+        void Create() {
+            bool wim = IsWim();
+            BCD::windows = windows;
+            OpenJournal();
+            TaskGraph graph;
+            auto traced = [](const char* name, std::function<bool()> task) {
+                return [name, task] {
+                    TraceScope scope(name);
+                    return task();
+                };
+            };
+            auto journaled = [this, traced](const char* name, std::function<bool()> task) {
+                return traced(name, [this, name, task] {
+                    if (journal.StageDone(name)) {
+                        std::string stage = name;
+                        Progress().Message(L"Resuming: " + std::wstring(stage.begin(), stage.end()) + L" already done");
+                        return true;
+                    }
+                    return task() && (!journal.IsOpen() || journal.RecordStage(name) || Unjournaled());
+                });
+            };
+            std::vector<TaskGraph::Id> before, boot;
+            if (!wim) {
+                boot.push_back(graph.Add(L"detect", traced("stage.detect", [this] { return DetectSource(); })));
+                before.push_back(graph.Add(L"bcd", traced("stage.bcd", [] { return BCD::ValidateSystemBCD(); })));
+            }
+            if (!wim && mode != COPY_BLOCKS && mode != COPY_VHDX) {
+                before.push_back(graph.Add(L"scan", traced("stage.scan", [this, &graph] { return ScanSource(graph.CancelFlag()); })));
+            }
+            before.push_back(graph.Add(L"probe", traced("stage.probe", [this] { return ValidateUSB(); })));
+            TaskGraph::Id prepare = graph.Add(L"prepare", journaled("stage.prepare", [this] { return PrepareUSB(); }), before);
+            TaskGraph::Id verify = graph.Add(L"verify", journaled("stage.verify", [this] { return ValidateWindows(); }), { prepare });
+            TaskGraph::Id optimize = graph.Add(L"optimize", journaled("stage.optimize", [this] {
+                // A failed tweak leaves a slower stick, not a broken one
+                if (mode == COPY_VHDX) {
+                    Progress().Message(L"Skipping optimization: the hives are inside " + usb_drive + VHDX_NAME);
+                    return true;
+                }
+                for (const auto& drive : mode == COPY_BLOCKS ? usb_drives : std::vector<std::wstring>{ usb_drive }) OptimizeWindows(drive);
+                return true;
+            }), { verify });
+            // The primary is cloned onto the rest of the batch; a block copy already wrote them all
+            boot.push_back(mode == COPY_BLOCKS ? optimize
+                : graph.Add(L"replicate", journaled("stage.replicate", [this] { return Replicate(); }), { optimize }));
+            graph.Add(L"boot", journaled("stage.boot", [this] { return MakeBootable(); }), boot);
+            if (!graph.Run()) {
+                Progress().Error(L"Stopped after " + (graph.Error().empty() ? std::wstring(L"cancel") : graph.Error()));
+                journal.Close();
+                if (journal.Stats().appended) Progress().Message(L"Run again with the same arguments to continue where this stopped");
+                return;
+            }
+            journal.Remove();
+        }
+
+        // The journal of a file copy lives on the stick, next to what it describes, and each
+        // commit flushes the stick first. A block copy overwrites the volume, so its journal
+        // stays on this machine and the imager flushes every segment before recording it.
+        // A batch's journal moves to this machine too before the primary is cloned; a rerun
+        // takes it up only if it is this run's, since one left by another run would commit
+        // without flushing the stick it vouches for.
+        void OpenJournal() {
+            std::string identity;
+            for (const std::wstring& part : { windows, std::to_wstring(mode), std::to_wstring(image), std::to_wstring(compression), DriveList(usb_drives) }) {
+                identity += Manifest::Key(part) + '\n';
+            }
+            std::error_code ec;
+            bool host = mode == COPY_BLOCKS;
+            if (!host && std::filesystem::exists(HostJournal(), ec)) {
+                host = !std::filesystem::exists(StickJournal(), ec) && Journal::Matches(HostJournal(), identity);
+                if (!host) std::filesystem::remove(HostJournal(), ec);
+            }
+            std::filesystem::path path = host ? HostJournal() : StickJournal();
+            if (!journal.Open(path, identity, !host)) {
+                Progress().Warning(L"No journal, an interrupted run starts over: " + journal.Error());
+                return;
+            }
+            if (journal.Resumed()) Progress().Message(L"Continuing an interrupted run: " + journal.Stats().ToString());
+        }
+
+        std::filesystem::path StickJournal() const { return std::filesystem::path(VolumeRoot(usb_drive)) / Journal::FILE_NAME; }
+
+        std::filesystem::path HostJournal() const {
+            return std::filesystem::temp_directory_path() / (std::filesystem::path(Journal::FILE_NAME).wstring() + L"_" + usb_drive.substr(0, 1));
+        }
+
+        // A journal that cannot commit must not vouch for anything more; the run goes on
+        bool Unjournaled() {
+            Progress().Warning(journal.Error() + L"; an interruption from here on starts over");
+            journal.Close();
+            return true;
+        }
+
+        bool IsWim() const {
+            return PathComponentsEqual(std::filesystem::path(windows).extension().wstring(), L".wim");
+        }
+
+        bool DetectSource() {
+            if (!WindowsVersionDetector::Detect(windows, source)) {
+                Progress().Warning(L"Cannot tell which Windows is on " + windows);
+                return true;
+            }
+            Progress().Message(L"Source: " + source.ToString());
+            return true;
+        }
+
+        bool ScanSource(const std::atomic<bool>& cancel) {
+            TreeScanner scanner(Excludes());
+            if (!scanner.Run(VolumeRoot(windows), &cancel)) {
+                Progress().Error(L"Cannot scan " + windows + L": " + scanner.Error());
+                return false;
+            }
+            scan = scanner.Stats();
+            Progress().Message(L"Source: " + scan.ToString());
+            return true;
+        }
+
+        bool ValidateUSB() {
             // Here we validate the usb flash drive's health and wipe out any existing data here
             // Make sure there is enough space to copy over the system to the usb flash drive
+            // The write tests and the capacity verify overwrite the stick. Only the block copy
+            // replaces the volume wholesale; the file copies need its filesystem, so they get
+            // the read tests only, and their size check waits for the scan in PrepareUSB.
+            // Every stick of a batch is probed at once; the unhealthy ones are dropped.
+            // A stick that holds part of an interrupted block copy only gets the read tests.
+            UsbProbeOptions options;
+            options.write = mode == COPY_BLOCKS && !journal.Resumed();
+            if (mode == COPY_BLOCKS) {
+                File source;
+                if (source.Open(VolumeDevice(windows), File::READ)) options.minCapacity = source.Size();
+            }
+            std::vector<UsbProbeReport> reports(usb_drives.size());
+            std::vector<std::wstring> errors(usb_drives.size());
+            std::vector<std::thread> probes;
+            Progress().Stage(STAGE_PROBE, L"Probing " + DriveList(usb_drives) + L"...");
+            for (size_t i = 0; i < usb_drives.size(); ++i) {
+                probes.emplace_back([&, i] {
+                    UsbProbe prober(options);
+                    if (!prober.Run(VolumeDevice(usb_drives[i]))) errors[i] = L"Cannot probe the usb drive: " + prober.Error();
+                    else if (!prober.Report().Healthy()) errors[i] = L"The usb drive failed validation: " + prober.Report().ToString();
+                    reports[i] = prober.Report();
+                });
+            }
+            for (auto& thread : probes) thread.join();
 
-            return false;
+            std::vector<std::wstring> healthy;
+            for (size_t i = 0; i < usb_drives.size(); ++i) {
+                if (!errors[i].empty()) {
+                    Drop(usb_drives[i], errors[i]);
+                    continue;
+                }
+                Progress().Message(L"USB drive " + usb_drives[i] + L": " + reports[i].ToString());
+                // The primary's geometry drives the copy, the smallest stick bounds it
+                if (healthy.empty()) probe = reports[i];
+                else probe.capacity = std::min(probe.capacity, reports[i].capacity);
+                healthy.push_back(usb_drives[i]);
+            }
+            usb_drives = healthy;
+            if (usb_drives.empty()) {
+                Progress().Error(L"No usb drive passed validation");
+                return false;
+            }
+            usb_drive = usb_drives.front();
+            return true;
         }
-        static bool PrepareUSB() {
+        bool PrepareUSB() {
             // We need to convert the driver into windows driver format 
             // We intergrate the api methods into here: https://learn.microsoft.com/en-us/windows/win32/api/winioctl/
             // We find the windows operating system path and we find out the partitions 
             // We then create the partitions onto the usb flash drive with the boot flags and everything.
             // We then copy all the data from the windows operating system to the usb     
+            if (mode == COPY_VHDX) return ImageVhdx();
+            if (IsWim()) {
+                WimApplier applier;
+                Progress().Stage(STAGE_APPLY, L"Applying image " + std::to_wstring(image) + L" of " + windows + L" to " + usb_drive + L"...");
+                if (!applier.Run(windows, image, VolumeRoot(usb_drive))) {
+                    Progress().Error(L"Applying the WIM failed: " + applier.Error());
+                    return false;
+                }
+                Progress().Message(L"Applied " + applier.Stats().ToString());
+                return true;
+            }
+            // Compressed, the size on the stick is only known once the copy is done
+            if (mode != COPY_BLOCKS && compression == WOF_NONE && scan.bytes > probe.capacity) {
+                Progress().Error(L"The usb drive holds " + std::to_wstring(probe.capacity / 1000000) + L" MB, the source needs "
+                    + std::to_wstring(scan.bytes / 1000000) + L" MB");
+                return false;
+            }
+            if (mode == COPY_BLOCKS) {
+                ImageOptions options;
+                options.io.blockSize = probe.recommendedBlockSize;
+                options.io.queueDepth = probe.recommendedQueueDepth;
+                options.io.direct = probe.direct;
+                options.journal = journal.IsOpen() ? &journal : nullptr;
+                return Image(VolumeDevice(windows), usb_drives, options, true);
+            }
+            if (mode == COPY_RESYNC) {
+                ResyncOptions options;
+                options.excludes = Excludes();
+                options.progress = &Progress();
+                ResyncEngine engine(options);
+                Progress().Stage(STAGE_RESYNC, L"Resyncing " + usb_drive + L" with " + windows + L"...");
+                if (!engine.Run(VolumeRoot(windows), VolumeRoot(usb_drive))) {
+                    Progress().Error(L"Resync failed with " + std::to_wstring(engine.Stats().errors) + L" error(s), first: " + engine.Error());
+                    return false;
+                }
+                Progress().Message(L"Resynced " + engine.Stats().ToString());
+                return true;
+            }
+            CopyOptions options;
+            options.excludes = Excludes();
+            options.manifest = true;     // Hashed as written, checked by ValidateWindows
+            options.chunkSize = probe.recommendedBlockSize;
+            options.ordered = true;      // The source is often a spinning disk; planning is one extent query per file
+            options.compression = compression;
+            options.uncompressed = Uncompressed();
+            options.progress = &Progress();
+            options.journal = journal.IsOpen() ? &journal : nullptr;
+            CopyEngine engine(options);
+            Progress().Stage(STAGE_COPY, L"Copying " + windows + L" to " + usb_drive + L"...", scan.bytes, scan.files);
+            if (!engine.Run(VolumeRoot(windows), VolumeRoot(usb_drive))) {
+                Progress().Error(L"Copy failed with " + std::to_wstring(engine.Stats().errors) + L" error(s), first: " + engine.Error());
+                return false;
+            }
+            Progress().Message(L"Copied " + engine.Stats().ToString());
             return true;
         }
 
+        // Block copy of `source` onto every stick in `drives`, reading it once. Sticks that fail
+        // are dropped; when none is left, that is an error only if the stage depends on them.
+        bool Image(const std::filesystem::path& source, const std::vector<std::wstring>& drives, const ImageOptions& options, bool required) {
+            std::vector<std::filesystem::path> targets;
+            for (const auto& drive : drives) targets.push_back(VolumeDevice(drive));
+            VolumeImager imager(options);
+            Progress().Stage(STAGE_IMAGE, L"Imaging allocated clusters of " + source.wstring() + L" to " + DriveList(drives) + L"...");
+            bool ok = imager.Run(source, targets);
+            for (size_t i = 0; i < drives.size() && i < imager.Stats().targets.size(); ++i) {
+                FanOutTargetStats result = imager.Stats().targets[i];
+                result.name = drives[i];
+                if (result.failed) Drop(drives[i], result.error);
+                else written.push_back(result);
+            }
+            if (!ok) {
+                if (required) Progress().Error(L"Block copy failed: " + imager.Error());
+                return false;
+            }
+            Progress().Message(L"Imaged " + imager.Stats().ToString());
+            return true;
+        }
+
+        // Block copy of the source volume into a VHDX on the primary: a GPT disk of an MSR and
+        // the Windows partition, just big enough for the volume. Only blocks holding data are
+        // allocated, so the file costs about the used part of the volume. MakeBootable then puts
+        // the source's boot managers and a store whose entry points into the VHD next to it.
+        bool ImageVhdx() {
+            if (IsWim()) {
+                Progress().Error(L"A WIM cannot be applied into a VHDX; image a volume instead");
+                return false;
+            }
+            File input;
+            if (!input.Open(VolumeDevice(windows), File::READ)) {
+                Progress().Error(L"Cannot open " + windows + L": " + input.Error());
+                return false;
+            }
+            uint64_t volumeSize = input.Size();
+            input.Close();
+
+            PartitionOptions layout;
+            layout.esp = false;
+            layout.alignment = layout.minAlignment;
+            auto roundUp = [&](uint64_t value) { return (value + layout.alignment - 1) / layout.alignment * layout.alignment; };
+            VhdxOptions vhdxOptions;
+            vhdxOptions.size = 2 * layout.alignment + roundUp(layout.msrSize) + roundUp(volumeSize + 4096);
+            VhdxWriter vhdx;
+            std::filesystem::path path = VolumeRoot(usb_drive) / (VHDX_NAME + 1);
+            std::error_code ec;
+            Partitioner partitioner(layout);
+            if (!vhdx.Create(path, vhdxOptions) || !partitioner.Run(vhdx)) {
+                Progress().Error(L"Cannot create " + path.wstring() + L": " + (vhdx.Error().empty() ? partitioner.Error() : vhdx.Error()));
+                vhdx.Close();
+                std::filesystem::remove(path, ec);
+                return false;
+            }
+
+            ImageOptions options;
+            options.io.blockSize = probe.recommendedBlockSize;
+            options.targetOffset = partitioner.Partitions().back().offset;
+            options.targetCapacity = partitioner.Partitions().back().size;
+            VolumeImager imager(options);
+            Progress().Stage(STAGE_IMAGE, L"Imaging allocated clusters of " + windows + L" into " + path.wstring() + L"...");
+            if (!imager.Run(VolumeDevice(windows), vhdx) || !vhdx.Close()) {
+                Progress().Error(L"VHDX image failed: " + (imager.Error().empty() ? vhdx.Error() : imager.Error()));
+                vhdx.Close();
+                std::filesystem::remove(path, ec);    // Half a disk would boot into a broken volume
+                return false;
+            }
+            Progress().Message(L"Imaged " + imager.Stats().ToString());
+            Progress().Message(L"VHDX " + vhdx.Stats().ToString());
+            return true;
+        }
+
+        // Clones the primary's volume onto the other sticks of the batch, so the source is
+        // read and a WIM decompressed only once. The journal leaves the stick so the clones
+        // do not inherit it, and the volume is flushed; nothing writes to it from here on.
+        bool Replicate() {
+            if (usb_drives.size() < 2) return true;
+            std::error_code ec;
+            if (std::filesystem::exists(StickJournal(), ec)) {
+                if (!journal.IsOpen()) journal.Remove();     // Stopped recording, only the file is left
+                else if (!journal.Move(HostJournal(), false)) {
+                    Progress().Warning(L"No journal, an interruption from here on starts over: " + journal.Error());
+                    journal.Remove();
+                }
+            }
+            File primary;
+            if (!primary.Open(VolumeDevice(usb_drive), File::UPDATE) || !primary.Sync()) {
+                Progress().Error(L"Cannot flush " + usb_drive + L" before cloning it");
+                return false;
+            }
+            uint64_t size = primary.Size();
+            primary.Close();
+            std::vector<std::wstring> replicas;
+            for (size_t i = 1; i < usb_drives.size(); ++i) {
+                File replica;
+                if (!replica.Open(VolumeDevice(usb_drives[i]), File::READ)) Drop(usb_drives[i], replica.Error());
+                else if (replica.Size() < size) Drop(usb_drives[i], L"Its volume is smaller than " + usb_drive + L"'s");
+                else replicas.push_back(usb_drives[i]);
+            }
+            if (replicas.empty()) return true;
+            ImageOptions options;
+            options.io.blockSize = probe.recommendedBlockSize;
+            options.io.queueDepth = probe.recommendedQueueDepth;
+            options.io.direct = probe.direct;
+            // Clones that fail leave the primary, so the stage itself does not
+            if (!Image(VolumeDevice(usb_drive), replicas, options, false)) Progress().Warning(L"Only " + usb_drive + L" was made");
+            return true;
+        }
+
+        bool MakeBootable() {
+            std::vector<std::wstring> drives = usb_drives;
+            for (const auto& drive : drives) {
+                Progress().Stage(STAGE_BOOT, L"Making " + drive + L" bootable...");
+                // The stick of a VHDX copy holds only the image; it gets the boot managers and a
+                // store with the VHD loader, and nothing points at its partition as a Windows volume
+                if (mode == COPY_VHDX) {
+                    if (!BCD::CreateUSBSpecificBootEntry(drive, VHDX_NAME)) Drop(drive, L"Cannot add the VHD boot entry");
+                    continue;
+                }
+                BCD bcd(drive, windows);
+                if (!bcd.ModifyBootManager(drive)) Drop(drive, L"Cannot write its boot manager");
+            }
+            if (usb_drives.empty()) {
+                Progress().Error(L"No usb drive could be made bootable");
+                return false;
+            }
+            return true;
+        }
+
+        // Takes a stick out of the batch; the rest go on without it
+        void Drop(const std::wstring& drive, const std::wstring& reason) {
+            auto it = std::find(usb_drives.begin(), usb_drives.end(), drive);
+            if (it == usb_drives.end()) return;
+            usb_drives.erase(it);
+            failed.emplace_back(drive, reason);
+            Progress().Warning(drive + L" dropped: " + reason);
+        }
+
+        // Per stick outcome of a batch
+        void Report() {
+            if (usb_drives.size() + failed.size() < 2) return;
+            for (const auto& result : written) Progress().Message(L"  " + result.ToString());
+            for (const auto& drive : failed) Progress().Message(L"  " + drive.first + L": failed, " + drive.second);
+            Progress().Message(std::to_wstring(usb_drives.size()) + L" of " + std::to_wstring(usb_drives.size() + failed.size())
+                + L" usb drive(s) ready: " + DriveList(usb_drives));
+        }
+
+        static std::wstring DriveList(const std::vector<std::wstring>& drives) {
+            std::wstring list;
+            for (const auto& drive : drives) list += (list.empty() ? L"" : L", ") + drive;
+            return list;
+        }
+
+        // Left out of every file copy: recreated by Windows, or tied to the source machine
+        static std::vector<std::wstring> Excludes() {
+            return { L"pagefile.sys", L"hiberfil.sys", L"swapfile.sys", L"System Volume Information", L"$Recycle.Bin" };
+        }
+
+        // Kept plain in a compressed copy: read by the boot manager and winload, which come
+        // before the WOF driver, or rewritten in place all the time
+        static std::vector<std::wstring> Uncompressed() {
+            return { L"bootmgr", L"Boot", L"Windows\\Boot", L"Windows\\bootstat.dat", L"Windows\\System32\\Boot",
+                     L"Windows\\System32\\config", L"Windows\\System32\\drivers", L"Windows\\System32\\CodeIntegrity",
+                     L"Windows\\System32\\catroot", L"Windows\\System32\\winload.exe", L"Windows\\System32\\winload.efi",
+                     L"Windows\\System32\\winresume.exe", L"Windows\\System32\\winresume.efi", L"Windows\\System32\\ntoskrnl.exe",
+                     L"Windows\\System32\\hal.dll", L"Windows\\System32\\ci.dll", L"Windows\\System32\\kdcom.dll",
+                     L"Windows\\System32\\bootvid.dll", L"Windows\\System32\\pshed.dll", L"Windows\\System32\\bootres.dll" };
+        }
+
+        static void WriteTrace(const std::string& path);
+        static void ShowEvent(const ProgressEvent& event);
         static void ShowProgress(const std::wstring& message);
         static void ShowError(const std::wstring& error);
 